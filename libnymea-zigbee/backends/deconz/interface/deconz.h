@@ -73,7 +73,7 @@ public:
     Q_ENUM(Command)
 
     enum Parameter {
-        ParameterMacAddress = 0x01, // R
+        ParameterMacAddress = 0x01, // RW
         ParameterPanId = 0x05, // RW
         ParameterNetworkAddress = 0x07, // R
         ParameterNetworkExtendedPanId = 0x08, // R
@@ -28,6 +28,8 @@
 #include "zigbeeinterfacedeconz.h"
 #include "zigbee.h"
 #include "zigbeeutils.h"
+#include "zigbeemetrics.h"
+#include "zigbeeiothread.h"
 #include "loggingcategory.h"
 
 #include <QDataStream>
@@ -41,11 +43,24 @@ ZigbeeInterfaceDeconz::ZigbeeInterfaceDeconz(QObject *parent) : QObject(parent)
     m_reconnectTimer->setInterval(5000);
 
     connect(m_reconnectTimer, &QTimer::timeout, this, &ZigbeeInterfaceDeconz::onReconnectTimeout);
+
+    QString labels = "backend=\"deconz\"";
+    m_framesReceivedCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_frames_received_total", "Number of valid frames received from the controller.", labels);
+    m_framesSentCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_frames_sent_total", "Number of frames written to the controller.", labels);
+    m_bytesReceivedCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_bytes_received_total", "Number of bytes read from the serial port.", labels);
+    m_bytesSentCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_bytes_sent_total", "Number of bytes written to the serial port.", labels);
+    m_checksumErrorsCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_checksum_errors_total", "Number of received frames with an invalid checksum.", labels);
+    m_writeErrorsCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_write_errors_total", "Number of frames which could not be written to the serial port.", labels);
 }
 
 ZigbeeInterfaceDeconz::~ZigbeeInterfaceDeconz()
 {
-
+    if (m_serialPort) {
+        runInIoThread([this](){
+            delete m_serialPort;
+            m_serialPort = nullptr;
+        });
+    }
 }
 
 bool ZigbeeInterfaceDeconz::available() const
@@ -58,6 +73,32 @@ QString ZigbeeInterfaceDeconz::serialPort() const
     return m_serialPort->portName();
 }
 
+bool ZigbeeInterfaceDeconz::ioThreadEnabled() const
+{
+    return m_ioThread != nullptr;
+}
+
+void ZigbeeInterfaceDeconz::setIoThreadEnabled(bool ioThreadEnabled)
+{
+    if (this->ioThreadEnabled() == ioThreadEnabled)
+        return;
+
+    if (m_serialPort) {
+        qCWarning(dcZigbeeInterface()) << "Cannot change the I/O thread while the interface is enabled.";
+        return;
+    }
+
+    if (ioThreadEnabled) {
+        qCDebug(dcZigbeeInterface()) << "Enable dedicated I/O thread for the serial communication";
+        m_ioThread = new ZigbeeIoThread("deconz-io", this);
+        connect(m_ioThread, &ZigbeeIoThread::frameReceived, this, &ZigbeeInterfaceDeconz::packageReceived);
+    } else {
+        qCDebug(dcZigbeeInterface()) << "Disable dedicated I/O thread for the serial communication";
+        delete m_ioThread;
+        m_ioThread = nullptr;
+    }
+}
+
 quint16 ZigbeeInterfaceDeconz::calculateCrc(const QByteArray &data)
 {
     quint16 crc = 0;
@@ -143,14 +184,28 @@ void ZigbeeInterfaceDeconz::setAvailable(bool available)
 
 void ZigbeeInterfaceDeconz::onReconnectTimeout()
 {
-    if (m_serialPort && !m_serialPort->isOpen()) {
-        if (!m_serialPort->open(QSerialPort::ReadWrite)) {
+    if (!m_serialPort)
+        return;
+
+    bool wasOpen = false;
+    bool opened = false;
+    runInIoThread([this, &wasOpen, &opened](){
+        wasOpen = m_serialPort->isOpen();
+        if (!wasOpen) {
+            opened = m_serialPort->open(QSerialPort::ReadWrite);
+            if (opened) {
+                m_serialPort->clear();
+            }
+        }
+    });
+
+    if (!wasOpen) {
+        if (!opened) {
             setAvailable(false);
             qCDebug(dcZigbeeInterface()) << "Interface reconnected failed" << m_serialPort->portName() << m_serialPort->baudRate();
             m_reconnectTimer->start();
         } else {
             qCDebug(dcZigbeeInterface()) << "Interface reconnected successfully on" << m_serialPort->portName() << m_serialPort->baudRate();
-            m_serialPort->clear();
             setAvailable(true);
         }
     }
@@ -159,6 +214,7 @@ void ZigbeeInterfaceDeconz::onReconnectTimeout()
 void ZigbeeInterfaceDeconz::onReadyRead()
 {
     QByteArray data = m_serialPort->readAll();
+    m_bytesReceivedCounter->increment(data.length());
 
     // Read each byte until we get END byte, then unescape the package
     for (int i = 0; i < data.length(); i++) {
@@ -182,13 +238,19 @@ void ZigbeeInterfaceDeconz::onReadyRead()
                 quint16 calculatedChecksum = calculateCrc(package);
                 if (receivedChecksum != calculatedChecksum) {
                     qCWarning(dcZigbeeInterfaceTraffic()) << "Checksum verification failed for frame" << ZigbeeUtils::convertByteArrayToHexString(m_dataBuffer) << receivedChecksum << "!=" << calculatedChecksum;
+                    m_checksumErrorsCounter->increment();
                     m_dataBuffer.clear();
                     continue;
                 }
 
                 // Checksum verified, we got valid data
                 qCDebug(dcZigbeeInterface()) << "Received frame" << ZigbeeUtils::convertByteArrayToHexString(frame);
-                emit packageReceived(package);
+                m_framesReceivedCounter->increment();
+                if (m_ioThread) {
+                    m_ioThread->enqueueFrame(package);
+                } else {
+                    emit packageReceived(package);
+                }
             }
             m_dataBuffer.clear();
         } else {
@@ -199,10 +261,22 @@ void ZigbeeInterfaceDeconz::onReadyRead()
 
 void ZigbeeInterfaceDeconz::onError(const QSerialPort::SerialPortError &error)
 {
-    if (error != QSerialPort::NoError && m_serialPort->isOpen()) {
-        qCWarning(dcZigbeeInterface()) << "Serial port error:" << error << m_serialPort->errorString();
+    if (error == QSerialPort::NoError || !m_serialPort)
+        return;
+
+    bool wasOpen = false;
+    QString errorString;
+    runInIoThread([this, &wasOpen, &errorString](){
+        wasOpen = m_serialPort->isOpen();
+        if (wasOpen) {
+            errorString = m_serialPort->errorString();
+            m_serialPort->close();
+        }
+    });
+
+    if (wasOpen) {
+        qCWarning(dcZigbeeInterface()) << "Serial port error:" << error << errorString;
         m_reconnectTimer->start();
-        m_serialPort->close();
         setAvailable(false);
     }
 }
@@ -238,44 +312,96 @@ void ZigbeeInterfaceDeconz::sendPackage(const QByteArray &package)
 
     // Send the data
     qCDebug(dcZigbeeInterfaceTraffic()) << "-->" << ZigbeeUtils::convertByteArrayToHexString(data);
-    if (m_serialPort->write(data) < 0) {
-        qCWarning(dcZigbeeInterface()) << "Could not stream byte" << ZigbeeUtils::convertByteArrayToHexString(data);
-    }
+    writeData(data);
 
     //m_serialPort->flush();
 }
 
+void ZigbeeInterfaceDeconz::runInIoThread(const std::function<void()> &function)
+{
+    if (m_ioThread) {
+        m_ioThread->execute(function);
+    } else {
+        function();
+    }
+}
+
+void ZigbeeInterfaceDeconz::writeData(const QByteArray &data)
+{
+    auto write = [this, data](){
+        if (!m_serialPort)
+            return;
+
+        if (m_serialPort->write(data) < 0) {
+            qCWarning(dcZigbeeInterface()) << "Could not stream byte" << ZigbeeUtils::convertByteArrayToHexString(data);
+            m_writeErrorsCounter->increment();
+            return;
+        }
+
+        m_framesSentCounter->increment();
+        m_bytesSentCounter->increment(data.length());
+    };
+
+    // Note: the caller does not have to wait until the data has been written in the I/O thread
+    if (m_ioThread) {
+        m_ioThread->post(write);
+    } else {
+        write();
+    }
+}
+
 bool ZigbeeInterfaceDeconz::enable(const QString &serialPort, qint32 baudrate)
 {
     qCDebug(dcZigbeeInterface()) << "Start UART interface " << serialPort << baudrate;
 
     if (m_serialPort) {
-        delete m_serialPort;
-        m_serialPort = nullptr;
+        runInIoThread([this](){
+            delete m_serialPort;
+            m_serialPort = nullptr;
+        });
     }
 
-    m_serialPort = new QSerialPort(serialPort, this);
-    m_serialPort->setBaudRate(baudrate);
-    m_serialPort->setDataBits(QSerialPort::Data8);
-    m_serialPort->setStopBits(QSerialPort::OneStop);
-    m_serialPort->setParity(QSerialPort::NoParity);
-    m_serialPort->setFlowControl(QSerialPort::NoFlowControl);
-
-    connect(m_serialPort, &QSerialPort::readyRead, this, &ZigbeeInterfaceDeconz::onReadyRead);
+    // Note: if the I/O thread is enabled, the serial port lives in the I/O thread without parent.
+    // The write lambdas read m_serialPort in the I/O thread, so it only gets assigned in there.
+    QSerialPort *serialPortDevice = new QSerialPort(serialPort, m_ioThread ? nullptr : this);
+    serialPortDevice->setBaudRate(baudrate);
+    serialPortDevice->setDataBits(QSerialPort::Data8);
+    serialPortDevice->setStopBits(QSerialPort::OneStop);
+    serialPortDevice->setParity(QSerialPort::NoParity);
+    serialPortDevice->setFlowControl(QSerialPort::NoFlowControl);
+
+    if (m_ioThread) {
+        // Read and decode the data directly in the I/O thread
+        m_ioThread->moveToIoThread(serialPortDevice);
+        connect(serialPortDevice, &QSerialPort::readyRead, this, &ZigbeeInterfaceDeconz::onReadyRead, Qt::DirectConnection);
+    } else {
+        connect(serialPortDevice, &QSerialPort::readyRead, this, &ZigbeeInterfaceDeconz::onReadyRead);
+    }
 #if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
-    connect(m_serialPort, &QSerialPort::errorOccurred, this, &ZigbeeInterfaceDeconz::onError, Qt::QueuedConnection);
+    connect(serialPortDevice, &QSerialPort::errorOccurred, this, &ZigbeeInterfaceDeconz::onError, Qt::QueuedConnection);
 #else
-    connect(m_serialPort, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(onError(QSerialPort::SerialPortError)), Qt::QueuedConnection);
+    connect(serialPortDevice, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(onError(QSerialPort::SerialPortError)), Qt::QueuedConnection);
 #endif
 
-    if (!m_serialPort->open(QSerialPort::ReadWrite)) {
-        qCWarning(dcZigbeeInterface()) << "Could not open serial port" << serialPort << baudrate << m_serialPort->errorString();
+    bool opened = false;
+    QString errorString;
+    runInIoThread([this, serialPortDevice, &opened, &errorString](){
+        m_serialPort = serialPortDevice;
+        opened = m_serialPort->open(QSerialPort::ReadWrite);
+        if (opened) {
+            m_serialPort->clear();
+        } else {
+            errorString = m_serialPort->errorString();
+        }
+    });
+
+    if (!opened) {
+        qCWarning(dcZigbeeInterface()) << "Could not open serial port" << serialPort << baudrate << errorString;
         m_reconnectTimer->start();
         return false;
     }
 
     qCDebug(dcZigbeeInterface()) << "Interface enabled successfully on" << serialPort << baudrate;
-    m_serialPort->clear();
 
     setAvailable(true);
     return true;
@@ -286,11 +412,13 @@ void ZigbeeInterfaceDeconz::reconnectController()
     if (!m_serialPort)
         return;
 
-    if (m_serialPort->isOpen())
-        m_serialPort->close();
+    runInIoThread([this](){
+        if (m_serialPort->isOpen())
+            m_serialPort->close();
 
-    delete m_serialPort;
-    m_serialPort = nullptr;
+        delete m_serialPort;
+        m_serialPort = nullptr;
+    });
     setAvailable(false);
     m_reconnectTimer->start();
 }
@@ -300,11 +428,13 @@ void ZigbeeInterfaceDeconz::disable()
     if (!m_serialPort)
         return;
 
-    if (m_serialPort->isOpen())
-        m_serialPort->close();
+    runInIoThread([this](){
+        if (m_serialPort->isOpen())
+            m_serialPort->close();
 
-    delete m_serialPort;
-    m_serialPort = nullptr;
+        delete m_serialPort;
+        m_serialPort = nullptr;
+    });
     setAvailable(false);
     qCDebug(dcZigbeeInterface()) << "Interface disabled";
 }
@@ -32,6 +32,11 @@
 #include <QTimer>
 #include <QSerialPort>
 
+#include <functional>
+
+class ZigbeeIoThread;
+class ZigbeeMetricCounter;
+
 class ZigbeeInterfaceDeconz : public QObject
 {
     Q_OBJECT
@@ -50,11 +55,24 @@ public:
     bool available() const;
     QString serialPort() const;
 
+    // Run the serial communication in a dedicated thread, must be set before enabling the interface
+    bool ioThreadEnabled() const;
+    void setIoThreadEnabled(bool ioThreadEnabled);
+
 private:
     QTimer *m_reconnectTimer = nullptr;
     QSerialPort *m_serialPort = nullptr;
     bool m_available = false;
     QByteArray m_dataBuffer;
+    ZigbeeIoThread *m_ioThread = nullptr;
+
+    // Metrics
+    ZigbeeMetricCounter *m_framesReceivedCounter = nullptr;
+    ZigbeeMetricCounter *m_framesSentCounter = nullptr;
+    ZigbeeMetricCounter *m_bytesReceivedCounter = nullptr;
+    ZigbeeMetricCounter *m_bytesSentCounter = nullptr;
+    ZigbeeMetricCounter *m_checksumErrorsCounter = nullptr;
+    ZigbeeMetricCounter *m_writeErrorsCounter = nullptr;
 
     quint16 calculateCrc(const QByteArray &data);
     QByteArray unescapeData(const QByteArray &data);
@@ -62,6 +80,9 @@ private:
 
     void setAvailable(bool available);
 
+    void runInIoThread(const std::function<void()> &function);
+    void writeData(const QByteArray &data);
+
 signals:
     void availableChanged(bool available);
     void packageReceived(const QByteArray &package);
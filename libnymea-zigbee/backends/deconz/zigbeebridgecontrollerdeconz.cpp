@@ -26,6 +26,7 @@
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "zigbeeutils.h"
+#include "zigbeemetrics.h"
 #include "loggingcategory.h"
 #include "zigbeechannelmask.h"
 #include "zdo/zigbeedeviceprofile.h"
@@ -44,6 +45,13 @@ ZigbeeBridgeControllerDeconz::ZigbeeBridgeControllerDeconz(QObject *parent) :
     m_watchdogTimer->setSingleShot(false);
     m_watchdogTimer->setInterval(m_watchdogResetTimout * 1000);
     connect(m_watchdogTimer, &QTimer::timeout, this, &ZigbeeBridgeControllerDeconz::resetControllerWatchdog);
+
+    QString labels = "backend=\"deconz\"";
+    m_queueDepthGauge = ZigbeeMetrics::instance()->gauge("zigbee_controller_queue_depth", "Number of requests waiting to be sent to the controller.", labels);
+    m_apsFreeSlotsGauge = ZigbeeMetrics::instance()->gauge("zigbee_controller_aps_free_slots", "Whether the controller has free APS request slots (1) or not (0).", labels);
+    m_retriesCounter = ZigbeeMetrics::instance()->counter("zigbee_controller_request_retries_total", "Number of controller requests which had to be sent again.", labels);
+    m_timeoutsCounter = ZigbeeMetrics::instance()->counter("zigbee_controller_request_timeouts_total", "Number of controller requests which timed out.", labels);
+    m_apsFreeSlotsGauge->set(1);
 }
 
 ZigbeeBridgeControllerDeconz::~ZigbeeBridgeControllerDeconz()
@@ -243,6 +251,7 @@ void ZigbeeBridgeControllerDeconz::sendNextRequest()
 
     // Get the next reply, set the sequence number, send the request data over the interface and start waiting
     m_currentReply = m_replyQueue.dequeue();
+    m_queueDepthGauge->set(m_replyQueue.count());
     m_currentReply->setSequenceNumber(generateSequenceNumber());
     qCDebug(dcZigbeeController()) << "Send request" << m_currentReply;
     m_interface->sendPackage(m_currentReply->requestData());
@@ -254,6 +263,12 @@ quint8 ZigbeeBridgeControllerDeconz::generateSequenceNumber()
     return m_sequenceNumber++;
 }
 
+void ZigbeeBridgeControllerDeconz::setApsFreeSlotsAvailable(bool apsFreeSlotsAvailable)
+{
+    m_apsFreeSlotsAvailable = apsFreeSlotsAvailable;
+    m_apsFreeSlotsGauge->set(apsFreeSlotsAvailable ? 1 : 0);
+}
+
 ZigbeeInterfaceDeconzReply *ZigbeeBridgeControllerDeconz::createReply(Deconz::Command command, const QString &requestName, const QByteArray &requestData, QObject *parent)
 {
     // Create the reply
@@ -264,6 +279,7 @@ ZigbeeInterfaceDeconzReply *ZigbeeBridgeControllerDeconz::createReply(Deconz::Co
     // Make sure we clean up on timeout
     connect(reply, &ZigbeeInterfaceDeconzReply::timeout, this, [this, reply](){
         qCWarning(dcZigbeeController()) << "Reply timeout" << reply;
+        m_timeoutsCounter->increment();
 
         // Make sure we can send the next read confirm reply
         if (m_readConfirmReply == reply) {
@@ -298,8 +314,10 @@ ZigbeeInterfaceDeconzReply *ZigbeeBridgeControllerDeconz::createReply(Deconz::Co
         m_replyQueue.enqueue(reply);
         qCDebug(dcZigbeeController()) << "Enqueue request:" << reply->requestName();
     }
+    m_queueDepthGauge->set(m_replyQueue.count());
     connect(reply, &ZigbeeInterfaceDeconzReply::timeout, this, [=](){
         m_replyQueue.removeAll(reply);
+        m_queueDepthGauge->set(m_replyQueue.count());
     });
 
     QMetaObject::invokeMethod(this, "sendNextRequest", Qt::QueuedConnection);
@@ -792,6 +810,100 @@ ZigbeeInterfaceDeconzReply *ZigbeeBridgeControllerDeconz::readNetworkParameters(
     return readNetworkParametersReply;
 }
 
+ZigbeeInterfaceDeconzReply *ZigbeeBridgeControllerDeconz::readWarmStartParameters()
+{
+    qCDebug(dcZigbeeController()) << "Start reading warm start network parameters";
+
+    // Create an independent reply for finishing the entire read sequence
+    ZigbeeInterfaceDeconzReply *readParametersReply = new ZigbeeInterfaceDeconzReply(Deconz::CommandReadParameter, this);
+    connect(readParametersReply, &ZigbeeInterfaceDeconzReply::finished, readParametersReply, &ZigbeeInterfaceDeconzReply::deleteLater, Qt::QueuedConnection);
+
+    QList<Deconz::Parameter> parameters;
+    parameters << Deconz::ParameterMacAddress;
+    parameters << Deconz::ParameterPanId;
+    parameters << Deconz::ParameterNetworkAddress;
+    parameters << Deconz::ParameterNetworkExtendedPanId;
+    parameters << Deconz::ParameterCurrentChannel;
+    parameters << Deconz::ParameterProtocolVersion;
+    readNextParameter(readParametersReply, parameters);
+
+    return readParametersReply;
+}
+
+void ZigbeeBridgeControllerDeconz::readNextParameter(ZigbeeInterfaceDeconzReply *parametersReply, QList<Deconz::Parameter> parameters)
+{
+    if (parameters.isEmpty()) {
+        // Make sure the watchdog gets fed if this version supports it
+        if (m_networkConfiguration.protocolVersion < 0x0108) {
+            m_watchdogTimer->stop();
+        } else {
+            resetControllerWatchdog();
+        }
+
+        emit networkConfigurationParameterChanged(m_networkConfiguration);
+        parametersReply->m_statusCode = Deconz::StatusCodeSuccess;
+        emit parametersReply->finished();
+        return;
+    }
+
+    Deconz::Parameter parameter = parameters.takeFirst();
+    ZigbeeInterfaceDeconzReply *reply = requestReadParameter(parameter);
+    connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, parametersReply, parameters, parameter, reply](){
+        if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Request" << "SQN:" << reply->sequenceNumber() << reply->command()
+                                            << parameter << "finished with error" << reply->statusCode();
+            parametersReply->m_statusCode = reply->statusCode();
+            emit parametersReply->finished();
+            return;
+        }
+
+        qCDebug(dcZigbeeController()) << "Request" << "SQN:" << reply->sequenceNumber() << reply->command() << parameter << "finished successfully";
+        processParameter(parameter, reply->responseData());
+        readNextParameter(parametersReply, parameters);
+    });
+}
+
+void ZigbeeBridgeControllerDeconz::processParameter(Deconz::Parameter parameter, const QByteArray &responseData)
+{
+    QDataStream stream(responseData);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    quint16 payloadLenght = 0; quint8 parameterId = 0;
+    stream >> payloadLenght >> parameterId;
+
+    switch (parameter) {
+    case Deconz::ParameterMacAddress: {
+        quint64 macAddress = 0;
+        stream >> macAddress;
+        m_networkConfiguration.ieeeAddress = ZigbeeAddress(macAddress);
+        qCDebug(dcZigbeeController()) << "IEEE address:" << m_networkConfiguration.ieeeAddress.toString();
+        break;
+    }
+    case Deconz::ParameterPanId:
+        stream >> m_networkConfiguration.panId;
+        qCDebug(dcZigbeeController()) << "PAN ID:" << ZigbeeUtils::convertUint16ToHexString(m_networkConfiguration.panId);
+        break;
+    case Deconz::ParameterNetworkAddress:
+        stream >> m_networkConfiguration.shortAddress;
+        qCDebug(dcZigbeeController()) << "Network address:" << ZigbeeUtils::convertUint16ToHexString(m_networkConfiguration.shortAddress);
+        break;
+    case Deconz::ParameterNetworkExtendedPanId:
+        stream >> m_networkConfiguration.extendedPanId;
+        qCDebug(dcZigbeeController()) << "Extended PAN ID:" << ZigbeeUtils::convertUint64ToHexString(m_networkConfiguration.extendedPanId);
+        break;
+    case Deconz::ParameterCurrentChannel:
+        stream >> m_networkConfiguration.currentChannel;
+        qCDebug(dcZigbeeController()) << "Current channel:" << m_networkConfiguration.currentChannel;
+        break;
+    case Deconz::ParameterProtocolVersion:
+        stream >> m_networkConfiguration.protocolVersion;
+        qCDebug(dcZigbeeController()) << "Protocol version:" << ZigbeeUtils::convertUint16ToHexString(m_networkConfiguration.protocolVersion);
+        break;
+    default:
+        qCWarning(dcZigbeeController()) << "Reading" << parameter << "is not supported by the warm start sequence";
+        break;
+    }
+}
+
 DeconzDeviceState ZigbeeBridgeControllerDeconz::parseDeviceStateFlag(quint8 deviceStateFlag)
 {
     DeconzDeviceState state;
@@ -864,22 +976,18 @@ void ZigbeeBridgeControllerDeconz::processDeviceState(DeconzDeviceState deviceSt
 {
     qCDebug(dcZigbeeController()) << "Process device state notification" << deviceState;
 
-    if (m_networkState != deviceState.networkState) {
-        qCDebug(dcZigbeeController()) << "Network state changed" << deviceState.networkState;
-        m_networkState = deviceState.networkState;
-        emit networkStateChanged(m_networkState);
-    }
+    updateNetworkState(deviceState.networkState);
 
     if (m_apsFreeSlotsAvailable != deviceState.apsDataRequestFreeSlots) {
         if (!deviceState.apsDataRequestFreeSlots) {
             // Warn only if the network is up
             if (m_networkState == Deconz::NetworkStateConnected) {
                 qCWarning(dcZigbeeController()) << "The APS request table is full on the device. Cannot send requests until the queue gets processed on the controller.";
-                m_apsFreeSlotsAvailable = false;
+                setApsFreeSlotsAvailable(false);
             }
             return;
         } else {
-            m_apsFreeSlotsAvailable = true;
+            setApsFreeSlotsAvailable(true);
             qCDebug(dcZigbeeController()) << "The APS request table is free again. Sending the next request";
             sendNextRequest();
         }
@@ -902,6 +1010,16 @@ void ZigbeeBridgeControllerDeconz::processDeviceState(DeconzDeviceState deviceSt
 
 }
 
+void ZigbeeBridgeControllerDeconz::updateNetworkState(Deconz::NetworkState networkState)
+{
+    if (m_networkState == networkState)
+        return;
+
+    qCDebug(dcZigbeeController()) << "Network state changed" << networkState;
+    m_networkState = networkState;
+    emit networkStateChanged(m_networkState);
+}
+
 void ZigbeeBridgeControllerDeconz::processDataIndication(const QByteArray &data)
 {
     // APS data indication
@@ -947,6 +1065,7 @@ void ZigbeeBridgeControllerDeconz::processDataIndication(const QByteArray &data)
     // Process the device state in order to check if we have to request another indication
     DeconzDeviceState deviceState = parseDeviceStateFlag(deviceStateFlag);
     qCDebug(dcZigbeeController()) << "Verify device state after data indication response" << deviceState;
+    updateNetworkState(deviceState.networkState);
     if (deviceState.apsDataIndication) {
         readDataIndication();
     }
@@ -978,6 +1097,7 @@ void ZigbeeBridgeControllerDeconz::processDataConfirm(const QByteArray &data)
     // Process the device state in order to check if we have to request another indication
     DeconzDeviceState deviceState = parseDeviceStateFlag(deviceStateFlag);
     qCDebug(dcZigbeeController()) << "Verify device state after data confirmation response" << deviceState;
+    updateNetworkState(deviceState.networkState);
     if (deviceState.apsDataConfirm) {
         readDataConfirm();
     }
@@ -1004,9 +1124,10 @@ void ZigbeeBridgeControllerDeconz::onInterfaceAvailableChanged(bool available)
             ZigbeeInterfaceDeconzReply *reply = m_replyQueue.dequeue();
             reply->abort();
         }
+        m_queueDepthGauge->set(0);
 
         m_sequenceNumber = 0;
-        m_apsFreeSlotsAvailable = true;
+        setApsFreeSlotsAvailable(true);
         m_watchdogTimer->stop();
     }
 
@@ -1032,8 +1153,10 @@ void ZigbeeBridgeControllerDeconz::onInterfacePackageReceived(const QByteArray &
         // If the controller is busy, let's try again once the device state reports free slots
         if (status == Deconz::StatusCodeBusy) {
             qCWarning(dcZigbeeController()) << "Controller busy. Rescheduling command.";
-            m_apsFreeSlotsAvailable = false;
+            m_retriesCounter->increment();
+            setApsFreeSlotsAvailable(false);
             m_replyQueue.prepend(m_currentReply);
+            m_queueDepthGauge->set(m_replyQueue.count());
             m_currentReply = nullptr;
             return;
         }
@@ -1090,6 +1213,7 @@ void ZigbeeBridgeControllerDeconz::resetControllerWatchdog()
 
 bool ZigbeeBridgeControllerDeconz::enable(const QString &serialPort, qint32 baudrate)
 {
+    m_interface->setIoThreadEnabled(m_ioThreadEnabled);
     return m_interface->enable(serialPort, baudrate);
 }
 
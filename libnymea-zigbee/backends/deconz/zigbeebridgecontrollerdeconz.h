@@ -43,6 +43,9 @@
 #include "interface/zigbeeinterfacedeconz.h"
 #include "interface/zigbeeinterfacedeconzreply.h"
 
+class ZigbeeMetricGauge;
+class ZigbeeMetricCounter;
+
 // This struct describes the current deCONZ network configuration parameters
 typedef struct DeconzNetworkConfiguration {
     ZigbeeAddress ieeeAddress; // R
@@ -116,7 +119,14 @@ private:
 
     QQueue<ZigbeeInterfaceDeconzReply *> m_replyQueue;
 
+    // Metrics
+    ZigbeeMetricGauge *m_queueDepthGauge = nullptr;
+    ZigbeeMetricGauge *m_apsFreeSlotsGauge = nullptr;
+    ZigbeeMetricCounter *m_retriesCounter = nullptr;
+    ZigbeeMetricCounter *m_timeoutsCounter = nullptr;
+
     quint8 generateSequenceNumber();
+    void setApsFreeSlotsAvailable(bool apsFreeSlotsAvailable);
 
     ZigbeeInterfaceDeconzReply *createReply(Deconz::Command command, const QString &requestName, const QByteArray &requestData, QObject *parent);
 
@@ -134,6 +144,12 @@ private:
     // The data can be fetched from m_networkConfiguration on success.
     ZigbeeInterfaceDeconzReply *readNetworkParameters();
 
+    // Note: this method reads only the parameters required for verifying a known network during a warm start.
+    // Like readNetworkParameters(), the data can be fetched from m_networkConfiguration on success.
+    ZigbeeInterfaceDeconzReply *readWarmStartParameters();
+    void readNextParameter(ZigbeeInterfaceDeconzReply *parametersReply, QList<Deconz::Parameter> parameters);
+    void processParameter(Deconz::Parameter parameter, const QByteArray &responseData);
+
     // Device state helper
     DeconzDeviceState parseDeviceStateFlag(quint8 deviceStateFlag);
 
@@ -142,6 +158,7 @@ private:
     void readDataConfirm();
 
     void processDeviceState(DeconzDeviceState deviceState);
+    void updateNetworkState(Deconz::NetworkState networkState);
     void processDataIndication(const QByteArray &data);
     void processDataConfirm(const QByteArray &data);
     void processMacPoll(const QByteArray &data);
@@ -30,6 +30,7 @@
 #include "loggingcategory.h"
 #include "zigbeeutils.h"
 #include "zigbeenetworkdatabase.h"
+#include "zigbeebroadcastgovernor.h"
 
 #include <QDataStream>
 
@@ -42,10 +43,20 @@ ZigbeeNetworkDeconz::ZigbeeNetworkDeconz(const QUuid &networkUuid, QObject *pare
     connect(m_controller, &ZigbeeBridgeControllerDeconz::apsDataConfirmReceived, this, &ZigbeeNetworkDeconz::onApsDataConfirmReceived);
     connect(m_controller, &ZigbeeBridgeControllerDeconz::apsDataIndicationReceived, this, &ZigbeeNetworkDeconz::onApsDataIndicationReceived);
 
+    connect(m_controller, &ZigbeeBridgeControllerDeconz::networkStateChanged, this, &ZigbeeNetworkDeconz::onControllerNetworkStateChanged);
+
+    // The network state changes get notified by the controller, polling is only a fallback in case a notification got lost
     m_pollNetworkStateTimer = new QTimer(this);
-    m_pollNetworkStateTimer->setInterval(1000);
-    m_pollNetworkStateTimer->setSingleShot(false);
+    m_pollNetworkStateTimer->setInterval(2000);
+    m_pollNetworkStateTimer->setSingleShot(true);
     connect(m_pollNetworkStateTimer, &QTimer::timeout, this, &ZigbeeNetworkDeconz::onPollNetworkStateTimeout);
+
+    connect(this, &ZigbeeNetwork::stateChanged, this, [this](ZigbeeNetwork::State state){
+        if (state == StateRunning && m_startupTimer.isValid()) {
+            qCDebug(dcZigbeeNetwork()) << "Network startup finished after" << m_startupTimer.elapsed() << "ms";
+            m_startupTimer.invalidate();
+        }
+    });
 }
 
 ZigbeeBridgeController *ZigbeeNetworkDeconz::bridgeController() const
@@ -76,6 +87,10 @@ ZigbeeNetworkReply *ZigbeeNetworkDeconz::sendRequest(const ZigbeeNetworkRequest
         return reply;
     }
 
+    // The firmware does not fragment outgoing requests, make sure the payload fits into one frame
+    if (!verifyRequestLength(reply))
+        return reply;
+
     if (state() == ZigbeeNetwork::StateStarting) {
         m_requestQueue.append(reply);
         connect(reply, &ZigbeeNetworkReply::finished, this, [this, reply](){
@@ -84,16 +99,8 @@ ZigbeeNetworkReply *ZigbeeNetworkDeconz::sendRequest(const ZigbeeNetworkRequest
         return reply;
     }
 
-    ZigbeeInterfaceDeconzReply *interfaceReply = m_controller->requestSendRequest(request);
-    connect(interfaceReply, &ZigbeeInterfaceDeconzReply::finished, reply, [this, reply, interfaceReply](){
-        if (interfaceReply->statusCode() != Deconz::StatusCodeSuccess) {
-            qCWarning(dcZigbeeController()) << "Could not send request to controller. SQN:" << interfaceReply->sequenceNumber() << interfaceReply->statusCode();
-            finishNetworkReply(reply, ZigbeeNetworkReply::ErrorInterfaceError);
-            return;
-        }
-
-        // The request has been sent successfully to the device, start the timeout timer now
-        startWaitingReply(reply);
+    broadcastGovernor()->send(reply, [this](ZigbeeNetworkReply *governedReply){
+        sendRequestInternally(governedReply);
     });
 
     return reply;
@@ -169,21 +176,27 @@ void ZigbeeNetworkDeconz::sendPendingRequests()
 {
     while (!m_requestQueue.isEmpty()) {
         ZigbeeNetworkReply *reply = m_requestQueue.takeFirst();
-
-        ZigbeeInterfaceDeconzReply *interfaceReply = m_controller->requestSendRequest(reply->request());
-        connect(interfaceReply, &ZigbeeInterfaceDeconzReply::finished, reply, [this, reply, interfaceReply](){
-            if (interfaceReply->statusCode() != Deconz::StatusCodeSuccess) {
-                qCWarning(dcZigbeeController()) << "Could not send request to controller. SQN:" << interfaceReply->sequenceNumber() << interfaceReply->statusCode();
-                finishNetworkReply(reply, ZigbeeNetworkReply::ErrorInterfaceError);
-                return;
-            }
-
-            // The request has been sent successfully to the device, start the timeout timer now
-            startWaitingReply(reply);
+        broadcastGovernor()->send(reply, [this](ZigbeeNetworkReply *governedReply){
+            sendRequestInternally(governedReply);
         });
     }
 }
 
+void ZigbeeNetworkDeconz::sendRequestInternally(ZigbeeNetworkReply *reply)
+{
+    ZigbeeInterfaceDeconzReply *interfaceReply = m_controller->requestSendRequest(reply->request());
+    connect(interfaceReply, &ZigbeeInterfaceDeconzReply::finished, reply, [this, reply, interfaceReply](){
+        if (interfaceReply->statusCode() != Deconz::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Could not send request to controller. SQN:" << interfaceReply->sequenceNumber() << interfaceReply->statusCode();
+            finishNetworkReply(reply, ZigbeeNetworkReply::ErrorInterfaceError);
+            return;
+        }
+
+        // The request has been sent successfully to the device, start the timeout timer now
+        startWaitingReply(reply);
+    });
+}
+
 void ZigbeeNetworkDeconz::setCreateNetworkState(ZigbeeNetworkDeconz::CreateNetworkState state)
 {
     if (m_createState == state)
@@ -207,8 +220,11 @@ void ZigbeeNetworkDeconz::setCreateNetworkState(ZigbeeNetworkDeconz::CreateNetwo
 
             qCDebug(dcZigbeeNetwork()) << "Stop network finished successfully. SQN:" << reply->sequenceNumber();
 
-            // Start polling the device state, should be Online -> Leaving -> Offline
-            m_pollNetworkStateTimer->start();
+            // Wait for the device state, should be Online -> Leaving -> Offline
+            if (m_createState == CreateNetworkStateStopNetwork) {
+                m_pollNetworkStateTimer->start();
+                evaluateNetworkState();
+            }
         });
         break;
     }
@@ -267,6 +283,65 @@ void ZigbeeNetworkDeconz::setCreateNetworkState(ZigbeeNetworkDeconz::CreateNetwo
 
                     qCDebug(dcZigbeeController()) << "Configured firmware to use predefined network PNAID successfully. SQN:" << reply->sequenceNumber();
 
+                    if (m_restoreBackup.isValid() && extendedPanId() != 0) {
+                        // Form the network with the extended PAN ID from the backup so the nodes rejoin without a mesh rebuild
+                        qCDebug(dcZigbeeNetwork()) << "Configure extended PANID from backup" << ZigbeeUtils::convertUint64ToHexString(extendedPanId());
+                        QByteArray paramData;
+                        QDataStream stream(&paramData, QIODevice::WriteOnly);
+                        stream.setByteOrder(QDataStream::LittleEndian);
+                        stream << extendedPanId();
+                        ZigbeeInterfaceDeconzReply *reply = m_controller->requestWriteParameter(Deconz::ParameterApsExtendedPanId, paramData);
+                        connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [reply](){
+                            if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+                                qCWarning(dcZigbeeController()) << "Could not write parameter. SQN:" << reply->sequenceNumber() << Deconz::ParameterApsExtendedPanId << reply->statusCode();
+                                return;
+                            }
+
+                            qCDebug(dcZigbeeController()) << "Configured extended PANID successfully. SQN:" << reply->sequenceNumber();
+                        });
+                    }
+
+                    // Take over the IEEE address of the previous coordinator. The nodes know it as trust center and
+                    // have bindings to it, which remain valid this way.
+                    m_macAddressRestored = false;
+                    if (m_restoreBackup.isValid() && !m_restoreBackup.coordinatorAddress().isNull()) {
+                        qCDebug(dcZigbeeNetwork()) << "Configure MAC address from backup" << m_restoreBackup.coordinatorAddress().toString();
+                        QByteArray paramData;
+                        QDataStream stream(&paramData, QIODevice::WriteOnly);
+                        stream.setByteOrder(QDataStream::LittleEndian);
+                        stream << m_restoreBackup.coordinatorAddress().toUInt64();
+                        ZigbeeInterfaceDeconzReply *reply = m_controller->requestWriteParameter(Deconz::ParameterMacAddress, paramData);
+                        connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply](){
+                            if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+                                qCWarning(dcZigbeeController()) << "Could not write parameter. SQN:" << reply->sequenceNumber() << Deconz::ParameterMacAddress << reply->statusCode();
+                                qCWarning(dcZigbeeNetwork()) << "The controller keeps its own MAC address. Nodes which rely on the previous trust center address may have to be paired again.";
+                                return;
+                            }
+
+                            qCDebug(dcZigbeeController()) << "Configured MAC address successfully. SQN:" << reply->sequenceNumber();
+                            m_macAddressRestored = true;
+                        });
+                    }
+
+                    if (m_restoreBackup.isValid() && m_restoreBackup.frameCounter() != 0) {
+                        // Continue above the frame counter of the previous coordinator, the nodes would drop our frames otherwise
+                        quint32 frameCounter = m_restoreBackup.restoreFrameCounter();
+                        qCDebug(dcZigbeeNetwork()) << "Configure network frame counter from backup" << frameCounter;
+                        QByteArray paramData;
+                        QDataStream stream(&paramData, QIODevice::WriteOnly);
+                        stream.setByteOrder(QDataStream::LittleEndian);
+                        stream << frameCounter;
+                        ZigbeeInterfaceDeconzReply *reply = m_controller->requestWriteParameter(Deconz::ParameterNetworkFrameCounter, paramData);
+                        connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [reply](){
+                            if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+                                qCWarning(dcZigbeeController()) << "Could not write parameter. SQN:" << reply->sequenceNumber() << Deconz::ParameterNetworkFrameCounter << reply->statusCode();
+                                return;
+                            }
+
+                            qCDebug(dcZigbeeController()) << "Configured network frame counter successfully. SQN:" << reply->sequenceNumber();
+                        });
+                    }
+
 
 
                     qCDebug(dcZigbeeNetwork()) << "Configure network PANID" << panId() << ZigbeeUtils::convertUint16ToHexString(panId());
@@ -284,11 +359,13 @@ void ZigbeeNetworkDeconz::setCreateNetworkState(ZigbeeNetworkDeconz::CreateNetwo
 
                         qCDebug(dcZigbeeController()) << "Configured network PANID successfully. SQN:" << reply->sequenceNumber();
 
+                        // The requests are processed in order, the MAC address has been written already
+                        ZigbeeAddress trustCenterAddress = m_macAddressRestored ? m_restoreBackup.coordinatorAddress() : m_controller->networkConfiguration().ieeeAddress;
                         QByteArray paramData;
                         QDataStream stream(&paramData, QIODevice::WriteOnly);
                         stream.setByteOrder(QDataStream::LittleEndian);
-                        stream << m_controller->networkConfiguration().ieeeAddress.toUInt64();
-                        qCDebug(dcZigbeeNetwork()) << "Configure trust center address" << m_controller->networkConfiguration().ieeeAddress.toString();
+                        stream << trustCenterAddress.toUInt64();
+                        qCDebug(dcZigbeeNetwork()) << "Configure trust center address" << trustCenterAddress.toString();
                         ZigbeeInterfaceDeconzReply *reply = m_controller->requestWriteParameter(Deconz::ParameterTrustCenterAddress, paramData);
                         connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply](){
                             if (reply->statusCode() != Deconz::StatusCodeSuccess) {
@@ -359,8 +436,10 @@ void ZigbeeNetworkDeconz::setCreateNetworkState(ZigbeeNetworkDeconz::CreateNetwo
             }
 
             qCDebug(dcZigbeeNetwork()) << "Start network finished successfully. SQN:" << reply->sequenceNumber();
-            // Start polling the device state, should be Online -> Leaving -> Offline
-            m_pollNetworkStateTimer->start();
+            // Wait for the device state, should be Offline -> Joining -> Connected
+            if (m_createState == CreateNetworkStateStartNetwork) {
+                m_pollNetworkStateTimer->start();
+            }
         });
         break;
     }
@@ -492,44 +571,7 @@ void ZigbeeNetworkDeconz::runNetworkInitProcess()
             qCDebug(dcZigbeeNetwork()) << "Request current firmware version...";
             ZigbeeInterfaceDeconzReply *reply = m_controller->requestVersion();
             connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply](){
-                QString firmwareVersion;
-                if (reply->statusCode() != Deconz::StatusCodeSuccess) {
-                    qCWarning(dcZigbeeController()) << "Request" << reply->command() << "finished with error" << reply->statusCode();
-                } else {
-                    // Note: version is an uint32 value, little endian, but we can read the individual bytes in reversed order
-                    qCDebug(dcZigbeeNetwork()) << "Version request finished successfully" << ZigbeeUtils::convertByteArrayToHexString(reply->responseData());
-                    quint8 majorVersion = static_cast<quint8>(reply->responseData().at(3));
-                    quint8 minorVersion = static_cast<quint8>(reply->responseData().at(2));
-                    Deconz::Platform platform = static_cast<Deconz::Platform>(reply->responseData().at(1));
-                    quint8 patchVersion = static_cast<quint8>(reply->responseData().at(0));
-                    QString platformString;
-                    switch (platform) {
-                    case Deconz::PlatformConbeeRaspbee:
-                        platformString = "RaspBee";
-                        break;
-                    case Deconz::PlatformConbeeII:
-                        platformString = "ConBee II";
-                        break;
-                    default:
-                        platformString = "N/A";
-                    }
-
-                    QString versionString = QString("0x%1%2%3%4").arg(majorVersion, 2, 16, QChar('0'))
-                            .arg(minorVersion, 2, 16, QChar('0'))
-                            .arg(platform, 2, 16, QChar('0'))
-                            .arg(patchVersion, 2, 16, QChar('0'));
-
-
-                    m_firmwareVersion = QString("%1.%2 - %3 (%4)").arg(majorVersion).arg(minorVersion).arg(platformString).arg(QString(versionString));
-                    qCDebug(dcZigbeeNetwork()) << "Firmware version" << firmwareVersion << platform << versionString;
-
-                }
-
-                if (!m_firmwareVersion.isEmpty()) {
-                    m_controller->setFirmwareVersion(m_firmwareVersion);
-                } else {
-                    m_controller->setFirmwareVersion("N/A");
-                }
+                processVersionReply(reply);
 
                 qCDebug(dcZigbeeNetwork()) << "Reading current network state";
                 ZigbeeInterfaceDeconzReply *reply = m_controller->requestDeviceState();
@@ -564,33 +606,16 @@ void ZigbeeNetworkDeconz::runNetworkInitProcess()
                         // Get the network state and start the network if required
                         if (m_controller->networkState() == Deconz::NetworkStateConnected) {
                             qCDebug(dcZigbeeNetwork()) << "The network is already running.";
-                            m_initializing = false;
-                            setPermitJoiningState(false);
-                            // Set the permit joining timeout network configuration parameter
-                            QByteArray parameterData;
-                            QDataStream stream(&parameterData, QIODevice::WriteOnly);
-                            stream.setByteOrder(QDataStream::LittleEndian);
-                            stream << static_cast<quint8>(0);
-
-                            ZigbeeInterfaceDeconzReply *reply = m_controller->requestWriteParameter(Deconz::ParameterPermitJoin, parameterData);
-                            connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply](){
-                                if (reply->statusCode() != Deconz::StatusCodeSuccess) {
-                                    qCWarning(dcZigbeeController()) << "Request" << reply->command() << "finished with error" << reply->statusCode();
-                                    // FIXME: set an appropriate error
-                                    return;
-                                }
-
-                                qCDebug(dcZigbeeNetwork()) << "Set permit join configuration request finished" << reply->statusCode();
-                                setState(StateRunning);
-                                sendPendingRequests();
-                            });
-
+                            resumeRunningNetwork();
                         } else if (m_controller->networkState() == Deconz::NetworkStateOffline) {
                             m_initializing = true;
                             qCDebug(dcZigbeeNetwork()) << "The network is offline. Lets start it";
                             setCreateNetworkState(CreateNetworkStateStartNetwork);
                         } else {
                             // The network is not running yet, lets wait for the state changed
+                            qCDebug(dcZigbeeNetwork()) << "The network is currently" << m_controller->networkState() << "Waiting for the state to settle";
+                            m_waitForNetworkState = true;
+                            m_pollNetworkStateTimer->start();
                         }
                     }
                 });
@@ -599,20 +624,318 @@ void ZigbeeNetworkDeconz::runNetworkInitProcess()
     });
 }
 
+void ZigbeeNetworkDeconz::runWarmStartProcess(const ZigbeeControllerSnapshot &snapshot)
+{
+    // - Read the network state, the network has to be connected already
+    // - Read the firmware version
+    // - Read the minimal set of network parameters
+
+    // If anything differs from the snapshot taken during the last run, continue with the full init process
+    qCDebug(dcZigbeeNetwork()) << "Try to warm start the network using" << snapshot;
+    ZigbeeInterfaceDeconzReply *reply = m_controller->requestDeviceState();
+    connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply, snapshot](){
+        if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+            qCWarning(dcZigbeeNetwork()) << "Could not read device state during warm start." << reply->statusCode() << "Continue with the full initialization.";
+            runNetworkInitProcess();
+            return;
+        }
+
+        QDataStream stream(reply->responseData());
+        stream.setByteOrder(QDataStream::LittleEndian);
+        quint8 deviceStateFlag = 0;
+        stream >> deviceStateFlag;
+        DeconzDeviceState deviceState = m_controller->parseDeviceStateFlag(deviceStateFlag);
+        qCDebug(dcZigbeeNetwork()) << deviceState;
+        m_controller->processDeviceState(deviceState);
+
+        if (m_controller->networkState() != Deconz::NetworkStateConnected) {
+            qCDebug(dcZigbeeNetwork()) << "The network is" << m_controller->networkState() << "and can not be warm started. Continue with the full initialization.";
+            runNetworkInitProcess();
+            return;
+        }
+
+        ZigbeeInterfaceDeconzReply *reply = m_controller->requestVersion();
+        connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply, snapshot](){
+            processVersionReply(reply);
+            if (m_controller->firmwareVersion() != snapshot.firmwareVersion) {
+                qCDebug(dcZigbeeNetwork()) << "The firmware version has changed since the last start" << snapshot.firmwareVersion << "->" << m_controller->firmwareVersion() << "Continue with the full initialization.";
+                runNetworkInitProcess();
+                return;
+            }
+
+            ZigbeeInterfaceDeconzReply *reply = m_controller->readWarmStartParameters();
+            connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply, snapshot](){
+                if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+                    qCWarning(dcZigbeeNetwork()) << "Could not read network parameters during warm start." << reply->statusCode() << "Continue with the full initialization.";
+                    runNetworkInitProcess();
+                    return;
+                }
+
+                DeconzNetworkConfiguration configuration = m_controller->networkConfiguration();
+                if (configuration.ieeeAddress != snapshot.ieeeAddress || configuration.panId != snapshot.panId
+                        || configuration.extendedPanId != snapshot.extendedPanId || configuration.currentChannel != snapshot.channel) {
+                    qCDebug(dcZigbeeNetwork()) << "The controller network configuration does not match the snapshot. Continue with the full initialization.";
+                    runNetworkInitProcess();
+                    return;
+                }
+
+                m_protocolVersion = QString("%1.%2").arg(configuration.protocolVersion >> 8 & 0xFF).arg(configuration.protocolVersion & 0xFF);
+                qCDebug(dcZigbeeNetwork()) << "The controller matches the snapshot. Skipping the full initialization.";
+                resumeRunningNetwork();
+            });
+        });
+    });
+}
+
+void ZigbeeNetworkDeconz::processVersionReply(ZigbeeInterfaceDeconzReply *reply)
+{
+    if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+        qCWarning(dcZigbeeController()) << "Request" << reply->command() << "finished with error" << reply->statusCode();
+    } else {
+        // Note: version is an uint32 value, little endian, but we can read the individual bytes in reversed order
+        qCDebug(dcZigbeeNetwork()) << "Version request finished successfully" << ZigbeeUtils::convertByteArrayToHexString(reply->responseData());
+        quint8 majorVersion = static_cast<quint8>(reply->responseData().at(3));
+        quint8 minorVersion = static_cast<quint8>(reply->responseData().at(2));
+        Deconz::Platform platform = static_cast<Deconz::Platform>(reply->responseData().at(1));
+        quint8 patchVersion = static_cast<quint8>(reply->responseData().at(0));
+        QString platformString;
+        switch (platform) {
+        case Deconz::PlatformConbeeRaspbee:
+            platformString = "RaspBee";
+            break;
+        case Deconz::PlatformConbeeII:
+            platformString = "ConBee II";
+            break;
+        default:
+            platformString = "N/A";
+        }
+
+        QString versionString = QString("0x%1%2%3%4").arg(majorVersion, 2, 16, QChar('0'))
+                .arg(minorVersion, 2, 16, QChar('0'))
+                .arg(platform, 2, 16, QChar('0'))
+                .arg(patchVersion, 2, 16, QChar('0'));
+
+
+        m_firmwareVersion = QString("%1.%2 - %3 (%4)").arg(majorVersion).arg(minorVersion).arg(platformString).arg(QString(versionString));
+        qCDebug(dcZigbeeNetwork()) << "Firmware version" << m_firmwareVersion << platform << versionString;
+    }
+
+    if (!m_firmwareVersion.isEmpty()) {
+        m_controller->setFirmwareVersion(m_firmwareVersion);
+    } else {
+        m_controller->setFirmwareVersion("N/A");
+    }
+}
+
+void ZigbeeNetworkDeconz::resumeRunningNetwork()
+{
+    m_initializing = false;
+    setPermitJoiningState(false);
+    // Set the permit joining timeout network configuration parameter
+    QByteArray parameterData;
+    QDataStream stream(&parameterData, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << static_cast<quint8>(0);
+
+    ZigbeeInterfaceDeconzReply *reply = m_controller->requestWriteParameter(Deconz::ParameterPermitJoin, parameterData);
+    connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply](){
+        if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Request" << reply->command() << "finished with error" << reply->statusCode();
+            // FIXME: set an appropriate error
+            return;
+        }
+
+        qCDebug(dcZigbeeNetwork()) << "Set permit join configuration request finished" << reply->statusCode();
+        setState(StateRunning);
+        sendPendingRequests();
+    });
+}
+
+bool ZigbeeNetworkDeconz::waitingForNetworkState() const
+{
+    switch (m_createState) {
+    case CreateNetworkStateStopNetwork:
+    case CreateNetworkStateStartNetwork:
+        return true;
+    case CreateNetworkStateIdle:
+        // The controller has been found joining or leaving during the startup
+        return m_waitForNetworkState;
+    default:
+        return false;
+    }
+}
+
+void ZigbeeNetworkDeconz::evaluateNetworkState()
+{
+    if (!waitingForNetworkState())
+        return;
+
+    switch (m_createState) {
+    case CreateNetworkStateStopNetwork:
+        if (m_controller->networkState() == Deconz::NetworkStateOffline) {
+            m_pollNetworkStateTimer->stop();
+            if (m_changingChannel) {
+                // The channel configuration has been written already, start on the new channel
+                qCDebug(dcZigbeeNetwork()) << "Network stopped successfully for the channel change";
+                m_changingChannel = false;
+                setCreateNetworkState(CreateNetworkStateStartNetwork);
+            } else {
+                qCDebug(dcZigbeeNetwork()) << "Network stopped successfully for creation";
+                setCreateNetworkState(CreateNetworkStateWriteConfiguration);
+            }
+        }
+        break;
+    case CreateNetworkStateStartNetwork:
+        if (m_controller->networkState() == Deconz::NetworkStateConnected) {
+            // The network is now online, continue with the state machine
+            m_pollNetworkStateTimer->stop();
+            setCreateNetworkState(CreateNetworkStateReadConfiguration);
+        } else if (m_controller->networkState() == Deconz::NetworkStateOffline) {
+            qCWarning(dcZigbeeNetwork()) << "Failed to start the network.";
+            m_pollNetworkStateTimer->stop();
+            setCreateNetworkState(CreateNetworkStateIdle);
+            setState(StateOffline);
+            setError(ErrorZigbeeError);
+        }
+        break;
+    case CreateNetworkStateIdle:
+        if (m_controller->networkState() == Deconz::NetworkStateConnected) {
+            qCDebug(dcZigbeeNetwork()) << "The network is running now.";
+            m_waitForNetworkState = false;
+            m_pollNetworkStateTimer->stop();
+            resumeRunningNetwork();
+        } else if (m_controller->networkState() == Deconz::NetworkStateOffline) {
+            qCDebug(dcZigbeeNetwork()) << "The network is offline now. Lets start it";
+            m_waitForNetworkState = false;
+            m_pollNetworkStateTimer->stop();
+            setCreateNetworkState(CreateNetworkStateStartNetwork);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
 void ZigbeeNetworkDeconz::startNetworkInternally()
 {
     qCDebug(dcZigbeeNetwork()) << "Start zigbee network internally";
 
+    if (!m_startupTimer.isValid())
+        m_startupTimer.start();
+
+    // Restart the state machine, a previous start might have been interrupted
+    m_waitForNetworkState = false;
+    m_changingChannel = false;
+    m_pollNetworkStateTimer->stop();
+    setCreateNetworkState(CreateNetworkStateIdle);
+
     m_createNewNetwork = false;
     // Check if we have to create a pan ID and select the channel
-    if (panId() == 0 || !m_coordinatorNode) {
+    if (m_restoreBackup.isValid()) {
+        qCDebug(dcZigbeeNetwork()) << "Programming the controller with the network configuration from the backup";
+        m_createNewNetwork = true;
+    } else if (panId() == 0 || !m_coordinatorNode) {
         setPanId(ZigbeeUtils::generateRandomPanId());
         qCDebug(dcZigbeeNetwork()) << "Generated new extended PAN ID" << panId() << ZigbeeUtils::convertUint16ToHexString(panId());
         m_createNewNetwork = true;
     }
 
     m_initRetry = 0;
-    runNetworkInitProcess();
+    ZigbeeControllerSnapshot snapshot = m_createNewNetwork ? ZigbeeControllerSnapshot() : warmStartSnapshot();
+    if (snapshot.isValid()) {
+        runWarmStartProcess(snapshot);
+    } else {
+        runNetworkInitProcess();
+    }
+}
+
+void ZigbeeNetworkDeconz::readControllerBackupData()
+{
+    readFrameCounter([this](bool success, quint32 frameCounter){
+        finishBackup(success, QByteArray(), frameCounter);
+    });
+}
+
+void ZigbeeNetworkDeconz::readFrameCounter(const std::function<void (bool, quint32)> &callback)
+{
+    ZigbeeInterfaceDeconzReply *reply = m_controller->requestReadParameter(Deconz::ParameterNetworkFrameCounter);
+    connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [reply, callback](){
+        if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Could not read parameter. SQN:" << reply->sequenceNumber() << Deconz::ParameterNetworkFrameCounter << reply->statusCode();
+            callback(false, 0);
+            return;
+        }
+
+        QDataStream stream(reply->responseData());
+        stream.setByteOrder(QDataStream::LittleEndian);
+        quint16 payloadLength = 0; quint8 parameter = 0; quint32 frameCounter = 0;
+        stream >> payloadLength >> parameter >> frameCounter;
+        qCDebug(dcZigbeeNetwork()) << "Network frame counter:" << frameCounter;
+        callback(true, frameCounter);
+    });
+}
+
+bool ZigbeeNetworkDeconz::channelChangeSupported() const
+{
+    return true;
+}
+
+void ZigbeeNetworkDeconz::readNetworkUpdateId(const std::function<void (bool, quint8)> &callback)
+{
+    ZigbeeInterfaceDeconzReply *reply = m_controller->requestReadParameter(Deconz::ParameterNetworkUpdateId);
+    connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [reply, callback](){
+        if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Could not read parameter. SQN:" << reply->sequenceNumber() << Deconz::ParameterNetworkUpdateId << reply->statusCode();
+            callback(false, 0);
+            return;
+        }
+
+        QDataStream stream(reply->responseData());
+        stream.setByteOrder(QDataStream::LittleEndian);
+        quint16 payloadLength = 0; quint8 parameter = 0; quint8 networkUpdateId = 0;
+        stream >> payloadLength >> parameter >> networkUpdateId;
+        qCDebug(dcZigbeeNetwork()) << "Current network update ID" << networkUpdateId;
+        callback(true, networkUpdateId);
+    });
+}
+
+void ZigbeeNetworkDeconz::changeControllerChannel(quint8 channel, quint8 networkUpdateId)
+{
+    // The firmware starts the network on the channel of the channel mask. Write the new channel and network update ID
+    // and restart the network, PAN ID and keys remain the same so the nodes stay in the network.
+    QByteArray paramData;
+    QDataStream stream(&paramData, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << networkUpdateId;
+    qCDebug(dcZigbeeNetwork()) << "Configure network update ID" << networkUpdateId;
+    ZigbeeInterfaceDeconzReply *reply = m_controller->requestWriteParameter(Deconz::ParameterNetworkUpdateId, paramData);
+    connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply, channel](){
+        if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Could not write parameter. SQN:" << reply->sequenceNumber() << Deconz::ParameterNetworkUpdateId << reply->statusCode();
+            finishControllerChannelChange(false);
+            return;
+        }
+
+        QByteArray paramData;
+        QDataStream stream(&paramData, QIODevice::WriteOnly);
+        stream.setByteOrder(QDataStream::LittleEndian);
+        stream << static_cast<quint32>(1 << channel);
+        qCDebug(dcZigbeeNetwork()) << "Configure channel mask for channel" << channel;
+        ZigbeeInterfaceDeconzReply *reply = m_controller->requestWriteParameter(Deconz::ParameterChannelMask, paramData);
+        connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply](){
+            if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+                qCWarning(dcZigbeeController()) << "Could not write parameter. SQN:" << reply->sequenceNumber() << Deconz::ParameterChannelMask << reply->statusCode();
+                finishControllerChannelChange(false);
+                return;
+            }
+
+            // Requests sent meanwhile get queued until the network is running again
+            qCDebug(dcZigbeeNetwork()) << "Restarting the network on the new channel";
+            m_changingChannel = true;
+            setState(StateStarting);
+            setCreateNetworkState(CreateNetworkStateStopNetwork);
+        });
+    });
 }
 
 void ZigbeeNetworkDeconz::onControllerAvailableChanged(bool available)
@@ -621,6 +944,9 @@ void ZigbeeNetworkDeconz::onControllerAvailableChanged(bool available)
         qCWarning(dcZigbeeNetwork()) << "Hardware controller is not available any more.";
         setError(ErrorHardwareUnavailable);
         m_initializing = false;
+        m_waitForNetworkState = false;
+        m_pollNetworkStateTimer->stop();
+        m_startupTimer.invalidate();
         setPermitJoiningState(false);
         setState(StateOffline);
     } else {
@@ -632,76 +958,38 @@ void ZigbeeNetworkDeconz::onControllerAvailableChanged(bool available)
     }
 }
 
-void ZigbeeNetworkDeconz::onPollNetworkStateTimeout()
+void ZigbeeNetworkDeconz::onControllerNetworkStateChanged(Deconz::NetworkState networkState)
 {
-    // Stop the timer and make the request
-    m_pollNetworkStateTimer->stop();
+    qCDebug(dcZigbeeNetwork()) << "Controller network state changed" << networkState << m_createState;
+    evaluateNetworkState();
+}
 
-    switch (m_createState) {
-    case CreateNetworkStateStopNetwork: {
-        ZigbeeInterfaceDeconzReply *reply = m_controller->requestDeviceState();
-        connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply](){
-            if (reply->statusCode() != Deconz::StatusCodeSuccess) {
-                qCWarning(dcZigbeeController()) << "Could not read device state during network start up." << reply->statusCode();
-                // FIXME: set an appropriate error
-                return;
-            }
+void ZigbeeNetworkDeconz::onPollNetworkStateTimeout()
+{
+    if (!waitingForNetworkState())
+        return;
 
-            //qCDebug(dcZigbeeNetwork()) << "Read device state finished successfully";
-            QDataStream stream(reply->responseData());
-            stream.setByteOrder(QDataStream::LittleEndian);
-            quint8 deviceStateFlag = 0;
-            stream >> deviceStateFlag;
-            // Update the device state in the controller
-            m_controller->processDeviceState(m_controller->parseDeviceStateFlag(deviceStateFlag));
-            if (m_controller->networkState() == Deconz::NetworkStateOffline) {
-                qCDebug(dcZigbeeNetwork()) << "Network stopped successfully for creation";
-                // The network is now offline, continue with the state machine in one second (some grace period after network shutdown)
-                QTimer::singleShot(1000, this, [=](){
-                    setCreateNetworkState(CreateNetworkStateWriteConfiguration);
-                });
-            } else {
-                // Not offline yet, continue poll
-                m_pollNetworkStateTimer->start();
-            }
-        });
-        break;
-    }
-    case CreateNetworkStateStartNetwork: {
-        ZigbeeInterfaceDeconzReply *reply = m_controller->requestDeviceState();
-        connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply](){
-            if (reply->statusCode() != Deconz::StatusCodeSuccess) {
-                qCWarning(dcZigbeeController()) << "Could not read device state during network start up. SQN:" << reply->sequenceNumber() << reply->statusCode();
-                // FIXME: set an appropriate error
-                return;
-            }
+    ZigbeeInterfaceDeconzReply *reply = m_controller->requestDeviceState();
+    connect(reply, &ZigbeeInterfaceDeconzReply::finished, this, [this, reply](){
+        if (reply->statusCode() != Deconz::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Could not read device state during network start up. SQN:" << reply->sequenceNumber() << reply->statusCode();
+            // FIXME: set an appropriate error
+            return;
+        }
 
-            //qCDebug(dcZigbeeNetwork()) << "Read device state finished successfully. SQN:" << reply->sequenceNumber();
-            QDataStream stream(reply->responseData());
-            stream.setByteOrder(QDataStream::LittleEndian);
-            quint8 deviceStateFlag = 0;
-            stream >> deviceStateFlag;
-            // Update the device state in the controller
-            m_controller->processDeviceState(m_controller->parseDeviceStateFlag(deviceStateFlag));
-            if (m_controller->networkState() == Deconz::NetworkStateConnected) {
-                // The network is now online, continue with the state machine
-                setCreateNetworkState(CreateNetworkStateReadConfiguration);
-            } else if (m_controller->networkState() == Deconz::NetworkStateOffline) {
-                qCWarning(dcZigbeeNetwork()) << "Failed to start the network.";
-                setCreateNetworkState(CreateNetworkStateIdle);
-                setState(StateOffline);
-                setError(ErrorZigbeeError);
-                return;
-            } else {
-                // Not offline yet, continue poll
-                m_pollNetworkStateTimer->start();
-            }
-        });
-        break;
-    }
-    default:
-        break;
-    }
+        QDataStream stream(reply->responseData());
+        stream.setByteOrder(QDataStream::LittleEndian);
+        quint8 deviceStateFlag = 0;
+        stream >> deviceStateFlag;
+        // Update the device state in the controller, a network state change will be evaluated right away
+        m_controller->processDeviceState(m_controller->parseDeviceStateFlag(deviceStateFlag));
+        evaluateNetworkState();
+
+        // Not there yet, continue polling
+        if (waitingForNetworkState()) {
+            m_pollNetworkStateTimer->start();
+        }
+    });
 }
 
 void ZigbeeNetworkDeconz::onApsDataConfirmReceived(const Zigbee::ApsdeDataConfirm &confirm)
@@ -729,6 +1017,7 @@ void ZigbeeNetworkDeconz::onApsDataIndicationReceived(const Zigbee::ApsdeDataInd
 
 void ZigbeeNetworkDeconz::startNetwork()
 {
+    m_startupTimer.start();
     loadNetwork();
 
     if (!m_controller->enable(serialPortName(), serialBaudrate())) {
@@ -29,6 +29,7 @@
 #define ZIGBEENETWORKDECONZ_H
 
 #include <QObject>
+#include <QElapsedTimer>
 
 #include "zigbeenetwork.h"
 #include "zigbeechannelmask.h"
@@ -65,6 +66,8 @@ private:
     CreateNetworkState m_createState = CreateNetworkStateIdle;
     bool m_createNewNetwork = false;
     bool m_initializing = false;
+    bool m_changingChannel = false;
+    bool m_macAddressRestored = false;
     QString m_protocolVersion;
     QString m_firmwareVersion;
 
@@ -72,21 +75,35 @@ private:
     QHash<quint8, ZigbeeNetworkReply *> m_pendingReplies;
 
     QTimer *m_pollNetworkStateTimer = nullptr;
+    bool m_waitForNetworkState = false;
+    QElapsedTimer m_startupTimer;
     void setCreateNetworkState(CreateNetworkState state);
+    bool waitingForNetworkState() const;
+    void evaluateNetworkState();
+    void resumeRunningNetwork();
 
     // Init procedure
     int m_initRetry = 0;
     void runNetworkInitProcess();
+    void runWarmStartProcess(const ZigbeeControllerSnapshot &snapshot);
+    void processVersionReply(ZigbeeInterfaceDeconzReply *reply);
 
     ZigbeeNetworkReply *requestSetPermitJoin(quint16 shortAddress = Zigbee::BroadcastAddressAllRouters, quint8 duration = 0xfe);
 
     void sendPendingRequests();
+    void sendRequestInternally(ZigbeeNetworkReply *reply);
 
 protected:
     void startNetworkInternally();
+    void readControllerBackupData() override;
+    void readFrameCounter(const std::function<void(bool success, quint32 frameCounter)> &callback) override;
+    bool channelChangeSupported() const override;
+    void readNetworkUpdateId(const std::function<void(bool success, quint8 networkUpdateId)> &callback) override;
+    void changeControllerChannel(quint8 channel, quint8 networkUpdateId) override;
 
 private slots:
     void onControllerAvailableChanged(bool available);
+    void onControllerNetworkStateChanged(Deconz::NetworkState networkState);
     void onPollNetworkStateTimeout();
 
     void onApsDataConfirmReceived(const Zigbee::ApsdeDataConfirm &confirm);
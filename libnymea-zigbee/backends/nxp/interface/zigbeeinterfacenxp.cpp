@@ -28,6 +28,8 @@
 #include "zigbeeinterfacenxp.h"
 #include "zigbee.h"
 #include "zigbeeutils.h"
+#include "zigbeemetrics.h"
+#include "zigbeeiothread.h"
 #include "loggingcategory.h"
 
 #include <QDataStream>
@@ -41,11 +43,24 @@ ZigbeeInterfaceNxp::ZigbeeInterfaceNxp(QObject *parent) : QObject(parent)
     m_reconnectTimer->setInterval(5000);
 
     connect(m_reconnectTimer, &QTimer::timeout, this, &ZigbeeInterfaceNxp::onReconnectTimeout);
+
+    QString labels = "backend=\"nxp\"";
+    m_framesReceivedCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_frames_received_total", "Number of valid frames received from the controller.", labels);
+    m_framesSentCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_frames_sent_total", "Number of frames written to the controller.", labels);
+    m_bytesReceivedCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_bytes_received_total", "Number of bytes read from the serial port.", labels);
+    m_bytesSentCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_bytes_sent_total", "Number of bytes written to the serial port.", labels);
+    m_checksumErrorsCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_checksum_errors_total", "Number of received frames with an invalid checksum.", labels);
+    m_writeErrorsCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_write_errors_total", "Number of frames which could not be written to the serial port.", labels);
 }
 
 ZigbeeInterfaceNxp::~ZigbeeInterfaceNxp()
 {
-
+    if (m_serialPort) {
+        runInIoThread([this](){
+            delete m_serialPort;
+            m_serialPort = nullptr;
+        });
+    }
 }
 
 bool ZigbeeInterfaceNxp::available() const
@@ -58,6 +73,32 @@ QString ZigbeeInterfaceNxp::serialPort() const
     return m_serialPort->portName();
 }
 
+bool ZigbeeInterfaceNxp::ioThreadEnabled() const
+{
+    return m_ioThread != nullptr;
+}
+
+void ZigbeeInterfaceNxp::setIoThreadEnabled(bool ioThreadEnabled)
+{
+    if (this->ioThreadEnabled() == ioThreadEnabled)
+        return;
+
+    if (m_serialPort) {
+        qCWarning(dcZigbeeInterface()) << "Cannot change the I/O thread while the interface is enabled.";
+        return;
+    }
+
+    if (ioThreadEnabled) {
+        qCDebug(dcZigbeeInterface()) << "Enable dedicated I/O thread for the serial communication";
+        m_ioThread = new ZigbeeIoThread("nxp-io", this);
+        connect(m_ioThread, &ZigbeeIoThread::frameReceived, this, &ZigbeeInterfaceNxp::packageReceived);
+    } else {
+        qCDebug(dcZigbeeInterface()) << "Disable dedicated I/O thread for the serial communication";
+        delete m_ioThread;
+        m_ioThread = nullptr;
+    }
+}
+
 quint8 ZigbeeInterfaceNxp::calculateCrc(const QByteArray &data)
 {
     quint8 crc = 0;
@@ -142,13 +183,27 @@ void ZigbeeInterfaceNxp::setAvailable(bool available)
 
 void ZigbeeInterfaceNxp::onReconnectTimeout()
 {
-    if (m_serialPort && !m_serialPort->isOpen()) {
-        if (!m_serialPort->open(QSerialPort::ReadWrite)) {
+    if (!m_serialPort)
+        return;
+
+    bool wasOpen = false;
+    bool opened = false;
+    runInIoThread([this, &wasOpen, &opened](){
+        wasOpen = m_serialPort->isOpen();
+        if (!wasOpen) {
+            opened = m_serialPort->open(QSerialPort::ReadWrite);
+            if (opened) {
+                m_serialPort->clear();
+            }
+        }
+    });
+
+    if (!wasOpen) {
+        if (!opened) {
             setAvailable(false);
             m_reconnectTimer->start();
         } else {
             qCDebug(dcZigbeeInterface()) << "Interface reconnected successfully on" << m_serialPort->portName() << m_serialPort->baudRate();
-            m_serialPort->clear();
             setAvailable(true);
         }
     }
@@ -157,6 +212,7 @@ void ZigbeeInterfaceNxp::onReconnectTimeout()
 void ZigbeeInterfaceNxp::onReadyRead()
 {
     QByteArray data = m_serialPort->readAll();
+    m_bytesReceivedCounter->increment(data.length());
 
     // Read each byte until we get END byte, then unescape the package
     for (int i = 0; i < data.length(); i++) {
@@ -177,13 +233,19 @@ void ZigbeeInterfaceNxp::onReadyRead()
                 quint8 calculatedChecksum = calculateCrc(package);
                 if (receivedChecksum != calculatedChecksum) {
                     qCWarning(dcZigbeeInterfaceTraffic()) << "Checksum verification failed for frame" << ZigbeeUtils::convertByteArrayToHexString(m_dataBuffer) << receivedChecksum << "!=" << calculatedChecksum;
+                    m_checksumErrorsCounter->increment();
                     m_dataBuffer.clear();
                     continue;
                 }
 
                 // Checksum verified, we got valid data
                 qCDebug(dcZigbeeInterface()) << "Received frame" << ZigbeeUtils::convertByteArrayToHexString(frame);
-                emit packageReceived(package);
+                m_framesReceivedCounter->increment();
+                if (m_ioThread) {
+                    m_ioThread->enqueueFrame(package);
+                } else {
+                    emit packageReceived(package);
+                }
             }
             m_dataBuffer.clear();
         } else {
@@ -194,10 +256,22 @@ void ZigbeeInterfaceNxp::onReadyRead()
 
 void ZigbeeInterfaceNxp::onError(const QSerialPort::SerialPortError &error)
 {
-    if (error != QSerialPort::NoError && m_serialPort->isOpen()) {
-        qCWarning(dcZigbeeInterface()) << "Serial port error:" << error << m_serialPort->errorString();
+    if (error == QSerialPort::NoError || !m_serialPort)
+        return;
+
+    bool wasOpen = false;
+    QString errorString;
+    runInIoThread([this, &wasOpen, &errorString](){
+        wasOpen = m_serialPort->isOpen();
+        if (wasOpen) {
+            errorString = m_serialPort->errorString();
+            m_serialPort->close();
+        }
+    });
+
+    if (wasOpen) {
+        qCWarning(dcZigbeeInterface()) << "Serial port error:" << error << errorString;
         m_reconnectTimer->start();
-        m_serialPort->close();
         setAvailable(false);
     }
 }
@@ -237,8 +311,39 @@ void ZigbeeInterfaceNxp::sendPackage(const QByteArray &package)
 //        qCDebug(dcZigbeeInterfaceTraffic()) << "[out]" << ZigbeeUtils::convertByteToHexString(data.at(i));
 //    }
 
-    if (m_serialPort->write(data) < 0) {
-        qCWarning(dcZigbeeInterface()) << "Could not stream byte" << ZigbeeUtils::convertByteArrayToHexString(data);
+    writeData(data);
+}
+
+void ZigbeeInterfaceNxp::runInIoThread(const std::function<void()> &function)
+{
+    if (m_ioThread) {
+        m_ioThread->execute(function);
+    } else {
+        function();
+    }
+}
+
+void ZigbeeInterfaceNxp::writeData(const QByteArray &data)
+{
+    auto write = [this, data](){
+        if (!m_serialPort)
+            return;
+
+        if (m_serialPort->write(data) < 0) {
+            qCWarning(dcZigbeeInterface()) << "Could not stream byte" << ZigbeeUtils::convertByteArrayToHexString(data);
+            m_writeErrorsCounter->increment();
+            return;
+        }
+
+        m_framesSentCounter->increment();
+        m_bytesSentCounter->increment(data.length());
+    };
+
+    // Note: the caller does not have to wait until the data has been written in the I/O thread
+    if (m_ioThread) {
+        m_ioThread->post(write);
+    } else {
+        write();
     }
 }
 
@@ -247,32 +352,53 @@ bool ZigbeeInterfaceNxp::enable(const QString &serialPort, qint32 baudrate)
     qCDebug(dcZigbeeInterface()) << "Start UART interface " << serialPort << baudrate;
 
     if (m_serialPort) {
-        delete m_serialPort;
-        m_serialPort = nullptr;
+        runInIoThread([this](){
+            delete m_serialPort;
+            m_serialPort = nullptr;
+        });
     }
 
-    m_serialPort = new QSerialPort(serialPort, this);
-    m_serialPort->setBaudRate(baudrate);
-    m_serialPort->setDataBits(QSerialPort::Data8);
-    m_serialPort->setStopBits(QSerialPort::OneStop);
-    m_serialPort->setParity(QSerialPort::NoParity);
-    m_serialPort->setFlowControl(QSerialPort::NoFlowControl);
-
-    connect(m_serialPort, &QSerialPort::readyRead, this, &ZigbeeInterfaceNxp::onReadyRead);
+    // Note: if the I/O thread is enabled, the serial port lives in the I/O thread without parent.
+    // The write lambdas read m_serialPort in the I/O thread, so it only gets assigned in there.
+    QSerialPort *serialPortDevice = new QSerialPort(serialPort, m_ioThread ? nullptr : this);
+    serialPortDevice->setBaudRate(baudrate);
+    serialPortDevice->setDataBits(QSerialPort::Data8);
+    serialPortDevice->setStopBits(QSerialPort::OneStop);
+    serialPortDevice->setParity(QSerialPort::NoParity);
+    serialPortDevice->setFlowControl(QSerialPort::NoFlowControl);
+
+    if (m_ioThread) {
+        // Read and decode the data directly in the I/O thread
+        m_ioThread->moveToIoThread(serialPortDevice);
+        connect(serialPortDevice, &QSerialPort::readyRead, this, &ZigbeeInterfaceNxp::onReadyRead, Qt::DirectConnection);
+    } else {
+        connect(serialPortDevice, &QSerialPort::readyRead, this, &ZigbeeInterfaceNxp::onReadyRead);
+    }
 #if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
-    connect(m_serialPort, &QSerialPort::errorOccurred, this, &ZigbeeInterfaceNxp::onError, Qt::QueuedConnection);
+    connect(serialPortDevice, &QSerialPort::errorOccurred, this, &ZigbeeInterfaceNxp::onError, Qt::QueuedConnection);
 #else
-    connect(m_serialPort, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(onError(QSerialPort::SerialPortError)), Qt::QueuedConnection);
+    connect(serialPortDevice, SIGNAL(error(QSerialPort::SerialPortError)), this, SLOT(onError(QSerialPort::SerialPortError)), Qt::QueuedConnection);
 #endif
 
-    if (!m_serialPort->open(QSerialPort::ReadWrite)) {
-        qCWarning(dcZigbeeInterface()) << "Could not open serial port" << serialPort << baudrate << m_serialPort->errorString();
+    bool opened = false;
+    QString errorString;
+    runInIoThread([this, serialPortDevice, &opened, &errorString](){
+        m_serialPort = serialPortDevice;
+        opened = m_serialPort->open(QSerialPort::ReadWrite);
+        if (opened) {
+            m_serialPort->clear();
+        } else {
+            errorString = m_serialPort->errorString();
+        }
+    });
+
+    if (!opened) {
+        qCWarning(dcZigbeeInterface()) << "Could not open serial port" << serialPort << baudrate << errorString;
         m_reconnectTimer->start();
         return false;
     }
 
     qCDebug(dcZigbeeInterface()) << "Interface enabled successfully on" << serialPort << baudrate;
-    m_serialPort->clear();
 
     setAvailable(true);
     return true;
@@ -283,11 +409,13 @@ void ZigbeeInterfaceNxp::reconnectController()
     if (!m_serialPort)
         return;
 
-    if (m_serialPort->isOpen())
-        m_serialPort->close();
+    runInIoThread([this](){
+        if (m_serialPort->isOpen())
+            m_serialPort->close();
 
-    delete m_serialPort;
-    m_serialPort = nullptr;
+        delete m_serialPort;
+        m_serialPort = nullptr;
+    });
     setAvailable(false);
     m_reconnectTimer->start();
 }
@@ -297,11 +425,13 @@ void ZigbeeInterfaceNxp::disable()
     if (!m_serialPort)
         return;
 
-    if (m_serialPort->isOpen())
-        m_serialPort->close();
+    runInIoThread([this](){
+        if (m_serialPort->isOpen())
+            m_serialPort->close();
 
-    delete m_serialPort;
-    m_serialPort = nullptr;
+        delete m_serialPort;
+        m_serialPort = nullptr;
+    });
 
     qCDebug(dcZigbeeInterface()) << "Interface disabled.";
     setAvailable(false);
@@ -27,6 +27,7 @@
 
 #include "zigbeebridgecontrollernxp.h"
 #include "loggingcategory.h"
+#include "zigbeemetrics.h"
 #include "zigbeeutils.h"
 
 #include <QDataStream>
@@ -37,6 +38,11 @@ ZigbeeBridgeControllerNxp::ZigbeeBridgeControllerNxp(QObject *parent) :
     m_interface = new ZigbeeInterfaceNxp(this);
     connect(m_interface, &ZigbeeInterfaceNxp::availableChanged, this, &ZigbeeBridgeControllerNxp::onInterfaceAvailableChanged);
     connect(m_interface, &ZigbeeInterfaceNxp::packageReceived, this, &ZigbeeBridgeControllerNxp::onInterfacePackageReceived);
+
+    QString labels = "backend=\"nxp\"";
+    m_queueDepthGauge = ZigbeeMetrics::instance()->gauge("zigbee_controller_queue_depth", "Number of requests waiting to be sent to the controller.", labels);
+    m_retriesCounter = ZigbeeMetrics::instance()->counter("zigbee_controller_request_retries_total", "Number of controller requests which had to be sent again.", labels);
+    m_timeoutsCounter = ZigbeeMetrics::instance()->counter("zigbee_controller_request_timeouts_total", "Number of controller requests which timed out.", labels);
 }
 
 ZigbeeBridgeControllerNxp::~ZigbeeBridgeControllerNxp()
@@ -288,8 +294,9 @@ ZigbeeInterfaceNxpReply *ZigbeeBridgeControllerNxp::createReply(Nxp::Command com
     reply->m_requestData = requestData;
     reply->m_sequenceNumber = sequenceNumber;
     // Make sure we clean up on timeout
-    connect(reply, &ZigbeeInterfaceNxpReply::timeout, this, [reply](){
+    connect(reply, &ZigbeeInterfaceNxpReply::timeout, this, [this, reply](){
         qCWarning(dcZigbeeController()) << "Reply timeout" << reply;
+        m_timeoutsCounter->increment();
     });
 
     // Auto delete the object on finished
@@ -303,6 +310,7 @@ ZigbeeInterfaceNxpReply *ZigbeeBridgeControllerNxp::createReply(Nxp::Command com
 
     qCDebug(dcZigbeeController()) << "Enqueue request" << reply->command() << "SQN:" << reply->sequenceNumber();
     m_replyQueue.enqueue(reply);
+    m_queueDepthGauge->set(m_replyQueue.count());
 
     QMetaObject::invokeMethod(this, "sendNextRequest", Qt::QueuedConnection);
     return reply;
@@ -640,6 +648,7 @@ void ZigbeeBridgeControllerNxp::sendNextRequest()
 
     // Send next message
     m_currentReply = m_replyQueue.dequeue();
+    m_queueDepthGauge->set(m_replyQueue.count());
     qCDebug(dcZigbeeController()) << "Send request" << m_currentReply;
     m_interface->sendPackage(m_currentReply->requestData());
     m_currentReply->m_timer->start();
@@ -649,6 +658,7 @@ bool ZigbeeBridgeControllerNxp::enable(const QString &serialPort, qint32 baudrat
 {
     m_serialPort = serialPort;
     m_baudrate = baudrate;
+    m_interface->setIoThreadEnabled(m_ioThreadEnabled);
     return m_interface->enable(serialPort, baudrate);
 }
 
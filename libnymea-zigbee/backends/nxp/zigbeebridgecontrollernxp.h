@@ -42,6 +42,9 @@
 #include "interface/zigbeeinterfacenxp.h"
 #include "interface/zigbeeinterfacenxpreply.h"
 
+class ZigbeeMetricGauge;
+class ZigbeeMetricCounter;
+
 class ZigbeeBridgeControllerNxp : public ZigbeeBridgeController
 {
     Q_OBJECT
@@ -113,6 +116,12 @@ private:
 
     ZigbeeInterfaceNxpReply *m_currentReply = nullptr;
     QQueue<ZigbeeInterfaceNxpReply *> m_replyQueue;
+
+    // Metrics
+    ZigbeeMetricGauge *m_queueDepthGauge = nullptr;
+    ZigbeeMetricCounter *m_retriesCounter = nullptr;
+    ZigbeeMetricCounter *m_timeoutsCounter = nullptr;
+
     ZigbeeInterfaceNxpReply *createReply(Nxp::Command command, quint8 sequenceNumber, const QString &requestName, const QByteArray &requestData, QObject *parent);
 
     void bumpSequenceNumber();
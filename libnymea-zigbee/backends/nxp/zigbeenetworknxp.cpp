@@ -29,6 +29,8 @@
 #include "loggingcategory.h"
 #include "zigbeeutils.h"
 #include "zigbeenetworkdatabase.h"
+#include "zigbeebroadcastgovernor.h"
+#include "zigbeelatencystatistics.h"
 
 #include <QDataStream>
 
@@ -98,10 +100,16 @@ ZigbeeNetworkReply *ZigbeeNetworkNxp::sendRequest(const ZigbeeNetworkRequest &re
         return reply;
     }
 
+    // The firmware does not fragment outgoing requests, make sure the payload fits into one frame
+    if (!verifyRequestLength(reply))
+        return reply;
+
     // Enqueu reply and send next one if we have enouth capacity
-    m_replyQueue.enqueue(reply);
-    //qCDebug(dcZigbeeNetwork()) << "=== Pending replies count (enqueued)" << m_replyQueue.count();
-    sendNextReply();
+    broadcastGovernor()->send(reply, [this](ZigbeeNetworkReply *governedReply){
+        m_replyQueue.enqueue(governedReply);
+        //qCDebug(dcZigbeeNetwork()) << "=== Pending replies count (enqueued)" << m_replyQueue.count();
+        sendNextReply();
+    });
 
     return reply;
 }
@@ -566,10 +574,12 @@ void ZigbeeNetworkNxp::onApsDataAckReceived(const Zigbee::ApsdeDataAck &acknowle
             qCDebug(dcZigbeeNetwork()) << "Buffered frame from network request has been acknowledged successfully" << acknowledgement;
         }
         setReplyResponseError(reply, acknowledgement.zigbeeStatusCode);
+        latencyStatistics()->processAcknowledgement(acknowledgement.requestId, acknowledgement.clusterId);
     } else {
         if (acknowledgement.zigbeeStatusCode != Zigbee::ZigbeeApsStatusSuccess) {
             qCWarning(dcZigbeeNetwork()) << acknowledgement;
         } else {
+            latencyStatistics()->processAcknowledgement(acknowledgement.requestId, acknowledgement.clusterId);
             ZigbeeNode *node = getZigbeeNode(acknowledgement.destinationAddress);
             if (node) {
                 // We received a successfull ACk from this node...it is reachable in any case
@@ -509,6 +509,7 @@ public:
         NvItemIdRandomSeed = 0x70,
         NvItemIdTrustcenterAddr = 0x71,
         NvItemIdLegacyNwkSecMaterialTableStart = 0x74, // Valid for <= Z-Stack 3.0.x
+        NvItemIdLegacyNwkSecMaterialTableEnd = 0x80,
         NvItemIdExNwkSecMaterialTable = 0x07, // Valid for >= Z-Stack 3.x.0
         NvItemIdUserDesc = 0x81,
         NvItemIdNwkKey = 0x82,
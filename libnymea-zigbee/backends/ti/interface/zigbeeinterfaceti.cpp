@@ -28,6 +28,8 @@
 #include "zigbeeinterfaceti.h"
 #include "zigbee.h"
 #include "zigbeeutils.h"
+#include "zigbeemetrics.h"
+#include "zigbeeiothread.h"
 #include "loggingcategory.h"
 
 #include <QDataStream>
@@ -39,11 +41,24 @@ ZigbeeInterfaceTi::ZigbeeInterfaceTi(QObject *parent) : QObject(parent)
     m_reconnectTimer->setInterval(5000);
 
     connect(m_reconnectTimer, &QTimer::timeout, this, &ZigbeeInterfaceTi::onReconnectTimeout);
+
+    QString labels = "backend=\"ti\"";
+    m_framesReceivedCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_frames_received_total", "Number of valid frames received from the controller.", labels);
+    m_framesSentCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_frames_sent_total", "Number of frames written to the controller.", labels);
+    m_bytesReceivedCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_bytes_received_total", "Number of bytes read from the serial port.", labels);
+    m_bytesSentCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_bytes_sent_total", "Number of bytes written to the serial port.", labels);
+    m_checksumErrorsCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_checksum_errors_total", "Number of received frames with an invalid checksum.", labels);
+    m_writeErrorsCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_write_errors_total", "Number of frames which could not be written to the serial port.", labels);
 }
 
 ZigbeeInterfaceTi::~ZigbeeInterfaceTi()
 {
-
+    if (m_serialPort) {
+        runInIoThread([this](){
+            delete m_serialPort;
+            m_serialPort = nullptr;
+        });
+    }
 }
 
 bool ZigbeeInterfaceTi::available() const
@@ -56,22 +71,52 @@ QString ZigbeeInterfaceTi::serialPort() const
     return m_serialPort->portName();
 }
 
+bool ZigbeeInterfaceTi::ioThreadEnabled() const
+{
+    return m_ioThread != nullptr;
+}
+
+void ZigbeeInterfaceTi::setIoThreadEnabled(bool ioThreadEnabled)
+{
+    if (this->ioThreadEnabled() == ioThreadEnabled)
+        return;
+
+    if (m_serialPort) {
+        qCWarning(dcZigbeeInterface()) << "Cannot change the I/O thread while the interface is enabled.";
+        return;
+    }
+
+    if (ioThreadEnabled) {
+        qCDebug(dcZigbeeInterface()) << "Enable dedicated I/O thread for the serial communication";
+        m_ioThread = new ZigbeeIoThread("ti-io", this);
+        connect(m_ioThread, &ZigbeeIoThread::frameReceived, this, &ZigbeeInterfaceTi::processPacket);
+    } else {
+        qCDebug(dcZigbeeInterface()) << "Disable dedicated I/O thread for the serial communication";
+        delete m_ioThread;
+        m_ioThread = nullptr;
+    }
+}
+
 void ZigbeeInterfaceTi::sendMagicByte()
 {
     QByteArray message;
     QDataStream stream(&message, QIODevice::WriteOnly);
     stream << static_cast<quint8>(0xef);
-    m_serialPort->write(message);
+    writeData(message);
 }
 
 void ZigbeeInterfaceTi::setDTR(bool dtr)
 {
-    m_serialPort->setDataTerminalReady(dtr);
+    runInIoThread([this, dtr](){
+        m_serialPort->setDataTerminalReady(dtr);
+    });
 }
 
 void ZigbeeInterfaceTi::setRTS(bool rts)
 {
-    m_serialPort->setRequestToSend(rts);
+    runInIoThread([this, rts](){
+        m_serialPort->setRequestToSend(rts);
+    });
 }
 
 quint8 ZigbeeInterfaceTi::calculateChecksum(const QByteArray &data)
@@ -100,14 +145,28 @@ void ZigbeeInterfaceTi::setAvailable(bool available)
 void ZigbeeInterfaceTi::onReconnectTimeout()
 {
     qCDebug(dcZigbeeInterface()) << "Reconnecting to serial port...";
-    if (m_serialPort && !m_serialPort->isOpen()) {
-        if (!m_serialPort->open(QSerialPort::ReadWrite)) {
+    if (!m_serialPort)
+        return;
+
+    bool wasOpen = false;
+    bool opened = false;
+    runInIoThread([this, &wasOpen, &opened](){
+        wasOpen = m_serialPort->isOpen();
+        if (!wasOpen) {
+            opened = m_serialPort->open(QSerialPort::ReadWrite);
+            if (opened) {
+                m_serialPort->clear();
+            }
+        }
+    });
+
+    if (!wasOpen) {
+        if (!opened) {
             setAvailable(false);
             qCDebug(dcZigbeeInterface()) << "Interface reconnected failed" << m_serialPort->portName() << m_serialPort->baudRate();
             m_reconnectTimer->start();
         } else {
             qCDebug(dcZigbeeInterface()) << "Interface reconnected successfully on" << m_serialPort->portName() << m_serialPort->baudRate();
-            m_serialPort->clear();
             setAvailable(true);
         }
     }
@@ -115,7 +174,9 @@ void ZigbeeInterfaceTi::onReconnectTimeout()
 
 void ZigbeeInterfaceTi::onReadyRead()
 {
-    m_dataBuffer.append(m_serialPort->readAll());
+    QByteArray data = m_serialPort->readAll();
+    m_bytesReceivedCounter->increment(data.length());
+    m_dataBuffer.append(data);
     processBuffer();
 }
 
@@ -144,32 +205,56 @@ void ZigbeeInterfaceTi::processBuffer()
     QByteArray packet = m_dataBuffer.left(5 + payloadLength);
     m_dataBuffer.remove(0, 5 + payloadLength);
 
-    quint8 cmd0 = static_cast<quint8>(packet[2]);
-    quint8 cmd1 = static_cast<quint8>(packet[3]);
-    QByteArray payload = packet.mid(4, payloadLength);
     quint8 checksum = packet.at(4 + payloadLength);
 
     if (calculateChecksum(packet.mid(1, 3 + payloadLength)) != checksum) {
         qCWarning(dcZigbeeInterface()) << "Checksum mismatch!";
+        m_checksumErrorsCounter->increment();
         processBuffer();
         return;
     }
-//    qCDebug(dcZigbeeInterface()) << "packet received:" << payloadLength << cmd0 << command << payload.toHex(' ') << checksum;
 
-    Ti::SubSystem subSystem = static_cast<Ti::SubSystem>(cmd0 & 0x1F);
-    Ti::CommandType type = static_cast<Ti::CommandType>(cmd0 & 0xE0);
+    m_framesReceivedCounter->increment();
 
-    emit packetReceived(subSystem, type, cmd1, payload);
+    // CMD0 + CMD1 + payload
+    if (m_ioThread) {
+        m_ioThread->enqueueFrame(packet.mid(2, 2 + payloadLength));
+    } else {
+        processPacket(packet.mid(2, 2 + payloadLength));
+    }
 
     // In case there's more...
     processBuffer();
 
 }
 
+void ZigbeeInterfaceTi::processPacket(const QByteArray &packet)
+{
+    quint8 cmd0 = static_cast<quint8>(packet[0]);
+    quint8 cmd1 = static_cast<quint8>(packet[1]);
+    QByteArray payload = packet.mid(2);
+//    qCDebug(dcZigbeeInterface()) << "packet received:" << payload.length() << cmd0 << cmd1 << payload.toHex(' ');
+
+    Ti::SubSystem subSystem = static_cast<Ti::SubSystem>(cmd0 & 0x1F);
+    Ti::CommandType type = static_cast<Ti::CommandType>(cmd0 & 0xE0);
+
+    emit packetReceived(subSystem, type, cmd1, payload);
+}
+
 void ZigbeeInterfaceTi::onError(const QSerialPort::SerialPortError &error)
 {
-    if (error != QSerialPort::NoError && m_serialPort->isOpen()) {
-        qCWarning(dcZigbeeInterface()) << "Serial port error:" << error << m_serialPort->errorString();
+    if (error == QSerialPort::NoError || !m_serialPort)
+        return;
+
+    bool isOpen = false;
+    QString errorString;
+    runInIoThread([this, &isOpen, &errorString](){
+        isOpen = m_serialPort->isOpen();
+        errorString = m_serialPort->errorString();
+    });
+
+    if (isOpen) {
+        qCWarning(dcZigbeeInterface()) << "Serial port error:" << error << errorString;
         reconnectController();
     }
 }
@@ -197,45 +282,97 @@ void ZigbeeInterfaceTi::sendPacket(Ti::CommandType type, Ti::SubSystem subSystem
 
     // Send the data
     qCDebug(dcZigbeeInterfaceTraffic()) << "-->" << data.toHex();
-    if (m_serialPort->write(data) < 0) {
-        qCWarning(dcZigbeeInterface()) << "Could not stream byte" << ZigbeeUtils::convertByteArrayToHexString(data);
-    }
+    writeData(data);
 
     //m_serialPort->flush();
 }
 
+void ZigbeeInterfaceTi::runInIoThread(const std::function<void()> &function)
+{
+    if (m_ioThread) {
+        m_ioThread->execute(function);
+    } else {
+        function();
+    }
+}
+
+void ZigbeeInterfaceTi::writeData(const QByteArray &data)
+{
+    auto write = [this, data](){
+        if (!m_serialPort)
+            return;
+
+        if (m_serialPort->write(data) < 0) {
+            qCWarning(dcZigbeeInterface()) << "Could not stream byte" << ZigbeeUtils::convertByteArrayToHexString(data);
+            m_writeErrorsCounter->increment();
+            return;
+        }
+
+        m_framesSentCounter->increment();
+        m_bytesSentCounter->increment(data.length());
+    };
+
+    // Note: the caller does not have to wait until the data has been written in the I/O thread
+    if (m_ioThread) {
+        m_ioThread->post(write);
+    } else {
+        write();
+    }
+}
+
 bool ZigbeeInterfaceTi::enable(const QString &serialPort, qint32 baudrate)
 {
     qCDebug(dcZigbeeInterface()) << "Starting UART interface " << serialPort << baudrate;
 
     if (m_serialPort) {
-        delete m_serialPort;
-        m_serialPort = nullptr;
+        runInIoThread([this](){
+            delete m_serialPort;
+            m_serialPort = nullptr;
+        });
     }
 
-    m_serialPort = new QSerialPort(serialPort, this);
-    m_serialPort->setBaudRate(baudrate);
-    m_serialPort->setDataBits(QSerialPort::Data8);
-    m_serialPort->setStopBits(QSerialPort::OneStop);
-    m_serialPort->setParity(QSerialPort::NoParity);
-    m_serialPort->setFlowControl(QSerialPort::NoFlowControl);
-
-    connect(m_serialPort, &QSerialPort::readyRead, this, &ZigbeeInterfaceTi::onReadyRead);
+    // Note: if the I/O thread is enabled, the serial port lives in the I/O thread without parent.
+    // The write lambdas read m_serialPort in the I/O thread, so it only gets assigned in there.
+    QSerialPort *serialPortDevice = new QSerialPort(serialPort, m_ioThread ? nullptr : this);
+    serialPortDevice->setBaudRate(baudrate);
+    serialPortDevice->setDataBits(QSerialPort::Data8);
+    serialPortDevice->setStopBits(QSerialPort::OneStop);
+    serialPortDevice->setParity(QSerialPort::NoParity);
+    serialPortDevice->setFlowControl(QSerialPort::NoFlowControl);
+
+    if (m_ioThread) {
+        // Read and frame the data directly in the I/O thread
+        m_ioThread->moveToIoThread(serialPortDevice);
+        connect(serialPortDevice, &QSerialPort::readyRead, this, &ZigbeeInterfaceTi::onReadyRead, Qt::DirectConnection);
+    } else {
+        connect(serialPortDevice, &QSerialPort::readyRead, this, &ZigbeeInterfaceTi::onReadyRead);
+    }
 #if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
-    connect(m_serialPort, &QSerialPort::errorOccurred, this, &ZigbeeInterfaceTi::onError);
+    connect(serialPortDevice, &QSerialPort::errorOccurred, this, &ZigbeeInterfaceTi::onError);
 #else
     typedef void (QSerialPort::* errorSignal)(QSerialPort::SerialPortError);
-    connect(m_serialPort, static_cast<errorSignal>(&QSerialPort::error), this, &ZigbeeInterfaceTi::onError);
+    connect(serialPortDevice, static_cast<errorSignal>(&QSerialPort::error), this, &ZigbeeInterfaceTi::onError);
 #endif
 
-    if (!m_serialPort->open(QSerialPort::ReadWrite)) {
-        qCWarning(dcZigbeeInterface()) << "Could not open serial port" << serialPort << baudrate << m_serialPort->errorString();
+    bool opened = false;
+    QString errorString;
+    runInIoThread([this, serialPortDevice, &opened, &errorString](){
+        m_serialPort = serialPortDevice;
+        opened = m_serialPort->open(QSerialPort::ReadWrite);
+        if (opened) {
+            m_serialPort->clear();
+        } else {
+            errorString = m_serialPort->errorString();
+        }
+    });
+
+    if (!opened) {
+        qCWarning(dcZigbeeInterface()) << "Could not open serial port" << serialPort << baudrate << errorString;
         m_reconnectTimer->start();
         return false;
     }
 
     qCDebug(dcZigbeeInterface()) << "Interface enabled successfully on" << serialPort << baudrate;
-    m_serialPort->clear();
 
     setAvailable(true);
     return true;
@@ -246,16 +383,18 @@ void ZigbeeInterfaceTi::reconnectController()
     if (!m_serialPort)
         return;
 
-    if (m_serialPort->isOpen()) {
-        m_serialPort->close();
-    }
-
     QString portName = m_serialPort->portName();
     int baudrate = m_serialPort->baudRate();
-    setAvailable(false);
 
-    delete m_serialPort;
-    m_serialPort = nullptr;
+    runInIoThread([this](){
+        if (m_serialPort->isOpen()) {
+            m_serialPort->close();
+        }
+
+        delete m_serialPort;
+        m_serialPort = nullptr;
+    });
+    setAvailable(false);
 
     enable(portName, baudrate);
 }
@@ -265,11 +404,13 @@ void ZigbeeInterfaceTi::disable()
     if (!m_serialPort)
         return;
 
-    if (m_serialPort->isOpen())
-        m_serialPort->close();
+    runInIoThread([this](){
+        if (m_serialPort->isOpen())
+            m_serialPort->close();
 
-    delete m_serialPort;
-    m_serialPort = nullptr;
+        delete m_serialPort;
+        m_serialPort = nullptr;
+    });
     setAvailable(false);
     qCDebug(dcZigbeeInterface()) << "Interface disabled";
 }
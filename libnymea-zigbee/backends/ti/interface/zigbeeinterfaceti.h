@@ -33,8 +33,13 @@
 #include <QSerialPort>
 #include "zigbeeinterfacetireply.h"
 
+#include <functional>
+
 #define SOF 0xFE
 
+class ZigbeeIoThread;
+class ZigbeeMetricCounter;
+
 class ZigbeeInterfaceTi : public QObject
 {
     Q_OBJECT
@@ -45,6 +50,10 @@ public:
     bool available() const;
     QString serialPort() const;
 
+    // Run the serial communication in a dedicated thread, must be set before enabling the interface
+    bool ioThreadEnabled() const;
+    void setIoThreadEnabled(bool ioThreadEnabled);
+
     void sendMagicByte();
     void setDTR(bool dtr);
     void setRTS(bool rts);
@@ -65,16 +74,29 @@ private slots:
     void onReadyRead();
     void onError(const QSerialPort::SerialPortError &error);
     void processBuffer();
+    void processPacket(const QByteArray &packet);
 
 private:
     QTimer *m_reconnectTimer = nullptr;
     QSerialPort *m_serialPort = nullptr;
     bool m_available = false;
     QByteArray m_dataBuffer;
+    ZigbeeIoThread *m_ioThread = nullptr;
+
+    // Metrics
+    ZigbeeMetricCounter *m_framesReceivedCounter = nullptr;
+    ZigbeeMetricCounter *m_framesSentCounter = nullptr;
+    ZigbeeMetricCounter *m_bytesReceivedCounter = nullptr;
+    ZigbeeMetricCounter *m_bytesSentCounter = nullptr;
+    ZigbeeMetricCounter *m_checksumErrorsCounter = nullptr;
+    ZigbeeMetricCounter *m_writeErrorsCounter = nullptr;
 
     quint8 calculateChecksum(const QByteArray &data);
 
     void setAvailable(bool available);
+
+    void runInIoThread(const std::function<void()> &function);
+    void writeData(const QByteArray &data);
 };
 
 #endif // ZIGBEEINTERFACETI_H
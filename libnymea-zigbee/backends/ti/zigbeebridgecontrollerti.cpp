@@ -26,17 +26,57 @@
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "zigbeeutils.h"
+#include "zigbeemetrics.h"
 #include "loggingcategory.h"
 #include "zigbeechannelmask.h"
 #include "zdo/zigbeedeviceprofile.h"
 #include "zigbeebridgecontrollerti.h"
 
+#include <QtEndian>
 #include <QDataStream>
+#include <QDateTime>
 #include <QMetaEnum>
 
 #define NEW_PAYLOAD QByteArray payload; QDataStream stream(&payload, QIODevice::WriteOnly); stream.setByteOrder(QDataStream::LittleEndian);
 #define PAYLOAD_STREAM(x) QDataStream stream(x); stream.setByteOrder(QDataStream::LittleEndian);
 
+// Max data bytes per AF_DATA_RETRIEVE response, the number of chunk requests kept in flight
+// per message and how long we wait for a huge message to complete before dropping it.
+static const quint8 hugeMessageChunkSize = 248;
+static const int hugeMessageWindowSize = 2;
+static const int hugeMessageTimeout = 10000;
+
+// Max data bytes per SYS_OSAL_NV_READ_EXT response and SYS_OSAL_NV_WRITE_EXT request
+static const int nvReadChunkSize = 248;
+static const int nvWriteChunkSize = 244;
+// SYS_NV_WRITE requests carry a larger header. All extended NV items we use belong to the Z-Stack system.
+static const int nvExWriteChunkSize = 242;
+static const quint8 nvExSystemIdZStack = 0x01;
+// The NWK security material table has one entry per known network
+static const int nwkSecMaterialTableSize = 12;
+
+// Returns the offset of the outgoing NWK frame counter within the given item or -1 if it doesn't contain one.
+// Z-Stack 1.2 stores it in the NWK key item (key sequence number, key, frame counter), newer versions in the
+// security material table entries (frame counter, extended PAN ID).
+static int nvFrameCounterOffset(Ti::ZnpVersion znpVersion, const TiNvItem &item)
+{
+    switch (znpVersion) {
+    case Ti::zStack12:
+        if (!item.extended && item.itemId == Ti::NvItemIdNwkKey)
+            return 17;
+        break;
+    case Ti::zStack30x:
+        if (!item.extended && item.itemId >= Ti::NvItemIdLegacyNwkSecMaterialTableStart && item.itemId <= Ti::NvItemIdLegacyNwkSecMaterialTableEnd)
+            return 0;
+        break;
+    case Ti::zStack3x0:
+        if (item.extended && item.itemId == Ti::NvItemIdExNwkSecMaterialTable)
+            return 0;
+        break;
+    }
+    return -1;
+}
+
 ZigbeeBridgeControllerTi::ZigbeeBridgeControllerTi(QObject *parent) :
     ZigbeeBridgeController(parent)
 {
@@ -46,6 +86,14 @@ ZigbeeBridgeControllerTi::ZigbeeBridgeControllerTi(QObject *parent) :
 
     m_permitJoinTimer.setSingleShot(true);
     connect(&m_permitJoinTimer, &QTimer::timeout, this, [=]{emit permitJoinStateChanged(0);});
+
+    m_hugeMessageTimer.setInterval(1000);
+    connect(&m_hugeMessageTimer, &QTimer::timeout, this, &ZigbeeBridgeControllerTi::onHugeMessageTimeout);
+
+    QString labels = "backend=\"ti\"";
+    m_queueDepthGauge = ZigbeeMetrics::instance()->gauge("zigbee_controller_queue_depth", "Number of requests waiting to be sent to the controller.", labels);
+    m_retriesCounter = ZigbeeMetrics::instance()->counter("zigbee_controller_request_retries_total", "Number of controller requests which had to be sent again.", labels);
+    m_timeoutsCounter = ZigbeeMetrics::instance()->counter("zigbee_controller_request_timeouts_total", "Number of controller requests which timed out.", labels);
 }
 
 ZigbeeBridgeControllerTi::~ZigbeeBridgeControllerTi()
@@ -167,22 +215,7 @@ void ZigbeeBridgeControllerTi::initPhase2(ZigbeeInterfaceTiReply *initReply, int
                 initReply->finish(versionReply->statusCode());
                 return;
             }
-            PAYLOAD_STREAM(versionReply->responsePayload());
-            quint8 transportRevision, product, majorRelease, minorRelease, maintRelease;
-            quint32 revision;
-            stream >> transportRevision >> product >> majorRelease >> minorRelease >> maintRelease >> revision;
-            qCDebug(dcZigbeeNetwork()).nospace().noquote() << "Controller versions: Transport rev: " << transportRevision << " Product: " << product
-                                                           << " Version: " << majorRelease << "." << minorRelease << "." << maintRelease
-                                                           << " Revision: " << revision;
-
-            m_networkConfiguration.znpVersion = static_cast<Ti::ZnpVersion>(product);
-            setFirmwareVersion(QString("%0(%1) - %2.%3.%4.%5")
-                               .arg(QMetaEnum::fromType<Ti::ZnpVersion>().valueToKey(product))
-                               .arg(transportRevision)
-                               .arg(majorRelease)
-                               .arg(minorRelease)
-                               .arg(maintRelease)
-                               .arg(revision));
+            processVersionReply(versionReply);
 
             qCDebug(dcZigbeeController()) << "Reading IEEE address";
 
@@ -212,94 +245,211 @@ void ZigbeeBridgeControllerTi::initPhase2(ZigbeeInterfaceTiReply *initReply, int
     });
 }
 
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::warmStart(const ZigbeeControllerSnapshot &snapshot)
+{
+    // If the controller is still running the network from the snapshot (e.g. only the host application restarted),
+    // the reset, bootloader skipping and network startup can be skipped. Any mismatch finishes the reply with an error
+    // and the caller is expected to continue with the full init().
+    ZigbeeInterfaceTiReply *warmStartReply = new ZigbeeInterfaceTiReply(this, 10000);
+
+    qCDebug(dcZigbeeController()) << "Trying to warm start controller using" << snapshot;
+    ZigbeeInterfaceTiReply *pingReply = sendCommand(Ti::SubSystemSys, Ti::SYSCommandPing, QByteArray(), 1000);
+    connect(pingReply, &ZigbeeInterfaceTiReply::finished, warmStartReply, [=]() {
+        if (pingReply->statusCode() != Ti::StatusCodeSuccess) {
+            qCDebug(dcZigbeeController()) << "Controller is not responding to ping. Warm start not possible.";
+            warmStartReply->finish(Ti::StatusCodeFailure);
+            return;
+        }
+
+        ZigbeeInterfaceTiReply *versionReply = sendCommand(Ti::SubSystemSys, Ti::SYSCommandVersion);
+        connect(versionReply, &ZigbeeInterfaceTiReply::finished, warmStartReply, [=]() {
+            if (versionReply->statusCode() != Ti::StatusCodeSuccess) {
+                qCWarning(dcZigbeeController()) << "Error reading controller version";
+                warmStartReply->finish(versionReply->statusCode());
+                return;
+            }
+
+            processVersionReply(versionReply);
+            if (firmwareVersion() != snapshot.firmwareVersion) {
+                qCDebug(dcZigbeeController()) << "The firmware version has changed since the last start" << snapshot.firmwareVersion << "->" << firmwareVersion();
+                warmStartReply->finish(Ti::StatusCodeFailure);
+                return;
+            }
+
+            ZigbeeInterfaceTiReply *getExtAddrReply = sendCommand(Ti::SubSystemSys, Ti::SYSCommandGetExtAddress);
+            connect(getExtAddrReply, &ZigbeeInterfaceTiReply::finished, warmStartReply, [=](){
+                if (getExtAddrReply->statusCode() != Ti::StatusCodeSuccess) {
+                    qCWarning(dcZigbeeController()) << "Call to getDeviceInfo failed:" << getExtAddrReply->statusCode();
+                    warmStartReply->finish(getExtAddrReply->statusCode());
+                    return;
+                }
+
+                PAYLOAD_STREAM(getExtAddrReply->responsePayload());
+                quint64 ieeeAddress;
+                stream >> ieeeAddress;
+                if (ZigbeeAddress(ieeeAddress) != snapshot.ieeeAddress) {
+                    qCDebug(dcZigbeeController()) << "The controller IEEE address does not match the snapshot" << ZigbeeAddress(ieeeAddress).toString();
+                    warmStartReply->finish(Ti::StatusCodeFailure);
+                    return;
+                }
+
+                ZigbeeInterfaceTiReply *networkInfoReply = sendCommand(Ti::SubSystemZDO, Ti::ZDOCommandExtNwkInfo);
+                connect(networkInfoReply, &ZigbeeInterfaceTiReply::finished, warmStartReply, [=](){
+                    if (networkInfoReply->statusCode() != Ti::StatusCodeSuccess) {
+                        qCWarning(dcZigbeeController()) << "Failed to read network info" << networkInfoReply->statusCode();
+                        warmStartReply->finish(networkInfoReply->statusCode());
+                        return;
+                    }
+
+                    quint8 devState, channel;
+                    quint16 shortAddr, panId, parentAddr;
+                    quint64 extendedPanId, parentExtAddr;
+                    PAYLOAD_STREAM(networkInfoReply->responsePayload());
+                    stream >> shortAddr >> devState >> panId >> parentAddr >> extendedPanId >> parentExtAddr >> channel;
+
+                    // 0x09: started as coordinator
+                    if (devState != 0x09 || panId != snapshot.panId || extendedPanId != snapshot.extendedPanId || channel != snapshot.channel) {
+                        qCDebug(dcZigbeeController()) << "The controller network does not match the snapshot. Device state:" << devState
+                                                      << "PAN ID:" << ZigbeeUtils::convertUint16ToHexString(panId)
+                                                      << "Extended PAN ID:" << ZigbeeUtils::convertUint64ToHexString(extendedPanId)
+                                                      << "Channel:" << channel;
+                        warmStartReply->finish(Ti::StatusCodeFailure);
+                        return;
+                    }
+
+                    qCDebug(dcZigbeeController()) << "The controller is running the known network. Skipping the controller initialization.";
+                    m_registeredEndpointIds.clear();
+                    m_networkConfiguration.ieeeAddress = ZigbeeAddress(ieeeAddress);
+                    m_controllerState = ControllerStateInitialized;
+                    warmStartReply->finish();
+
+                    // Not emitting the initialized state, the network is up already. postStartup() will bring us to running.
+                    postStartup();
+                });
+            });
+        });
+    });
+
+    return warmStartReply;
+}
+
+void ZigbeeBridgeControllerTi::processVersionReply(ZigbeeInterfaceTiReply *versionReply)
+{
+    PAYLOAD_STREAM(versionReply->responsePayload());
+    quint8 transportRevision, product, majorRelease, minorRelease, maintRelease;
+    quint32 revision;
+    stream >> transportRevision >> product >> majorRelease >> minorRelease >> maintRelease >> revision;
+    qCDebug(dcZigbeeNetwork()).nospace().noquote() << "Controller versions: Transport rev: " << transportRevision << " Product: " << product
+                                                   << " Version: " << majorRelease << "." << minorRelease << "." << maintRelease
+                                                   << " Revision: " << revision;
+
+    m_networkConfiguration.znpVersion = static_cast<Ti::ZnpVersion>(product);
+    setFirmwareVersion(QString("%0(%1) - %2.%3.%4.%5")
+                       .arg(QMetaEnum::fromType<Ti::ZnpVersion>().valueToKey(product))
+                       .arg(transportRevision)
+                       .arg(majorRelease)
+                       .arg(minorRelease)
+                       .arg(maintRelease)
+                       .arg(revision));
+}
 
-ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::commission(Ti::DeviceLogicalType deviceType, quint16 panId, const ZigbeeChannelMask &channelMask)
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::commission(Ti::DeviceLogicalType deviceType, quint16 panId, const ZigbeeChannelMask &channelMask, quint64 extendedPanId, const ZigbeeNetworkKey &networkKey)
 {
     ZigbeeInterfaceTiReply *reply = new ZigbeeInterfaceTiReply(this, 30000);
 
     ZigbeeInterfaceTiReply *resetReply = factoryReset();
     connect(resetReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
 
+        QList<TiNvItem> items;
+        TiNvItem item;
+
         // Make sure the controller is set to normal startup mode, so it will keep the commissioned settings on next reboot
-        NEW_PAYLOAD;
-        stream << static_cast<quint8>(Ti::StartupModeNormal);
-        ZigbeeInterfaceTiReply *startupOptionReply = writeNvItem(Ti::NvItemIdStartupOption, payload);
-        connect(startupOptionReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
+        item.itemId = Ti::NvItemIdStartupOption;
+        item.data = QByteArray(1, static_cast<char>(Ti::StartupModeNormal));
+        items.append(item);
 
+        item.itemId = Ti::NvItemIdLogicalType;
+        item.data = QByteArray(1, static_cast<char>(deviceType));
+        items.append(item);
+
+        item.itemId = Ti::NvItemIdZdoDirectCb;
+        item.data = QByteArray(1, 0x01);
+        items.append(item);
+
+        {
+            NEW_PAYLOAD;
+            stream << panId;
+            item.itemId = Ti::NvItemIdPanId;
+            item.data = payload;
+            items.append(item);
+        }
+
+        {
             NEW_PAYLOAD;
-            stream << static_cast<quint8>(deviceType);
-            ZigbeeInterfaceTiReply *deviceTypeReply = writeNvItem(Ti::NvItemIdLogicalType, payload);
-            connect(deviceTypeReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
+            if (extendedPanId != 0) {
+                stream << extendedPanId;
+            } else {
+                stream << ZigbeeUtils::generateRandomPanId();
+                stream << ZigbeeUtils::generateRandomPanId();
+                stream << ZigbeeUtils::generateRandomPanId();
+                stream << ZigbeeUtils::generateRandomPanId();
+            }
+            item.itemId = Ti::NvItemIdExtendedPanId;
+            item.data = payload;
+            items.append(item);
+            item.itemId = Ti::NvItemIdApsUseExtPanId;
+            items.append(item);
+        }
+
+        {
+            NEW_PAYLOAD;
+            stream << channelMask.toUInt32();
+            item.itemId = Ti::NvItemIdChanList;
+            item.data = payload;
+            items.append(item);
+        }
+
+        // If no key is given, the adapter will generate one. A given key (i.e. restoring a backup) gets provisioned as pre-configured key.
+        if (!networkKey.isNull()) {
+            item.itemId = Ti::NvItemIdPreCfgKeysEnable;
+            item.data = QByteArray(1, 0x01);
+            items.append(item);
+
+            item.itemId = Ti::NvItemIdPreCfgKey;
+            item.data = networkKey.toByteArray();
+            items.append(item);
+        }
+
+        ZigbeeInterfaceTiReply *writeReply = writeNvItems(items);
+        connect(writeReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
+            if (writeReply->statusCode() != Ti::StatusCodeSuccess) {
+                qCWarning(dcZigbeeController()) << "Writing the network configuration NV items finished with error" << writeReply->statusCode();
+            }
+
+            // For zStack12 we're done here.
+            if (m_networkConfiguration.znpVersion == Ti::zStack12) {
+                reply->finish();
+                return;
+            }
+
+            // zStack3x requires channels to be commissioned via AppCnf subsystem BdbCommissioning
+            NEW_PAYLOAD;
+            stream << static_cast<quint8>(1); // Primary channel
+            stream << static_cast<quint32>(channelMask.toUInt32());
+            ZigbeeInterfaceTiReply *commissionReply = sendCommand(Ti::SubSystemAppCnf, Ti::AppCnfCommandBdbSetChannel, payload);
+            connect(commissionReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
 
                 NEW_PAYLOAD;
-                stream << static_cast<quint8>(0x01);
-                ZigbeeInterfaceTiReply *deviceTypeReply = writeNvItem(Ti::NvItemIdZdoDirectCb, payload);
-                connect(deviceTypeReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
+                stream << static_cast<quint8>(0); // Non-primary channel
+                stream << static_cast<quint32>(0);
+                ZigbeeInterfaceTiReply *commissionReply = sendCommand(Ti::SubSystemAppCnf, Ti::AppCnfCommandBdbSetChannel, payload);
+                connect(commissionReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
 
                     NEW_PAYLOAD;
-                    stream << panId;
-                    ZigbeeInterfaceTiReply *panIdReply = writeNvItem(Ti::NvItemIdPanId, payload);
-                    connect(panIdReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
-
-                        NEW_PAYLOAD;
-                        stream << ZigbeeUtils::generateRandomPanId();
-                        stream << ZigbeeUtils::generateRandomPanId();
-                        stream << ZigbeeUtils::generateRandomPanId();
-                        stream << ZigbeeUtils::generateRandomPanId();
-                        ZigbeeInterfaceTiReply *panIdReply = writeNvItem(Ti::NvItemIdExtendedPanId, payload);
-                        connect(panIdReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
-                            ZigbeeInterfaceTiReply *panIdReply = writeNvItem(Ti::NvItemIdApsUseExtPanId, payload);
-                            connect(panIdReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
-
-                                NEW_PAYLOAD;
-                                stream << channelMask.toUInt32();
-                                ZigbeeInterfaceTiReply *channelsReply = writeNvItem(Ti::NvItemIdChanList, payload);
-                                connect(channelsReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
-
-                                    // TODO: commission nwk key
-                                    // The adapter will generate a key, but we could provision our own so we could re-apply when restoring a backup
-//                                    NEW_PAYLOAD;
-//                                    stream << static_cast<quint8>(0x01);
-//                                    ZigbeeInterfaceTiReply *channelsReply = writeNvItem(Ti::NvItemIdPreCfgKeysEnable, payload);
-//                                    connect(channelsReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
-
-//                                        NEW_PAYLOAD;
-//                                        stream << <128 bit data>;
-//                                        ZigbeeInterfaceTiReply *channelsReply = writeNvItem(Ti::NvItemIdPreCfgKey, payload);
-//                                        connect(channelsReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
-
-                                            // For zStack12 we're done here.
-                                            if (m_networkConfiguration.znpVersion == Ti::zStack12) {
-                                                reply->finish();
-                                                return;
-                                            }
-
-                                            // zStack3x requires channels to be commissioned via AppCnf subsystem BdbCommissioning
-                                            NEW_PAYLOAD;
-                                            stream << static_cast<quint8>(1); // Primary channel
-                                            stream << static_cast<quint32>(channelMask.toUInt32());
-                                            ZigbeeInterfaceTiReply *commissionReply = sendCommand(Ti::SubSystemAppCnf, Ti::AppCnfCommandBdbSetChannel, payload);
-                                            connect(commissionReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
-
-                                                NEW_PAYLOAD;
-                                                stream << static_cast<quint8>(0); // Non-primary channel
-                                                stream << static_cast<quint32>(0);
-                                                ZigbeeInterfaceTiReply *commissionReply = sendCommand(Ti::SubSystemAppCnf, Ti::AppCnfCommandBdbSetChannel, payload);
-                                                connect(commissionReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
-
-                                                    NEW_PAYLOAD;
-                                                    stream << static_cast<quint8>(0x04);;
-                                                    ZigbeeInterfaceTiReply *commissionReply = sendCommand(Ti::SubSystemAppCnf, Ti::AppCnfCommandBdbStartCommissioning, payload);
-                                                    connect(commissionReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
-                                                        reply->finish();
-                                                    });
-                                                });
-                                            });
-//                                        });
-//                                    });
-                                });
-                            });
-                        });
+                    stream << static_cast<quint8>(0x04);;
+                    ZigbeeInterfaceTiReply *commissionReply = sendCommand(Ti::SubSystemAppCnf, Ti::AppCnfCommandBdbStartCommissioning, payload);
+                    connect(commissionReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
+                        reply->finish();
                     });
                 });
             });
@@ -308,9 +458,8 @@ ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::commission(Ti::DeviceLogicalTy
     return reply;
 }
 
-void ZigbeeBridgeControllerTi::postStartup()
-{    
-    // Reading Network Info
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::readNetworkInfo()
+{
     ZigbeeInterfaceTiReply *networkInfoReply = sendCommand(Ti::SubSystemZDO, Ti::ZDOCommandExtNwkInfo);
     connect(networkInfoReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
         if (networkInfoReply->statusCode() != Ti::StatusCodeSuccess) {
@@ -335,6 +484,17 @@ void ZigbeeBridgeControllerTi::postStartup()
         qCDebug(dcZigbeeController()) << "Device state:" << devState;
         qCDebug(dcZigbeeController()) << "Channel:" << channel;
         qCDebug(dcZigbeeController()) << "IEEE address:" << m_networkConfiguration.ieeeAddress.toString();
+    });
+    return networkInfoReply;
+}
+
+void ZigbeeBridgeControllerTi::postStartup()
+{    
+    // Reading Network Info
+    ZigbeeInterfaceTiReply *networkInfoReply = readNetworkInfo();
+    connect(networkInfoReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
+        if (networkInfoReply->statusCode() != Ti::StatusCodeSuccess)
+            return;
 
         // Registering for the ZDO raw message callback
         NEW_PAYLOAD;
@@ -410,6 +570,33 @@ ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::factoryReset()
     return reply;
 }
 
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::setIeeeAddress(const ZigbeeAddress &ieeeAddress)
+{
+    // Z-Stack applies the address right away and stores it in the NV item of the extended address
+    qCDebug(dcZigbeeController()) << "Setting IEEE address" << ieeeAddress.toString();
+    ZigbeeInterfaceTiReply *reply = new ZigbeeInterfaceTiReply(this);
+
+    NEW_PAYLOAD;
+    stream << ieeeAddress.toUInt64();
+    ZigbeeInterfaceTiReply *setExtAddrReply = sendCommand(Ti::SubSystemSys, Ti::SYSCommandSetExtAddress, payload);
+    connect(setExtAddrReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
+        Ti::StatusCode statusCode = setExtAddrReply->statusCode();
+        if (statusCode == Ti::StatusCodeSuccess) {
+            statusCode = setExtAddrReply->responsePayload().isEmpty() ? Ti::StatusCodeError : static_cast<Ti::StatusCode>(setExtAddrReply->responsePayload().at(0));
+        }
+
+        if (statusCode != Ti::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Error setting the IEEE address:" << statusCode;
+            reply->finish(statusCode);
+            return;
+        }
+
+        m_networkConfiguration.ieeeAddress = ieeeAddress;
+        reply->finish();
+    });
+    return reply;
+}
+
 ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::requestSendRequest(const ZigbeeNetworkRequest &request)
 {
     Ti::TxOptions tiTxOptions = Ti::TxOptionNone;
@@ -444,23 +631,48 @@ ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::requestSendRequest(const Zigbe
         return sendCommand(Ti::SubSystemAF, Ti::AFCommandDataRequestExt, payload);
     }
 
-    // NOTE: Leaving those prints as warnings for now as I didn't get the chance to test this much
-    // so if anything goes wrong, it would appear in the logs unconditionally.
-    qCWarning(dcZigbeeController()) << "Splitting huge packet into chunks!";
-    qCWarning(dcZigbeeController()) << "Full packet payload:" << asdu.toHex() << "LEN:" << asdu.length();
-    ZigbeeInterfaceTiReply *lastReply = nullptr;
-    int i = 0;
-    while (!asdu.isEmpty()) {
-        QByteArray chunk = asdu.left(qMin(asdu.length(), 252));
-        asdu.remove(0, chunk.size());
-        qCWarning(dcZigbeeController()) << "Chunk" << i << ":" << chunk.toHex() << "LEN:" << chunk.length();
+    // The request header announces the full length and makes the controller allocate a buffer for it.
+    // The payload is then written using AF_DATA_STORE and a final store with length 0 sends the message.
+    // Z-Stack takes care about APS fragmentation if the payload doesn't fit into a single frame.
+    qCDebug(dcZigbeeController()) << "Sending large payload of" << asdu.length() << "bytes using the controller data store";
+    ZigbeeInterfaceTiReply *reply = new ZigbeeInterfaceTiReply(this);
+    ZigbeeInterfaceTiReply *requestReply = sendCommand(Ti::SubSystemAF, Ti::AFCommandDataRequestExt, payload);
+    connect(requestReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
+        if (requestReply->statusCode() != Ti::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Failed to allocate large payload buffer on the controller" << requestReply->statusCode();
+            reply->finish(requestReply->statusCode());
+            return;
+        }
+        storeRequestData(reply, asdu, 0);
+    });
+    return reply;
+}
 
-        NEW_PAYLOAD;
-        stream << static_cast<quint16>(i++);
-        stream << static_cast<quint8>(chunk.length());
-        lastReply = sendCommand(Ti::SubSystemAF, Ti::AFCommandDataStore, chunk);
-    }
-    return lastReply;
+void ZigbeeBridgeControllerTi::storeRequestData(ZigbeeInterfaceTiReply *reply, const QByteArray &asdu, quint16 index)
+{
+    // Store frame header: index (2 bytes) and length (1 byte)
+    quint8 length = static_cast<quint8>(qMin<int>(MT_RPC_DATA_MAX - 3, asdu.length() - index));
+
+    NEW_PAYLOAD;
+    stream << index;
+    stream << length;
+    payload.append(asdu.constData() + index, length);
+    ZigbeeInterfaceTiReply *storeReply = sendCommand(Ti::SubSystemAF, Ti::AFCommandDataStore, payload);
+    connect(storeReply, &ZigbeeInterfaceTiReply::finished, reply, [=](){
+        if (storeReply->statusCode() != Ti::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Failed to store large payload chunk at index" << index << storeReply->statusCode();
+            reply->finish(storeReply->statusCode());
+            return;
+        }
+
+        // The store request with length 0 has been sent, the message is on its way
+        if (length == 0) {
+            reply->finish(storeReply->statusCode());
+            return;
+        }
+
+        storeRequestData(reply, asdu, index + length);
+    });
 }
 
 void ZigbeeBridgeControllerTi::sendNextRequest()
@@ -474,6 +686,7 @@ void ZigbeeBridgeControllerTi::sendNextRequest()
         return;
 
     m_currentReply = m_replyQueue.dequeue();
+    m_queueDepthGauge->set(m_replyQueue.count());
     qCDebug(dcZigbeeController()) << "-->" << m_currentReply->subSystem() << QHash<Ti::SubSystem, QMetaEnum>({
             { Ti::SubSystemSys, QMetaEnum::fromType<Ti::SYSCommand>() },
             { Ti::SubSystemMAC, QMetaEnum::fromType<Ti::MACCommand>() },
@@ -501,8 +714,10 @@ ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::sendCommand(Ti::SubSystem subS
         if (reply->timedOut()) {
             if (m_controllerState == ControllerStateRunning) {
                 qCWarning(dcZigbeeController()) << "Interface command timed out.";
+                m_timeoutsCounter->increment();
                 if (++m_timeouts < 5) {
                     qCInfo(dcZigbeeController()) << "Retrying..." << m_timeouts << "/" << 5;
+                    m_retriesCounter->increment();
                     sendCommand(subSystem, command, payload, timeout);
                 } else {
                     qCInfo(dcZigbeeController()) << "Resetting ZigBee interface";
@@ -520,6 +735,7 @@ ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::sendCommand(Ti::SubSystem subS
     });
 
     m_replyQueue.enqueue(reply);
+    m_queueDepthGauge->set(m_replyQueue.count());
 
     QMetaObject::invokeMethod(this, "sendNextRequest", Qt::QueuedConnection);
     return reply;
@@ -578,42 +794,560 @@ ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::deleteNvItem(Ti::NvItemId item
     return reply;
 }
 
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::readExNvItem(Ti::NvItemId itemId, quint16 subId, quint16 offset, quint8 length)
+{
+    NEW_PAYLOAD;
+    stream << nvExSystemIdZStack;
+    stream << static_cast<quint16>(itemId);
+    stream << subId;
+    stream << offset;
+    stream << length;
+    return sendCommand(Ti::SubSystemSys, Ti::SYSCommandNvRead, payload);
+}
+
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::writeExNvItem(Ti::NvItemId itemId, quint16 subId, const QByteArray &data, quint16 offset)
+{
+    qCDebug(dcZigbeeController()) << "Writing extended NV item:" << itemId << subId << data.toHex();
+    NEW_PAYLOAD;
+    stream << nvExSystemIdZStack;
+    stream << static_cast<quint16>(itemId);
+    stream << subId;
+    stream << offset;
+    stream << static_cast<quint8>(data.length());
+    payload.append(data);
+    return sendCommand(Ti::SubSystemSys, Ti::SYSCommandNvWrite, payload);
+}
+
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::readNvItems(const QList<Ti::NvItemId> &itemIds)
+{
+    QList<TiNvItem> items;
+    foreach (Ti::NvItemId itemId, itemIds) {
+        TiNvItem item;
+        item.itemId = itemId;
+        items.append(item);
+    }
+    return readNvItemBatch(items);
+}
+
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::readNvItemBatch(const QList<TiNvItem> &items)
+{
+    qCDebug(dcZigbeeController()) << "Reading" << items.count() << "NV items";
+    ZigbeeInterfaceTiReply *batchReply = new ZigbeeInterfaceTiReply(this);
+
+    QSharedPointer<NvBatch> batch(new NvBatch);
+    batch->items = items;
+
+    requestNvItemLengths(batchReply, batch, [=](){
+        if (batch->statusCode != Ti::StatusCodeSuccess) {
+            batchReply->finish(batch->statusCode);
+            return;
+        }
+
+        batch->finishedCallback = [=](){
+            QList<TiNvItem> items;
+            for (int i = 0; i < batch->items.count(); i++) {
+                if (batch->lengths.at(i) > 0) {
+                    items.append(batch->items.at(i));
+                }
+            }
+            qCDebug(dcZigbeeController()) << "Reading" << items.count() << "NV items finished" << batch->statusCode;
+            batchReply->m_responsePayload = buildNvSnapshot(items);
+            batchReply->finish(batch->statusCode);
+        };
+
+        // Queue all chunks of all items at once
+        for (int i = 0; i < batch->items.count(); i++) {
+            quint16 length = batch->lengths.at(i);
+            if (length == 0) {
+                qCDebug(dcZigbeeController()) << "NV item" << batch->items.at(i).itemId << "does not exist on the controller. Skipping it.";
+                continue;
+            }
+
+            batch->items[i].data = QByteArray(length, 0);
+            const TiNvItem &item = batch->items.at(i);
+            for (int offset = 0; offset < length; offset += nvReadChunkSize) {
+                ZigbeeInterfaceTiReply *readReply = nullptr;
+                if (item.extended) {
+                    readReply = readExNvItem(item.itemId, item.subId, offset, static_cast<quint8>(qMin(nvReadChunkSize, length - offset)));
+                } else {
+                    readReply = readNvItem(item.itemId, offset);
+                }
+                addNvBatchReply(batchReply, batch, readReply, [=](){
+                    updateNvBatchStatus(batch, readReply);
+                    if (readReply->statusCode() != Ti::StatusCodeSuccess || readReply->responsePayload().length() < 2)
+                        return;
+
+                    // Status, length, value
+                    QByteArray chunk = readReply->responsePayload().mid(2, static_cast<quint8>(readReply->responsePayload().at(1)));
+                    if (offset + chunk.length() > length) {
+                        qCWarning(dcZigbeeController()) << "Received more NV data than expected for" << batch->items.at(i).itemId;
+                        batch->statusCode = Ti::StatusCodeInvalidValue;
+                        return;
+                    }
+                    batch->items[i].data.replace(offset, chunk.length(), chunk);
+                });
+            }
+        }
+
+        if (batch->pendingReplies == 0) {
+            batch->finishedCallback = nullptr;
+            QTimer::singleShot(0, batchReply, [=](){
+                batchReply->m_responsePayload = buildNvSnapshot(QList<TiNvItem>());
+                batchReply->finish();
+            });
+        }
+    });
+
+    return batchReply;
+}
+
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::writeNvItems(const QList<TiNvItem> &items)
+{
+    qCDebug(dcZigbeeController()) << "Writing" << items.count() << "NV items";
+    ZigbeeInterfaceTiReply *batchReply = new ZigbeeInterfaceTiReply(this);
+    QSharedPointer<NvBatch> batch(new NvBatch);
+    batch->finishedCallback = [=](){
+        qCDebug(dcZigbeeController()) << "Writing" << items.count() << "NV items finished" << batch->statusCode;
+        batchReply->finish(batch->statusCode);
+    };
+
+    foreach (const TiNvItem &item, items) {
+        int chunkSize = item.extended ? nvExWriteChunkSize : nvWriteChunkSize;
+        for (int offset = 0; offset < item.data.length(); offset += chunkSize) {
+            ZigbeeInterfaceTiReply *writeReply = nullptr;
+            if (item.extended) {
+                writeReply = writeExNvItem(item.itemId, item.subId, item.data.mid(offset, chunkSize), offset);
+            } else {
+                writeReply = writeNvItem(item.itemId, item.data.mid(offset, chunkSize), offset);
+            }
+            addNvBatchReply(batchReply, batch, writeReply, [=](){
+                updateNvBatchStatus(batch, writeReply);
+            });
+        }
+    }
+
+    if (batch->pendingReplies == 0) {
+        batch->finishedCallback = nullptr;
+        QTimer::singleShot(0, batchReply, [=](){
+            batchReply->finish();
+        });
+    }
+
+    return batchReply;
+}
+
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::exportNvSnapshot()
+{
+    return readNvItemBatch(networkNvItems());
+}
+
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::importNvSnapshot(const QByteArray &snapshot, quint32 frameCounter)
+{
+    ZigbeeInterfaceTiReply *batchReply = new ZigbeeInterfaceTiReply(this);
+
+    Ti::ZnpVersion znpVersion = Ti::zStack12;
+    QList<TiNvItem> items;
+    if (!parseNvSnapshot(snapshot, &znpVersion, &items) || znpVersion != m_networkConfiguration.znpVersion) {
+        qCWarning(dcZigbeeController()) << "Cannot import NV snapshot. The snapshot is invalid or has been taken from a different Z-Stack version:" << znpVersion;
+        QTimer::singleShot(0, batchReply, [=](){
+            batchReply->finish(Ti::StatusCodeInvalidValue);
+        });
+        return batchReply;
+    }
+
+    // Frames sent with a counter the nodes have seen already would be dropped
+    for (int i = 0; i < items.count(); i++) {
+        int offset = nvFrameCounterOffset(znpVersion, items.at(i));
+        if (offset < 0 || items.at(i).data.length() < offset + 4)
+            continue;
+
+        // Unused security material table entries have no extended PAN ID
+        if (offset == 0 && items.at(i).data.mid(4, 8) == QByteArray(8, 0))
+            continue;
+
+        if (qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(items.at(i).data.constData() + offset)) < frameCounter) {
+            qCDebug(dcZigbeeController()) << "Raising the NWK frame counter of NV item" << items.at(i).itemId << items.at(i).subId << "to" << frameCounter;
+            qToLittleEndian<quint32>(frameCounter, reinterpret_cast<uchar *>(items[i].data.data() + offset));
+        }
+    }
+
+    qCDebug(dcZigbeeController()) << "Importing NV snapshot with" << items.count() << "items";
+    QSharedPointer<NvBatch> batch(new NvBatch);
+    batch->items = items;
+
+    requestNvItemLengths(batchReply, batch, [=](){
+        if (batch->statusCode != Ti::StatusCodeSuccess) {
+            batchReply->finish(batch->statusCode);
+            return;
+        }
+
+        // Write the items once all of them have been recreated
+        batch->finishedCallback = [=](){
+            if (batch->statusCode != Ti::StatusCodeSuccess) {
+                qCWarning(dcZigbeeController()) << "Failed to recreate NV items for the snapshot import" << batch->statusCode;
+                batchReply->finish(batch->statusCode);
+                return;
+            }
+
+            ZigbeeInterfaceTiReply *writeReply = writeNvItems(batch->items);
+            connect(writeReply, &ZigbeeInterfaceTiReply::finished, batchReply, [=](){
+                batchReply->finish(writeReply->statusCode());
+            });
+        };
+
+        // Items must exist with the exact length before they can be written. Recreate the ones which don't match.
+        for (int i = 0; i < batch->items.count(); i++) {
+            const TiNvItem &item = batch->items.at(i);
+            quint16 length = batch->lengths.at(i);
+            if (length == item.data.length())
+                continue;
+
+            if (item.extended) {
+                if (length > 0) {
+                    NEW_PAYLOAD;
+                    stream << nvExSystemIdZStack;
+                    stream << static_cast<quint16>(item.itemId);
+                    stream << item.subId;
+                    ZigbeeInterfaceTiReply *deleteReply = sendCommand(Ti::SubSystemSys, Ti::SYSCommandNvDelete, payload);
+                    addNvBatchReply(batchReply, batch, deleteReply, [=](){
+                        updateNvBatchStatus(batch, deleteReply);
+                    });
+                }
+
+                NEW_PAYLOAD;
+                stream << nvExSystemIdZStack;
+                stream << static_cast<quint16>(item.itemId);
+                stream << item.subId;
+                stream << static_cast<quint32>(item.data.length());
+                ZigbeeInterfaceTiReply *createReply = sendCommand(Ti::SubSystemSys, Ti::SYSCommandNvCreate, payload);
+                addNvBatchReply(batchReply, batch, createReply, [=](){
+                    updateNvBatchStatus(batch, createReply);
+                });
+                continue;
+            }
+
+            if (length > 0) {
+                NEW_PAYLOAD;
+                stream << static_cast<quint16>(item.itemId);
+                stream << length;
+                ZigbeeInterfaceTiReply *deleteReply = sendCommand(Ti::SubSystemSys, Ti::SYSCommandOsalNvDelete, payload);
+                addNvBatchReply(batchReply, batch, deleteReply, [=](){
+                    updateNvBatchStatus(batch, deleteReply);
+                });
+            }
+
+            NEW_PAYLOAD;
+            stream << static_cast<quint16>(item.itemId);
+            stream << static_cast<quint16>(item.data.length());
+            stream << static_cast<quint8>(0); // No init data, the item will be written right after
+            ZigbeeInterfaceTiReply *initReply = sendCommand(Ti::SubSystemSys, Ti::SYSCommandOsalNvItemInit, payload);
+            addNvBatchReply(batchReply, batch, initReply, [=](){
+                // 0x09: the item has been created and is not initialized yet
+                if (initReply->statusCode() == Ti::StatusCodeSuccess && !initReply->responsePayload().isEmpty() && initReply->responsePayload().at(0) == 0x09)
+                    return;
+
+                updateNvBatchStatus(batch, initReply);
+            });
+        }
+
+        if (batch->pendingReplies == 0) {
+            std::function<void()> writeItems = batch->finishedCallback;
+            batch->finishedCallback = nullptr;
+            writeItems();
+        }
+    });
+
+    return batchReply;
+}
+
+QByteArray ZigbeeBridgeControllerTi::buildNvSnapshot(const QList<TiNvItem> &items) const
+{
+    // Format version, Z-Stack version, item count, items (id, extended, sub id, length, data)
+    NEW_PAYLOAD;
+    stream << static_cast<quint8>(2);
+    stream << static_cast<quint8>(m_networkConfiguration.znpVersion);
+    stream << static_cast<quint16>(items.count());
+    foreach (const TiNvItem &item, items) {
+        stream << static_cast<quint16>(item.itemId);
+        stream << static_cast<quint8>(item.extended ? 1 : 0);
+        stream << item.subId;
+        stream << static_cast<quint16>(item.data.length());
+        stream.writeRawData(item.data.constData(), item.data.length());
+    }
+    return payload;
+}
+
+bool ZigbeeBridgeControllerTi::parseNvSnapshot(const QByteArray &snapshot, Ti::ZnpVersion *znpVersion, QList<TiNvItem> *items)
+{
+    PAYLOAD_STREAM(snapshot);
+    quint8 formatVersion = 0, version = 0;
+    quint16 itemCount = 0;
+    stream >> formatVersion >> version >> itemCount;
+    // Version 1 snapshots contain legacy NV items only
+    if (stream.status() != QDataStream::Ok || formatVersion < 1 || formatVersion > 2) {
+        qCWarning(dcZigbeeController()) << "Invalid NV snapshot format" << formatVersion;
+        return false;
+    }
+
+    *znpVersion = static_cast<Ti::ZnpVersion>(version);
+    items->clear();
+    for (int i = 0; i < itemCount; i++) {
+        quint16 itemId = 0, length = 0;
+        quint8 extended = 0;
+        TiNvItem item;
+        stream >> itemId;
+        if (formatVersion >= 2) {
+            stream >> extended >> item.subId;
+        }
+        stream >> length;
+        item.itemId = static_cast<Ti::NvItemId>(itemId);
+        item.extended = extended != 0;
+        item.data = QByteArray(length, 0);
+        if (stream.readRawData(item.data.data(), length) != length || stream.status() != QDataStream::Ok) {
+            qCWarning(dcZigbeeController()) << "NV snapshot is truncated at item" << i;
+            return false;
+        }
+        items->append(item);
+    }
+    return true;
+}
+
+quint32 ZigbeeBridgeControllerTi::nvSnapshotFrameCounter(const QByteArray &snapshot)
+{
+    Ti::ZnpVersion znpVersion = Ti::zStack12;
+    QList<TiNvItem> items;
+    if (!parseNvSnapshot(snapshot, &znpVersion, &items))
+        return 0;
+
+    quint32 frameCounter = 0;
+    foreach (const TiNvItem &item, items) {
+        int offset = nvFrameCounterOffset(znpVersion, item);
+        if (offset < 0 || item.data.length() < offset + 4)
+            continue;
+
+        frameCounter = qMax(frameCounter, qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(item.data.constData() + offset)));
+    }
+    return frameCounter;
+}
+
+QList<TiNvItem> ZigbeeBridgeControllerTi::networkNvItems() const
+{
+    QList<Ti::NvItemId> itemIds;
+    itemIds << Ti::NvItemIdStartupOption << Ti::NvItemIdLogicalType << Ti::NvItemIdZdoDirectCb;
+    itemIds << Ti::NvItemIdNIB << Ti::NvItemIdPanId << Ti::NvItemIdExtendedPanId << Ti::NvItemIdApsUseExtPanId << Ti::NvItemIdChanList;
+    itemIds << Ti::NvItemIdPreCfgKey << Ti::NvItemIdPreCfgKeysEnable << Ti::NvItemIdNwkKey << Ti::NvItemIdNwkActiveKeyInfo << Ti::NvItemIdNwkAlternKeyInfo;
+    itemIds << Ti::NvItemIdTrustcenterAddr << Ti::NvItemIdApsLinkKeyTable << Ti::NvItemIdAddrMgr;
+
+    // The NWK security material, including the frame counters, lives in the legacy NV items up to Z-Stack 3.0.x
+    // and in the extended NV table since Z-Stack 3.x.0
+    if (m_networkConfiguration.znpVersion != Ti::zStack3x0) {
+        for (int itemId = Ti::NvItemIdLegacyNwkSecMaterialTableStart; itemId <= Ti::NvItemIdLegacyNwkSecMaterialTableEnd; itemId++) {
+            itemIds << static_cast<Ti::NvItemId>(itemId);
+        }
+    }
+
+    QList<TiNvItem> items;
+    foreach (Ti::NvItemId itemId, itemIds) {
+        TiNvItem item;
+        item.itemId = itemId;
+        items.append(item);
+    }
+
+    if (m_networkConfiguration.znpVersion == Ti::zStack3x0) {
+        for (int i = 0; i < nwkSecMaterialTableSize; i++) {
+            TiNvItem item;
+            item.itemId = Ti::NvItemIdExNwkSecMaterialTable;
+            item.extended = true;
+            item.subId = static_cast<quint16>(i);
+            items.append(item);
+        }
+    }
+    return items;
+}
+
+void ZigbeeBridgeControllerTi::requestNvItemLengths(ZigbeeInterfaceTiReply *batchReply, QSharedPointer<NvBatch> batch, const std::function<void ()> &callback)
+{
+    batch->lengths = QList<quint16>();
+    if (batch->items.isEmpty()) {
+        QTimer::singleShot(0, batchReply, [=](){
+            callback();
+        });
+        return;
+    }
+
+    batch->finishedCallback = callback;
+    for (int i = 0; i < batch->items.count(); i++) {
+        batch->lengths.append(0);
+
+        bool extended = batch->items.at(i).extended;
+        NEW_PAYLOAD;
+        if (extended) {
+            stream << nvExSystemIdZStack;
+            stream << static_cast<quint16>(batch->items.at(i).itemId);
+            stream << batch->items.at(i).subId;
+        } else {
+            stream << static_cast<quint16>(batch->items.at(i).itemId);
+        }
+        ZigbeeInterfaceTiReply *lengthReply = sendCommand(Ti::SubSystemSys, extended ? Ti::SYSCommandNvLength : Ti::SYSCommandOsalNvLength, payload);
+        addNvBatchReply(batchReply, batch, lengthReply, [=](){
+            // The length response has no status, a length of 0 means the item does not exist
+            updateNvBatchStatus(batch, lengthReply, false);
+            if (lengthReply->statusCode() != Ti::StatusCodeSuccess)
+                return;
+
+            PAYLOAD_STREAM(lengthReply->responsePayload());
+            if (extended) {
+                // The extended NV table reports 32 bit lengths
+                quint32 length = 0;
+                stream >> length;
+                batch->lengths[i] = static_cast<quint16>(length);
+            } else {
+                quint16 length = 0;
+                stream >> length;
+                batch->lengths[i] = length;
+            }
+        });
+    }
+}
+
+void ZigbeeBridgeControllerTi::updateNvBatchStatus(QSharedPointer<NvBatch> batch, ZigbeeInterfaceTiReply *reply, bool hasStatus)
+{
+    Ti::StatusCode statusCode = reply->statusCode();
+    if (reply->timedOut()) {
+        statusCode = Ti::StatusCodeTimeout;
+    } else if (statusCode == Ti::StatusCodeSuccess && hasStatus) {
+        statusCode = reply->responsePayload().isEmpty() ? Ti::StatusCodeError : static_cast<Ti::StatusCode>(reply->responsePayload().at(0));
+    }
+
+    if (statusCode != Ti::StatusCodeSuccess) {
+        qCWarning(dcZigbeeController()) << "NV command" << reply->command() << "failed:" << statusCode;
+        // Keep the first error
+        if (batch->statusCode == Ti::StatusCodeSuccess) {
+            batch->statusCode = statusCode;
+        }
+    }
+}
+
+void ZigbeeBridgeControllerTi::addNvBatchReply(ZigbeeInterfaceTiReply *batchReply, QSharedPointer<NvBatch> batch, ZigbeeInterfaceTiReply *reply, const std::function<void ()> &handler)
+{
+    batch->pendingReplies++;
+    connect(reply, &ZigbeeInterfaceTiReply::finished, batchReply, [=](){
+        handler();
+        batch->pendingReplies--;
+        if (batch->pendingReplies > 0 || !batch->finishedCallback)
+            return;
+
+        // The callback may continue with the next step of the batch
+        std::function<void()> callback = batch->finishedCallback;
+        batch->finishedCallback = nullptr;
+        callback();
+    });
+}
+
 void ZigbeeBridgeControllerTi::retrieveHugeMessage(const Zigbee::ApsdeDataIndication &pendingIndication, quint32 timestamp, quint16 dataLength)
 {
-    // Suppressing clang analyzer warning about leaking "indication", since we'll actually
-    // clean it up in the capturing lambda when the last request finishes.
-#ifndef __clang_analyzer__
-    Zigbee::ApsdeDataIndication *indication = new Zigbee::ApsdeDataIndication(pendingIndication);
-#endif
-
-    quint8 chunkSize = 0;
-    quint16 maxChunkSize = 253;
-    for (quint16 i = 0; i * maxChunkSize < dataLength; i++) {
-        chunkSize = qMin(maxChunkSize, static_cast<quint16>(dataLength - i));
+    if (m_hugeMessages.contains(timestamp)) {
+        qCWarning(dcZigbeeController()) << "Already retrieving a large payload with timestamp" << timestamp << "Dropping the previous one.";
+        m_hugeMessages.remove(timestamp);
+    }
+
+    HugeMessage message;
+    message.indication = pendingIndication;
+    message.indication.asdu = QByteArray(dataLength, 0);
+    message.dataLength = dataLength;
+    message.startTime = QDateTime::currentMSecsSinceEpoch();
+    m_hugeMessages.insert(timestamp, message);
+
+    if (!m_hugeMessageTimer.isActive())
+        m_hugeMessageTimer.start();
+
+    qCDebug(dcZigbeeController()) << "Retrieving large payload of" << dataLength << "bytes with timestamp" << timestamp;
+    requestHugeMessageChunks(timestamp);
+}
+
+void ZigbeeBridgeControllerTi::requestHugeMessageChunks(quint32 timestamp)
+{
+    if (!m_hugeMessages.contains(timestamp))
+        return;
+
+    HugeMessage &message = m_hugeMessages[timestamp];
+    while (message.outstandingChunks < hugeMessageWindowSize && message.nextOffset < message.dataLength) {
+        quint16 offset = message.nextOffset;
+        quint8 chunkSize = static_cast<quint8>(qMin<int>(hugeMessageChunkSize, message.dataLength - offset));
+        message.nextOffset += chunkSize;
+        message.outstandingChunks++;
+
         NEW_PAYLOAD;
         stream << timestamp;
-        stream << i;
+        stream << offset;
         stream << chunkSize;
         ZigbeeInterfaceTiReply *reply = sendCommand(Ti::SubSystemAF, Ti::AFCommandDataRetrieve, payload);
-        // Note, capturing copies of i and chunksize, but a
-        connect(reply, &ZigbeeInterfaceTiReply::finished, this, [this, reply, indication, i, maxChunkSize, dataLength](){
-            PAYLOAD_STREAM(reply->responsePayload());
-            quint8 status, len;
-            stream >> status >> len;
-            if (status != 0x00) {
-                qCWarning(dcZigbeeController()) << "Failed to retrieve large payload chunk!" << status;
+        connect(reply, &ZigbeeInterfaceTiReply::finished, this, [this, reply, timestamp, offset, chunkSize](){
+            // The message might have timed out or failed in the meantime
+            if (!m_hugeMessages.contains(timestamp))
+                return;
+
+            HugeMessage &message = m_hugeMessages[timestamp];
+            message.outstandingChunks--;
+
+            const QByteArray response = reply->responsePayload();
+            if (reply->statusCode() != Ti::StatusCodeSuccess || response.length() < 2) {
+                qCWarning(dcZigbeeController()) << "Failed to retrieve large payload chunk at offset" << offset << reply->statusCode();
+                releaseHugeMessage(timestamp);
+                return;
+            }
+
+            quint8 status = static_cast<quint8>(response.at(0));
+            quint8 length = static_cast<quint8>(response.at(1));
+            if (status != 0x00 || length != chunkSize || response.length() < 2 + length) {
+                qCWarning(dcZigbeeController()) << "Failed to retrieve large payload chunk at offset" << offset << "Status:" << status << "Length:" << length << "Expected:" << chunkSize;
+                releaseHugeMessage(timestamp);
+                return;
             }
-            indication->asdu.append(reply->responsePayload().right(len));
 
-            if (i * maxChunkSize >= dataLength) {
-                // This is the last one...
-                emit apsDataIndicationReceived(*indication);
-                delete indication;
+            memcpy(message.indication.asdu.data() + offset, response.constData() + 2, length);
+            message.receivedLength += length;
+
+            if (message.receivedLength < message.dataLength) {
+                requestHugeMessageChunks(timestamp);
+                return;
             }
+
+            qCDebug(dcZigbeeController()) << "Large payload with timestamp" << timestamp << "retrieved in" << QDateTime::currentMSecsSinceEpoch() - message.startTime << "ms";
+            Zigbee::ApsdeDataIndication indication = message.indication;
+            releaseHugeMessage(timestamp);
+            emit apsDataIndicationReceived(indication);
         });
     }
 }
 
+void ZigbeeBridgeControllerTi::releaseHugeMessage(quint32 timestamp)
+{
+    m_hugeMessages.remove(timestamp);
+    if (m_hugeMessages.isEmpty())
+        m_hugeMessageTimer.stop();
+
+    // A retrieve request with length 0 frees the message buffer in the controller
+    NEW_PAYLOAD;
+    stream << timestamp;
+    stream << static_cast<quint16>(0);
+    stream << static_cast<quint8>(0);
+    sendCommand(Ti::SubSystemAF, Ti::AFCommandDataRetrieve, payload);
+}
+
+void ZigbeeBridgeControllerTi::onHugeMessageTimeout()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    foreach (quint32 timestamp, m_hugeMessages.keys()) {
+        const HugeMessage &message = m_hugeMessages.value(timestamp);
+        if (now - message.startTime < hugeMessageTimeout)
+            continue;
+
+        qCWarning(dcZigbeeController()) << "Timeout retrieving large payload with timestamp" << timestamp << "Received" << message.receivedLength << "of" << message.dataLength << "bytes.";
+        releaseHugeMessage(timestamp);
+    }
+}
+
 ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::start()
 {
     NEW_PAYLOAD;
@@ -712,6 +1446,20 @@ ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::requestPermitJoin(quint8 secon
     return reply;
 }
 
+ZigbeeInterfaceTiReply *ZigbeeBridgeControllerTi::requestChangeChannel(quint8 channel)
+{
+    // A broadcasted Mgmt_NWK_Update_req is processed by z-Stack itself as well, the coordinator
+    // moves to the new channel together with the network and increases the network update ID.
+    NEW_PAYLOAD;
+    stream << static_cast<quint16>(Zigbee::BroadcastAddressAllNonSleepingNodes);
+    stream << static_cast<quint8>(0x0F); // Broadcast
+    stream << static_cast<quint32>(1 << channel);
+    stream << static_cast<quint8>(0xfe); // Change channel
+    stream << static_cast<quint8>(0x00); // Scan count
+    stream << static_cast<quint16>(0x0000); // Network manager
+    return sendCommand(Ti::SubSystemZDO, Ti::ZDOCommandMgmtNwkUpdateReq, payload);
+}
+
 void ZigbeeBridgeControllerTi::waitFor(ZigbeeInterfaceTiReply *reply, Ti::SubSystem subSystem, quint8 command)
 {
     WaitData waitData;
@@ -747,6 +1495,10 @@ void ZigbeeBridgeControllerTi::onInterfaceAvailableChanged(bool available)
             ZigbeeInterfaceTiReply *reply = m_replyQueue.dequeue();
             reply->abort();
         }
+        m_queueDepthGauge->set(0);
+
+        m_hugeMessages.clear();
+        m_hugeMessageTimer.stop();
 
         m_controllerState = ControllerStateDown;
         emit controllerStateChanged(m_controllerState);
@@ -1060,6 +1812,7 @@ void ZigbeeBridgeControllerTi::onInterfacePacketReceived(Ti::SubSystem subSystem
 
 bool ZigbeeBridgeControllerTi::enable(const QString &serialPort, qint32 baudrate)
 {
+    m_interface->setIoThreadEnabled(m_ioThreadEnabled);
     return m_interface->enable(serialPort, baudrate);
 }
 
@@ -32,6 +32,9 @@
 #include <QTimer>
 #include <QQueue>
 #include <QObject>
+#include <QSharedPointer>
+
+#include <functional>
 
 #include "zigbee.h"
 #include "zigbeenetwork.h"
@@ -39,11 +42,15 @@
 #include "zigbeenetworkkey.h"
 #include "zigbeenetworkrequest.h"
 #include "zigbeebridgecontroller.h"
+#include "zigbeecontrollersnapshot.h"
 
 #include "interface/ti.h"
 #include "interface/zigbeeinterfaceti.h"
 #include "interface/zigbeeinterfacetireply.h"
 
+class ZigbeeMetricGauge;
+class ZigbeeMetricCounter;
+
 typedef struct TiNetworkConfiguration {
     ZigbeeAddress ieeeAddress; // R
     quint16 panId = 0; // R
@@ -55,6 +62,14 @@ typedef struct TiNetworkConfiguration {
     Ti::ZnpVersion znpVersion = Ti::zStack12;
 } TiNetworkConfiguration;
 
+// Items of the extended NV table (Z-Stack 3.x.0) are addressed with an item ID and a sub ID
+typedef struct TiNvItem {
+    Ti::NvItemId itemId = Ti::NvItemIdExtAddr;
+    bool extended = false;
+    quint16 subId = 0;
+    QByteArray data;
+} TiNvItem;
+
 class ZigbeeBridgeControllerTi : public ZigbeeBridgeController
 {
     Q_OBJECT
@@ -75,24 +90,46 @@ public:
     ControllerState state() const;
 
     ZigbeeInterfaceTiReply *init();
-    ZigbeeInterfaceTiReply *commission(Ti::DeviceLogicalType deviceType, quint16 panId, const ZigbeeChannelMask &channelMask);
+    ZigbeeInterfaceTiReply *warmStart(const ZigbeeControllerSnapshot &snapshot);
+    ZigbeeInterfaceTiReply *commission(Ti::DeviceLogicalType deviceType, quint16 panId, const ZigbeeChannelMask &channelMask, quint64 extendedPanId = 0, const ZigbeeNetworkKey &networkKey = ZigbeeNetworkKey());
     ZigbeeInterfaceTiReply *start();
     ZigbeeInterfaceTiReply *reset();
     ZigbeeInterfaceTiReply *factoryReset();
+    ZigbeeInterfaceTiReply *setIeeeAddress(const ZigbeeAddress &ieeeAddress);
 
     // Network config will be available after initialisation.
     TiNetworkConfiguration networkConfiguration() const;
 
+    // Reads the current network parameters from z-Stack into the network configuration
+    ZigbeeInterfaceTiReply *readNetworkInfo();
+
     // Anything else is available once running
     ZigbeeInterfaceTiReply *setLed(bool on);
 
     ZigbeeInterfaceTiReply *requestPermitJoin(quint8 seconds, const quint16 &networkAddress);
+    ZigbeeInterfaceTiReply *requestChangeChannel(quint8 channel);
     ZigbeeInterfaceTiReply *registerEndpoint(quint8 endpointId, Zigbee::ZigbeeProfile profile, quint16 deviceId, quint8 deviceVersion, const QList<quint16> &inputClusters = QList<quint16>(), const QList<quint16> &outputClusters = QList<quint16>());
     ZigbeeInterfaceTiReply *addEndpointToGroup(quint8 endpointId, quint16 groupId);
 
     // Send APS request data
     ZigbeeInterfaceTiReply *requestSendRequest(const ZigbeeNetworkRequest &request);
 
+    // Batched NV item access. All commands of a batch are queued at once and sent back to back, the controller accepts
+    // only one request at a time. Items which don't exist on the controller are skipped when reading.
+    // The reply of readNvItems() contains the read items in the NV snapshot format.
+    ZigbeeInterfaceTiReply *readNvItems(const QList<Ti::NvItemId> &itemIds);
+    ZigbeeInterfaceTiReply *writeNvItems(const QList<TiNvItem> &items);
+
+    // Export and import all network related NV items. The reply of exportNvSnapshot() contains the snapshot.
+    // When importing, NWK frame counters in the snapshot below the given frame counter are raised to it.
+    ZigbeeInterfaceTiReply *exportNvSnapshot();
+    ZigbeeInterfaceTiReply *importNvSnapshot(const QByteArray &snapshot, quint32 frameCounter = 0);
+
+    QByteArray buildNvSnapshot(const QList<TiNvItem> &items) const;
+    static bool parseNvSnapshot(const QByteArray &snapshot, Ti::ZnpVersion *znpVersion, QList<TiNvItem> *items);
+    // The highest outgoing NWK frame counter of the snapshot, 0 if it contains none
+    static quint32 nvSnapshotFrameCounter(const QByteArray &snapshot);
+
 public slots:
     bool enable(const QString &serialPort, qint32 baudrate);
     void disable();
@@ -113,6 +150,7 @@ private slots:
     void sendNextRequest();
 
     void initPhase2(ZigbeeInterfaceTiReply* initReply, int attempt);
+    void processVersionReply(ZigbeeInterfaceTiReply *versionReply);
     void postStartup();
 
 private:
@@ -120,7 +158,43 @@ private:
     ZigbeeInterfaceTiReply *readNvItem(Ti::NvItemId itemId, quint16 offset = 0);
     ZigbeeInterfaceTiReply *writeNvItem(Ti::NvItemId itemId, const QByteArray &data, quint16 offset = 0);
     ZigbeeInterfaceTiReply *deleteNvItem(Ti::NvItemId itemId);
+    ZigbeeInterfaceTiReply *readExNvItem(Ti::NvItemId itemId, quint16 subId, quint16 offset, quint8 length);
+    ZigbeeInterfaceTiReply *writeExNvItem(Ti::NvItemId itemId, quint16 subId, const QByteArray &data, quint16 offset = 0);
+    void storeRequestData(ZigbeeInterfaceTiReply *reply, const QByteArray &asdu, quint16 index);
+
+    // State shared by the commands of one NV batch
+    // Retried commands are queued again at the end, so the replies of a batch may finish in any order.
+    // Each step of a batch continues once all of its outstanding replies have finished.
+    struct NvBatch {
+        QList<TiNvItem> items;
+        QList<quint16> lengths;
+        Ti::StatusCode statusCode = Ti::StatusCodeSuccess;
+        int pendingReplies = 0;
+        std::function<void()> finishedCallback;
+    };
+    ZigbeeInterfaceTiReply *readNvItemBatch(const QList<TiNvItem> &items);
+    QList<TiNvItem> networkNvItems() const;
+    void requestNvItemLengths(ZigbeeInterfaceTiReply *batchReply, QSharedPointer<NvBatch> batch, const std::function<void()> &callback);
+    void updateNvBatchStatus(QSharedPointer<NvBatch> batch, ZigbeeInterfaceTiReply *reply, bool hasStatus = true);
+    void addNvBatchReply(ZigbeeInterfaceTiReply *batchReply, QSharedPointer<NvBatch> batch, ZigbeeInterfaceTiReply *reply, const std::function<void()> &handler);
     void retrieveHugeMessage(const Zigbee::ApsdeDataIndication &pendingIndication, quint32 timestamp, quint16 dataLength);
+    void requestHugeMessageChunks(quint32 timestamp);
+    void releaseHugeMessage(quint32 timestamp);
+    void onHugeMessageTimeout();
+
+    // Incoming messages which don't fit into a single AF_INCOMING_MSG frame are stored in the
+    // controller and need to be fetched in chunks. The asdu is allocated once with the full
+    // length and every chunk is written to its offset, so chunks may complete in any order.
+    struct HugeMessage {
+        Zigbee::ApsdeDataIndication indication;
+        quint16 dataLength = 0;
+        quint16 nextOffset = 0;
+        quint16 receivedLength = 0;
+        int outstandingChunks = 0;
+        qint64 startTime = 0;
+    };
+    QHash<quint32, HugeMessage> m_hugeMessages;
+    QTimer m_hugeMessageTimer;
 
     void waitFor(ZigbeeInterfaceTiReply *reply, Ti::SubSystem subSystem, quint8 command);
     void waitFor(ZigbeeInterfaceTiReply *reply, Ti::SubSystem subSystem, quint8 command, const QByteArray &payload);
@@ -141,6 +215,11 @@ private:
 
     QQueue<ZigbeeInterfaceTiReply *> m_replyQueue;
 
+    // Metrics
+    ZigbeeMetricGauge *m_queueDepthGauge = nullptr;
+    ZigbeeMetricCounter *m_retriesCounter = nullptr;
+    ZigbeeMetricCounter *m_timeoutsCounter = nullptr;
+
     QTimer m_permitJoinTimer;
 
     QList<int> m_registeredEndpointIds;
@@ -30,10 +30,16 @@
 #include "loggingcategory.h"
 #include "zigbeeutils.h"
 #include "zigbeenetworkdatabase.h"
+#include "zigbeebroadcastgovernor.h"
 
+#include <QTimer>
 #include <QDataStream>
 #include <QtCrypto>
 
+// z-Stack switches after the broadcast delivery time, poll the channel for up to 30 s
+static const int s_channelConfirmInterval = 1000;
+static const int s_channelConfirmAttempts = 30;
+
 ZigbeeNetworkTi::ZigbeeNetworkTi(const QUuid &networkUuid, QObject *parent) :
     ZigbeeNetwork(networkUuid, parent)
 {
@@ -61,6 +67,33 @@ Zigbee::ZigbeeBackendType ZigbeeNetworkTi::backendType() const
     return Zigbee::ZigbeeBackendTypeTi;
 }
 
+void ZigbeeNetworkTi::readControllerBackupData()
+{
+    // The frame counters keep increasing while the network is running, the backup needs a fresh snapshot
+    ZigbeeInterfaceTiReply *snapshotReply = refreshNvSnapshot();
+    connect(snapshotReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
+        if (snapshotReply->statusCode() != Ti::StatusCodeSuccess) {
+            finishBackup(false);
+            return;
+        }
+
+        finishBackup(true, m_nvSnapshot, ZigbeeBridgeControllerTi::nvSnapshotFrameCounter(m_nvSnapshot));
+    });
+}
+
+void ZigbeeNetworkTi::readFrameCounter(const std::function<void (bool, quint32)> &callback)
+{
+    ZigbeeInterfaceTiReply *snapshotReply = refreshNvSnapshot();
+    connect(snapshotReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
+        if (snapshotReply->statusCode() != Ti::StatusCodeSuccess) {
+            callback(false, 0);
+            return;
+        }
+
+        callback(true, ZigbeeBridgeControllerTi::nvSnapshotFrameCounter(m_nvSnapshot));
+    });
+}
+
 ZigbeeNetworkReply *ZigbeeNetworkTi::sendRequest(const ZigbeeNetworkRequest &request)
 {
     ZigbeeNetworkReply *reply = createNetworkReply(request);
@@ -71,25 +104,31 @@ ZigbeeNetworkReply *ZigbeeNetworkTi::sendRequest(const ZigbeeNetworkRequest &req
         return reply;
     }
 
+    if (!verifyRequestLength(reply))
+        return reply;
+
     if (state() == ZigbeeNetwork::StateStarting) {
         m_requestQueue.append(reply);
         return reply;
     }
 
-    ZigbeeInterfaceTiReply *interfaceReply = m_controller->requestSendRequest(request);
-    connect(interfaceReply, &ZigbeeInterfaceTiReply::finished, reply, [this, reply, interfaceReply](){
-        if (interfaceReply->statusCode() != Ti::StatusCodeSuccess) {
-            qCWarning(dcZigbeeController()) << "Could not send request to controller." << interfaceReply->statusCode();
-            finishNetworkReply(reply, ZigbeeNetworkReply::ErrorInterfaceError);
-            return;
-        }
-
-        finishNetworkReply(reply, ZigbeeNetworkReply::ErrorNoError);
+    broadcastGovernor()->send(reply, [this](ZigbeeNetworkReply *governedReply){
+        sendRequestInternally(governedReply);
     });
 
     return reply;
 }
 
+quint16 ZigbeeNetworkTi::maximumAsduLength(Zigbee::DestinationAddressMode destinationAddressMode, quint16 destinationShortAddress) const
+{
+    // Z-Stack fragments unicast requests which don't fit into a single frame on its own.
+    // Group casts and broadcasts can't be acknowledged and therefore not fragmented.
+    if (destinationAddressMode == Zigbee::DestinationAddressModeGroup || destinationShortAddress >= 0xfff8)
+        return ZigbeeNetwork::maximumAsduLength(destinationAddressMode, destinationShortAddress);
+
+    return 1024;
+}
+
 void ZigbeeNetworkTi::setPermitJoining(quint8 duration, quint16 address)
 {
     if (duration > 0) {
@@ -107,47 +146,6 @@ void ZigbeeNetworkTi::setPermitJoining(quint8 duration, quint16 address)
         qCDebug(dcZigbeeNetwork()) << "Permit join request finished successfully:" << duration;
 
         setPermitJoiningState(true, duration);
-
-        // Opening the green power network too
-        // Todo: This should probably be somewhere else, but not yet sure how other backeds deal with this
-        QByteArray payload;
-        QDataStream stream(&payload, QIODevice::WriteOnly);
-        stream.setByteOrder(QDataStream::LittleEndian);
-        stream << static_cast<quint8>(0x0b); // options
-        stream << static_cast<quint16>(duration);
-
-
-        // Build ZCL frame control
-        ZigbeeClusterLibrary::FrameControl frameControl;
-        frameControl.frameType = ZigbeeClusterLibrary::FrameTypeClusterSpecific;
-        frameControl.manufacturerSpecific = false;
-        frameControl.direction = ZigbeeClusterLibrary::DirectionServerToClient;
-        frameControl.disableDefaultResponse = true;
-
-        // Build ZCL header
-        ZigbeeClusterLibrary::Header header;
-        header.frameControl = frameControl;
-        header.command = 0x02;// TODO: ZigbeeClusterGreenPower::ClusterCommandCommissioningMode;
-        header.transactionSequenceNumber = generateSequenceNumber();
-
-        // Build ZCL frame
-        ZigbeeClusterLibrary::Frame frame;
-        frame.header = header;
-        frame.payload = payload;
-
-        ZigbeeNetworkRequest request;
-        request.setRequestId(generateSequenceNumber());
-        request.setDestinationAddressMode(Zigbee::DestinationAddressModeShortAddress);
-        request.setDestinationShortAddress(0xFFFD);
-        request.setDestinationEndpoint(242); // Green Power Endpoint
-        request.setProfileId(Zigbee::ZigbeeProfileDevice); // ZDP
-        request.setClusterId(0x21);
-        request.setTxOptions(static_cast<Zigbee::ZigbeeTxOption>(0x00)); // FIXME: There should be TxOptionsNone  I guess...
-        request.setSourceEndpoint(242); // Green Power Endpoint
-        request.setRadius(30); // FIXME: There should be a more clever way to figure out the radius
-        request.setAsdu(ZigbeeClusterLibrary::buildFrame(frame));
-
-        m_controller->requestSendRequest(request);
     });
 }
 
@@ -157,6 +155,25 @@ void ZigbeeNetworkTi::initController()
     setState(StateStarting);
     setError(ErrorNoError);
 
+    ZigbeeControllerSnapshot snapshot = warmStartSnapshot();
+    if (snapshot.isValid()) {
+        ZigbeeInterfaceTiReply *warmStartReply = m_controller->warmStart(snapshot);
+        connect(warmStartReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
+            if (warmStartReply->statusCode() != Ti::StatusCodeSuccess) {
+                qCDebug(dcZigbeeNetwork()) << "Warm start not possible. Continue with the full controller initialization.";
+                initControllerInternally();
+                return;
+            }
+            qCDebug(dcZigbeeNetwork()) << "Controller warm started successfully";
+        });
+        return;
+    }
+
+    initControllerInternally();
+}
+
+void ZigbeeNetworkTi::initControllerInternally()
+{
     ZigbeeInterfaceTiReply *initReply = m_controller->init();
     connect(initReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
         if (initReply->statusCode() != Ti::StatusCodeSuccess) {
@@ -173,21 +190,103 @@ void ZigbeeNetworkTi::commissionController()
     qCDebug(dcZigbeeNetwork()) << "Commissioning controller";
 
     quint16 panId = ZigbeeUtils::generateRandomPanId();
+    quint64 extendedPanId = 0;
+    ZigbeeNetworkKey networkKey;
+
+    if (m_restoreBackup.isValid()) {
+        // A backup from a TI controller contains the complete network NV items, including the frame counters
+        if (m_restoreBackup.backendType() == Zigbee::ZigbeeBackendTypeTi && !m_restoreBackup.controllerData().isEmpty()) {
+            restoreControllerNvSnapshot(m_restoreBackup.controllerData());
+            return;
+        }
+
+        qCDebug(dcZigbeeNetwork()) << "Commissioning controller with the network configuration from the backup";
+        panId = this->panId();
+        extendedPanId = this->extendedPanId();
+        networkKey = securityConfiguration().networkKey();
+    }
+
+    // The address has to be in place before forming the network, Z-Stack uses it as trust center address
+    restoreCoordinatorAddress([=](){
+        ZigbeeInterfaceTiReply *commissionReply = m_controller->commission(Ti::DeviceLogicalTypeCoordinator, panId, channelMask(), extendedPanId, networkKey);
+        connect(commissionReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
+            if (commissionReply->statusCode() != Ti::StatusCodeSuccess) {
+                qCWarning(dcZigbeeNetwork()) << "Error commissioning controller.";
+                setState(StateUninitialized);
+                setError(ErrorZigbeeError);
+                return;
+            }
+
+            qCDebug(dcZigbeeNetwork()) << "Controller commissioned";
+
+            startControllerNetwork();
+            setMacAddress(m_controller->networkConfiguration().ieeeAddress);
+        });
+    });
+}
+
+void ZigbeeNetworkTi::restoreControllerNvSnapshot(const QByteArray &nvSnapshot)
+{
+    qCDebug(dcZigbeeNetwork()) << "Restoring controller NV snapshot from the backup";
+
+    ZigbeeInterfaceTiReply *resetReply = m_controller->factoryReset();
+    connect(resetReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
+        ZigbeeInterfaceTiReply *importReply = m_controller->importNvSnapshot(nvSnapshot, m_restoreBackup.restoreFrameCounter());
+        connect(importReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
+            if (importReply->statusCode() != Ti::StatusCodeSuccess) {
+                qCWarning(dcZigbeeNetwork()) << "Error restoring the controller NV snapshot." << importReply->statusCode();
+                setState(StateUninitialized);
+                setError(ErrorZigbeeError);
+                return;
+            }
+
+            qCDebug(dcZigbeeNetwork()) << "Controller NV snapshot restored";
+
+            // The snapshot contains the trust center address of the previous coordinator
+            restoreCoordinatorAddress([=](){
+                startControllerNetwork();
+                setMacAddress(m_controller->networkConfiguration().ieeeAddress);
+            });
+        });
+    });
+}
 
-    ZigbeeInterfaceTiReply *commissionReply = m_controller->commission(Ti::DeviceLogicalTypeCoordinator, panId, channelMask());
-    connect(commissionReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
-        if (commissionReply->statusCode() != Ti::StatusCodeSuccess) {
-            qCWarning(dcZigbeeNetwork()) << "Error commissioning controller.";
+void ZigbeeNetworkTi::restoreCoordinatorAddress(const std::function<void ()> &callback)
+{
+    // The controller takes over the IEEE address of the previous coordinator instead of rewriting the restored
+    // trust center address. The nodes know the coordinator by this address, their bindings remain valid this way.
+    ZigbeeAddress coordinatorAddress = m_restoreBackup.coordinatorAddress();
+    if (!m_restoreBackup.isValid() || coordinatorAddress.isNull() || coordinatorAddress == m_controller->networkConfiguration().ieeeAddress) {
+        callback();
+        return;
+    }
+
+    qCDebug(dcZigbeeNetwork()) << "Restoring the coordinator IEEE address" << coordinatorAddress.toString();
+    ZigbeeInterfaceTiReply *reply = m_controller->setIeeeAddress(coordinatorAddress);
+    connect(reply, &ZigbeeInterfaceTiReply::finished, this, [=](){
+        if (reply->statusCode() != Ti::StatusCodeSuccess) {
+            qCWarning(dcZigbeeNetwork()) << "Error restoring the coordinator IEEE address." << reply->statusCode();
             setState(StateUninitialized);
             setError(ErrorZigbeeError);
             return;
         }
 
-        qCDebug(dcZigbeeNetwork()) << "Controller commissioned";
+        callback();
+    });
+}
 
-        startControllerNetwork();
-        setMacAddress(m_controller->networkConfiguration().ieeeAddress);
+ZigbeeInterfaceTiReply *ZigbeeNetworkTi::refreshNvSnapshot()
+{
+    // Keep the NV snapshot for network backups up to date
+    ZigbeeInterfaceTiReply *snapshotReply = m_controller->exportNvSnapshot();
+    connect(snapshotReply, &ZigbeeInterfaceTiReply::finished, this, [=](){
+        if (snapshotReply->statusCode() != Ti::StatusCodeSuccess) {
+            qCWarning(dcZigbeeNetwork()) << "Could not read the controller NV snapshot." << snapshotReply->statusCode();
+            return;
+        }
+        m_nvSnapshot = snapshotReply->responsePayload();
     });
+    return snapshotReply;
 }
 
 void ZigbeeNetworkTi::startControllerNetwork()
@@ -205,92 +304,9 @@ void ZigbeeNetworkTi::startControllerNetwork()
     });
 }
 
-void ZigbeeNetworkTi::processGreenPowerFrame(const Zigbee::ApsdeDataIndication &indication)
-{
-    ZigbeeClusterLibrary::Frame inputFrame = ZigbeeClusterLibrary::parseFrameData(indication.asdu);
-    QDataStream inputStream(inputFrame.payload);
-    inputStream.setByteOrder(QDataStream::LittleEndian);
-    quint8 commandId, payloadSize;
-    quint16 options;
-    quint32 srcId, frameCounter;
-    inputStream >> options >> srcId >> frameCounter >> commandId >> payloadSize;
-    QByteArray commandFrame = inputFrame.payload.right(payloadSize);
-    qCWarning(dcZigbeeNetwork()) << "Green Power frame:" << options << srcId << frameCounter << commandId << payloadSize << commandFrame.toHex();
-
-    if (commandId == 0xE0) {
-        qCWarning(dcZigbeeNetwork()) << "Green power commissioning";
-        QDataStream commandStream(commandFrame);
-        commandStream.setByteOrder(QDataStream::LittleEndian);
-        quint8 deviceId, inputOptions, extendedOptions;
-        QByteArray securityKey;
-        quint32 keyMic;
-        quint32 outgoingCounter;
-        commandStream >> deviceId >> inputOptions >> extendedOptions;
-        for (int i = 0; i < 16; i++) {
-            quint8 byte;
-            commandStream >> byte;
-            securityKey.append(byte);
-        }
-        commandStream >> keyMic >> outgoingCounter;
-
-        // Send commissioning reply
-        QByteArray payload;
-        QDataStream stream(&payload, QIODevice::WriteOnly);
-        stream.setByteOrder(QDataStream::LittleEndian);
-        ZigbeeDataType options = ZigbeeDataType(static_cast<quint32>(0x00e548), Zigbee::Uint24); // options
-        for (int i = 0; i < options.data().length(); i++) {
-            stream << static_cast<quint8>(options.data().at(i));
-        }
-        stream << srcId;
-        stream << static_cast<quint16>(0x0b84); // Green Power group as configured during startup
-        stream << deviceId;
-        stream << outgoingCounter;
-        payload.append(encryptSecurityKey(srcId, securityKey));
-
-        // Build ZCL frame control
-        ZigbeeClusterLibrary::FrameControl frameControl;
-        frameControl.frameType = ZigbeeClusterLibrary::FrameTypeClusterSpecific;
-        frameControl.manufacturerSpecific = false;
-        frameControl.direction = ZigbeeClusterLibrary::DirectionServerToClient;
-        frameControl.disableDefaultResponse = true;
-
-        // Build ZCL header
-        ZigbeeClusterLibrary::Header header;
-        header.frameControl = frameControl;
-        header.command = 0x01; // TODO: ZigbeeClusterGreenPower::ClusterCommandPairing;
-        header.transactionSequenceNumber = generateSequenceNumber() - 1;
-
-        // Build ZCL frame
-        ZigbeeClusterLibrary::Frame frame;
-        frame.header = header;
-        frame.payload = payload;
-
-        ZigbeeNetworkRequest request;
-        request.setRequestId(generateSequenceNumber() + 1);
-        request.setDestinationAddressMode(Zigbee::DestinationAddressModeShortAddress);
-        request.setDestinationShortAddress(0xFFFD);
-        request.setDestinationEndpoint(242); // Green Power Endpoint
-        request.setProfileId(Zigbee::ZigbeeProfileDevice); // ZDP
-        request.setClusterId(0x21);
-        request.setTxOptions(static_cast<Zigbee::ZigbeeTxOption>(0x00)); // FIXME: There should be TxOptionsNone  I guess...
-        request.setSourceEndpoint(242); // Green Power Endpoint
-        request.setRadius(30); // FIXME: There should be a more clever way to figure out the radius
-        request.setAsdu(ZigbeeClusterLibrary::buildFrame(frame));
-
-        m_controller->requestSendRequest(request);
-
-        QStringList l;
-        for (int i = 0; i < request.asdu().length(); i++) {
-            l.append(QString::number(static_cast<quint8>(request.asdu().at(i))));
-        }
-
-        // TODO: create the GreenPower Node here once GreenPower support is added properly
-        // emit greenPowerDeviceJoined(srcId, deviceId, indication.sourceIeeeAddress())
-    }
-}
-
-QByteArray ZigbeeNetworkTi::encryptSecurityKey(quint32 sourceId, const QByteArray &securityKey)
+QByteArray ZigbeeNetworkTi::decryptGreenPowerKey(quint32 sourceId, const QByteArray &encryptedKey) const
 {
+    // Note: AES-CCM uses CTR mode for the payload, encrypting the received key decrypts it
 #if (QCA_VERSION >= QCA_VERSION_CHECK(2, 2, 0))
     QByteArray sourceIdArray;
     sourceIdArray.append(static_cast<quint8>(sourceId & 0x000000ff));
@@ -310,16 +326,140 @@ QByteArray ZigbeeNetworkTi::encryptSecurityKey(quint32 sourceId, const QByteArra
 
     QCA::Initializer init;
     QCA::Cipher cipher("aes128", QCA::Cipher::CCM, QCA::Cipher::DefaultPadding, QCA::Encode, zigbeeLinkKey, nonce);
-    QByteArray encrypted = cipher.update(securityKey).toByteArray();
-    encrypted.append(cipher.final().toByteArray());
-    return encrypted;
+    QByteArray decrypted = cipher.update(encryptedKey).toByteArray();
+    decrypted.append(cipher.final().toByteArray());
+    return decrypted.left(encryptedKey.length());
 #else
     Q_UNUSED(sourceId)
     qCWarning(dcZigbeeNetwork()) << "Greenpower encryption requires AES-128-CCM (requires qca-qt5-2 >= 2.2.0)";
-    return securityKey;
+    return encryptedKey;
 #endif
 }
 
+bool ZigbeeNetworkTi::greenPowerGroupSupported() const
+{
+    // The Green Power endpoint gets added to the sink group on startup
+    return true;
+}
+
+bool ZigbeeNetworkTi::channelChangeSupported() const
+{
+    return true;
+}
+
+bool ZigbeeNetworkTi::announcesChannelChange() const
+{
+    // z-Stack broadcasts the Mgmt_NWK_Update_req itself and moves the coordinator together with the network
+    return true;
+}
+
+void ZigbeeNetworkTi::readNetworkUpdateId(const std::function<void (bool, quint8)> &callback)
+{
+    ZigbeeInterfaceTiReply *reply = m_controller->readNvItems(QList<Ti::NvItemId>() << Ti::NvItemIdNIB);
+    connect(reply, &ZigbeeInterfaceTiReply::finished, this, [reply, callback](){
+        Ti::ZnpVersion znpVersion;
+        QList<TiNvItem> items;
+        if (reply->statusCode() != Ti::StatusCodeSuccess || !ZigbeeBridgeControllerTi::parseNvSnapshot(reply->responsePayload(), &znpVersion, &items) || items.isEmpty()) {
+            qCWarning(dcZigbeeNetwork()) << "Could not read the NIB of the controller." << reply->statusCode();
+            callback(false, 0);
+            return;
+        }
+
+        // nwkUpdateId is the second last member of the NIB, which is word aligned on CC26xx and packed on CC253x
+        const QByteArray nib = items.first().data;
+        int offset = -1;
+        if (nib.length() == 116) {
+            offset = 114;
+        } else if (nib.length() == 110) {
+            offset = 109;
+        }
+
+        if (offset < 0) {
+            qCWarning(dcZigbeeNetwork()) << "Unknown NIB layout with" << nib.length() << "bytes";
+            callback(false, 0);
+            return;
+        }
+
+        const quint8 networkUpdateId = static_cast<quint8>(nib.at(offset));
+        qCDebug(dcZigbeeNetwork()) << "Current network update ID" << networkUpdateId;
+        callback(true, networkUpdateId);
+    });
+}
+
+void ZigbeeNetworkTi::changeControllerChannel(quint8 channel, quint8 networkUpdateId)
+{
+    // z-Stack announces the change and increases the network update ID of its NIB on its own
+    qCDebug(dcZigbeeNetwork()) << "Requesting z-Stack to move the network to channel" << channel << "network update ID" << networkUpdateId;
+
+    ZigbeeInterfaceTiReply *reply = m_controller->requestChangeChannel(channel);
+    connect(reply, &ZigbeeInterfaceTiReply::finished, this, [this, reply, channel](){
+        Ti::StatusCode statusCode = reply->statusCode();
+        if (statusCode == Ti::StatusCodeSuccess) {
+            statusCode = reply->responsePayload().isEmpty() ? Ti::StatusCodeError : static_cast<Ti::StatusCode>(reply->responsePayload().at(0));
+        }
+
+        if (statusCode != Ti::StatusCodeSuccess) {
+            qCWarning(dcZigbeeNetwork()) << "Could not change the channel of the controller." << statusCode;
+            finishControllerChannelChange(false);
+            return;
+        }
+
+        confirmControllerChannel(channel);
+    });
+}
+
+void ZigbeeNetworkTi::confirmControllerChannel(quint8 channel, int attempt)
+{
+    ZigbeeInterfaceTiReply *reply = m_controller->readNetworkInfo();
+    connect(reply, &ZigbeeInterfaceTiReply::finished, this, [this, reply, channel, attempt](){
+        if (reply->statusCode() != Ti::StatusCodeSuccess || m_controller->networkConfiguration().currentChannel != channel) {
+            if (state() != StateRunning || attempt + 1 >= s_channelConfirmAttempts) {
+                qCWarning(dcZigbeeNetwork()) << "The controller did not move to channel" << channel << "Current channel:" << m_controller->networkConfiguration().currentChannel;
+                finishControllerChannelChange(false);
+                return;
+            }
+
+            QTimer::singleShot(s_channelConfirmInterval, this, [this, channel, attempt](){
+                confirmControllerChannel(channel, attempt + 1);
+            });
+            return;
+        }
+
+        // Store the new channel, otherwise the controller would form the network on the old one after a factory reset
+        TiNvItem item;
+        item.itemId = Ti::NvItemIdChanList;
+        QDataStream stream(&item.data, QIODevice::WriteOnly);
+        stream.setByteOrder(QDataStream::LittleEndian);
+        stream << static_cast<quint32>(1 << channel);
+
+        ZigbeeInterfaceTiReply *nvReply = m_controller->writeNvItems(QList<TiNvItem>() << item);
+        connect(nvReply, &ZigbeeInterfaceTiReply::finished, this, [this, nvReply, channel](){
+            if (nvReply->statusCode() != Ti::StatusCodeSuccess) {
+                qCWarning(dcZigbeeNetwork()) << "Could not write the channel list of the controller." << nvReply->statusCode();
+            }
+
+            qCDebug(dcZigbeeNetwork()) << "Controller moved to channel" << channel;
+            setChannel(channel);
+            refreshNvSnapshot();
+        });
+    });
+}
+
+void ZigbeeNetworkTi::sendRequestInternally(ZigbeeNetworkReply *reply)
+{
+    ZigbeeInterfaceTiReply *interfaceReply = m_controller->requestSendRequest(reply->request());
+    connect(interfaceReply, &ZigbeeInterfaceTiReply::finished, reply, [this, reply, interfaceReply](){
+        if (interfaceReply->statusCode() != Ti::StatusCodeSuccess) {
+            qCWarning(dcZigbeeController()) << "Could not send request to controller." << interfaceReply->statusCode();
+            finishNetworkReply(reply, ZigbeeNetworkReply::ErrorInterfaceError);
+            return;
+        }
+
+        setReplySent(reply);
+        finishNetworkReply(reply, ZigbeeNetworkReply::ErrorNoError);
+    });
+}
+
 void ZigbeeNetworkTi::onControllerAvailableChanged(bool available)
 {
     if (!available) {
@@ -395,7 +535,7 @@ void ZigbeeNetworkTi::onControllerStateChanged(ZigbeeBridgeControllerTi::Control
             }
             qCDebug(dcZigbeeNetwork()) << "Registered GreenPower endpoint on coordinator node.";
 
-            ZigbeeInterfaceTiReply *addGEndpointGroupReply = m_controller->addEndpointToGroup(242, 0x0b84);
+            ZigbeeInterfaceTiReply *addGEndpointGroupReply = m_controller->addEndpointToGroup(242, greenPowerSink()->groupId());
             connect(addGEndpointGroupReply, &ZigbeeInterfaceTiReply::finished, this, [=]() {
                 if (addGEndpointGroupReply->statusCode() != Ti::StatusCodeSuccess) {
                     qCWarning(dcZigbeeNetwork()) << "Error adding GreenPower endpoint to group.";
@@ -417,6 +557,7 @@ void ZigbeeNetworkTi::onControllerStateChanged(ZigbeeBridgeControllerTi::Control
                 connect(ledReply, &ZigbeeInterfaceTiReply::finished, this, [=]() {
 
                     setState(StateRunning);
+                    refreshNvSnapshot();
 
                     // Introspecing ourselves on every start. Most of the times this wouldn't be needed, but if the above
                     // endpoints are changed (e.g. on a future upgrade), we'll want to refresh.
@@ -429,14 +570,8 @@ void ZigbeeNetworkTi::onControllerStateChanged(ZigbeeBridgeControllerTi::Control
 
                     while (!m_requestQueue.isEmpty()) {
                         ZigbeeNetworkReply *reply = m_requestQueue.takeFirst();
-                        ZigbeeInterfaceTiReply *interfaceReply = m_controller->requestSendRequest(reply->request());
-                        connect(interfaceReply, &ZigbeeInterfaceTiReply::finished, reply, [this, reply, interfaceReply](){
-                            if (interfaceReply->statusCode() != Ti::StatusCodeSuccess) {
-                                qCWarning(dcZigbeeController()) << "Could send request to controller." << interfaceReply->statusCode();
-                                finishNetworkReply(reply, ZigbeeNetworkReply::ErrorInterfaceError);
-                                return;
-                            }
-                            finishNetworkReply(reply, ZigbeeNetworkReply::ErrorNoError);
+                        broadcastGovernor()->send(reply, [this](ZigbeeNetworkReply *governedReply){
+                            sendRequestInternally(governedReply);
                         });
                     }
                 });
@@ -479,12 +614,6 @@ void ZigbeeNetworkTi::onApsDataConfirmReceived(const Zigbee::ApsdeDataConfirm &c
 
 void ZigbeeNetworkTi::onApsDataIndicationReceived(const Zigbee::ApsdeDataIndication &indication)
 {
-    // If it's for the green power endpoint, we'll have to do a commissioning.
-    // TODO: This should probably be in ZigbeeNode or ZigbeeDeviceObject, but not yet sure how other backends deal with it
-    if (indication.destinationEndpoint == 242) {
-        processGreenPowerFrame(indication);
-    }
-
     // Check if this indocation is related to any pending reply
     if (indication.profileId == Zigbee::ZigbeeProfileDevice) {
         handleZigbeeDeviceProfileIndication(indication);
@@ -532,6 +661,7 @@ void ZigbeeNetworkTi::factoryResetNetwork()
 
         m_controller->disable();
         clearSettings();
+        m_nvSnapshot.clear();
         setMacAddress(ZigbeeAddress("00:00:00:00:00:00"));
         setState(StateOffline);
         setError(ErrorNoError);
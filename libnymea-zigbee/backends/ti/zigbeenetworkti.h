@@ -47,6 +47,7 @@ public:
 
     // Sending an APSDE-DATA.request, will be finished on APSDE-DATA.confirm
     ZigbeeNetworkReply *sendRequest(const ZigbeeNetworkRequest &request) override;
+    quint16 maximumAsduLength(Zigbee::DestinationAddressMode destinationAddressMode = Zigbee::DestinationAddressModeShortAddress, quint16 destinationShortAddress = 0x0000) const override;
 
     void setPermitJoining(quint8 duration, quint16 address = Zigbee::BroadcastAddressAllRouters) override;
 
@@ -57,6 +58,15 @@ public slots:
     void factoryResetNetwork() override;
     void destroyNetwork() override;
 
+protected:
+    void readControllerBackupData() override;
+    void readFrameCounter(const std::function<void(bool success, quint32 frameCounter)> &callback) override;
+    QByteArray decryptGreenPowerKey(quint32 sourceId, const QByteArray &encryptedKey) const override;
+    bool greenPowerGroupSupported() const override;
+    bool channelChangeSupported() const override;
+    bool announcesChannelChange() const override;
+    void readNetworkUpdateId(const std::function<void(bool success, quint8 networkUpdateId)> &callback) override;
+    void changeControllerChannel(quint8 channel, quint8 networkUpdateId) override;
 
 private slots:
     void onControllerAvailableChanged(bool available);
@@ -70,16 +80,22 @@ private slots:
 
 private:
     void initController();
+    void initControllerInternally();
     void commissionController();
+    void restoreControllerNvSnapshot(const QByteArray &nvSnapshot);
+    void restoreCoordinatorAddress(const std::function<void()> &callback);
+    ZigbeeInterfaceTiReply *refreshNvSnapshot();
+    void confirmControllerChannel(quint8 channel, int attempt = 0);
     void startControllerNetwork();
-
-    void processGreenPowerFrame(const Zigbee::ApsdeDataIndication &indication);
-    QByteArray encryptSecurityKey(quint32 sourceId, const QByteArray &securityKey);
+    void sendRequestInternally(ZigbeeNetworkReply *reply);
 
 private:
     ZigbeeBridgeControllerTi *m_controller = nullptr;
 
     QList<ZigbeeNetworkReply*> m_requestQueue;
+
+    // The NV snapshot last read from the controller
+    QByteArray m_nvSnapshot;
 };
 
 #endif // ZIGBEENETWORKDECONZ_H
@@ -70,6 +70,7 @@ SOURCES += \
     zcl/smartenergy/zigbeeclustermetering.cpp \
     zcl/zigbeecluster.cpp \
     zcl/zigbeeclusterattribute.cpp \
+    zcl/zigbeeclusterattributefilter.cpp \
     zcl/zigbeeclusterlibrary.cpp \
     zcl/zigbeeclusterreply.cpp \
     zcl/general/zigbeeclusterbasic.cpp \
@@ -77,12 +78,26 @@ SOURCES += \
     zdo/zigbeedeviceobjectreply.cpp \
     zdo/zigbeedeviceprofile.cpp \
     zigbeeadpu.cpp \
+    zigbeeattributehistory.cpp \
+    zigbeeattributereadbatch.cpp \
+    zigbeebindingbatch.cpp \
     zigbeebridgecontroller.cpp \
+    zigbeebroadcastgovernor.cpp \
+    zigbeechannelmanager.cpp \
     zigbeechannelmask.cpp \
+    zigbeecontrollersnapshot.cpp \
     zigbeedatatype.cpp \
+    zigbeeduplicatefilter.cpp \
+    zigbeeframeringbuffer.cpp \
+    zigbeegreenpowersink.cpp \
+    zigbeeiothread.cpp \
+    zigbeelatencystatistics.cpp \
     zigbeemanufacturer.cpp \
+    zigbeemetrics.cpp \
     zigbeenetwork.cpp \
+    zigbeenetworkbackup.cpp \
     zigbeenetworkdatabase.cpp \
+    zigbeenetworkdatabaseworker.cpp \
     zigbeenetworkkey.cpp \
     zigbeenetworkmanager.cpp \
     zigbee.cpp \
@@ -91,11 +106,16 @@ SOURCES += \
     zigbeenetworkrequest.cpp \
     zigbeenodeendpoint.cpp \
     zigbeereply.cpp \
+    zigbeereportingreconciler.cpp \
+    zigbeerttestimator.cpp \
     zigbeesecurityconfiguration.cpp \
+    zigbeesequencenumberallocator.cpp \
+    zigbeetimerwheel.cpp \
     zigbeeuartadapter.cpp \
     zigbeeuartadaptermonitor.cpp \
     zigbeeutils.cpp \
     zigbeenode.cpp \
+    zigbeenodemailbox.cpp \
     zigbeeaddress.cpp
 
 !contains(DEFINES, ZIGBEE_DISABLE_TI) {
@@ -159,6 +179,8 @@ HEADERS += \
     zcl/smartenergy/zigbeeclustermetering.h \
     zcl/zigbeecluster.h \
     zcl/zigbeeclusterattribute.h \
+    zcl/zigbeeclusterattributedescriptor.h \
+    zcl/zigbeeclusterattributefilter.h \
     zcl/zigbeeclusterlibrary.h \
     zcl/zigbeeclusterreply.h \
     zcl/general/zigbeeclusterbasic.h \
@@ -166,12 +188,26 @@ HEADERS += \
     zdo/zigbeedeviceobjectreply.h \
     zdo/zigbeedeviceprofile.h \
     zigbeeadpu.h \
+    zigbeeattributehistory.h \
+    zigbeeattributereadbatch.h \
+    zigbeebindingbatch.h \
     zigbeebridgecontroller.h \
+    zigbeebroadcastgovernor.h \
+    zigbeechannelmanager.h \
     zigbeechannelmask.h \
+    zigbeecontrollersnapshot.h \
     zigbeedatatype.h \
+    zigbeeduplicatefilter.h \
+    zigbeeframeringbuffer.h \
+    zigbeegreenpowersink.h \
+    zigbeeiothread.h \
+    zigbeelatencystatistics.h \
     zigbeemanufacturer.h \
+    zigbeemetrics.h \
     zigbeenetwork.h \
+    zigbeenetworkbackup.h \
     zigbeenetworkdatabase.h \
+    zigbeenetworkdatabaseworker.h \
     zigbeenetworkkey.h \
     zigbeenetworkmanager.h \
     zigbee.h \
@@ -180,13 +216,66 @@ HEADERS += \
     zigbeenetworkrequest.h \
     zigbeenodeendpoint.h \
     zigbeereply.h \
+    zigbeereportingreconciler.h \
+    zigbeerttestimator.h \
     zigbeesecurityconfiguration.h \
+    zigbeesequencenumberallocator.h \
+    zigbeetimerwheel.h \
     zigbeeuartadapter.h \
     zigbeeuartadaptermonitor.h \
     zigbeeutils.h \
     zigbeenode.h \
+    zigbeenodemailbox.h \
     zigbeeaddress.h
 
+# Clusters generated from the JSON descriptions in zcl/definitions
+ZCL_DEFINITIONS += \
+    zcl/definitions/flowmeasurement.json \
+    zcl/definitions/illuminancelevelsensing.json
+
+ZCL_GENERATOR = $$PWD/zcl/generator/zclgenerator.py
+ZCL_GENERATED_DIR = $$OUT_PWD/zcl/generated
+INCLUDEPATH += $$OUT_PWD
+
+zclheaders.input = ZCL_DEFINITIONS
+zclheaders.output = $$ZCL_GENERATED_DIR/zigbeecluster${QMAKE_FILE_BASE}.h
+zclheaders.commands = python3 $$ZCL_GENERATOR --header ${QMAKE_FILE_IN} ${QMAKE_FILE_OUT}
+zclheaders.depends = $$ZCL_GENERATOR
+zclheaders.variable_out = ZCL_GENERATED_HEADERS
+zclheaders.CONFIG += target_predeps no_link
+zclheaders.name = ZCL generate header ${QMAKE_FILE_IN}
+
+zclsources.input = ZCL_DEFINITIONS
+zclsources.output = $$ZCL_GENERATED_DIR/zigbeecluster${QMAKE_FILE_BASE}.cpp
+zclsources.commands = python3 $$ZCL_GENERATOR --source ${QMAKE_FILE_IN} ${QMAKE_FILE_OUT}
+zclsources.depends = $$ZCL_GENERATOR
+zclsources.variable_out = SOURCES
+zclsources.name = ZCL generate source ${QMAKE_FILE_IN}
+
+# Note: the generated headers don't exist when qmake runs, so they need their own moc step
+greaterThan(QT_MAJOR_VERSION, 5) {
+    ZCL_MOC = $$[QT_HOST_LIBEXECS]/moc
+} else {
+    ZCL_MOC = $$[QT_HOST_BINS]/moc
+}
+
+zclmoc.input = ZCL_GENERATED_HEADERS
+zclmoc.output = $$ZCL_GENERATED_DIR/moc_${QMAKE_FILE_BASE}.cpp
+zclmoc.commands = $$ZCL_MOC -I$$PWD -I$$OUT_PWD ${QMAKE_FILE_IN} -o ${QMAKE_FILE_OUT}
+zclmoc.variable_out = SOURCES
+zclmoc.name = ZCL moc ${QMAKE_FILE_IN}
+
+QMAKE_EXTRA_COMPILERS += zclheaders zclsources zclmoc
+
+for (definition, ZCL_DEFINITIONS) {
+    name = $$basename(definition)
+    name ~= s/\\.json$//
+    zclgeneratedheaders.files += $$ZCL_GENERATED_DIR/zigbeecluster$${name}.h
+}
+zclgeneratedheaders.path = $$[QT_INSTALL_PREFIX]/include/nymea-zigbee/zcl/generated
+zclgeneratedheaders.CONFIG += no_check_exist
+INSTALLS += zclgeneratedheaders
+
 # install header file with relative subdirectory
 for (header, HEADERS) {
     path = $$[QT_INSTALL_PREFIX]/include/nymea-zigbee/$${dirname(header)}
@@ -32,8 +32,10 @@ Q_LOGGING_CATEGORY(dcZigbeeNode, "ZigbeeNode")
 Q_LOGGING_CATEGORY(dcZigbeeNetwork, "ZigbeeNetwork")
 Q_LOGGING_CATEGORY(dcZigbeeCluster, "ZigbeeCluster")
 Q_LOGGING_CATEGORY(dcZigbeeEndpoint, "ZigbeeEndpoint")
+Q_LOGGING_CATEGORY(dcZigbeeLatency, "ZigbeeLatency")
 Q_LOGGING_CATEGORY(dcZigbeeInterface, "ZigbeeInterface")
 Q_LOGGING_CATEGORY(dcZigbeeController, "ZigbeeController")
+Q_LOGGING_CATEGORY(dcZigbeeGreenPower, "ZigbeeGreenPower")
 Q_LOGGING_CATEGORY(dcZigbeeDeviceObject, "ZigbeeDeviceObject")
 Q_LOGGING_CATEGORY(dcZigbeeAdapterMonitor, "ZigbeeAdapterMonitor")
 Q_LOGGING_CATEGORY(dcZigbeeClusterLibrary, "ZigbeeClusterLibrary")
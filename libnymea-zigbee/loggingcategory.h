@@ -36,8 +36,10 @@ Q_DECLARE_LOGGING_CATEGORY(dcZigbeeNode)
 Q_DECLARE_LOGGING_CATEGORY(dcZigbeeNetwork)
 Q_DECLARE_LOGGING_CATEGORY(dcZigbeeCluster)
 Q_DECLARE_LOGGING_CATEGORY(dcZigbeeEndpoint)
+Q_DECLARE_LOGGING_CATEGORY(dcZigbeeLatency)
 Q_DECLARE_LOGGING_CATEGORY(dcZigbeeInterface)
 Q_DECLARE_LOGGING_CATEGORY(dcZigbeeController)
+Q_DECLARE_LOGGING_CATEGORY(dcZigbeeGreenPower)
 Q_DECLARE_LOGGING_CATEGORY(dcZigbeeDeviceObject)
 Q_DECLARE_LOGGING_CATEGORY(dcZigbeeAdapterMonitor)
 Q_DECLARE_LOGGING_CATEGORY(dcZigbeeClusterLibrary)
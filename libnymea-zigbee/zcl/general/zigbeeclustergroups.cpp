@@ -26,6 +26,10 @@
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "zigbeeclustergroups.h"
+#include "zigbeenetwork.h"
+#include "zigbeenode.h"
+#include "zigbeenodeendpoint.h"
+#include "zigbeebroadcastgovernor.h"
 #include "loggingcategory.h"
 
 #include <QDataStream>
@@ -49,7 +53,15 @@ ZigbeeClusterReply *ZigbeeClusterGroups::addGroup(quint16 groupId, const QString
     for (int i = 0; i < groupName.length(); i++) {
         stream << static_cast<quint8>(groupName.toUtf8().at(i));
     }
-    return executeClusterCommand(ZigbeeClusterGroups::CommandAddGroup, payload);
+    ZigbeeClusterReply *reply = executeClusterCommand(ZigbeeClusterGroups::CommandAddGroup, payload);
+    connect(reply, &ZigbeeClusterReply::finished, this, [this, reply, groupId](){
+        // An existing membership is reported as duplicate, the endpoint is in the group either way
+        quint8 status = responseStatus(reply);
+        if (status == ZigbeeClusterLibrary::StatusSuccess || status == ZigbeeClusterLibrary::StatusDuplicateExists) {
+            m_network->broadcastGovernor()->addGroupMember(groupId, m_node->extendedAddress(), m_endpoint->endpointId());
+        }
+    });
+    return reply;
 }
 
 ZigbeeClusterReply *ZigbeeClusterGroups::viewGroup(quint16 groupId)
@@ -91,12 +103,25 @@ ZigbeeClusterReply *ZigbeeClusterGroups::removeGroup(quint16 groupId)
 #endif
     stream.setByteOrder(QDataStream::LittleEndian);
     stream << groupId;
-    return executeClusterCommand(ZigbeeClusterGroups::CommandRemoveGroup, payload);
+    ZigbeeClusterReply *reply = executeClusterCommand(ZigbeeClusterGroups::CommandRemoveGroup, payload);
+    connect(reply, &ZigbeeClusterReply::finished, this, [this, reply, groupId](){
+        quint8 status = responseStatus(reply);
+        if (status == ZigbeeClusterLibrary::StatusSuccess || status == ZigbeeClusterLibrary::StatusNotFound) {
+            m_network->broadcastGovernor()->removeGroupMember(groupId, m_node->extendedAddress(), m_endpoint->endpointId());
+        }
+    });
+    return reply;
 }
 
 ZigbeeClusterReply *ZigbeeClusterGroups::removeAllGroups()
 {
-    return executeClusterCommand(ZigbeeClusterGroups::CommandRemoveAllGroups);
+    ZigbeeClusterReply *reply = executeClusterCommand(ZigbeeClusterGroups::CommandRemoveAllGroups);
+    connect(reply, &ZigbeeClusterReply::finished, this, [this, reply](){
+        if (reply->error() == ZigbeeClusterReply::ErrorNoError) {
+            m_network->broadcastGovernor()->removeGroupMember(m_node->extendedAddress(), m_endpoint->endpointId());
+        }
+    });
+    return reply;
 }
 
 ZigbeeClusterReply *ZigbeeClusterGroups::addGroupIfIdentifying(quint16 groupId, const QString &groupName)
@@ -112,5 +137,24 @@ ZigbeeClusterReply *ZigbeeClusterGroups::addGroupIfIdentifying(quint16 groupId,
     for (int i = 0; i < groupName.length(); i++) {
         stream << static_cast<quint8>(groupName.toUtf8().at(i));
     }
+    // Memberships added this way are not tracked
+    m_network->broadcastGovernor()->setGroupMembershipUnknown(groupId);
     return executeClusterCommand(ZigbeeClusterGroups::CommandAddGroup, payload);
 }
+
+quint8 ZigbeeClusterGroups::responseStatus(ZigbeeClusterReply *reply)
+{
+    if (reply->error() != ZigbeeClusterReply::ErrorNoError)
+        return ZigbeeClusterLibrary::StatusFailure;
+
+    // The add and remove group responses start with the status, a default response carries it after the command
+    ZigbeeClusterLibrary::Frame frame = reply->responseFrame();
+    int statusIndex = 0;
+    if (frame.header.frameControl.frameType == ZigbeeClusterLibrary::FrameTypeGlobal && frame.header.command == ZigbeeClusterLibrary::CommandDefaultResponse)
+        statusIndex = 1;
+
+    if (frame.payload.length() <= statusIndex)
+        return ZigbeeClusterLibrary::StatusSuccess;
+
+    return static_cast<quint8>(frame.payload.at(statusIndex));
+}
@@ -61,6 +61,9 @@ public:
     ZigbeeClusterReply *removeAllGroups();
     ZigbeeClusterReply *addGroupIfIdentifying(quint16 groupId, const QString &groupName);
 
+private:
+    static quint8 responseStatus(ZigbeeClusterReply *reply);
+
 signals:
 
 
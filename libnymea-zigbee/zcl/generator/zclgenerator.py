@@ -0,0 +1,327 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: LGPL-3.0-or-later
+#
+# nymea-zigbee
+# Zigbee integration module for nymea
+#
+# Copyright (C) 2024 - 2025, chargebyte austria GmbH
+#
+# Generates ZigbeeCluster implementations from a JSON cluster description.
+# Called by qmake for every file in ZCL_DEFINITIONS:
+#
+#     zclgenerator.py --header|--source <definition.json> <output>
+#
+# A definition looks like this:
+#
+# {
+#     "name": "FlowMeasurement",
+#     "clusterId": "ClusterIdFlowMeasurement",
+#     "enums": [ { "name": "Mode", "values": { "ModeOff": "0x00", "ModeOn": "0x01" } } ],
+#     "attributes": [ { "id": "0x0000", "name": "MeasuredValue", "type": "Uint16", "access": [ "read", "report" ], "valueType": "Mode" } ],
+#     "commands": [ { "id": "0x00", "name": "Reset", "parameters": [ { "name": "delay", "type": "Uint16" } ] } ]
+# }
+#
+# The attribute access defaults to read and report, valueType is optional and can be one of the enums.
+# All attributes and command parameters must have a fixed size data type.
+
+import argparse
+import json
+import os
+import re
+import sys
+
+# ZCL data type -> (native type, size), must match ZigbeeDataTypeTraits
+DATA_TYPES = {
+    'Bool': ('bool', 1),
+    'BitMap8': ('quint8', 1),
+    'BitMap16': ('quint16', 2),
+    'BitMap24': ('quint32', 3),
+    'BitMap32': ('quint32', 4),
+    'Enum8': ('quint8', 1),
+    'Enum16': ('quint16', 2),
+    'Uint8': ('quint8', 1),
+    'Uint16': ('quint16', 2),
+    'Uint24': ('quint32', 3),
+    'Uint32': ('quint32', 4),
+    'Uint40': ('quint64', 5),
+    'Uint48': ('quint64', 6),
+    'Uint56': ('quint64', 7),
+    'Uint64': ('quint64', 8),
+    'Int8': ('qint8', 1),
+    'Int16': ('qint16', 2),
+    'Int24': ('qint32', 3),
+    'Int32': ('qint32', 4),
+    'Int40': ('qint64', 5),
+    'Int48': ('qint64', 6),
+    'Int56': ('qint64', 7),
+    'Int64': ('qint64', 8),
+    'FloatSingle': ('float', 4),
+    'FloatDouble': ('double', 8),
+    'UtcTime': ('quint32', 4),
+}
+
+ACCESS_FLAGS = {
+    'read': 'ZigbeeClusterAttributeAccessRead',
+    'write': 'ZigbeeClusterAttributeAccessWrite',
+    'report': 'ZigbeeClusterAttributeAccessReport',
+}
+
+IDENTIFIER = re.compile(r'^[A-Za-z][A-Za-z0-9]*$')
+
+
+class DefinitionError(Exception):
+    pass
+
+
+def lower_first(name):
+    return name[0].lower() + name[1:]
+
+
+def words(name):
+    return re.sub(r'(?<!^)(?=[A-Z])', ' ', name).lower()
+
+
+def hex_value(value, digits):
+    number = int(value, 0) if isinstance(value, str) else int(value)
+    return '0x%0*x' % (digits, number)
+
+
+def load_definition(path):
+    with open(path, 'r', encoding='utf-8') as definition_file:
+        definition = json.load(definition_file)
+
+    for key in ('name', 'clusterId'):
+        if key not in definition or not IDENTIFIER.match(definition[key]):
+            raise DefinitionError('%s: missing or invalid "%s"' % (path, key))
+
+    enums = {}
+    for enum in definition.setdefault('enums', []):
+        if not IDENTIFIER.match(enum.get('name', '')) or not enum.get('values'):
+            raise DefinitionError('%s: invalid enum %s' % (path, enum))
+        enums[enum['name']] = enum
+
+    names = set()
+    for attribute in definition.setdefault('attributes', []):
+        name = attribute.get('name', '')
+        if not IDENTIFIER.match(name) or name in names:
+            raise DefinitionError('%s: invalid or duplicated attribute name "%s"' % (path, name))
+        names.add(name)
+        if attribute.get('type') not in DATA_TYPES:
+            raise DefinitionError('%s: attribute %s has no fixed size data type' % (path, name))
+        for access in attribute.setdefault('access', ['read', 'report']):
+            if access not in ACCESS_FLAGS:
+                raise DefinitionError('%s: attribute %s has an invalid access "%s"' % (path, name, access))
+        value_type = attribute.get('valueType')
+        if value_type is not None and value_type not in enums:
+            raise DefinitionError('%s: attribute %s uses the unknown enum %s' % (path, name, value_type))
+
+    for command in definition.setdefault('commands', []):
+        if not IDENTIFIER.match(command.get('name', '')):
+            raise DefinitionError('%s: invalid command %s' % (path, command))
+        for parameter in command.setdefault('parameters', []):
+            if not IDENTIFIER.match(parameter.get('name', '')) or parameter.get('type') not in DATA_TYPES:
+                raise DefinitionError('%s: invalid parameter %s of command %s' % (path, parameter, command['name']))
+
+    return definition
+
+
+def value_type(attribute, scope=None):
+    if attribute.get('valueType'):
+        return '%s::%s' % (scope, attribute['valueType']) if scope else attribute['valueType']
+
+    return DATA_TYPES[attribute['type']][0]
+
+
+def class_name(definition):
+    return 'ZigbeeCluster' + definition['name']
+
+
+def file_comment(source):
+    return ('// SPDX-License-Identifier: LGPL-3.0-or-later\n'
+            '\n'
+            '// This file has been generated by zclgenerator.py from %s.\n'
+            '// Do not edit, changes will be overwritten.\n' % os.path.basename(source))
+
+
+def generate_header(definition, source):
+    name = class_name(definition)
+    guard = name.upper() + '_H'
+    lines = [file_comment(source),
+             '#ifndef %s' % guard,
+             '#define %s' % guard,
+             '',
+             '#include <QObject>',
+             '',
+             '#include "zcl/zigbeecluster.h"',
+             '#include "zcl/zigbeeclusterreply.h"',
+             '#include "zcl/zigbeeclusterattributedescriptor.h"',
+             '',
+             'class ZigbeeNode;',
+             'class ZigbeeNetwork;',
+             'class ZigbeeNodeEndpoint;',
+             'class ZigbeeNetworkReply;',
+             '',
+             'class %s : public ZigbeeCluster' % name,
+             '{',
+             '    Q_OBJECT',
+             '',
+             '    friend class ZigbeeNode;',
+             '    friend class ZigbeeNetwork;',
+             '',
+             'public:']
+
+    if definition['attributes']:
+        lines.append('    enum Attribute {')
+        lines.append(',\n'.join('        Attribute%s = %s' % (attribute['name'], hex_value(attribute['id'], 4)) for attribute in definition['attributes']))
+        lines += ['    };', '    Q_ENUM(Attribute)', '']
+
+    if definition['commands']:
+        lines.append('    enum Command {')
+        lines.append(',\n'.join('        Command%s = %s' % (command['name'], hex_value(command['id'], 2)) for command in definition['commands']))
+        lines += ['    };', '    Q_ENUM(Command)', '']
+
+    for enum in definition['enums']:
+        lines.append('    enum %s {' % enum['name'])
+        lines.append(',\n'.join('        %s = %s' % (key, hex_value(value, 2)) for key, value in enum['values'].items()))
+        lines += ['    };', '    Q_ENUM(%s)' % enum['name'], '']
+
+    if definition['attributes']:
+        lines.append('    // Attribute schema')
+        for attribute in definition['attributes']:
+            access = ' | '.join(ACCESS_FLAGS[access] for access in attribute['access'])
+            lines.append('    typedef ZigbeeClusterAttributeDescriptor<Attribute%s, Zigbee::%s, %s, %s> %sAttribute;'
+                         % (attribute['name'], attribute['type'], value_type(attribute), access, attribute['name']))
+        lines.append('')
+
+    lines += ['    explicit %s(ZigbeeNetwork *network, ZigbeeNode *node, ZigbeeNodeEndpoint *endpoint, Direction direction, QObject *parent = nullptr);' % name, '']
+
+    for attribute in definition['attributes']:
+        lines.append('    %s %s() const;' % (value_type(attribute), lower_first(attribute['name'])))
+    for attribute in definition['attributes']:
+        if 'write' in attribute['access']:
+            lines.append('    ZigbeeClusterReply *write%s(%s %s);' % (attribute['name'], value_type(attribute), lower_first(attribute['name'])))
+    if definition['attributes']:
+        lines.append('')
+
+    for command in definition['commands']:
+        parameters = ', '.join('%s %s' % (DATA_TYPES[parameter['type']][0], parameter['name']) for parameter in command['parameters'])
+        lines.append('    ZigbeeClusterReply *command%s(%s);' % (command['name'], parameters))
+    if definition['commands']:
+        lines.append('')
+
+    if definition['attributes']:
+        lines.append('signals:')
+        for attribute in definition['attributes']:
+            lines.append('    void %sChanged(%s %s);' % (lower_first(attribute['name']), value_type(attribute), lower_first(attribute['name'])))
+        lines += ['', 'private:']
+        for attribute in definition['attributes']:
+            lines.append('    ZigbeeClusterAttributeValue<%sAttribute> m_%s;' % (attribute['name'], lower_first(attribute['name'])))
+        lines += ['', '    void setAttribute(const ZigbeeClusterAttribute &attribute) override;', '']
+
+    lines += ['};', '', '#endif // %s' % guard, '']
+    return '\n'.join(lines)
+
+
+def generate_source(definition, source):
+    name = class_name(definition)
+    lines = [file_comment(source),
+             '#include "zigbeecluster%s.h"' % definition['name'].lower(),
+             '#include "zigbeenetworkreply.h"',
+             '#include "loggingcategory.h"',
+             '#include "zigbeenetwork.h"',
+             '#include "zigbeenode.h"',
+             '#include "zigbeenodeendpoint.h"',
+             '',
+             '%s::%s(ZigbeeNetwork *network, ZigbeeNode *node, ZigbeeNodeEndpoint *endpoint, Direction direction, QObject *parent) :' % (name, name),
+             '    ZigbeeCluster(network, node, endpoint, ZigbeeClusterLibrary::%s, direction, parent)' % definition['clusterId'],
+             '{',
+             '',
+             '}',
+             '']
+
+    for attribute in definition['attributes']:
+        lines += ['%s %s::%s() const' % (value_type(attribute, name), name, lower_first(attribute['name'])),
+                  '{',
+                  '    return m_%s.value();' % lower_first(attribute['name']),
+                  '}',
+                  '']
+
+    for attribute in definition['attributes']:
+        if 'write' in attribute['access']:
+            lines += ['ZigbeeClusterReply *%s::write%s(%s %s)' % (name, attribute['name'], value_type(attribute), lower_first(attribute['name'])),
+                      '{',
+                      '    return writeAttribute<%sAttribute>(%s);' % (attribute['name'], lower_first(attribute['name'])),
+                      '}',
+                      '']
+
+    for command in definition['commands']:
+        parameters = ', '.join('%s %s' % (DATA_TYPES[parameter['type']][0], parameter['name']) for parameter in command['parameters'])
+        size = sum(DATA_TYPES[parameter['type']][1] for parameter in command['parameters'])
+        lines += ['ZigbeeClusterReply *%s::command%s(%s)' % (name, command['name'], parameters), '{']
+        if command['parameters']:
+            lines += ['    QByteArray payload(%d, 0);' % size,
+                      '    uchar *data = reinterpret_cast<uchar *>(payload.data());']
+            offset = 0
+            for parameter in command['parameters']:
+                native, length = DATA_TYPES[parameter['type']]
+                lines.append('    ZigbeeClusterAttributeCodec::writeBits(ZigbeeClusterAttributeCodec::toBits<%s>(%s), data + %d, %d);' % (native, parameter['name'], offset, length))
+                offset += length
+            lines.append('    return executeClusterCommand(%s::Command%s, payload);' % (name, command['name']))
+        else:
+            lines.append('    return executeClusterCommand(%s::Command%s);' % (name, command['name']))
+        lines += ['}', '']
+
+    if definition['attributes']:
+        lines += ['void %s::setAttribute(const ZigbeeClusterAttribute &attribute)' % name,
+                  '{',
+                  '    ZigbeeCluster::setAttribute(attribute);',
+                  '',
+                  '    switch (attribute.id()) {']
+        for attribute in definition['attributes']:
+            member = 'm_%s' % lower_first(attribute['name'])
+            lines += ['    case Attribute%s:' % attribute['name'],
+                      '        if (%s.update(attribute)) {' % member,
+                      '            qCDebug(dcZigbeeCluster()) << "%s: %s changed on" << m_node << m_endpoint << this << %s.value();' % (definition['name'], words(attribute['name']), member),
+                      '            emit %sChanged(%s.value());' % (lower_first(attribute['name']), member),
+                      '        } else {',
+                      '            qCWarning(dcZigbeeCluster()) << "Failed to parse attribute data" << m_node << m_endpoint << this << attribute;',
+                      '        }',
+                      '        break;']
+        lines += ['    default:',
+                  '        break;',
+                  '    }',
+                  '}',
+                  '']
+
+    return '\n'.join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate a ZigbeeCluster implementation from a JSON cluster description.')
+    mode = parser.add_mutually_exclusive_group(required=True)
+    mode.add_argument('--header', action='store_true', help='generate the header file')
+    mode.add_argument('--source', action='store_true', help='generate the source file')
+    parser.add_argument('definition', help='the JSON cluster description')
+    parser.add_argument('output', help='the file to write')
+    arguments = parser.parse_args()
+
+    try:
+        definition = load_definition(arguments.definition)
+    except (OSError, ValueError, DefinitionError) as error:
+        print('zclgenerator: %s' % error, file=sys.stderr)
+        return 1
+
+    content = generate_header(definition, arguments.definition) if arguments.header else generate_source(definition, arguments.definition)
+
+    output_directory = os.path.dirname(arguments.output)
+    if output_directory:
+        os.makedirs(output_directory, exist_ok=True)
+
+    with open(arguments.output, 'w', encoding='utf-8') as output_file:
+        output_file.write(content)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -215,12 +215,12 @@ ZigbeeClusterReply *ZigbeeClusterColorControl::commandStepColorTemperature(Zigbe
 
 quint16 ZigbeeClusterColorControl::colorTemperatureMireds() const
 {
-    return m_colorTemperatureMireds;
+    return m_colorTemperatureMireds.value();
 }
 
 ZigbeeClusterColorControl::ColorCapabilities ZigbeeClusterColorControl::colorCapabilities() const
 {
-    return m_colorCapabilities;
+    return m_colorCapabilities.value();
 }
 
 void ZigbeeClusterColorControl::processDataIndication(ZigbeeClusterLibrary::Frame frame)
@@ -246,24 +246,18 @@ void ZigbeeClusterColorControl::setAttribute(const ZigbeeClusterAttribute &attri
 
     switch (attribute.id()) {
     case AttributeColorTemperatureMireds: {
-        bool valueOk = false;
-        quint16 value = attribute.dataType().toUInt16(&valueOk);
-        if (valueOk) {
-            m_colorTemperatureMireds = value;
-            qCDebug(dcZigbeeCluster()) << "Color temperature mired changed on" << m_node << m_endpoint << this << m_colorTemperatureMireds;
-            emit colorTemperatureMiredsChanged(m_colorTemperatureMireds);
+        if (m_colorTemperatureMireds.update(attribute)) {
+            qCDebug(dcZigbeeCluster()) << "Color temperature mired changed on" << m_node << m_endpoint << this << m_colorTemperatureMireds.value();
+            emit colorTemperatureMiredsChanged(m_colorTemperatureMireds.value());
         } else {
             qCWarning(dcZigbeeCluster()) << "Failed to parse attribute data"  << m_node << m_endpoint << this << attribute;
         }
         break;
     }
     case AttributeColorCapabilities: {
-        bool valueOk = false;
-        quint16 value = attribute.dataType().toUInt16(&valueOk);
-        if (valueOk) {
-            m_colorCapabilities = static_cast<ZigbeeClusterColorControl::ColorCapabilities>(value);
-            qCDebug(dcZigbeeCluster()) << "Color capabilities changed on" << m_node << m_endpoint << this << m_colorCapabilities;
-            emit colorCapabilitiesChanged(m_colorCapabilities);
+        if (m_colorCapabilities.update(attribute)) {
+            qCDebug(dcZigbeeCluster()) << "Color capabilities changed on" << m_node << m_endpoint << this << m_colorCapabilities.value();
+            emit colorCapabilitiesChanged(m_colorCapabilities.value());
         } else {
             qCWarning(dcZigbeeCluster()) << "Failed to parse attribute data"  << m_node << m_endpoint << this << attribute;
         }
@@ -205,6 +205,10 @@ public:
     };
     Q_ENUM(ColorLoopDirection)
 
+    // Attribute schema
+    typedef ZigbeeClusterAttributeDescriptor<AttributeColorTemperatureMireds, Zigbee::Uint16> ColorTemperatureMiredsAttribute;
+    typedef ZigbeeClusterAttributeDescriptor<AttributeColorCapabilities, Zigbee::BitMap16, ColorCapabilities> ColorCapabilitiesAttribute;
+
     explicit ZigbeeClusterColorControl(ZigbeeNetwork *network, ZigbeeNode *node, ZigbeeNodeEndpoint *endpoint, Direction direction, QObject *parent = nullptr);
 
     ZigbeeClusterReply *commandMoveToHue(quint8 hue, MoveDirection direction, quint16 transitionTime);
@@ -244,8 +248,8 @@ protected:
     void processDataIndication(ZigbeeClusterLibrary::Frame frame) override;
 
 private:
-    quint16 m_colorTemperatureMireds = 0;
-    ColorCapabilities m_colorCapabilities = ColorCapabilities();
+    ZigbeeClusterAttributeValue<ColorTemperatureMiredsAttribute> m_colorTemperatureMireds;
+    ZigbeeClusterAttributeValue<ColorCapabilitiesAttribute> m_colorCapabilities;
 
     void setAttribute(const ZigbeeClusterAttribute &attribute) override;
 
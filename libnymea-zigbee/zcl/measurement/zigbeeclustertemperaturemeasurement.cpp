@@ -62,17 +62,17 @@ ZigbeeClusterReply *ZigbeeClusterTemperatureMeasurement::readMinMaxTemperature()
 
 double ZigbeeClusterTemperatureMeasurement::temperature() const
 {
-    return m_temperature;
+    return m_measuredValue.value() / 100.0;
 }
 
 double ZigbeeClusterTemperatureMeasurement::minTemperature() const
 {
-    return m_minTemperature;
+    return m_minMeasuredValue.value() / 100.0;
 }
 
 double ZigbeeClusterTemperatureMeasurement::maxTemperature() const
 {
-    return m_maxTemperature;
+    return m_maxMeasuredValue.value() / 100.0;
 }
 
 void ZigbeeClusterTemperatureMeasurement::setAttribute(const ZigbeeClusterAttribute &attribute)
@@ -80,32 +80,45 @@ void ZigbeeClusterTemperatureMeasurement::setAttribute(const ZigbeeClusterAttrib
     ZigbeeCluster::setAttribute(attribute);
 
     // Parse the information for convenience
-    if (attribute.id() == AttributeMeasuredValue) {
-        bool valueOk = false;
-        qint16 value = attribute.dataType().toInt16(&valueOk);
-        if (valueOk) {
+    qint16 value = 0;
+    switch (attribute.id()) {
+    case AttributeMeasuredValue:
+        if (MeasuredValueAttribute::decode(attribute.dataType(), &value)) {
             if (value == static_cast<qint16>(0x8000)) {
                 qCDebug(dcZigbeeCluster()) << m_node << m_endpoint << this << "received invalid measurement value. Not updating the attribute.";
                 return;
             }
 
-            m_temperature = value / 100.0;
-            qCDebug(dcZigbeeCluster()) << "Temperature changed on" << m_node << m_endpoint << this << m_temperature << "°C";
-            emit temperatureChanged(m_temperature);
+            m_measuredValue.setValue(value);
+            qCDebug(dcZigbeeCluster()) << "Temperature changed on" << m_node << m_endpoint << this << temperature() << "°C";
+            emit temperatureChanged(temperature());
         }
-    }
-    if (attribute.id() == AttributeMinMeasuredValue) {
-        bool valueOk = false;
-        qint16 value = attribute.dataType().toInt16(&valueOk);
-        if (valueOk) {
+        break;
+    case AttributeMinMeasuredValue:
+        if (MinMeasuredValueAttribute::decode(attribute.dataType(), &value)) {
             if (value == static_cast<qint16>(0x8000)) {
                 qCDebug(dcZigbeeCluster()) << m_node << m_endpoint << this << "received invalid min measurement value. Not updating the attribute.";
                 return;
             }
 
-            m_temperature = value / 100.0;
-            qCDebug(dcZigbeeCluster()) << "Temperature changed on" << m_node << m_endpoint << this << m_temperature << "°C";
-            emit temperatureChanged(m_temperature);
+            m_minMeasuredValue.setValue(value);
+            qCDebug(dcZigbeeCluster()) << "Min temperature changed on" << m_node << m_endpoint << this << minTemperature() << "°C";
+            emit minTemperatureChanged(minTemperature());
+        }
+        break;
+    case AttributeMaxMeasuredValue:
+        if (MaxMeasuredValueAttribute::decode(attribute.dataType(), &value)) {
+            if (value == static_cast<qint16>(0x8000)) {
+                qCDebug(dcZigbeeCluster()) << m_node << m_endpoint << this << "received invalid max measurement value. Not updating the attribute.";
+                return;
+            }
+
+            m_maxMeasuredValue.setValue(value);
+            qCDebug(dcZigbeeCluster()) << "Max temperature changed on" << m_node << m_endpoint << this << maxTemperature() << "°C";
+            emit maxTemperatureChanged(maxTemperature());
         }
+        break;
+    default:
+        break;
     }
 }
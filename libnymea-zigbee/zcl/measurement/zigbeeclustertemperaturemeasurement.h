@@ -54,6 +54,11 @@ public:
     };
     Q_ENUM(Attribute)
 
+    // Attribute schema, values in 0.01 °C
+    typedef ZigbeeClusterAttributeDescriptor<AttributeMeasuredValue, Zigbee::Int16> MeasuredValueAttribute;
+    typedef ZigbeeClusterAttributeDescriptor<AttributeMinMeasuredValue, Zigbee::Int16, qint16, ZigbeeClusterAttributeAccessRead> MinMeasuredValueAttribute;
+    typedef ZigbeeClusterAttributeDescriptor<AttributeMaxMeasuredValue, Zigbee::Int16, qint16, ZigbeeClusterAttributeAccessRead> MaxMeasuredValueAttribute;
+
     explicit ZigbeeClusterTemperatureMeasurement(ZigbeeNetwork *network, ZigbeeNode *node, ZigbeeNodeEndpoint *endpoint, Direction direction, QObject *parent = nullptr);
 
     ZigbeeClusterReply* readTemperature();
@@ -64,9 +69,9 @@ public:
     double maxTemperature() const;
 
 private:
-    double m_temperature = 0;
-    double m_minTemperature = -55.54; // Absolute min/max as per Zigbee spec
-    double m_maxTemperature = 327.67;
+    ZigbeeClusterAttributeValue<MeasuredValueAttribute> m_measuredValue;
+    ZigbeeClusterAttributeValue<MinMeasuredValueAttribute> m_minMeasuredValue{-5554}; // Absolute min/max as per Zigbee spec
+    ZigbeeClusterAttributeValue<MaxMeasuredValueAttribute> m_maxMeasuredValue{32767};
 
     void setAttribute(const ZigbeeClusterAttribute &attribute) override;
 
@@ -32,7 +32,12 @@
 #include "zigbeenetworkreply.h"
 #include "zigbeeclusterlibrary.h"
 #include "zigbeenetworkrequest.h"
+#include "zigbeelatencystatistics.h"
+#include "zigbeemetrics.h"
+#include "zigbeetimerwheel.h"
+#include "zigbeenodemailbox.h"
 
+#include <QPointer>
 #include <QDataStream>
 #include <QMetaEnum>
 
@@ -102,6 +107,35 @@ void ZigbeeCluster::setAttribute(const ZigbeeClusterAttribute &attribute)
     }
 }
 
+ZigbeeClusterAttributeFilter ZigbeeCluster::attributeFilter(quint16 attributeId) const
+{
+    return m_attributeFilters.value(attributeId).filter;
+}
+
+void ZigbeeCluster::setAttributeFilter(quint16 attributeId, const ZigbeeClusterAttributeFilter &filter)
+{
+    if (filter.isNull()) {
+        removeAttributeFilter(attributeId);
+        return;
+    }
+
+    qCDebug(dcZigbeeCluster()) << "Set attribute filter" << m_node << m_endpoint << this << ZigbeeUtils::convertUint16ToHexString(attributeId) << filter;
+    m_attributeFilters[attributeId].filter = filter;
+}
+
+void ZigbeeCluster::removeAttributeFilter(quint16 attributeId)
+{
+    if (!m_attributeFilters.contains(attributeId))
+        return;
+
+    // Apply a held back value, it is the most recent one
+    AttributeFilterState state = m_attributeFilters.take(attributeId);
+    if (state.pendingTimerId != 0) {
+        m_network->timerWheel()->cancel(state.pendingTimerId);
+        setAttribute(state.pendingAttribute);
+    }
+}
+
 ZigbeeClusterReply *ZigbeeCluster::readAttributes(QList<quint16> attributes, quint16 manufacturerCode)
 {
     qCDebug(dcZigbeeCluster()) << "Read attributes from" << m_node << m_endpoint << this << attributes;
@@ -125,7 +159,11 @@ ZigbeeClusterReply *ZigbeeCluster::writeAttributes(QList<ZigbeeClusterLibrary::W
         payload += ZigbeeClusterLibrary::buildWriteAttributeRecord(writeAttributeRecord);
     }
 
-    return executeGlobalCommand(ZigbeeClusterLibrary::CommandWriteAttributes, payload, manufacturerCode);
+    // Keep the records, so the mailbox of sleepy nodes can merge superseded writes
+    ZigbeeClusterReply *zclReply = createGlobalCommandReply(ZigbeeClusterLibrary::CommandWriteAttributes, payload, manufacturerCode, newTransactionSequenceNumber());
+    zclReply->m_writeAttributeRecords = writeAttributeRecords;
+    sendClusterRequest(zclReply);
+    return zclReply;
 }
 
 ZigbeeClusterReply *ZigbeeCluster::configureReporting(QList<ZigbeeClusterLibrary::AttributeReportingConfiguration> reportingConfigurations, quint16 manufacturerCode)
@@ -140,8 +178,32 @@ ZigbeeClusterReply *ZigbeeCluster::configureReporting(QList<ZigbeeClusterLibrary
     return executeGlobalCommand(ZigbeeClusterLibrary::CommandConfigureReporting, payload, manufacturerCode);
 }
 
+ZigbeeClusterReply *ZigbeeCluster::readReportingConfiguration(QList<quint16> attributes, quint16 manufacturerCode)
+{
+    qCDebug(dcZigbeeCluster()) << "Read reporting configuration from" << m_node << m_endpoint << this << attributes;
+
+    QByteArray payload;
+    foreach (quint16 attribute, attributes) {
+        payload += ZigbeeClusterLibrary::buildReadReportingConfigurationRecord(ZigbeeClusterLibrary::ReportingDirectionReporting, attribute);
+    }
+
+    return executeGlobalCommand(ZigbeeClusterLibrary::CommandReadReportingConfiguration, payload, manufacturerCode);
+}
+
+
+ZigbeeClusterReply *ZigbeeCluster::executeGlobalCommand(quint8 command, const QByteArray &payload, quint16 manufacturerCode)
+{
+    return executeGlobalCommand(command, payload, manufacturerCode, newTransactionSequenceNumber());
+}
 
 ZigbeeClusterReply *ZigbeeCluster::executeGlobalCommand(quint8 command, const QByteArray &payload, quint16 manufacturerCode, quint8 transactionSequenceNumber)
+{
+    ZigbeeClusterReply *zclReply = createGlobalCommandReply(command, payload, manufacturerCode, transactionSequenceNumber);
+    sendClusterRequest(zclReply);
+    return zclReply;
+}
+
+ZigbeeClusterReply *ZigbeeCluster::createGlobalCommandReply(quint8 command, const QByteArray &payload, quint16 manufacturerCode, quint8 transactionSequenceNumber)
 {
     // Build the request
     ZigbeeNetworkRequest request = createGeneralRequest();
@@ -181,38 +243,64 @@ ZigbeeClusterReply *ZigbeeCluster::executeGlobalCommand(quint8 command, const QB
     request.setTxOptions(Zigbee::ZigbeeTxOptions(Zigbee::ZigbeeTxOptionAckTransmission));
     request.setAsdu(ZigbeeClusterLibrary::buildFrame(frame));
 
-    ZigbeeClusterReply *zclReply = createClusterReply(request, frame);
-    ZigbeeNetworkReply *networkReply = m_network->sendRequest(request);
-    connect(networkReply, &ZigbeeNetworkReply::finished, zclReply, [this, networkReply, zclReply](){
-        if (!verifyNetworkError(zclReply, networkReply)) {
-            finishZclReply(zclReply);
-            return;
-        }
-
-        // The request was successfully sent to the device
-        // Now check if the expected indication response received already
-        if (zclReply->isComplete()) {
-            finishZclReply(zclReply);
-            return;
-        }
-    });
-
-    return zclReply;
+    return createClusterReply(request, frame);
 }
 
 ZigbeeClusterReply *ZigbeeCluster::createClusterReply(const ZigbeeNetworkRequest &request, ZigbeeClusterLibrary::Frame frame)
 {
+    static ZigbeeMetricCounter *requestsCounter = ZigbeeMetrics::instance()->counter("zigbee_zcl_requests_total", "Number of ZCL requests sent.");
+    requestsCounter->increment();
+
     ZigbeeClusterReply *zclReply = new ZigbeeClusterReply(request, frame, this);
     zclReply->m_transactionSequenceNumber = frame.header.transactionSequenceNumber;
+
+    // Sequence numbers allocated by newTransactionSequenceNumber() are reserved already. Sequence numbers
+    // given by the caller which are in use by another request stay owned by that request.
+    bool reserved = m_allocatedSequenceNumbers.remove(zclReply->transactionSequenceNumber());
+    if (!reserved && !m_node->m_zclSequenceNumbers.reserve(zclReply->transactionSequenceNumber())) {
+        qCWarning(dcZigbeeCluster()) << "The TSN" << ZigbeeUtils::convertByteToHexString(zclReply->transactionSequenceNumber()) << "is already in use by another request on" << m_node << "Responses may get mixed up.";
+    } else {
+        reserved = true;
+    }
+
+    if (m_pendingReplies.contains(zclReply->transactionSequenceNumber())) {
+        qCWarning(dcZigbeeCluster()) << "There is already a pending request with TSN" << ZigbeeUtils::convertByteToHexString(zclReply->transactionSequenceNumber()) << "on" << m_node << m_endpoint << this << "The previous request will not receive the response.";
+    }
+
     m_pendingReplies.insert(zclReply->transactionSequenceNumber(), zclReply);
-    connect(zclReply, &ZigbeeClusterReply::finished, this, [this, zclReply](){
+    connect(zclReply, &ZigbeeClusterReply::finished, this, [this, zclReply, reserved](){
         qCDebug(dcZigbeeCluster()) << "ZCL request to" << zclReply->request().destinationShortAddress() << "finished with status:" << zclReply->error();
         zclReply->deleteLater();
-        m_pendingReplies.remove(zclReply->transactionSequenceNumber());
+        if (m_pendingReplies.value(zclReply->transactionSequenceNumber()) == zclReply) {
+            m_pendingReplies.remove(zclReply->transactionSequenceNumber());
+        }
+
+        if (reserved) {
+            m_node->m_zclSequenceNumbers.release(zclReply->transactionSequenceNumber());
+        }
     });
     return zclReply;
 }
 
+ZigbeeClusterReply *ZigbeeCluster::createResponseReply(const ZigbeeNetworkRequest &request, ZigbeeClusterLibrary::Frame frame)
+{
+    // Responses use the sequence number of the node's request and don't wait for any indication,
+    // so they must not be mixed up with our pending requests
+    ZigbeeClusterReply *zclReply = new ZigbeeClusterReply(request, frame, this);
+    zclReply->m_transactionSequenceNumber = frame.header.transactionSequenceNumber;
+    connect(zclReply, &ZigbeeClusterReply::finished, zclReply, &ZigbeeClusterReply::deleteLater);
+    return zclReply;
+}
+
+void ZigbeeCluster::sendClusterRequest(ZigbeeClusterReply *zclReply)
+{
+    // Requests for sleepy nodes will be held back until the node is awake
+    if (m_node->mailbox()->enqueue(this, zclReply))
+        return;
+
+    transmitClusterRequest(zclReply);
+}
+
 ZigbeeClusterReply *ZigbeeCluster::executeClusterCommand(quint8 command, const QByteArray &payload, ZigbeeClusterLibrary::Direction direction, bool disableDefaultResponse)
 {
     ZigbeeNetworkRequest request = createGeneralRequest();
@@ -240,21 +328,7 @@ ZigbeeClusterReply *ZigbeeCluster::executeClusterCommand(quint8 command, const Q
 
     ZigbeeClusterReply *zclReply = createClusterReply(request, frame);
     qCDebug(dcZigbeeCluster()) << "Executing command" << ZigbeeUtils::convertByteToHexString(command) << ZigbeeUtils::convertByteArrayToHexString(payload);
-    ZigbeeNetworkReply *networkReply = m_network->sendRequest(request);
-    connect(networkReply, &ZigbeeNetworkReply::finished, zclReply, [this, networkReply, zclReply](){
-        if (!verifyNetworkError(zclReply, networkReply)) {
-            finishZclReply(zclReply);
-            return;
-        }
-
-        // The request was successfully sent to the device
-        // Now check if the expected indication response received already
-        if (zclReply->isComplete()) {
-            finishZclReply(zclReply);
-            return;
-        }
-    });
-
+    sendClusterRequest(zclReply);
     return zclReply;
 }
 
@@ -283,7 +357,7 @@ ZigbeeClusterReply *ZigbeeCluster::sendClusterServerResponse(quint8 command, qui
     request.setTxOptions(Zigbee::ZigbeeTxOptions(Zigbee::ZigbeeTxOptionAckTransmission));
     request.setAsdu(ZigbeeClusterLibrary::buildFrame(frame));
 
-    ZigbeeClusterReply *zclReply = createClusterReply(request, frame);
+    ZigbeeClusterReply *zclReply = createResponseReply(request, frame);
     qCDebug(dcZigbeeCluster()) << "Send command response" << ZigbeeUtils::convertByteToHexString(command) << "TSN:" << ZigbeeUtils::convertByteToHexString(transactionSequenceNumber) << ZigbeeUtils::convertByteArrayToHexString(payload);
     ZigbeeNetworkReply *networkReply = m_network->sendRequest(request);
     connect(networkReply, &ZigbeeNetworkReply::finished, zclReply, [this, networkReply, zclReply](){
@@ -329,7 +403,7 @@ ZigbeeClusterReply *ZigbeeCluster::sendDefaultResponse(quint8 transactionSequenc
     request.setTxOptions(Zigbee::ZigbeeTxOptions(Zigbee::ZigbeeTxOptionAckTransmission));
     request.setAsdu(ZigbeeClusterLibrary::buildFrame(frame));
 
-    ZigbeeClusterReply *zclReply = createClusterReply(request, frame);
+    ZigbeeClusterReply *zclReply = createResponseReply(request, frame);
     qCDebug(dcZigbeeCluster()) << "Send default response" << "TSN:" << ZigbeeUtils::convertByteToHexString(transactionSequenceNumber) << ZigbeeUtils::convertByteArrayToHexString(payload);
     ZigbeeNetworkReply *networkReply = m_network->sendRequest(request);
     connect(networkReply, &ZigbeeNetworkReply::finished, zclReply, [this, networkReply, zclReply](){
@@ -345,6 +419,24 @@ ZigbeeClusterReply *ZigbeeCluster::sendDefaultResponse(quint8 transactionSequenc
     return zclReply;
 }
 
+void ZigbeeCluster::transmitClusterRequest(ZigbeeClusterReply *zclReply)
+{
+    ZigbeeNetworkReply *networkReply = m_network->sendRequest(zclReply->request());
+    connect(networkReply, &ZigbeeNetworkReply::finished, zclReply, [this, networkReply, zclReply](){
+        if (!verifyNetworkError(zclReply, networkReply)) {
+            finishZclReply(zclReply);
+            return;
+        }
+
+        // The request was successfully sent to the device
+        // Now check if the expected indication response received already
+        if (zclReply->isComplete()) {
+            finishZclReply(zclReply);
+            return;
+        }
+    });
+}
+
 ZigbeeNetworkRequest ZigbeeCluster::createGeneralRequest()
 {
     // Build the request
@@ -371,7 +463,7 @@ bool ZigbeeCluster::verifyNetworkError(ZigbeeClusterReply *zclReply, ZigbeeNetwo
         qCDebug(dcZigbeeCluster()) << "ZCL request sent. Waiting for response data indication...";
         zclReply->m_apsConfirmReceived = true;
         if (!zclReply->m_zclIndicationReceived) {
-            zclReply->m_timeoutTimer.start();
+            startZclReplyTimeout(zclReply);
         }
         success = true;
         break;
@@ -414,10 +506,95 @@ void ZigbeeCluster::finishZclReply(ZigbeeClusterReply *zclReply)
 {
     qCDebug(dcZigbeeCluster()) << "ZigbeeClusterReply finished" << zclReply->request() << zclReply->requestFrame() << zclReply->responseFrame();
     // FIXME: Set the status
-    zclReply->m_timeoutTimer.stop();
+    m_network->timerWheel()->cancel(zclReply->m_timeoutTimerId);
+    zclReply->m_timeoutTimerId = 0;
     emit zclReply->finished();
 }
 
+void ZigbeeCluster::startZclReplyTimeout(ZigbeeClusterReply *zclReply)
+{
+    m_network->timerWheel()->cancel(zclReply->m_timeoutTimerId);
+    zclReply->m_responseTimer.start();
+    QPointer<ZigbeeClusterReply> replyPointer(zclReply);
+    QPointer<ZigbeeNode> nodePointer(m_node);
+    zclReply->m_timeoutTimerId = m_network->timerWheel()->schedule(m_node->replyTimeout(), [replyPointer, nodePointer](){
+        if (replyPointer.isNull())
+            return;
+
+        if (!nodePointer.isNull())
+            nodePointer->handleResponseTimeout();
+
+        static ZigbeeMetricCounter *timeoutCounter = ZigbeeMetrics::instance()->counter("zigbee_zcl_timeouts_total", "Number of ZCL requests without response.");
+        timeoutCounter->increment();
+        replyPointer->m_timeoutTimerId = 0;
+        replyPointer->m_error = ZigbeeClusterReply::ErrorTimeout;
+        emit replyPointer->finished();
+    });
+}
+
+void ZigbeeCluster::processAttributeReport(const ZigbeeClusterAttribute &attribute)
+{
+    if (!m_attributeFilters.contains(attribute.id())) {
+        setAttribute(attribute);
+        return;
+    }
+
+    AttributeFilterState &state = m_attributeFilters[attribute.id()];
+    if (hasAttribute(attribute.id()) && !state.filter.exceedsDeadBand(m_attributes.value(attribute.id()).dataType(), attribute.dataType())) {
+        // The last value wins, a held back value is outdated now
+        if (state.pendingTimerId != 0) {
+            m_network->timerWheel()->cancel(state.pendingTimerId);
+            state.pendingTimerId = 0;
+        }
+
+        qCDebug(dcZigbeeCluster()) << "Drop attribute report within the dead band" << m_node << m_endpoint << this << attribute;
+        return;
+    }
+
+    qint64 remaining = state.lastUpdate.isValid() ? state.filter.minimumInterval() - state.lastUpdate.elapsed() : 0;
+    if (remaining > 0) {
+        qCDebug(dcZigbeeCluster()) << "Hold back attribute report for" << remaining << "ms" << m_node << m_endpoint << this << attribute;
+        state.pendingAttribute = attribute;
+        if (state.pendingTimerId == 0) {
+            QPointer<ZigbeeCluster> clusterPointer(this);
+            quint16 attributeId = attribute.id();
+            state.pendingTimerId = m_network->timerWheel()->schedule(static_cast<int>(remaining), [clusterPointer, attributeId](){
+                if (!clusterPointer.isNull()) {
+                    clusterPointer->applyPendingAttribute(attributeId);
+                }
+            });
+        }
+        return;
+    }
+
+    applyAttribute(attribute);
+}
+
+void ZigbeeCluster::applyAttribute(const ZigbeeClusterAttribute &attribute)
+{
+    if (m_attributeFilters.contains(attribute.id())) {
+        AttributeFilterState &state = m_attributeFilters[attribute.id()];
+        if (state.pendingTimerId != 0) {
+            m_network->timerWheel()->cancel(state.pendingTimerId);
+            state.pendingTimerId = 0;
+        }
+
+        state.lastUpdate.start();
+    }
+
+    setAttribute(attribute);
+}
+
+void ZigbeeCluster::applyPendingAttribute(quint16 attributeId)
+{
+    if (!m_attributeFilters.contains(attributeId))
+        return;
+
+    AttributeFilterState &state = m_attributeFilters[attributeId];
+    state.pendingTimerId = 0;
+    applyAttribute(state.pendingAttribute);
+}
+
 void ZigbeeCluster::processDataIndication(ZigbeeClusterLibrary::Frame frame)
 {
     // Warn about the unhandled cluster indication, you can override this method in cluster implementations
@@ -427,18 +604,33 @@ void ZigbeeCluster::processDataIndication(ZigbeeClusterLibrary::Frame frame)
 
 quint8 ZigbeeCluster::newTransactionSequenceNumber()
 {
-    static quint8 tsn = 1;
-    return tsn++;
+    // Each node has its own sequence number space, shared by all endpoints and clusters
+    if (m_node->m_zclSequenceNumbers.isFull()) {
+        qCWarning(dcZigbeeCluster()) << "All ZCL transaction sequence numbers for" << m_node << "are in use. Reusing the next one.";
+        return m_node->m_zclSequenceNumbers.allocate();
+    }
+
+    quint8 transactionSequenceNumber = m_node->m_zclSequenceNumbers.allocate();
+    m_allocatedSequenceNumbers.insert(transactionSequenceNumber);
+    return transactionSequenceNumber;
 }
 
 void ZigbeeCluster::processApsDataIndication(const QByteArray &asdu, const ZigbeeClusterLibrary::Frame &frame)
 {
     // Check if this indication is for a pending reply
-    if (m_pendingReplies.contains(frame.header.transactionSequenceNumber)) {
-        ZigbeeClusterReply *reply = m_pendingReplies.value(frame.header.transactionSequenceNumber);
+    // Note: a request from the node might use the same sequence number, only match frames in the opposite direction
+    ZigbeeClusterReply *reply = m_pendingReplies.value(frame.header.transactionSequenceNumber);
+    if (reply && reply->requestFrame().header.frameControl.direction != frame.header.frameControl.direction) {
         reply->m_responseData = asdu;
         reply->m_responseFrame = frame;
         reply->m_zclIndicationReceived = true;
+        static ZigbeeMetricCounter *responsesCounter = ZigbeeMetrics::instance()->counter("zigbee_zcl_responses_total", "Number of ZCL responses matched to a pending request.");
+        responsesCounter->increment();
+        m_network->latencyStatistics()->addSample(ZigbeeLatencyStatistics::PhaseResponse, m_clusterId, m_node->extendedAddress(), reply->m_elapsedTimer.elapsed());
+        // Only responses arriving after the confirmation are valid round trip samples
+        if (reply->m_responseTimer.isValid() && reply->m_timeoutTimerId != 0)
+            m_node->addResponseTimeSample(reply->m_responseTimer.elapsed());
+
         if (reply->isComplete())
             finishZclReply(reply);
 
@@ -451,7 +643,7 @@ void ZigbeeCluster::processApsDataIndication(const QByteArray &asdu, const Zigbe
                 foreach (const ZigbeeClusterLibrary::ReadAttributeStatusRecord &attributeStatusRecord, attributeStatusRecords) {
                     qCDebug(dcZigbeeCluster()) << "Received read attribute status record" << this << attributeStatusRecord;
                     if (attributeStatusRecord.attributeStatus == ZigbeeClusterLibrary::StatusSuccess) {
-                        setAttribute(ZigbeeClusterAttribute(attributeStatusRecord.attributeId, attributeStatusRecord.dataType));
+                        applyAttribute(ZigbeeClusterAttribute(attributeStatusRecord.attributeId, attributeStatusRecord.dataType));
                     } else {
                         qCWarning(dcZigbeeCluster()) << "Reading attribute status record returned an error" << attributeStatusRecord;
                     }
@@ -466,6 +658,9 @@ void ZigbeeCluster::processApsDataIndication(const QByteArray &asdu, const Zigbe
     if (m_direction == Server && frame.header.frameControl.frameType == ZigbeeClusterLibrary::FrameTypeGlobal) {
         ZigbeeClusterLibrary::Command globalCommand = static_cast<ZigbeeClusterLibrary::Command>(frame.header.command);
         if (globalCommand == ZigbeeClusterLibrary::CommandReportAttributes) {
+            static ZigbeeMetricCounter *reportsCounter = ZigbeeMetrics::instance()->counter("zigbee_zcl_attribute_reports_total", "Number of ZCL attribute reports received.");
+            reportsCounter->increment();
+
             // Read the attribute reports and update/set the attributes
             QDataStream stream(frame.payload);
             stream.setByteOrder(QDataStream::LittleEndian);
@@ -474,7 +669,7 @@ void ZigbeeCluster::processApsDataIndication(const QByteArray &asdu, const Zigbe
                 stream >> attributeId >> type;
                 ZigbeeDataType dataType = ZigbeeClusterLibrary::readDataType(&stream, static_cast<Zigbee::DataType>(type));
                 qCDebug(dcZigbeeCluster()) << "Received attributes report" << this << frame;
-                setAttribute(ZigbeeClusterAttribute(attributeId, dataType));
+                processAttributeReport(ZigbeeClusterAttribute(attributeId, dataType));
             }
 
             return;
@@ -28,12 +28,16 @@
 #ifndef ZIGBEECLUSTER_H
 #define ZIGBEECLUSTER_H
 
+#include <QSet>
 #include <QObject>
+#include <QElapsedTimer>
 
 #include "zigbee.h"
 #include "zigbeeclusterreply.h"
 #include "zigbeeclusterlibrary.h"
 #include "zigbeeclusterattribute.h"
+#include "zigbeeclusterattributefilter.h"
+#include "zigbeeclusterattributedescriptor.h"
 
 struct ZigbeeClusterReportConfigurationRecord {
     quint8 direction;
@@ -67,6 +71,7 @@ class ZigbeeCluster : public QObject
     friend class ZigbeeNode;
     friend class ZigbeeNetwork;
     friend class ZigbeeNetworkDatabase;
+    friend class ZigbeeNodeMailbox;
 
 public:
     enum Direction {
@@ -89,19 +94,47 @@ public:
     bool hasAttribute(quint16 attributeId) const;
     ZigbeeClusterAttribute attribute(quint16 attributeId);
 
+    // Filter attribute reports before the attribute gets updated and the change signals are emitted.
+    // Read attribute responses are never filtered.
+    ZigbeeClusterAttributeFilter attributeFilter(quint16 attributeId) const;
+    void setAttributeFilter(quint16 attributeId, const ZigbeeClusterAttributeFilter &filter);
+    void removeAttributeFilter(quint16 attributeId);
+
     // ZCL global commands
     ZigbeeClusterReply *readAttributes(QList<quint16> attributes, quint16 manufacturerCode = 0x0000);
     ZigbeeClusterReply *writeAttributes(QList<ZigbeeClusterLibrary::WriteAttributeRecord> writeAttributeRecords, quint16 manufacturerCode = 0x0000);
     ZigbeeClusterReply *configureReporting(QList<ZigbeeClusterLibrary::AttributeReportingConfiguration> reportingConfigurations, quint16 manufacturerCode = 0x0000);
+    ZigbeeClusterReply *readReportingConfiguration(QList<quint16> attributes, quint16 manufacturerCode = 0x0000);
+
+    // Typed attribute access using a ZigbeeClusterAttributeDescriptor
+    template <typename Descriptor>
+    ZigbeeClusterReply *readAttribute(quint16 manufacturerCode = 0x0000)
+    {
+        static_assert(Descriptor::readable(), "The attribute is not readable");
+        return readAttributes({Descriptor::id()}, manufacturerCode);
+    }
+
+    template <typename Descriptor>
+    ZigbeeClusterReply *writeAttribute(typename Descriptor::ValueType value, quint16 manufacturerCode = 0x0000)
+    {
+        static_assert(Descriptor::writable(), "The attribute is not writable");
+        ZigbeeClusterLibrary::WriteAttributeRecord record;
+        record.attributeId = Descriptor::id();
+        record.dataType = Descriptor::dataType();
+        record.data = Descriptor::encode(value).data();
+        return writeAttributes({record}, manufacturerCode);
+    }
 
     // Helper methods for sending cluster specific commands
     ZigbeeNetworkRequest createGeneralRequest();
 
     // Global commands
-    ZigbeeClusterReply *executeGlobalCommand(quint8 command, const QByteArray &payload = QByteArray(), quint16 manufacturerCode = 0x0000, quint8 transactionSequenceNumber = newTransactionSequenceNumber());
+    ZigbeeClusterReply *executeGlobalCommand(quint8 command, const QByteArray &payload = QByteArray(), quint16 manufacturerCode = 0x0000);
+    ZigbeeClusterReply *executeGlobalCommand(quint8 command, const QByteArray &payload, quint16 manufacturerCode, quint8 transactionSequenceNumber);
 
     // Cluster specific
     ZigbeeClusterReply *createClusterReply(const ZigbeeNetworkRequest &request, ZigbeeClusterLibrary::Frame frame);
+    void sendClusterRequest(ZigbeeClusterReply *zclReply);
     ZigbeeClusterReply *executeClusterCommand(quint8 command, const QByteArray &payload = QByteArray(), ZigbeeClusterLibrary::Direction direction = ZigbeeClusterLibrary::DirectionClientToServer, bool disableDefaultResponse = false);
 
     ZigbeeClusterReply *sendClusterServerResponse(quint8 command, quint8 transactionSequenceNumber, const QByteArray &payload = QByteArray());
@@ -109,6 +142,7 @@ public:
 
     bool verifyNetworkError(ZigbeeClusterReply *zclReply, ZigbeeNetworkReply *networkReply);
     void finishZclReply(ZigbeeClusterReply *zclReply);
+    void startZclReplyTimeout(ZigbeeClusterReply *zclReply);
 
 protected:
     ZigbeeNetwork *m_network = nullptr;
@@ -125,7 +159,28 @@ protected:
 
     virtual void setAttribute(const ZigbeeClusterAttribute &attribute);
 
-    static quint8 newTransactionSequenceNumber();
+    quint8 newTransactionSequenceNumber();
+
+private:
+    typedef struct AttributeFilterState {
+        ZigbeeClusterAttributeFilter filter;
+        QElapsedTimer lastUpdate;
+        ZigbeeClusterAttribute pendingAttribute;
+        quint32 pendingTimerId = 0;
+    } AttributeFilterState;
+
+    QHash<quint16, AttributeFilterState> m_attributeFilters;
+
+    // Allocated by newTransactionSequenceNumber() and not yet taken over by a reply
+    QSet<quint8> m_allocatedSequenceNumbers;
+
+    void processAttributeReport(const ZigbeeClusterAttribute &attribute);
+    void applyAttribute(const ZigbeeClusterAttribute &attribute);
+    void applyPendingAttribute(quint16 attributeId);
+
+    ZigbeeClusterReply *createGlobalCommandReply(quint8 command, const QByteArray &payload, quint16 manufacturerCode, quint8 transactionSequenceNumber);
+    ZigbeeClusterReply *createResponseReply(const ZigbeeNetworkRequest &request, ZigbeeClusterLibrary::Frame frame);
+    void transmitClusterRequest(ZigbeeClusterReply *zclReply);
 
 signals:
     void attributeChanged(const ZigbeeClusterAttribute &attribute);
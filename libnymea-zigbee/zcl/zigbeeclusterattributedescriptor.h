@@ -0,0 +1,237 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEECLUSTERATTRIBUTEDESCRIPTOR_H
+#define ZIGBEECLUSTERATTRIBUTEDESCRIPTOR_H
+
+#include <cstring>
+#include <type_traits>
+
+#include "zigbee.h"
+#include "zigbeedatatype.h"
+#include "zigbeeclusterattribute.h"
+
+// Compile time description of cluster attributes. A descriptor knows the attribute id, the ZCL data type,
+// the native C++ type and the access of an attribute and decodes/encodes the raw attribute data
+// directly from/into the native type without QDataStream or intermediate copies.
+//
+//     typedef ZigbeeClusterAttributeDescriptor<AttributeMeasuredValue, Zigbee::Int16> MeasuredValue;
+//     ZigbeeClusterAttributeValue<MeasuredValue> m_measuredValue;
+
+enum ZigbeeClusterAttributeAccess {
+    ZigbeeClusterAttributeAccessRead = 0x01,
+    ZigbeeClusterAttributeAccessWrite = 0x02,
+    ZigbeeClusterAttributeAccessReport = 0x04
+};
+
+// Native type and size on the air of the fixed size ZCL data types
+template <typename Native, int Size>
+struct ZigbeeDataTypeStorage
+{
+    typedef Native NativeType;
+    static constexpr int size() { return Size; }
+};
+
+template <Zigbee::DataType Type> struct ZigbeeDataTypeTraits;
+template <> struct ZigbeeDataTypeTraits<Zigbee::Bool> : ZigbeeDataTypeStorage<bool, 1> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::BitMap8> : ZigbeeDataTypeStorage<quint8, 1> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::BitMap16> : ZigbeeDataTypeStorage<quint16, 2> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::BitMap24> : ZigbeeDataTypeStorage<quint32, 3> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::BitMap32> : ZigbeeDataTypeStorage<quint32, 4> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Enum8> : ZigbeeDataTypeStorage<quint8, 1> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Enum16> : ZigbeeDataTypeStorage<quint16, 2> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Uint8> : ZigbeeDataTypeStorage<quint8, 1> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Uint16> : ZigbeeDataTypeStorage<quint16, 2> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Uint24> : ZigbeeDataTypeStorage<quint32, 3> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Uint32> : ZigbeeDataTypeStorage<quint32, 4> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Uint40> : ZigbeeDataTypeStorage<quint64, 5> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Uint48> : ZigbeeDataTypeStorage<quint64, 6> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Uint56> : ZigbeeDataTypeStorage<quint64, 7> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Uint64> : ZigbeeDataTypeStorage<quint64, 8> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Int8> : ZigbeeDataTypeStorage<qint8, 1> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Int16> : ZigbeeDataTypeStorage<qint16, 2> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Int24> : ZigbeeDataTypeStorage<qint32, 3> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Int32> : ZigbeeDataTypeStorage<qint32, 4> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Int40> : ZigbeeDataTypeStorage<qint64, 5> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Int48> : ZigbeeDataTypeStorage<qint64, 6> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Int56> : ZigbeeDataTypeStorage<qint64, 7> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::Int64> : ZigbeeDataTypeStorage<qint64, 8> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::FloatSingle> : ZigbeeDataTypeStorage<float, 4> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::FloatDouble> : ZigbeeDataTypeStorage<double, 8> {};
+template <> struct ZigbeeDataTypeTraits<Zigbee::UtcTime> : ZigbeeDataTypeStorage<quint32, 4> {};
+
+class ZigbeeClusterAttributeCodec
+{
+public:
+    // Little endian raw data to native value, signed values get sign extended
+    template <typename Native>
+    static Native fromBits(quint64 bits, int size)
+    {
+        if (std::is_signed<Native>::value && size < 8 && ((bits >> (8 * size - 1)) & 1))
+            bits |= ~Q_UINT64_C(0) << (8 * size);
+
+        return static_cast<Native>(bits);
+    }
+
+    template <typename Native>
+    static quint64 toBits(Native value)
+    {
+        return static_cast<quint64>(value);
+    }
+
+    static quint64 readBits(const uchar *data, int size)
+    {
+        quint64 bits = 0;
+        for (int i = 0; i < size; i++)
+            bits |= static_cast<quint64>(data[i]) << (8 * i);
+
+        return bits;
+    }
+
+    static void writeBits(quint64 bits, uchar *data, int size)
+    {
+        for (int i = 0; i < size; i++)
+            data[i] = static_cast<uchar>(bits >> (8 * i));
+    }
+};
+
+template <>
+inline float ZigbeeClusterAttributeCodec::fromBits<float>(quint64 bits, int size)
+{
+    Q_UNUSED(size)
+    quint32 floatBits = static_cast<quint32>(bits);
+    float value = 0;
+    std::memcpy(&value, &floatBits, sizeof(value));
+    return value;
+}
+
+template <>
+inline double ZigbeeClusterAttributeCodec::fromBits<double>(quint64 bits, int size)
+{
+    Q_UNUSED(size)
+    double value = 0;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+template <>
+inline quint64 ZigbeeClusterAttributeCodec::toBits<float>(float value)
+{
+    quint32 floatBits = 0;
+    std::memcpy(&floatBits, &value, sizeof(value));
+    return floatBits;
+}
+
+template <>
+inline quint64 ZigbeeClusterAttributeCodec::toBits<double>(double value)
+{
+    quint64 bits = 0;
+    std::memcpy(&bits, &value, sizeof(value));
+    return bits;
+}
+
+// The value type defaults to the native type of the data type, it can be an enum or flags type as well
+template <quint16 Id, Zigbee::DataType Type, typename T = typename ZigbeeDataTypeTraits<Type>::NativeType, int Access = ZigbeeClusterAttributeAccessRead | ZigbeeClusterAttributeAccessReport>
+class ZigbeeClusterAttributeDescriptor
+{
+public:
+    typedef T ValueType;
+    typedef typename ZigbeeDataTypeTraits<Type>::NativeType NativeType;
+
+    static constexpr quint16 id() { return Id; }
+    static constexpr Zigbee::DataType dataType() { return Type; }
+    static constexpr int size() { return ZigbeeDataTypeTraits<Type>::size(); }
+    static constexpr int access() { return Access; }
+
+    static constexpr bool readable() { return (Access & ZigbeeClusterAttributeAccessRead) != 0; }
+    static constexpr bool writable() { return (Access & ZigbeeClusterAttributeAccessWrite) != 0; }
+    static constexpr bool reportable() { return (Access & ZigbeeClusterAttributeAccessReport) != 0; }
+
+    // Note: the data is implicitly shared, decoding does not copy it. Only the size is verified,
+    // some devices report a wrong data type with the correct size.
+    static bool decode(const ZigbeeDataType &dataType, ValueType *value)
+    {
+        const QByteArray &data = dataType.data();
+        if (data.size() != size())
+            return false;
+
+        quint64 bits = ZigbeeClusterAttributeCodec::readBits(reinterpret_cast<const uchar *>(data.constData()), size());
+        *value = static_cast<ValueType>(ZigbeeClusterAttributeCodec::fromBits<NativeType>(bits, size()));
+        return true;
+    }
+
+    static ZigbeeDataType encode(ValueType value)
+    {
+        QByteArray data(size(), 0);
+        ZigbeeClusterAttributeCodec::writeBits(ZigbeeClusterAttributeCodec::toBits<NativeType>(static_cast<NativeType>(value)), reinterpret_cast<uchar *>(data.data()), size());
+        return ZigbeeDataType(Type, data);
+    }
+};
+
+// Holds the decoded native value of one attribute
+template <typename Descriptor>
+class ZigbeeClusterAttributeValue
+{
+public:
+    typedef typename Descriptor::ValueType ValueType;
+
+    explicit ZigbeeClusterAttributeValue(ValueType defaultValue = ValueType()) :
+        m_value(defaultValue)
+    {
+
+    }
+
+    const ValueType &value() const { return m_value; }
+    bool isValid() const { return m_valid; }
+
+    void setValue(ValueType value)
+    {
+        m_value = value;
+        m_valid = true;
+    }
+
+    // Returns true if the attribute belongs to this descriptor and could be decoded
+    bool update(const ZigbeeClusterAttribute &attribute)
+    {
+        if (attribute.id() != Descriptor::id())
+            return false;
+
+        ValueType value = ValueType();
+        if (!Descriptor::decode(attribute.dataType(), &value))
+            return false;
+
+        setValue(value);
+        return true;
+    }
+
+private:
+    ValueType m_value;
+    bool m_valid = false;
+};
+
+#endif // ZIGBEECLUSTERATTRIBUTEDESCRIPTOR_H
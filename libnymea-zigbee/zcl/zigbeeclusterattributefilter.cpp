@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeeclusterattributefilter.h"
+
+ZigbeeClusterAttributeFilter::ZigbeeClusterAttributeFilter()
+{
+
+}
+
+double ZigbeeClusterAttributeFilter::absoluteDeadBand() const
+{
+    return m_absoluteDeadBand;
+}
+
+void ZigbeeClusterAttributeFilter::setAbsoluteDeadBand(double absoluteDeadBand)
+{
+    m_absoluteDeadBand = qMax(0.0, absoluteDeadBand);
+}
+
+double ZigbeeClusterAttributeFilter::relativeDeadBand() const
+{
+    return m_relativeDeadBand;
+}
+
+void ZigbeeClusterAttributeFilter::setRelativeDeadBand(double relativeDeadBand)
+{
+    m_relativeDeadBand = qMax(0.0, relativeDeadBand);
+}
+
+int ZigbeeClusterAttributeFilter::minimumInterval() const
+{
+    return m_minimumInterval;
+}
+
+void ZigbeeClusterAttributeFilter::setMinimumInterval(int minimumInterval)
+{
+    m_minimumInterval = qMax(0, minimumInterval);
+}
+
+bool ZigbeeClusterAttributeFilter::isNull() const
+{
+    return m_absoluteDeadBand <= 0 && m_relativeDeadBand <= 0 && m_minimumInterval <= 0;
+}
+
+bool ZigbeeClusterAttributeFilter::exceedsDeadBand(const ZigbeeDataType &currentValue, const ZigbeeDataType &value) const
+{
+    // Without a dead band unchanged values are periodic reports and must pass, i.e. as heartbeat
+    if (m_absoluteDeadBand <= 0 && m_relativeDeadBand <= 0)
+        return true;
+
+    if (currentValue.dataType() != value.dataType())
+        return true;
+
+    double current = 0; double next = 0;
+    if (!numericValue(currentValue, &current) || !numericValue(value, &next))
+        return currentValue.data() != value.data();
+
+    double change = qAbs(next - current);
+    if (m_absoluteDeadBand > 0 && change <= m_absoluteDeadBand)
+        return false;
+
+    if (m_relativeDeadBand > 0 && change <= qAbs(current) * m_relativeDeadBand)
+        return false;
+
+    return change > 0;
+}
+
+bool ZigbeeClusterAttributeFilter::numericValue(const ZigbeeDataType &dataType, double *value)
+{
+    bool ok = false;
+    switch (dataType.dataType()) {
+    case Zigbee::Uint8:
+        *value = dataType.toUInt8(&ok);
+        break;
+    case Zigbee::Uint16:
+        *value = dataType.toUInt16(&ok);
+        break;
+    case Zigbee::Uint24:
+    case Zigbee::Uint32:
+        *value = dataType.toUInt32(&ok);
+        break;
+    case Zigbee::Uint40:
+    case Zigbee::Uint48:
+    case Zigbee::Uint56:
+    case Zigbee::Uint64:
+        *value = dataType.toUInt64(&ok);
+        break;
+    case Zigbee::Int8:
+        *value = dataType.toInt8(&ok);
+        break;
+    case Zigbee::Int16:
+        *value = dataType.toInt16(&ok);
+        break;
+    case Zigbee::Int24:
+    case Zigbee::Int32:
+        *value = dataType.toInt32(&ok);
+        break;
+    case Zigbee::Int40:
+    case Zigbee::Int48:
+    case Zigbee::Int56:
+    case Zigbee::Int64:
+        *value = dataType.toInt64(&ok);
+        break;
+    case Zigbee::FloatSemi:
+    case Zigbee::FloatSingle:
+    case Zigbee::FloatDouble:
+        *value = dataType.toDouble(&ok);
+        break;
+    default:
+        break;
+    }
+
+    return ok;
+}
+
+bool ZigbeeClusterAttributeFilter::operator==(const ZigbeeClusterAttributeFilter &other) const
+{
+    return qFuzzyCompare(1 + m_absoluteDeadBand, 1 + other.absoluteDeadBand()) &&
+            qFuzzyCompare(1 + m_relativeDeadBand, 1 + other.relativeDeadBand()) &&
+            m_minimumInterval == other.minimumInterval();
+}
+
+bool ZigbeeClusterAttributeFilter::operator!=(const ZigbeeClusterAttributeFilter &other) const
+{
+    return !operator==(other);
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeClusterAttributeFilter &filter)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "AttributeFilter(absolute: " << filter.absoluteDeadBand();
+    debug.nospace() << ", relative: " << filter.relativeDeadBand();
+    debug.nospace() << ", interval: " << filter.minimumInterval() << "ms)";
+    return debug;
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEECLUSTERATTRIBUTEFILTER_H
+#define ZIGBEECLUSTERATTRIBUTEFILTER_H
+
+#include <QDebug>
+
+#include "zigbeedatatype.h"
+
+// Describes how attribute reports of one attribute will be filtered before they get applied to the cluster.
+// Many devices ignore the reportable change of the reporting configuration and report every tiny change.
+
+class ZigbeeClusterAttributeFilter
+{
+public:
+    ZigbeeClusterAttributeFilter();
+
+    // Changes smaller or equal to this value will be dropped, 0 disables the absolute dead band
+    double absoluteDeadBand() const;
+    void setAbsoluteDeadBand(double absoluteDeadBand);
+
+    // Changes smaller or equal to this fraction of the current value will be dropped, i.e. 0.05 for 5 %
+    double relativeDeadBand() const;
+    void setRelativeDeadBand(double relativeDeadBand);
+
+    // Minimum time between two applied values in ms. Values arriving earlier will be held back
+    // and only the last one will be applied once the interval is over.
+    int minimumInterval() const;
+    void setMinimumInterval(int minimumInterval);
+
+    bool isNull() const;
+
+    // Returns true if the new value differs enough from the current one. If both dead bands are set, both must be exceeded.
+    // Non numeric values pass if they differ from the current one. Without any dead band every value passes.
+    bool exceedsDeadBand(const ZigbeeDataType &currentValue, const ZigbeeDataType &value) const;
+
+    static bool numericValue(const ZigbeeDataType &dataType, double *value);
+
+    bool operator==(const ZigbeeClusterAttributeFilter &other) const;
+    bool operator!=(const ZigbeeClusterAttributeFilter &other) const;
+
+private:
+    double m_absoluteDeadBand = 0;
+    double m_relativeDeadBand = 0;
+    int m_minimumInterval = 0;
+};
+
+QDebug operator<<(QDebug debug, const ZigbeeClusterAttributeFilter &filter);
+
+#endif // ZIGBEECLUSTERATTRIBUTEFILTER_H
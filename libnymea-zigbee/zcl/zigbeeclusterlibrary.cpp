@@ -325,6 +325,69 @@ QList<ZigbeeClusterLibrary::AttributeReportingStatusRecord> ZigbeeClusterLibrary
     return statusRecords;
 }
 
+QByteArray ZigbeeClusterLibrary::buildReadReportingConfigurationRecord(ReportingDirection direction, quint16 attributeId)
+{
+    QByteArray payload;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    QDataStream stream(&payload, QDataStream::WriteOnly);
+#else
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+#endif
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << static_cast<quint8>(direction);
+    stream << attributeId;
+    return payload;
+}
+
+QList<ZigbeeClusterLibrary::ReadReportingConfigurationRecord> ZigbeeClusterLibrary::parseReadReportingConfigurationRecords(const QByteArray &payload)
+{
+    QList<ZigbeeClusterLibrary::ReadReportingConfigurationRecord> records;
+    QDataStream stream(payload);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    while (!stream.atEnd()) {
+        ZigbeeClusterLibrary::ReadReportingConfigurationRecord record;
+        quint8 status = 0; quint8 direction = 0;
+        stream >> status >> direction >> record.configuration.attributeId;
+        record.status = static_cast<ZigbeeClusterLibrary::Status>(status);
+        record.configuration.direction = static_cast<ReportingDirection>(direction);
+
+        // Note: the configuration is only included on success
+        if (record.status == ZigbeeClusterLibrary::StatusSuccess) {
+            if (record.configuration.direction == ReportingDirectionReporting) {
+                quint8 dataType = 0;
+                stream >> dataType >> record.configuration.minReportingInterval >> record.configuration.maxReportingInterval;
+                record.configuration.dataType = static_cast<Zigbee::DataType>(dataType);
+                if (isAnalogDataType(record.configuration.dataType)) {
+                    for (int i = 0; i < ZigbeeDataType::typeLength(record.configuration.dataType); i++) {
+                        quint8 byte = 0;
+                        stream >> byte;
+                        record.configuration.reportableChange.append(static_cast<char>(byte));
+                    }
+                }
+            } else {
+                stream >> record.configuration.timeoutPeriod;
+            }
+        }
+
+        if (stream.status() != QDataStream::Ok) {
+            qCWarning(dcZigbeeClusterLibrary()) << "Failed to parse read reporting configuration records" << ZigbeeUtils::convertByteArrayToHexString(payload);
+            break;
+        }
+
+        records.append(record);
+    }
+
+    return records;
+}
+
+bool ZigbeeClusterLibrary::isAnalogDataType(Zigbee::DataType dataType)
+{
+    // Unsigned and signed integers, floats and time
+    return (dataType >= Zigbee::Uint8 && dataType <= Zigbee::Int64)
+            || (dataType >= Zigbee::FloatSemi && dataType <= Zigbee::FloatDouble)
+            || (dataType >= Zigbee::TimeOfDay && dataType <= Zigbee::UtcTime);
+}
+
 QDebug operator<<(QDebug debug, const ZigbeeClusterLibrary::FrameControl &frameControl)
 {
     QDebugStateSaver saver(debug);
@@ -408,3 +471,11 @@ QDebug operator<<(QDebug debug, const ZigbeeClusterLibrary::AttributeReportingSt
     return debug;
 
 }
+
+QDebug operator<<(QDebug debug, const ZigbeeClusterLibrary::ReadReportingConfigurationRecord &readReportingConfigurationRecord)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "ReadReportingConfigurationRecord(" << readReportingConfigurationRecord.status << ", ";
+    debug.nospace() << readReportingConfigurationRecord.configuration << ")";
+    return debug;
+}
@@ -281,6 +281,12 @@ public:
         quint16 attributeId = 0x0000;
     } AttributeReportingStatusRecord;
 
+    // Response of read reporting configuration
+    typedef struct ReadReportingConfigurationRecord {
+        ZigbeeClusterLibrary::Status status = ZigbeeClusterLibrary::StatusSuccess;
+        AttributeReportingConfiguration configuration;
+    } ReadReportingConfigurationRecord;
+
 
     // General parse/build methods
     static quint8 buildFrameControlByte(const FrameControl &frameControl);
@@ -299,10 +305,15 @@ public:
     // AttributeReportingConfiguration
     static QByteArray buildAttributeReportingConfiguration(const AttributeReportingConfiguration &reportingConfiguration);
     static QByteArray buildWriteAttributeRecord(const WriteAttributeRecord &writeAttributeRecord);
-    // TODO: parseAttributeReportingConfiguration
 
     static QList<AttributeReportingStatusRecord> parseAttributeReportingStatusRecords(const QByteArray &payload);
 
+    static QByteArray buildReadReportingConfigurationRecord(ReportingDirection direction, quint16 attributeId);
+    static QList<ReadReportingConfigurationRecord> parseReadReportingConfigurationRecords(const QByteArray &payload);
+
+    // Only analog data types have a reportable change
+    static bool isAnalogDataType(Zigbee::DataType dataType);
+
 };
 
 QDebug operator<<(QDebug debug, const ZigbeeClusterLibrary::FrameControl &frameControl);
@@ -311,6 +322,7 @@ QDebug operator<<(QDebug debug, const ZigbeeClusterLibrary::Frame &frame);
 QDebug operator<<(QDebug debug, const ZigbeeClusterLibrary::ReadAttributeStatusRecord &attributeStatusRecord);
 QDebug operator<<(QDebug debug, const ZigbeeClusterLibrary::AttributeReportingConfiguration &attributeReportingConfiguration);
 QDebug operator<<(QDebug debug, const ZigbeeClusterLibrary::AttributeReportingStatusRecord &attributeReportingStatusRecord);
+QDebug operator<<(QDebug debug, const ZigbeeClusterLibrary::ReadReportingConfigurationRecord &readReportingConfigurationRecord);
 
 
 #endif // ZIGBEECLUSTERLIBRARY_H
@@ -30,6 +30,7 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QElapsedTimer>
 
 #include "zigbeenetworkrequest.h"
 #include "zigbeeclusterlibrary.h"
@@ -39,6 +40,7 @@ class ZigbeeClusterReply : public QObject
     Q_OBJECT
 
     friend class ZigbeeCluster;
+    friend class ZigbeeNodeMailbox;
 
 public:
     enum Error {
@@ -74,12 +76,15 @@ private:
 
     Error m_error = ErrorNoError;
 
-    QTimer m_timeoutTimer;
+    quint32 m_timeoutTimerId = 0;
+    QElapsedTimer m_elapsedTimer;
+    QElapsedTimer m_responseTimer; // Started once the request has been confirmed
 
     // Request
     quint8 m_transactionSequenceNumber = 0;
     ZigbeeNetworkRequest m_request;
     ZigbeeClusterLibrary::Frame m_requestFrame;
+    QList<ZigbeeClusterLibrary::WriteAttributeRecord> m_writeAttributeRecords;
 
     // Response
     bool m_apsConfirmReceived = false;
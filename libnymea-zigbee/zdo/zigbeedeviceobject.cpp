@@ -30,6 +30,7 @@
 #include "loggingcategory.h"
 #include "zigbeedeviceprofile.h"
 #include "zigbeeutils.h"
+#include "zigbeetimerwheel.h"
 
 #include <QDataStream>
 #include <QPointer>
@@ -680,6 +681,49 @@ ZigbeeDeviceObjectReply *ZigbeeDeviceObject::requestMgmtRtg(quint8 startIndex)
 
 }
 
+ZigbeeDeviceObjectReply *ZigbeeDeviceObject::requestMgmtNetworkUpdate(const ZigbeeChannelMask &scanChannels, quint8 scanDuration, quint8 scanCount)
+{
+    qCDebug(dcZigbeeDeviceObject()) << "Requesting energy scan from" << m_node << scanChannels << "duration" << scanDuration << "count" << scanCount;
+
+    // Build APS request
+    ZigbeeNetworkRequest request = buildZdoRequest(ZigbeeDeviceProfile::MgmtNetworkUpdateRequest);
+
+    // Generate a new transaction sequence number for this device object
+    quint8 transactionSequenceNumber = m_transactionSequenceNumber++;
+
+    // Note: only scan durations 0x00 - 0x05 request an energy scan, which will be answered with an update notification
+    QByteArray asdu;
+    QDataStream stream(&asdu, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << transactionSequenceNumber << scanChannels.toUInt32() << qMin(scanDuration, static_cast<quint8>(0x05)) << scanCount;
+
+    // Set the ZDO frame as APS request payload
+    request.setAsdu(asdu);
+
+    // Create the device object reply and wait for the response indication
+    ZigbeeDeviceObjectReply *zdoReply = createZigbeeDeviceObjectReply(request, transactionSequenceNumber);
+
+    // Send the request, on finished read the confirm information
+    ZigbeeNetworkReply *networkReply = m_network->sendRequest(request);
+    connect(networkReply, &ZigbeeNetworkReply::finished, zdoReply, [this, networkReply, zdoReply](){
+        if (!verifyNetworkError(zdoReply, networkReply)) {
+            finishZdoReply(zdoReply);
+            return;
+        }
+
+        // The request was successfully sent to the device
+        // Now check if the expected indication response received already
+        if (zdoReply->isComplete()) {
+            qCDebug(dcZigbeeDeviceObject()) << "Successfully received response for" << static_cast<ZigbeeDeviceProfile::ZdoCommand>(networkReply->request().clusterId());
+            finishZdoReply(zdoReply);
+            return;
+        }
+        // We received the confirmation but not yet the indication
+    });
+
+    return zdoReply;
+}
+
 ZigbeeNetworkRequest ZigbeeDeviceObject::buildZdoRequest(quint16 zdoRequest)
 {
     ZigbeeNetworkRequest request;
@@ -718,7 +762,7 @@ bool ZigbeeDeviceObject::verifyNetworkError(ZigbeeDeviceObjectReply *zdoReply, Z
         // wait for the expected indication or check if we already recieved it
         zdoReply->m_apsConfirmReceived = true;
         if (!zdoReply->m_zdpIndicationReceived) {
-            zdoReply->m_timeoutTimer.start();
+            startZdoReplyTimeout(zdoReply);
         }
         success = true;
         break;
@@ -770,10 +814,30 @@ void ZigbeeDeviceObject::finishZdoReply(ZigbeeDeviceObjectReply *zdoReply)
         break;
     }
 
-    zdoReply->m_timeoutTimer.stop();
+    m_network->timerWheel()->cancel(zdoReply->m_timeoutTimerId);
+    zdoReply->m_timeoutTimerId = 0;
     zdoReply->finished();
 }
 
+void ZigbeeDeviceObject::startZdoReplyTimeout(ZigbeeDeviceObjectReply *zdoReply)
+{
+    m_network->timerWheel()->cancel(zdoReply->m_timeoutTimerId);
+    zdoReply->m_responseTimer.start();
+    QPointer<ZigbeeDeviceObjectReply> replyPointer(zdoReply);
+    QPointer<ZigbeeNode> nodePointer(m_node);
+    zdoReply->m_timeoutTimerId = m_network->timerWheel()->schedule(m_node->replyTimeout(), [replyPointer, nodePointer](){
+        if (replyPointer.isNull())
+            return;
+
+        if (!nodePointer.isNull())
+            nodePointer->handleResponseTimeout();
+
+        replyPointer->m_timeoutTimerId = 0;
+        replyPointer->m_error = ZigbeeDeviceObjectReply::ErrorTimeout;
+        emit replyPointer->finished();
+    });
+}
+
 void ZigbeeDeviceObject::processApsDataIndication(const Zigbee::ApsdeDataIndication &indication)
 {
     // Check if we have a waiting ZDO reply for this data
@@ -784,6 +848,10 @@ void ZigbeeDeviceObject::processApsDataIndication(const Zigbee::ApsdeDataIndicat
         zdoReply->m_responseAdpu = asdu;
         zdoReply->setZigbeeDeviceObjectStatus(asdu.status);
         zdoReply->m_zdpIndicationReceived = true;
+        // Only responses arriving after the confirmation are valid round trip samples
+        if (zdoReply->m_responseTimer.isValid() && zdoReply->m_timeoutTimerId != 0)
+            m_node->addResponseTimeSample(zdoReply->m_responseTimer.elapsed());
+
         if (zdoReply->isComplete()) {
             finishZdoReply(zdoReply);
         }
@@ -30,6 +30,7 @@
 
 #include <QObject>
 
+#include "zigbeechannelmask.h"
 #include "zigbeenetworkreply.h"
 #include "zigbeedeviceobjectreply.h"
 
@@ -62,6 +63,7 @@ public:
     ZigbeeDeviceObjectReply *requestMgmtLqi(quint8 startIndex = 0x00);
     ZigbeeDeviceObjectReply *requestMgmtBind(quint8 startIndex = 0x00);
     ZigbeeDeviceObjectReply *requestMgmtRtg(quint8 startIndex = 0x00);
+    ZigbeeDeviceObjectReply *requestMgmtNetworkUpdate(const ZigbeeChannelMask &scanChannels, quint8 scanDuration, quint8 scanCount = 1);
 
     // TODO: write all requests
 
@@ -77,6 +79,7 @@ private:
     ZigbeeDeviceObjectReply *createZigbeeDeviceObjectReply(const ZigbeeNetworkRequest &request, quint8 transactionSequenceNumber);
     bool verifyNetworkError(ZigbeeDeviceObjectReply *zdoReply, ZigbeeNetworkReply *networkReply);
     void finishZdoReply(ZigbeeDeviceObjectReply *zdoReply);
+    void startZdoReplyTimeout(ZigbeeDeviceObjectReply *zdoReply);
 
 public slots:
     void processApsDataIndication(const Zigbee::ApsdeDataIndication &indication);
@@ -30,6 +30,7 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QElapsedTimer>
 
 #include "zigbeedeviceprofile.h"
 #include "zigbeenetworkrequest.h"
@@ -73,7 +74,8 @@ private:
 
     Error m_error = ErrorNoError;
 
-    QTimer m_timeoutTimer;
+    quint32 m_timeoutTimerId = 0;
+    QElapsedTimer m_responseTimer; // Started once the request has been confirmed
 
     // Request information
     ZigbeeNetworkRequest m_request;
@@ -275,6 +275,34 @@ ZigbeeDeviceProfile::RoutingTable ZigbeeDeviceProfile::parseRoutingTable(const Q
 
 }
 
+ZigbeeDeviceProfile::NetworkUpdateNotification ZigbeeDeviceProfile::parseNetworkUpdateNotification(const QByteArray &payload)
+{
+    ZigbeeDeviceProfile::NetworkUpdateNotification notification;
+    QDataStream stream(payload);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint8 messageId, status, listRecordCount = 0;
+    stream >> messageId >> status >> notification.scannedChannels >> notification.totalTransmissions >> notification.transmissionFailures >> listRecordCount;
+    notification.status = static_cast<Status>(status);
+
+    // The energy values are listed for each channel set in the scanned channels mask
+    quint8 channel = 11;
+    for (int i = 0; i < listRecordCount && !stream.atEnd(); i++) {
+        while (channel <= 26 && !(notification.scannedChannels & (1 << channel)))
+            channel++;
+
+        if (channel > 26)
+            break;
+
+        quint8 energy;
+        stream >> energy;
+        notification.energyValues.insert(channel, energy);
+        channel++;
+    }
+
+    return notification;
+}
+
 ZigbeeDeviceProfile::Adpu ZigbeeDeviceProfile::parseAdpu(const QByteArray &adpu)
 {
     QDataStream stream(adpu);
@@ -362,6 +390,32 @@ QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::PowerDescriptor &powe
     return debug;
 }
 
+bool operator==(const ZigbeeDeviceProfile::BindingTableListRecord &first, const ZigbeeDeviceProfile::BindingTableListRecord &second)
+{
+    if (first.sourceAddress != second.sourceAddress
+            || first.sourceEndpoint != second.sourceEndpoint
+            || first.clusterId != second.clusterId
+            || first.destinationAddressMode != second.destinationAddressMode)
+        return false;
+
+    switch (first.destinationAddressMode) {
+    case Zigbee::DestinationAddressModeGroup:
+        return first.destinationShortAddress == second.destinationShortAddress;
+    case Zigbee::DestinationAddressModeIeeeAddress:
+        return first.destinationIeeeAddress == second.destinationIeeeAddress
+                && first.destinationEndpoint == second.destinationEndpoint;
+    default:
+        return first.destinationShortAddress == second.destinationShortAddress
+                && first.destinationIeeeAddress == second.destinationIeeeAddress
+                && first.destinationEndpoint == second.destinationEndpoint;
+    }
+}
+
+bool operator!=(const ZigbeeDeviceProfile::BindingTableListRecord &first, const ZigbeeDeviceProfile::BindingTableListRecord &second)
+{
+    return !(first == second);
+}
+
 QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::BindingTableListRecord &bindingTableListRecord)
 {
     QDebugStateSaver saver(debug);
@@ -409,3 +463,18 @@ QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::RoutingTableListRecor
     debug.nospace() << "RRR: " << routingTableListRecord.routeRecordRequired << ")";
     return debug;
 }
+
+QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::NetworkUpdateNotification &notification)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "NetworkUpdateNotification(";
+    debug.nospace() << "Status: " << notification.status << ", ";
+    debug.nospace() << "Transmissions: " << notification.totalTransmissions << ", ";
+    debug.nospace() << "Failures: " << notification.transmissionFailures << ", ";
+    debug.nospace() << "Energy: ";
+    foreach (quint8 channel, notification.energyValues.keys()) {
+        debug.nospace() << static_cast<int>(channel) << ":" << static_cast<int>(notification.energyValues.value(channel)) << " ";
+    }
+    debug.nospace() << ")";
+    return debug;
+}
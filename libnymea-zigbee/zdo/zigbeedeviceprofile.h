@@ -28,6 +28,7 @@
 #ifndef ZIGBEEDEVICEPROFILE_H
 #define ZIGBEEDEVICEPROFILE_H
 
+#include <QMap>
 #include <QDebug>
 #include <QObject>
 
@@ -290,12 +291,12 @@ public:
 
     typedef struct BindingTableListRecord {
         ZigbeeAddress sourceAddress;
-        quint8 sourceEndpoint;
-        quint16 clusterId;
-        Zigbee::DestinationAddressMode destinationAddressMode;
-        quint16 destinationShortAddress;
+        quint8 sourceEndpoint = 0;
+        quint16 clusterId = 0;
+        Zigbee::DestinationAddressMode destinationAddressMode = Zigbee::DestinationAddressModeIeeeAddress;
+        quint16 destinationShortAddress = 0;
         ZigbeeAddress destinationIeeeAddress;
-        quint8 destinationEndpoint;
+        quint8 destinationEndpoint = 0;
     } BindingTableListRecord;
 
     typedef struct BindingTable {
@@ -340,6 +341,15 @@ public:
         QList<RoutingTableListRecord> records;
     } RoutingTable;
 
+    typedef struct NetworkUpdateNotification {
+        Status status = StatusSuccess;
+        quint32 scannedChannels = 0;
+        quint16 totalTransmissions = 0;
+        quint16 transmissionFailures = 0;
+        // Energy detected on the scanned channels in ascending channel order, 0x00 - 0xff
+        QMap<quint8, quint8> energyValues;
+    } NetworkUpdateNotification;
+
     static NodeDescriptor parseNodeDescriptor(const QByteArray &payload);
     static MacCapabilities parseMacCapabilities(quint8 macCapabilitiesFlag);
     static ServerMask parseServerMask(quint16 serverMaskFlag);
@@ -348,8 +358,13 @@ public:
     static BindingTable parseBindingTable(const QByteArray &payload);
     static NeighborTable parseNeighborTable(const QByteArray &payload);
     static RoutingTable parseRoutingTable(const QByteArray &payload);
+    static NetworkUpdateNotification parseNetworkUpdateNotification(const QByteArray &payload);
 };
 
+// Note: only the destination fields relevant for the destination address mode are compared
+bool operator==(const ZigbeeDeviceProfile::BindingTableListRecord &first, const ZigbeeDeviceProfile::BindingTableListRecord &second);
+bool operator!=(const ZigbeeDeviceProfile::BindingTableListRecord &first, const ZigbeeDeviceProfile::BindingTableListRecord &second);
+
 QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::Adpu &deviceAdpu);
 QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::NodeDescriptor &nodeDescriptor);
 QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::MacCapabilities &macCapabilities);
@@ -359,5 +374,6 @@ QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::PowerDescriptor &powe
 QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::BindingTableListRecord &bindingTableListRecord);
 QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::NeighborTableListRecord &neighborTableListRecord);
 QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::RoutingTableListRecord &routingTableListRecord);
+QDebug operator<<(QDebug debug, const ZigbeeDeviceProfile::NetworkUpdateNotification &notification);
 
 #endif // ZIGBEEDEVICEPROFILE_H
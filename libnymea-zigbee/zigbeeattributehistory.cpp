@@ -0,0 +1,352 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeeattributehistory.h"
+#include "zigbeenetwork.h"
+#include "zigbeenode.h"
+#include "zigbeeutils.h"
+#include "loggingcategory.h"
+#include "zcl/zigbeecluster.h"
+
+#include <QtEndian>
+
+#include <limits>
+
+ZigbeeAttributeHistory::ZigbeeAttributeHistory(ZigbeeNetwork *network, int maxSeries, int samplesPerSeries, QObject *parent) :
+    QObject(parent),
+    m_network(network),
+    m_maxSeries(qMax(1, maxSeries)),
+    m_samplesPerSeries(qMax(2, samplesPerSeries))
+{
+    m_series.resize(m_maxSeries);
+    connect(m_network, &ZigbeeNetwork::nodeRemoved, this, &ZigbeeAttributeHistory::onNodeRemoved);
+}
+
+int ZigbeeAttributeHistory::maxSeries() const
+{
+    return m_maxSeries;
+}
+
+int ZigbeeAttributeHistory::samplesPerSeries() const
+{
+    return m_samplesPerSeries;
+}
+
+int ZigbeeAttributeHistory::memoryUsage() const
+{
+    return m_arena.size();
+}
+
+int ZigbeeAttributeHistory::sampleInterval() const
+{
+    return m_sampleInterval;
+}
+
+void ZigbeeAttributeHistory::setSampleInterval(int sampleInterval)
+{
+    m_sampleInterval = qMax(0, sampleInterval);
+}
+
+bool ZigbeeAttributeHistory::track(ZigbeeCluster *cluster, quint16 attributeId, double resolution)
+{
+    if (indexOfSeries(cluster, attributeId) >= 0)
+        return true;
+
+    if (resolution <= 0) {
+        qCWarning(dcZigbeeNetwork()) << "Attribute history: invalid resolution" << resolution;
+        return false;
+    }
+
+    int index = -1;
+    for (int i = 0; i < m_series.count(); i++) {
+        if (!m_series.at(i).used) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < 0) {
+        qCWarning(dcZigbeeNetwork()) << "Attribute history: all" << m_maxSeries << "series are in use. Not tracking attribute" << ZigbeeUtils::convertUint16ToHexString(attributeId) << "of" << cluster;
+        return false;
+    }
+
+    // Reserve the whole arena at once, the memory usage will not change afterwards
+    if (m_arena.isEmpty()) {
+        m_arena = QByteArray(m_maxSeries * (m_samplesPerSeries - 1) * s_recordSize, 0);
+        qCDebug(dcZigbeeNetwork()) << "Attribute history: reserved" << m_arena.size() << "bytes for" << m_maxSeries << "series";
+    }
+
+    Series &series = m_series[index];
+    series = Series();
+    series.used = true;
+    series.extendedAddress = cluster->node()->extendedAddress();
+    series.endpointId = cluster->endpoint()->endpointId();
+    series.clusterId = cluster->clusterId();
+    series.attributeId = attributeId;
+    series.resolution = resolution;
+    series.connection = connect(cluster, &ZigbeeCluster::attributeChanged, this, [this, cluster, attributeId](const ZigbeeClusterAttribute &attribute){
+        if (attribute.id() != attributeId)
+            return;
+
+        double value = 0;
+        if (!ZigbeeClusterAttributeFilter::numericValue(attribute.dataType(), &value)) {
+            qCWarning(dcZigbeeNetwork()) << "Attribute history: ignoring non numeric value" << attribute << "of" << cluster;
+            return;
+        }
+
+        addSample(cluster, attributeId, QDateTime::currentDateTimeUtc(), value);
+    });
+
+    m_seriesIndex.insert(seriesKey(series.extendedAddress, series.endpointId, series.clusterId, attributeId), index);
+    qCDebug(dcZigbeeNetwork()) << "Attribute history: tracking attribute" << ZigbeeUtils::convertUint16ToHexString(attributeId) << "of" << cluster;
+    return true;
+}
+
+void ZigbeeAttributeHistory::untrack(ZigbeeCluster *cluster, quint16 attributeId)
+{
+    int index = indexOfSeries(cluster, attributeId);
+    if (index >= 0) {
+        freeSeries(index);
+    }
+}
+
+bool ZigbeeAttributeHistory::isTracked(ZigbeeCluster *cluster, quint16 attributeId) const
+{
+    return indexOfSeries(cluster, attributeId) >= 0;
+}
+
+void ZigbeeAttributeHistory::addSample(ZigbeeCluster *cluster, quint16 attributeId, const QDateTime &timestamp, double value)
+{
+    int index = indexOfSeries(cluster, attributeId);
+    if (index < 0)
+        return;
+
+    storeSample(index, timestamp.toMSecsSinceEpoch() / 1000, qRound64(value / m_series.at(index).resolution));
+}
+
+QList<ZigbeeAttributeHistory::Sample> ZigbeeAttributeHistory::samples(ZigbeeCluster *cluster, quint16 attributeId, const QDateTime &from, const QDateTime &to) const
+{
+    QList<Sample> samples;
+    int index = indexOfSeries(cluster, attributeId);
+    if (index < 0 || !m_series.at(index).hasSamples)
+        return samples;
+
+    const Series &series = m_series.at(index);
+    qint64 fromTimestamp = from.isValid() ? from.toMSecsSinceEpoch() / 1000 : std::numeric_limits<qint64>::min();
+    qint64 toTimestamp = to.isValid() ? to.toMSecsSinceEpoch() / 1000 : std::numeric_limits<qint64>::max();
+
+    qint64 timestamp = series.baseTimestamp;
+    qint64 value = series.baseValue;
+    qint64 lastTimestamp = 0;
+    for (int position = -1; position < series.count; position++) {
+        if (position < 0 && series.baseFiller)
+            continue;
+
+        if (position >= 0) {
+            const uchar *data = record(index, position);
+            quint16 timeDelta = qFromLittleEndian<quint16>(data);
+            timestamp += timeDelta;
+            value += qFromLittleEndian<qint32>(data + 2);
+            if (timeDelta == s_fillerTimeDelta)
+                continue;
+        }
+
+        if (timestamp < fromTimestamp || timestamp > toTimestamp)
+            continue;
+
+        // Large changes are split into several records with the same timestamp, the last one wins
+        if (!samples.isEmpty() && lastTimestamp == timestamp) {
+            samples.last().value = value * series.resolution;
+            continue;
+        }
+
+        Sample sample;
+        sample.timestamp = QDateTime::fromMSecsSinceEpoch(timestamp * 1000);
+        sample.value = value * series.resolution;
+        samples.append(sample);
+        lastTimestamp = timestamp;
+    }
+
+    return samples;
+}
+
+QList<ZigbeeAttributeHistory::Bucket> ZigbeeAttributeHistory::downsample(ZigbeeCluster *cluster, quint16 attributeId, int bucketInterval, const QDateTime &from, const QDateTime &to) const
+{
+    QList<Bucket> buckets;
+    QList<Sample> samples = this->samples(cluster, attributeId, from, to);
+    if (samples.isEmpty() || bucketInterval <= 0)
+        return buckets;
+
+    qint64 start = from.isValid() ? from.toMSecsSinceEpoch() / 1000 : samples.first().timestamp.toMSecsSinceEpoch() / 1000;
+    double sum = 0;
+    foreach (const Sample &sample, samples) {
+        qint64 timestamp = sample.timestamp.toMSecsSinceEpoch() / 1000;
+        qint64 bucketStart = start + (timestamp - start) / bucketInterval * bucketInterval;
+        if (buckets.isEmpty() || buckets.last().timestamp.toMSecsSinceEpoch() / 1000 != bucketStart) {
+            if (!buckets.isEmpty())
+                buckets.last().average = sum / buckets.last().count;
+
+            Bucket bucket;
+            bucket.timestamp = QDateTime::fromMSecsSinceEpoch(bucketStart * 1000);
+            bucket.minimum = sample.value;
+            bucket.maximum = sample.value;
+            buckets.append(bucket);
+            sum = 0;
+        }
+
+        Bucket &bucket = buckets.last();
+        bucket.minimum = qMin(bucket.minimum, sample.value);
+        bucket.maximum = qMax(bucket.maximum, sample.value);
+        bucket.count++;
+        sum += sample.value;
+    }
+
+    buckets.last().average = sum / buckets.last().count;
+    return buckets;
+}
+
+void ZigbeeAttributeHistory::clear()
+{
+    for (int i = 0; i < m_series.count(); i++) {
+        if (m_series.at(i).used) {
+            freeSeries(i);
+        }
+    }
+
+    m_arena.clear();
+}
+
+QString ZigbeeAttributeHistory::seriesKey(const ZigbeeAddress &extendedAddress, quint8 endpointId, quint16 clusterId, quint16 attributeId)
+{
+    return QString("%1-%2-%3-%4").arg(extendedAddress.toString()).arg(endpointId).arg(clusterId).arg(attributeId);
+}
+
+int ZigbeeAttributeHistory::indexOfSeries(ZigbeeCluster *cluster, quint16 attributeId) const
+{
+    return m_seriesIndex.value(seriesKey(cluster->node()->extendedAddress(), cluster->endpoint()->endpointId(), cluster->clusterId(), attributeId), -1);
+}
+
+uchar *ZigbeeAttributeHistory::record(int seriesIndex, int position)
+{
+    int capacity = m_samplesPerSeries - 1;
+    int index = (m_series.at(seriesIndex).first + position) % capacity;
+    return reinterpret_cast<uchar *>(m_arena.data()) + (seriesIndex * capacity + index) * s_recordSize;
+}
+
+const uchar *ZigbeeAttributeHistory::record(int seriesIndex, int position) const
+{
+    int capacity = m_samplesPerSeries - 1;
+    int index = (m_series.at(seriesIndex).first + position) % capacity;
+    return reinterpret_cast<const uchar *>(m_arena.constData()) + (seriesIndex * capacity + index) * s_recordSize;
+}
+
+void ZigbeeAttributeHistory::appendRecord(int seriesIndex, quint16 timeDelta, qint32 valueDelta)
+{
+    Series &series = m_series[seriesIndex];
+    int capacity = m_samplesPerSeries - 1;
+    if (series.count >= capacity) {
+        // Drop the oldest sample, the first record becomes the new base
+        const uchar *oldest = record(seriesIndex, 0);
+        series.baseFiller = qFromLittleEndian<quint16>(oldest) == s_fillerTimeDelta;
+        series.baseTimestamp += qFromLittleEndian<quint16>(oldest);
+        series.baseValue += qFromLittleEndian<qint32>(oldest + 2);
+        series.first = (series.first + 1) % capacity;
+        series.count--;
+    }
+
+    uchar *data = record(seriesIndex, series.count);
+    qToLittleEndian<quint16>(timeDelta, data);
+    qToLittleEndian<qint32>(valueDelta, data + 2);
+    series.count++;
+}
+
+void ZigbeeAttributeHistory::storeSample(int seriesIndex, qint64 timestamp, qint64 value)
+{
+    Series &series = m_series[seriesIndex];
+    if (!series.hasSamples) {
+        series.hasSamples = true;
+        series.baseTimestamp = series.lastTimestamp = timestamp;
+        series.baseValue = series.lastValue = value;
+        return;
+    }
+
+    // The clock went backwards, keep the samples in order
+    timestamp = qMax(timestamp, series.lastTimestamp);
+
+    // Within the sample interval the last value wins
+    if (timestamp - series.lastTimestamp < m_sampleInterval) {
+        if (series.count == 0) {
+            series.baseValue = series.lastValue = value;
+            return;
+        }
+
+        uchar *data = record(seriesIndex, series.count - 1);
+        qint64 valueDelta = value - (series.lastValue - qFromLittleEndian<qint32>(data + 2));
+        if (valueDelta >= std::numeric_limits<qint32>::min() && valueDelta <= std::numeric_limits<qint32>::max()) {
+            qToLittleEndian<qint32>(static_cast<qint32>(valueDelta), data + 2);
+            series.lastValue = value;
+            return;
+        }
+    }
+
+    // Deltas which don't fit into one record will be split
+    qint64 timeDelta = timestamp - series.lastTimestamp;
+    while (timeDelta >= s_fillerTimeDelta) {
+        appendRecord(seriesIndex, s_fillerTimeDelta, 0);
+        timeDelta -= s_fillerTimeDelta;
+    }
+
+    qint64 valueDelta = value - series.lastValue;
+    while (valueDelta > std::numeric_limits<qint32>::max() || valueDelta < std::numeric_limits<qint32>::min()) {
+        qint32 step = valueDelta > 0 ? std::numeric_limits<qint32>::max() : std::numeric_limits<qint32>::min();
+        appendRecord(seriesIndex, static_cast<quint16>(timeDelta), step);
+        timeDelta = 0;
+        valueDelta -= step;
+    }
+
+    appendRecord(seriesIndex, static_cast<quint16>(timeDelta), static_cast<qint32>(valueDelta));
+    series.lastTimestamp = timestamp;
+    series.lastValue = value;
+}
+
+void ZigbeeAttributeHistory::freeSeries(int seriesIndex)
+{
+    Series &series = m_series[seriesIndex];
+    disconnect(series.connection);
+    m_seriesIndex.remove(seriesKey(series.extendedAddress, series.endpointId, series.clusterId, series.attributeId));
+    series = Series();
+}
+
+void ZigbeeAttributeHistory::onNodeRemoved(ZigbeeNode *node)
+{
+    for (int i = 0; i < m_series.count(); i++) {
+        if (m_series.at(i).used && m_series.at(i).extendedAddress == node->extendedAddress()) {
+            freeSeries(i);
+        }
+    }
+}
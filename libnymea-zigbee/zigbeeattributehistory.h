@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEATTRIBUTEHISTORY_H
+#define ZIGBEEATTRIBUTEHISTORY_H
+
+#include <QHash>
+#include <QObject>
+#include <QVector>
+#include <QDateTime>
+
+#include "zigbeeaddress.h"
+
+class ZigbeeNode;
+class ZigbeeCluster;
+class ZigbeeNetwork;
+class ZigbeeClusterAttribute;
+
+// Keeps a short history of selected numeric attributes in memory. Each series is a fixed size ring
+// buffer of delta encoded samples within one contiguous arena, so the memory usage is known
+// in advance and does not grow. Values are stored as integer multiples of the series resolution.
+
+class ZigbeeAttributeHistory : public QObject
+{
+    Q_OBJECT
+public:
+    typedef struct Sample {
+        QDateTime timestamp;
+        double value = 0;
+    } Sample;
+
+    typedef struct Bucket {
+        QDateTime timestamp; // Start of the bucket
+        double minimum = 0;
+        double maximum = 0;
+        double average = 0;
+        int count = 0;
+    } Bucket;
+
+    explicit ZigbeeAttributeHistory(ZigbeeNetwork *network, int maxSeries = 32, int samplesPerSeries = 1440, QObject *parent = nullptr);
+
+    int maxSeries() const;
+    int samplesPerSeries() const;
+
+    // Bytes reserved for the samples, allocated when the first attribute gets tracked
+    int memoryUsage() const;
+
+    // Samples arriving within this interval (seconds) replace the value of the last stored sample
+    int sampleInterval() const;
+    void setSampleInterval(int sampleInterval);
+
+    bool track(ZigbeeCluster *cluster, quint16 attributeId, double resolution = 1);
+    void untrack(ZigbeeCluster *cluster, quint16 attributeId);
+    bool isTracked(ZigbeeCluster *cluster, quint16 attributeId) const;
+
+    void addSample(ZigbeeCluster *cluster, quint16 attributeId, const QDateTime &timestamp, double value);
+
+    // Invalid timestamps select the full history
+    QList<Sample> samples(ZigbeeCluster *cluster, quint16 attributeId, const QDateTime &from = QDateTime(), const QDateTime &to = QDateTime()) const;
+    QList<Bucket> downsample(ZigbeeCluster *cluster, quint16 attributeId, int bucketInterval, const QDateTime &from = QDateTime(), const QDateTime &to = QDateTime()) const;
+
+    void clear();
+
+private:
+    typedef struct Series {
+        bool used = false;
+        ZigbeeAddress extendedAddress;
+        quint8 endpointId = 0;
+        quint16 clusterId = 0;
+        quint16 attributeId = 0;
+        double resolution = 1;
+
+        // Ring buffer of delta records, the oldest sample is the base for the first record
+        int first = 0;
+        int count = 0;
+        bool hasSamples = false;
+        bool baseFiller = false; // The base has been taken over from a filler record
+        qint64 baseTimestamp = 0;
+        qint64 baseValue = 0;
+        qint64 lastTimestamp = 0;
+        qint64 lastValue = 0;
+        QMetaObject::Connection connection;
+    } Series;
+
+    // Record: time delta in seconds (uint16) followed by the value delta (int32), little endian.
+    // Gaps which don't fit into one record are bridged with filler records, they have the maximum
+    // time delta and are no samples. Real records always have a smaller time delta.
+    static const int s_recordSize = 6;
+    static const quint16 s_fillerTimeDelta = 0xffff;
+
+    ZigbeeNetwork *m_network = nullptr;
+    int m_maxSeries = 32;
+    int m_samplesPerSeries = 1440;
+    int m_sampleInterval = 60;
+
+    QByteArray m_arena;
+    QVector<Series> m_series;
+    QHash<QString, int> m_seriesIndex;
+
+    static QString seriesKey(const ZigbeeAddress &extendedAddress, quint8 endpointId, quint16 clusterId, quint16 attributeId);
+    int indexOfSeries(ZigbeeCluster *cluster, quint16 attributeId) const;
+
+    uchar *record(int seriesIndex, int position);
+    const uchar *record(int seriesIndex, int position) const;
+    void appendRecord(int seriesIndex, quint16 timeDelta, qint32 valueDelta);
+    void storeSample(int seriesIndex, qint64 timestamp, qint64 value);
+    void freeSeries(int seriesIndex);
+
+private slots:
+    void onNodeRemoved(ZigbeeNode *node);
+
+};
+
+#endif // ZIGBEEATTRIBUTEHISTORY_H
@@ -0,0 +1,366 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeeattributereadbatch.h"
+#include "zigbeenetwork.h"
+#include "zigbeenode.h"
+#include "zigbeeutils.h"
+#include "loggingcategory.h"
+#include "zcl/zigbeecluster.h"
+#include "zcl/zigbeeclusterreply.h"
+
+// Value length assumed for attributes which have not been read before
+static const int s_defaultValueLength = 8;
+
+// Attributes omitted from the response get read again at most this often
+static const int s_maxRereads = 2;
+
+ZigbeeAttributeReadBatch::ZigbeeAttributeReadBatch(int maxConcurrentReads, QObject *parent) :
+    QObject(parent),
+    m_maxConcurrentReads(qMax(1, maxConcurrentReads))
+{
+
+}
+
+int ZigbeeAttributeReadBatch::maxConcurrentReads() const
+{
+    return m_maxConcurrentReads;
+}
+
+void ZigbeeAttributeReadBatch::setMaxConcurrentReads(int maxConcurrentReads)
+{
+    m_maxConcurrentReads = qMax(1, maxConcurrentReads);
+    if (m_running) {
+        startNextRequests();
+    }
+}
+
+int ZigbeeAttributeReadBatch::maxAttributesPerRequest() const
+{
+    return m_maxAttributesPerRequest;
+}
+
+void ZigbeeAttributeReadBatch::setMaxAttributesPerRequest(int maxAttributesPerRequest)
+{
+    m_maxAttributesPerRequest = qMax(0, maxAttributesPerRequest);
+}
+
+void ZigbeeAttributeReadBatch::addRead(ZigbeeNode *node, quint8 endpointId, ZigbeeClusterLibrary::ClusterId clusterId, const QList<quint16> &attributes, quint16 manufacturerCode)
+{
+    ZigbeeNodeEndpoint *endpoint = node ? node->getEndpoint(endpointId) : nullptr;
+    ZigbeeCluster *cluster = endpoint ? endpoint->getInputCluster(clusterId) : nullptr;
+    if (cluster) {
+        addRead(cluster, attributes, manufacturerCode);
+        return;
+    }
+
+    qCWarning(dcZigbeeCluster()) << "Attribute read batch: cannot read attributes from" << node << "endpoint" << endpointId << clusterId << "The cluster does not exist.";
+    foreach (quint16 attributeId, attributes) {
+        Item item;
+        if (node)
+            item.extendedAddress = node->extendedAddress();
+
+        item.endpointId = endpointId;
+        item.clusterId = clusterId;
+        item.manufacturerCode = manufacturerCode;
+        item.attributeId = attributeId;
+        item.status = StatusUnavailable;
+        m_items.append(item);
+    }
+}
+
+void ZigbeeAttributeReadBatch::addRead(ZigbeeCluster *cluster, const QList<quint16> &attributes, quint16 manufacturerCode)
+{
+    foreach (quint16 attributeId, attributes) {
+        Item item;
+        item.extendedAddress = cluster->node()->extendedAddress();
+        item.endpointId = cluster->endpoint()->endpointId();
+        item.clusterId = cluster->clusterId();
+        item.manufacturerCode = manufacturerCode;
+        item.attributeId = attributeId;
+        m_items.append(item);
+        enqueueAttribute(cluster->node(), cluster, manufacturerCode, attributeId, m_items.count() - 1);
+    }
+
+    if (m_running) {
+        startNextRequests();
+    }
+}
+
+void ZigbeeAttributeReadBatch::start()
+{
+    if (m_running)
+        return;
+
+    qCDebug(dcZigbeeCluster()) << "Starting attribute read batch with" << m_items.count() << "attributes in" << m_pendingRequests.count() << "requests and max" << m_maxConcurrentReads << "concurrent reads";
+    m_running = true;
+    m_requestCount = 0;
+    m_timer.start();
+    startNextRequests();
+}
+
+bool ZigbeeAttributeReadBatch::running() const
+{
+    return m_running;
+}
+
+int ZigbeeAttributeReadBatch::pendingRequests() const
+{
+    return m_pendingRequests.count() + m_activeRequests.count();
+}
+
+ZigbeeAttributeReadBatch::Result ZigbeeAttributeReadBatch::result() const
+{
+    Result result;
+    result.items = m_items;
+    result.requestCount = m_requestCount;
+    result.duration = m_running ? m_timer.elapsed() : m_duration;
+    foreach (const Item &item, m_items) {
+        if (item.status == StatusSuccess) {
+            result.successCount++;
+        } else if (item.status != StatusPending) {
+            result.failedCount++;
+        }
+    }
+    return result;
+}
+
+void ZigbeeAttributeReadBatch::onNodeDestroyed(QObject *node)
+{
+    // Fail all reads for this node
+    QMutableListIterator<Request> it(m_pendingRequests);
+    while (it.hasNext()) {
+        if (it.next().node.isNull()) {
+            foreach (int itemIndex, it.value().itemIndexes) {
+                finishItem(itemIndex, StatusUnavailable);
+            }
+            it.remove();
+        }
+    }
+
+    if (m_activeRequests.contains(node)) {
+        foreach (int itemIndex, m_activeRequests.take(node).itemIndexes) {
+            finishItem(itemIndex, StatusUnavailable);
+        }
+    }
+
+    if (m_running) {
+        startNextRequests();
+    }
+}
+
+int ZigbeeAttributeReadBatch::maximumRequestLength(ZigbeeNode *node)
+{
+    return node->network()->maximumAsduLength(Zigbee::DestinationAddressModeShortAddress);
+}
+
+int ZigbeeAttributeReadBatch::maximumResponseLength(ZigbeeNode *node)
+{
+    // The node has to be able to send the response and we have to be able to receive it
+    int maximumLength = maximumRequestLength(node);
+    if (node->nodeDescriptorAvailable() && node->nodeDescriptor().maximumTxSize > 0)
+        maximumLength = qMin(maximumLength, static_cast<int>(node->nodeDescriptor().maximumTxSize));
+
+    return maximumLength;
+}
+
+int ZigbeeAttributeReadBatch::estimatedRecordLength(ZigbeeCluster *cluster, quint16 attributeId)
+{
+    // Attribute ID, status and data type, followed by the value
+    int valueLength = s_defaultValueLength;
+    if (cluster->hasAttribute(attributeId)) {
+        ZigbeeDataType dataType = cluster->attribute(attributeId).dataType();
+        valueLength = dataType.data().isEmpty() ? qMax(dataType.dataLength(), 1) : dataType.data().length();
+    }
+
+    return 4 + valueLength;
+}
+
+void ZigbeeAttributeReadBatch::enqueueAttribute(ZigbeeNode *node, ZigbeeCluster *cluster, quint16 manufacturerCode, quint16 attributeId, int itemIndex)
+{
+    // ZCL header: frame control, TSN and command, 2 additional bytes for the manufacturer code
+    const int headerLength = manufacturerCode != 0x0000 ? 5 : 3;
+    const int maximumAttributes = (maximumRequestLength(node) - headerLength) / static_cast<int>(sizeof(quint16));
+    const int maximumResponse = maximumResponseLength(node) - headerLength;
+    const int recordLength = estimatedRecordLength(cluster, attributeId);
+
+    for (int i = 0; i < m_pendingRequests.count(); i++) {
+        Request &request = m_pendingRequests[i];
+        if (request.cluster != cluster || request.manufacturerCode != manufacturerCode)
+            continue;
+
+        // The same attribute has been requested already
+        if (request.attributeIds.contains(attributeId)) {
+            request.itemIndexes.append(itemIndex);
+            return;
+        }
+
+        if (request.attributeIds.count() >= maximumAttributes || request.responseLength + recordLength > maximumResponse)
+            continue;
+
+        if (m_maxAttributesPerRequest > 0 && request.attributeIds.count() >= m_maxAttributesPerRequest)
+            continue;
+
+        request.attributeIds.append(attributeId);
+        request.itemIndexes.append(itemIndex);
+        request.responseLength += recordLength;
+        return;
+    }
+
+    Request request;
+    request.node = node;
+    request.cluster = cluster;
+    request.manufacturerCode = manufacturerCode;
+    request.attributeIds.append(attributeId);
+    request.itemIndexes.append(itemIndex);
+    request.responseLength = recordLength;
+    m_pendingRequests.append(request);
+}
+
+void ZigbeeAttributeReadBatch::startNextRequests()
+{
+    QMutableListIterator<Request> it(m_pendingRequests);
+    while (it.hasNext() && m_activeRequests.count() < m_maxConcurrentReads) {
+        Request request = it.next();
+        if (request.node.isNull() || request.cluster.isNull()) {
+            it.remove();
+            foreach (int itemIndex, request.itemIndexes) {
+                finishItem(itemIndex, StatusUnavailable);
+            }
+            continue;
+        }
+
+        // Only one request per node at a time
+        ZigbeeNode *node = request.node.data();
+        if (m_activeRequests.contains(node))
+            continue;
+
+        it.remove();
+        m_activeRequests.insert(node, request);
+        m_requestCount++;
+        connect(node, &QObject::destroyed, this, &ZigbeeAttributeReadBatch::onNodeDestroyed, Qt::UniqueConnection);
+
+        ZigbeeClusterReply *reply = request.cluster->readAttributes(request.attributeIds, request.manufacturerCode);
+        connect(reply, &ZigbeeClusterReply::finished, this, [this, node, reply](){
+            if (reply->error() != ZigbeeClusterReply::ErrorNoError) {
+                qCWarning(dcZigbeeCluster()) << "Attribute read batch: failed to read attributes from" << node << reply->error();
+                finishRequest(node, QList<ZigbeeClusterLibrary::ReadAttributeStatusRecord>(), false);
+                return;
+            }
+
+            // A default response indicates an error for the whole request
+            if (reply->responseFrame().header.command != ZigbeeClusterLibrary::CommandReadAttributesResponse) {
+                qCWarning(dcZigbeeCluster()) << "Attribute read batch: unexpected response from" << node << reply->responseFrame();
+                finishRequest(node, QList<ZigbeeClusterLibrary::ReadAttributeStatusRecord>(), false);
+                return;
+            }
+
+            finishRequest(node, ZigbeeClusterLibrary::parseAttributeStatusRecords(reply->responseFrame().payload), true);
+        });
+    }
+
+    if (m_running && m_pendingRequests.isEmpty() && m_activeRequests.isEmpty()) {
+        m_running = false;
+        m_duration = m_timer.elapsed();
+        Result batchResult = result();
+        qCDebug(dcZigbeeCluster()) << "Attribute read batch finished after" << batchResult.duration << "ms using" << batchResult.requestCount << "requests." << batchResult.successCount << "attributes read," << batchResult.failedCount << "failed";
+        emit finished(batchResult);
+    }
+}
+
+void ZigbeeAttributeReadBatch::finishRequest(QObject *node, const QList<ZigbeeClusterLibrary::ReadAttributeStatusRecord> &records, bool success)
+{
+    if (!m_activeRequests.contains(node))
+        return;
+
+    Request request = m_activeRequests.take(node);
+    QList<int> missingItemIndexes;
+    foreach (int itemIndex, request.itemIndexes) {
+        if (!success) {
+            finishItem(itemIndex, StatusRequestFailed);
+            continue;
+        }
+
+        bool found = false;
+        foreach (const ZigbeeClusterLibrary::ReadAttributeStatusRecord &record, records) {
+            if (record.attributeId != m_items.at(itemIndex).attributeId)
+                continue;
+
+            found = true;
+            m_items[itemIndex].zigbeeClusterLibraryStatus = record.attributeStatus;
+            if (record.attributeStatus == ZigbeeClusterLibrary::StatusSuccess) {
+                m_items[itemIndex].attribute = ZigbeeClusterAttribute(record.attributeId, record.dataType);
+                finishItem(itemIndex, StatusSuccess);
+            } else {
+                finishItem(itemIndex, StatusAttributeError);
+            }
+            break;
+        }
+
+        if (!found) {
+            missingItemIndexes.append(itemIndex);
+        }
+    }
+
+    // If the response does not fit into one frame, the node omits the remaining attributes. Read them again,
+    // but give up on attributes the node keeps omitting.
+    foreach (int itemIndex, missingItemIndexes) {
+        if (records.isEmpty() || request.node.isNull() || request.cluster.isNull() || m_itemRereads.value(itemIndex) >= s_maxRereads) {
+            finishItem(itemIndex, StatusRequestFailed);
+            continue;
+        }
+
+        m_itemRereads[itemIndex]++;
+        enqueueAttribute(request.node.data(), request.cluster.data(), request.manufacturerCode, m_items.at(itemIndex).attributeId, itemIndex);
+    }
+
+    startNextRequests();
+}
+
+void ZigbeeAttributeReadBatch::finishItem(int itemIndex, Status status)
+{
+    m_items[itemIndex].status = status;
+    if (status != StatusSuccess) {
+        qCDebug(dcZigbeeCluster()) << "Attribute read batch: failed" << m_items.at(itemIndex);
+    }
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeAttributeReadBatch::Item &item)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "AttributeReadItem(" << item.extendedAddress.toString();
+    debug.nospace() << ", endpoint: " << item.endpointId;
+    debug.nospace() << ", " << item.clusterId;
+    debug.nospace() << ", attribute: " << ZigbeeUtils::convertUint16ToHexString(item.attributeId);
+    debug.nospace() << ", " << item.status;
+    if (item.status == ZigbeeAttributeReadBatch::StatusAttributeError)
+        debug.nospace() << ", " << item.zigbeeClusterLibraryStatus;
+
+    debug.nospace() << ")";
+    return debug;
+}
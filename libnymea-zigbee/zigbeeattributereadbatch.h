@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEATTRIBUTEREADBATCH_H
+#define ZIGBEEATTRIBUTEREADBATCH_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+
+#include "zigbeeaddress.h"
+#include "zcl/zigbeeclusterattribute.h"
+#include "zcl/zigbeeclusterlibrary.h"
+
+class ZigbeeNode;
+class ZigbeeCluster;
+
+// Reads attributes from many clusters on many nodes. The requested attributes of one cluster
+// are packed into as few read attribute requests as the APS payload of the request and the
+// estimated response allow. Requests for the same node are sent one after the other, different
+// nodes are handled concurrently up to the given limit.
+
+class ZigbeeAttributeReadBatch : public QObject
+{
+    Q_OBJECT
+public:
+    enum Status {
+        StatusPending,
+        StatusSuccess,
+        StatusAttributeError, // The node returned an error for this attribute. See zigbeeClusterLibraryStatus
+        StatusRequestFailed, // The read request failed or timed out
+        StatusUnavailable // The node, endpoint or cluster does not exist (any more)
+    };
+    Q_ENUM(Status)
+
+    typedef struct Item {
+        ZigbeeAddress extendedAddress;
+        quint8 endpointId = 0;
+        ZigbeeClusterLibrary::ClusterId clusterId = ZigbeeClusterLibrary::ClusterIdUnknown;
+        quint16 manufacturerCode = 0x0000;
+        quint16 attributeId = 0;
+        Status status = StatusPending;
+        ZigbeeClusterLibrary::Status zigbeeClusterLibraryStatus = ZigbeeClusterLibrary::StatusSuccess;
+        ZigbeeClusterAttribute attribute;
+    } Item;
+
+    typedef struct Result {
+        QList<Item> items;
+        int successCount = 0;
+        int failedCount = 0;
+        int requestCount = 0;
+        qint64 duration = 0; // ms
+    } Result;
+
+    explicit ZigbeeAttributeReadBatch(int maxConcurrentReads = 4, QObject *parent = nullptr);
+
+    int maxConcurrentReads() const;
+    void setMaxConcurrentReads(int maxConcurrentReads);
+
+    // Always limited by the APS payload of the request and the response, 0 means no additional limit.
+    // Smaller values can be used for devices with small buffers.
+    int maxAttributesPerRequest() const;
+    void setMaxAttributesPerRequest(int maxAttributesPerRequest);
+
+    void addRead(ZigbeeNode *node, quint8 endpointId, ZigbeeClusterLibrary::ClusterId clusterId, const QList<quint16> &attributes, quint16 manufacturerCode = 0x0000);
+    void addRead(ZigbeeCluster *cluster, const QList<quint16> &attributes, quint16 manufacturerCode = 0x0000);
+
+    // Reads can be added also while running
+    void start();
+    bool running() const;
+
+    int pendingRequests() const;
+    Result result() const;
+
+signals:
+    void finished(const ZigbeeAttributeReadBatch::Result &result);
+
+private slots:
+    void onNodeDestroyed(QObject *node);
+
+private:
+    typedef struct Request {
+        QPointer<ZigbeeNode> node;
+        QPointer<ZigbeeCluster> cluster;
+        quint16 manufacturerCode = 0x0000;
+        QList<quint16> attributeIds;
+        QList<int> itemIndexes;
+        int responseLength = 0; // Estimated
+    } Request;
+
+    int m_maxConcurrentReads = 4;
+    int m_maxAttributesPerRequest = 0;
+    bool m_running = false;
+
+    QList<Item> m_items;
+    QHash<int, int> m_itemRereads;
+    QList<Request> m_pendingRequests;
+    QHash<QObject *, Request> m_activeRequests;
+    int m_requestCount = 0;
+    QElapsedTimer m_timer;
+    qint64 m_duration = 0;
+
+    static int maximumRequestLength(ZigbeeNode *node);
+    static int maximumResponseLength(ZigbeeNode *node);
+    static int estimatedRecordLength(ZigbeeCluster *cluster, quint16 attributeId);
+    void enqueueAttribute(ZigbeeNode *node, ZigbeeCluster *cluster, quint16 manufacturerCode, quint16 attributeId, int itemIndex);
+    void startNextRequests();
+    void finishRequest(QObject *node, const QList<ZigbeeClusterLibrary::ReadAttributeStatusRecord> &records, bool success);
+    void finishItem(int itemIndex, Status status);
+
+};
+
+QDebug operator<<(QDebug debug, const ZigbeeAttributeReadBatch::Item &item);
+
+#endif // ZIGBEEATTRIBUTEREADBATCH_H
@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeebindingbatch.h"
+#include "zigbeenode.h"
+#include "loggingcategory.h"
+
+ZigbeeBindingBatch::ZigbeeBindingBatch(int maxConcurrentOperations, QObject *parent) :
+    QObject(parent),
+    m_maxConcurrentOperations(qMax(1, maxConcurrentOperations))
+{
+
+}
+
+int ZigbeeBindingBatch::maxConcurrentOperations() const
+{
+    return m_maxConcurrentOperations;
+}
+
+void ZigbeeBindingBatch::setMaxConcurrentOperations(int maxConcurrentOperations)
+{
+    m_maxConcurrentOperations = qMax(1, maxConcurrentOperations);
+    if (m_running) {
+        startNextOperations();
+    }
+}
+
+void ZigbeeBindingBatch::addBinding(ZigbeeNode *node, quint8 sourceEndpointId, quint16 clusterId, const ZigbeeAddress &destinationAddress, quint8 destinationEndpoint)
+{
+    Operation operation;
+    operation.type = OperationTypeBind;
+    operation.node = node;
+    operation.record.sourceAddress = node->extendedAddress();
+    operation.record.sourceEndpoint = sourceEndpointId;
+    operation.record.clusterId = clusterId;
+    operation.record.destinationAddressMode = Zigbee::DestinationAddressModeIeeeAddress;
+    operation.record.destinationIeeeAddress = destinationAddress;
+    operation.record.destinationEndpoint = destinationEndpoint;
+    m_pendingOperations.append(operation);
+
+    if (m_running) {
+        startNextOperations();
+    }
+}
+
+void ZigbeeBindingBatch::addBinding(ZigbeeNode *node, quint8 sourceEndpointId, quint16 clusterId, quint16 destinationGroupAddress)
+{
+    Operation operation;
+    operation.type = OperationTypeBind;
+    operation.node = node;
+    operation.record.sourceAddress = node->extendedAddress();
+    operation.record.sourceEndpoint = sourceEndpointId;
+    operation.record.clusterId = clusterId;
+    operation.record.destinationAddressMode = Zigbee::DestinationAddressModeGroup;
+    operation.record.destinationShortAddress = destinationGroupAddress;
+    m_pendingOperations.append(operation);
+
+    if (m_running) {
+        startNextOperations();
+    }
+}
+
+void ZigbeeBindingBatch::removeBinding(ZigbeeNode *node, const ZigbeeDeviceProfile::BindingTableListRecord &binding)
+{
+    Operation operation;
+    operation.type = OperationTypeUnbind;
+    operation.node = node;
+    operation.record = binding;
+    m_pendingOperations.append(operation);
+
+    if (m_running) {
+        startNextOperations();
+    }
+}
+
+void ZigbeeBindingBatch::start()
+{
+    if (m_running)
+        return;
+
+    qCDebug(dcZigbeeNode()) << "Starting binding batch with" << m_pendingOperations.count() << "operations and max" << m_maxConcurrentOperations << "concurrent operations";
+    m_running = true;
+    m_failedOperations.clear();
+    startNextOperations();
+}
+
+bool ZigbeeBindingBatch::running() const
+{
+    return m_running;
+}
+
+int ZigbeeBindingBatch::pendingOperations() const
+{
+    return m_pendingOperations.count() + m_activeOperations.count();
+}
+
+QList<ZigbeeBindingBatch::Operation> ZigbeeBindingBatch::failedOperations() const
+{
+    return m_failedOperations;
+}
+
+void ZigbeeBindingBatch::onNodeDestroyed(QObject *node)
+{
+    // Fail all operations for this node
+    QMutableListIterator<Operation> it(m_pendingOperations);
+    while (it.hasNext()) {
+        if (it.next().node.isNull()) {
+            Operation operation = it.value();
+            it.remove();
+            m_failedOperations.append(operation);
+            emit operationFinished(operation, false);
+        }
+    }
+
+    finishOperation(node, false);
+}
+
+void ZigbeeBindingBatch::startNextOperations()
+{
+    QMutableListIterator<Operation> it(m_pendingOperations);
+    while (it.hasNext() && m_activeOperations.count() < m_maxConcurrentOperations) {
+        Operation operation = it.next();
+        if (operation.node.isNull()) {
+            it.remove();
+            m_failedOperations.append(operation);
+            emit operationFinished(operation, false);
+            continue;
+        }
+
+        // Only one request per node at a time
+        ZigbeeNode *node = operation.node.data();
+        if (m_activeOperations.contains(node))
+            continue;
+
+        it.remove();
+        m_activeOperations.insert(node, operation);
+        connect(node, &QObject::destroyed, this, &ZigbeeBindingBatch::onNodeDestroyed, Qt::UniqueConnection);
+
+        qCDebug(dcZigbeeNode()) << "Binding batch: start" << operation;
+        ZigbeeReply *reply = nullptr;
+        if (operation.type == OperationTypeUnbind) {
+            reply = node->removeBinding(operation.record);
+        } else if (operation.record.destinationAddressMode == Zigbee::DestinationAddressModeGroup) {
+            reply = node->addBinding(operation.record.sourceEndpoint, operation.record.clusterId, operation.record.destinationShortAddress);
+        } else {
+            reply = node->addBinding(operation.record.sourceEndpoint, operation.record.clusterId, operation.record.destinationIeeeAddress, operation.record.destinationEndpoint);
+        }
+
+        connect(reply, &ZigbeeReply::finished, this, [this, node, reply](){
+            finishOperation(node, reply->error() == ZigbeeReply::ErrorNoError);
+        });
+    }
+
+    if (m_running && m_pendingOperations.isEmpty() && m_activeOperations.isEmpty()) {
+        qCDebug(dcZigbeeNode()) << "Binding batch finished." << m_failedOperations.count() << "operations failed";
+        m_running = false;
+        emit finished();
+    }
+}
+
+void ZigbeeBindingBatch::finishOperation(QObject *node, bool success)
+{
+    if (!m_activeOperations.contains(node))
+        return;
+
+    Operation operation = m_activeOperations.take(node);
+    if (!success) {
+        qCWarning(dcZigbeeNode()) << "Binding batch: failed" << operation;
+        m_failedOperations.append(operation);
+    }
+
+    emit operationFinished(operation, success);
+    startNextOperations();
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeBindingBatch::Operation &operation)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "BindingOperation(" << operation.type << ", " << operation.record << ")";
+    return debug;
+}
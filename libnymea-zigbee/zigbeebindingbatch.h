@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEBINDINGBATCH_H
+#define ZIGBEEBINDINGBATCH_H
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+
+#include "zigbeeaddress.h"
+#include "zdo/zigbeedeviceprofile.h"
+
+class ZigbeeNode;
+
+// Executes bind and unbind requests for many nodes. Requests for the same node are sent
+// one after the other, different nodes are handled concurrently up to the given limit.
+
+class ZigbeeBindingBatch : public QObject
+{
+    Q_OBJECT
+public:
+    enum OperationType {
+        OperationTypeBind,
+        OperationTypeUnbind
+    };
+    Q_ENUM(OperationType)
+
+    typedef struct Operation {
+        OperationType type = OperationTypeBind;
+        QPointer<ZigbeeNode> node;
+        ZigbeeDeviceProfile::BindingTableListRecord record;
+    } Operation;
+
+    explicit ZigbeeBindingBatch(int maxConcurrentOperations = 4, QObject *parent = nullptr);
+
+    int maxConcurrentOperations() const;
+    void setMaxConcurrentOperations(int maxConcurrentOperations);
+
+    void addBinding(ZigbeeNode *node, quint8 sourceEndpointId, quint16 clusterId, const ZigbeeAddress &destinationAddress, quint8 destinationEndpoint);
+    void addBinding(ZigbeeNode *node, quint8 sourceEndpointId, quint16 clusterId, quint16 destinationGroupAddress);
+    void removeBinding(ZigbeeNode *node, const ZigbeeDeviceProfile::BindingTableListRecord &binding);
+
+    // Operations can be added also while running
+    void start();
+    bool running() const;
+
+    int pendingOperations() const;
+    QList<Operation> failedOperations() const;
+
+signals:
+    void operationFinished(const ZigbeeBindingBatch::Operation &operation, bool success);
+    void finished();
+
+private slots:
+    void onNodeDestroyed(QObject *node);
+
+private:
+    int m_maxConcurrentOperations = 4;
+    bool m_running = false;
+
+    QList<Operation> m_pendingOperations;
+    QHash<QObject *, Operation> m_activeOperations;
+    QList<Operation> m_failedOperations;
+
+    void startNextOperations();
+    void finishOperation(QObject *node, bool success);
+
+};
+
+QDebug operator<<(QDebug debug, const ZigbeeBindingBatch::Operation &operation);
+
+#endif // ZIGBEEBINDINGBATCH_H
@@ -58,6 +58,16 @@ bool ZigbeeBridgeController::updateRunning() const
     return m_updateRunning;
 }
 
+bool ZigbeeBridgeController::ioThreadEnabled() const
+{
+    return m_ioThreadEnabled;
+}
+
+void ZigbeeBridgeController::setIoThreadEnabled(bool ioThreadEnabled)
+{
+    m_ioThreadEnabled = ioThreadEnabled;
+}
+
 bool ZigbeeBridgeController::updateAvailable(const QString &currentVersion)
 {
     Q_UNUSED(currentVersion)
@@ -52,6 +52,10 @@ public:
     bool initiallyFlashed() const;
     bool updateRunning() const;
 
+    // Handle the serial communication in a dedicated thread, applied when enabling the controller
+    bool ioThreadEnabled() const;
+    void setIoThreadEnabled(bool ioThreadEnabled);
+
     // Optional update/initialize procedure for the zigbee controller
     virtual bool updateAvailable(const QString &currentVersion);
     virtual QString updateFirmwareVersion() const;
@@ -64,6 +68,7 @@ protected:
     bool m_canUpdate = false;
     bool m_initiallyFlashed = false;
     bool m_updateRunning = false;
+    bool m_ioThreadEnabled = false;
     QDir m_settingsDirectory = QDir("/var/lib/nymea/");
 
     void setAvailable(bool available);
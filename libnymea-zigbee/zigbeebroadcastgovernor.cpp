@@ -0,0 +1,337 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeebroadcastgovernor.h"
+#include "zigbeenetwork.h"
+#include "zigbeenode.h"
+#include "zigbeeutils.h"
+#include "loggingcategory.h"
+
+#include <QSharedPointer>
+
+ZigbeeBroadcastGovernor::ZigbeeBroadcastGovernor(ZigbeeNetwork *network, QObject *parent) :
+    QObject(parent),
+    m_network(network)
+{
+    m_clock.start();
+
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &ZigbeeBroadcastGovernor::sendQueuedBroadcasts);
+}
+
+int ZigbeeBroadcastGovernor::capacity() const
+{
+    return m_capacity;
+}
+
+void ZigbeeBroadcastGovernor::setCapacity(int capacity)
+{
+    m_capacity = qMax(1, capacity);
+    sendQueuedBroadcasts();
+}
+
+int ZigbeeBroadcastGovernor::deliveryTime() const
+{
+    return m_deliveryTime;
+}
+
+void ZigbeeBroadcastGovernor::setDeliveryTime(int deliveryTime)
+{
+    m_deliveryTime = qMax(0, deliveryTime);
+    sendQueuedBroadcasts();
+}
+
+int ZigbeeBroadcastGovernor::maxFanOut() const
+{
+    return m_maxFanOut;
+}
+
+void ZigbeeBroadcastGovernor::setMaxFanOut(int maxFanOut)
+{
+    m_maxFanOut = qMax(0, maxFanOut);
+}
+
+void ZigbeeBroadcastGovernor::addGroupMember(quint16 groupId, const ZigbeeAddress &address, quint8 endpointId)
+{
+    QList<Member> &members = m_groupMembers[groupId];
+    foreach (const Member &member, members) {
+        if (member.address == address && member.endpointId == endpointId) {
+            return;
+        }
+    }
+
+    qCDebug(dcZigbeeNetwork()) << "Group" << ZigbeeUtils::convertUint16ToHexString(groupId) << "member added" << address.toString() << "endpoint" << endpointId;
+    Member member;
+    member.address = address;
+    member.endpointId = endpointId;
+    members.append(member);
+}
+
+void ZigbeeBroadcastGovernor::removeGroupMember(quint16 groupId, const ZigbeeAddress &address, quint8 endpointId)
+{
+    if (!m_groupMembers.contains(groupId))
+        return;
+
+    QList<Member> &members = m_groupMembers[groupId];
+    for (int i = members.count() - 1; i >= 0; i--) {
+        if (members.at(i).address == address && members.at(i).endpointId == endpointId) {
+            qCDebug(dcZigbeeNetwork()) << "Group" << ZigbeeUtils::convertUint16ToHexString(groupId) << "member removed" << address.toString() << "endpoint" << endpointId;
+            members.removeAt(i);
+        }
+    }
+
+    if (members.isEmpty()) {
+        m_groupMembers.remove(groupId);
+    }
+}
+
+void ZigbeeBroadcastGovernor::removeGroupMember(const ZigbeeAddress &address, quint8 endpointId)
+{
+    foreach (quint16 groupId, m_groupMembers.keys()) {
+        removeGroupMember(groupId, address, endpointId);
+    }
+}
+
+void ZigbeeBroadcastGovernor::setGroupMembershipUnknown(quint16 groupId)
+{
+    qCDebug(dcZigbeeNetwork()) << "Group" << ZigbeeUtils::convertUint16ToHexString(groupId) << "has unknown members, not converting group casts to it";
+    m_unknownGroups.insert(groupId);
+}
+
+void ZigbeeBroadcastGovernor::removeGroupMember(const ZigbeeAddress &address)
+{
+    foreach (quint16 groupId, m_groupMembers.keys()) {
+        QList<Member> &members = m_groupMembers[groupId];
+        for (int i = members.count() - 1; i >= 0; i--) {
+            if (members.at(i).address == address) {
+                members.removeAt(i);
+            }
+        }
+
+        if (members.isEmpty()) {
+            m_groupMembers.remove(groupId);
+        }
+    }
+}
+
+QList<quint16> ZigbeeBroadcastGovernor::groups() const
+{
+    return m_groupMembers.keys();
+}
+
+int ZigbeeBroadcastGovernor::groupMemberCount(quint16 groupId) const
+{
+    return m_groupMembers.value(groupId).count();
+}
+
+bool ZigbeeBroadcastGovernor::isBroadcast(const ZigbeeNetworkRequest &request)
+{
+    switch (request.destinationAddressMode()) {
+    case Zigbee::DestinationAddressModeGroup:
+        return true;
+    case Zigbee::DestinationAddressModeShortAddress:
+        // 0xfff8 - 0xffff are reserved for broadcasts
+        return request.destinationShortAddress() >= 0xfff8;
+    default:
+        return false;
+    }
+}
+
+void ZigbeeBroadcastGovernor::send(ZigbeeNetworkReply *reply, const SendFunction &sendFunction)
+{
+    const ZigbeeNetworkRequest request = reply->request();
+    if (!isBroadcast(request)) {
+        sendFunction(reply);
+        return;
+    }
+
+    // A few acknowledged unicasts are cheaper than flooding the whole network
+    if (request.destinationAddressMode() == Zigbee::DestinationAddressModeGroup && sendFanOut(reply))
+        return;
+
+    const qint64 now = m_clock.elapsed();
+    expireTransactions(now);
+
+    // Keep the order, nothing may overtake already delayed broadcasts
+    if (m_queue.isEmpty() && m_transactions.count() < m_capacity) {
+        m_transactions.enqueue(now);
+        m_sentBroadcasts++;
+        sendFunction(reply);
+        return;
+    }
+
+    m_delayedBroadcasts++;
+    qCDebug(dcZigbeeNetwork()) << "Broadcast budget exhausted, delaying" << request << "Queued broadcasts:" << m_queue.count() + 1;
+
+    QueuedBroadcast queuedBroadcast;
+    queuedBroadcast.reply = reply;
+    queuedBroadcast.sendFunction = sendFunction;
+    m_queue.enqueue(queuedBroadcast);
+    scheduleQueue();
+}
+
+int ZigbeeBroadcastGovernor::availableBudget()
+{
+    expireTransactions(m_clock.elapsed());
+    return qMax(0, m_capacity - m_transactions.count() - m_queue.count());
+}
+
+int ZigbeeBroadcastGovernor::queuedBroadcasts() const
+{
+    return m_queue.count();
+}
+
+quint32 ZigbeeBroadcastGovernor::sentBroadcasts() const
+{
+    return m_sentBroadcasts;
+}
+
+quint32 ZigbeeBroadcastGovernor::delayedBroadcasts() const
+{
+    return m_delayedBroadcasts;
+}
+
+quint32 ZigbeeBroadcastGovernor::convertedBroadcasts() const
+{
+    return m_convertedBroadcasts;
+}
+
+void ZigbeeBroadcastGovernor::reset()
+{
+    m_sentBroadcasts = 0;
+    m_delayedBroadcasts = 0;
+    m_convertedBroadcasts = 0;
+}
+
+void ZigbeeBroadcastGovernor::expireTransactions(qint64 now)
+{
+    while (!m_transactions.isEmpty() && now - m_transactions.head() >= m_deliveryTime) {
+        m_transactions.dequeue();
+    }
+}
+
+void ZigbeeBroadcastGovernor::scheduleQueue()
+{
+    if (m_queue.isEmpty() || m_timer->isActive())
+        return;
+
+    // Wake up when the oldest entry leaves the broadcast transaction table
+    qint64 interval = 0;
+    if (!m_transactions.isEmpty())
+        interval = m_deliveryTime - (m_clock.elapsed() - m_transactions.head());
+
+    m_timer->start(static_cast<int>(qMax<qint64>(0, interval)));
+}
+
+bool ZigbeeBroadcastGovernor::sendFanOut(ZigbeeNetworkReply *reply)
+{
+    if (m_maxFanOut <= 0)
+        return false;
+
+    const ZigbeeNetworkRequest request = reply->request();
+    if (m_unknownGroups.contains(request.destinationShortAddress()))
+        return false;
+
+    const QList<Member> members = m_groupMembers.value(request.destinationShortAddress());
+    if (members.isEmpty() || members.count() > m_maxFanOut)
+        return false;
+
+    // Only if every registered member is known and awake, otherwise the group cast is the only way to reach all of them
+    QList<ZigbeeNetworkRequest> requests;
+    foreach (const Member &member, members) {
+        ZigbeeNode *node = m_network->getZigbeeNode(member.address);
+        if (!node || !node->macCapabilities().receiverOnWhenIdle)
+            return false;
+
+        ZigbeeNetworkRequest unicastRequest = request;
+        unicastRequest.setRequestId(m_network->generateSequenceNumber());
+        unicastRequest.setDestinationAddressMode(Zigbee::DestinationAddressModeShortAddress);
+        unicastRequest.setDestinationShortAddress(node->shortAddress());
+        unicastRequest.setDestinationEndpoint(member.endpointId);
+        unicastRequest.setTxOptions(Zigbee::ZigbeeTxOptions(Zigbee::ZigbeeTxOptionAckTransmission));
+        requests.append(unicastRequest);
+    }
+
+    m_convertedBroadcasts++;
+    qCDebug(dcZigbeeNetwork()) << "Sending group cast as" << requests.count() << "unicasts" << request;
+
+    // The group cast reply finishes once all unicasts are done, it succeeded if any member received it
+    QPointer<ZigbeeNetworkReply> groupReply(reply);
+    QSharedPointer<int> pending(new int(requests.count()));
+    QSharedPointer<ZigbeeNetworkReply::Error> error(new ZigbeeNetworkReply::Error(ZigbeeNetworkReply::ErrorNoError));
+    QSharedPointer<bool> delivered(new bool(false));
+    foreach (const ZigbeeNetworkRequest &unicastRequest, requests) {
+        ZigbeeNetworkReply *unicastReply = m_network->sendRequest(unicastRequest);
+        connect(unicastReply, &ZigbeeNetworkReply::finished, this, [this, unicastReply, groupReply, pending, error, delivered](){
+            if (unicastReply->error() == ZigbeeNetworkReply::ErrorNoError) {
+                *delivered = true;
+            } else if (*error == ZigbeeNetworkReply::ErrorNoError) {
+                *error = unicastReply->error();
+            }
+
+            if (--(*pending) > 0 || groupReply.isNull())
+                return;
+
+            m_network->finishNetworkReply(groupReply, *delivered ? ZigbeeNetworkReply::ErrorNoError : *error);
+        });
+    }
+
+    return true;
+}
+
+void ZigbeeBroadcastGovernor::clearQueue()
+{
+    m_timer->stop();
+    m_transactions.clear();
+
+    while (!m_queue.isEmpty()) {
+        QueuedBroadcast queuedBroadcast = m_queue.dequeue();
+        if (!queuedBroadcast.reply.isNull()) {
+            m_network->finishNetworkReply(queuedBroadcast.reply, ZigbeeNetworkReply::ErrorNetworkOffline);
+        }
+    }
+}
+
+void ZigbeeBroadcastGovernor::sendQueuedBroadcasts()
+{
+    const qint64 now = m_clock.elapsed();
+    expireTransactions(now);
+
+    while (!m_queue.isEmpty() && m_transactions.count() < m_capacity) {
+        QueuedBroadcast queuedBroadcast = m_queue.dequeue();
+        if (queuedBroadcast.reply.isNull())
+            continue;
+
+        m_transactions.enqueue(now);
+        m_sentBroadcasts++;
+        queuedBroadcast.sendFunction(queuedBroadcast.reply);
+    }
+
+    scheduleQueue();
+}
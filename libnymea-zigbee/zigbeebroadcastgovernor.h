@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEBROADCASTGOVERNOR_H
+#define ZIGBEEBROADCASTGOVERNOR_H
+
+#include <QSet>
+#include <QHash>
+#include <QQueue>
+#include <QTimer>
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+
+#include <functional>
+
+#include "zigbeeaddress.h"
+#include "zigbeenetworkreply.h"
+#include "zigbeenetworkrequest.h"
+
+class ZigbeeNetwork;
+
+// Keeps the broadcasts of the coordinator within the budget of the broadcast transaction table (BTT).
+// Every router remembers a broadcast for the broadcast delivery time, if the table is full, further
+// broadcasts get dropped silently by the network. Broadcasts and group casts exceeding the budget are
+// delayed until an entry expired. Optionally, group casts to a few known, non sleeping members are sent as
+// unicasts instead, which don't occupy the BTT at all and get acknowledged.
+
+class ZigbeeBroadcastGovernor : public QObject
+{
+    Q_OBJECT
+
+    friend class ZigbeeNetwork;
+
+public:
+    typedef std::function<void(ZigbeeNetworkReply *reply)> SendFunction;
+
+    // Broadcasts which may be in flight within one broadcast delivery time
+    int capacity() const;
+    void setCapacity(int capacity);
+
+    // Time (ms) a broadcast occupies its entry in the broadcast transaction table
+    int deliveryTime() const;
+    void setDeliveryTime(int deliveryTime);
+
+    // Group casts to at most this many members are sent as unicasts, 0 (default) disables the conversion.
+    // The group memberships are only known from the groups cluster commands sent by this process since it
+    // started. Members added in an earlier run, by Touchlink or by another controller would silently miss the
+    // converted group casts, so only enable this if all group memberships are managed through this library
+    // and have been registered with addGroupMember() on startup.
+    int maxFanOut() const;
+    void setMaxFanOut(int maxFanOut);
+
+    // Group memberships of node endpoints, learned from the groups cluster
+    void addGroupMember(quint16 groupId, const ZigbeeAddress &address, quint8 endpointId);
+    void removeGroupMember(quint16 groupId, const ZigbeeAddress &address, quint8 endpointId);
+    void removeGroupMember(const ZigbeeAddress &address, quint8 endpointId);
+    void removeGroupMember(const ZigbeeAddress &address);
+    // Endpoints may have joined the group without us knowing which (i.e. add group if identifying),
+    // group casts to it are never converted
+    void setGroupMembershipUnknown(quint16 groupId);
+    QList<quint16> groups() const;
+    int groupMemberCount(quint16 groupId) const;
+
+    static bool isBroadcast(const ZigbeeNetworkRequest &request);
+
+    // Sends the request of the reply using the given function as soon as the budget allows it.
+    // Requests which are neither broadcasts nor group casts are sent right away.
+    void send(ZigbeeNetworkReply *reply, const SendFunction &sendFunction);
+
+    int availableBudget();
+    int queuedBroadcasts() const;
+
+    // Statistics since the last reset
+    quint32 sentBroadcasts() const;
+    quint32 delayedBroadcasts() const;
+    quint32 convertedBroadcasts() const;
+
+    void reset();
+
+private:
+    explicit ZigbeeBroadcastGovernor(ZigbeeNetwork *network, QObject *parent = nullptr);
+
+    typedef struct Member {
+        ZigbeeAddress address;
+        quint8 endpointId = 0;
+    } Member;
+
+    typedef struct QueuedBroadcast {
+        QPointer<ZigbeeNetworkReply> reply;
+        SendFunction sendFunction;
+    } QueuedBroadcast;
+
+    ZigbeeNetwork *m_network = nullptr;
+    int m_capacity = 8;
+    int m_deliveryTime = 9000;
+    int m_maxFanOut = 0;
+
+    QElapsedTimer m_clock;
+    QQueue<qint64> m_transactions;
+    QQueue<QueuedBroadcast> m_queue;
+    QTimer *m_timer = nullptr;
+
+    QHash<quint16, QList<Member>> m_groupMembers;
+    QSet<quint16> m_unknownGroups;
+
+    quint32 m_sentBroadcasts = 0;
+    quint32 m_delayedBroadcasts = 0;
+    quint32 m_convertedBroadcasts = 0;
+
+    void expireTransactions(qint64 now);
+    void scheduleQueue();
+    bool sendFanOut(ZigbeeNetworkReply *reply);
+    void clearQueue();
+
+private slots:
+    void sendQueuedBroadcasts();
+
+};
+
+#endif // ZIGBEEBROADCASTGOVERNOR_H
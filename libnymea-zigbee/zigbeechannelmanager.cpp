@@ -0,0 +1,550 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeechannelmanager.h"
+#include "zigbeenetwork.h"
+#include "zigbeenode.h"
+#include "zigbeebroadcastgovernor.h"
+#include "zdo/zigbeedeviceobject.h"
+#include "zdo/zigbeedeviceprofile.h"
+#include "loggingcategory.h"
+
+#include <QDataStream>
+
+#include <algorithm>
+
+// Do not move for a slightly better channel, the new one has to be clearly quieter
+static const int s_energyMargin = 30;
+
+// Time the controller gets to move to the new channel and report the network running again
+static const int s_channelChangeTimeout = 60000;
+
+// Unsolicited interference reports trigger a scan at most this often (ms)
+static const qint64 s_reportScanInterval = 60000;
+
+ZigbeeChannelManager::ZigbeeChannelManager(ZigbeeNetwork *network, QObject *parent) :
+    QObject(parent),
+    m_network(network)
+{
+    m_scanTimer = new QTimer(this);
+    m_scanTimer->setSingleShot(false);
+    connect(m_scanTimer, &QTimer::timeout, this, &ZigbeeChannelManager::startEnergyScan);
+
+    m_changeTimer = new QTimer(this);
+    m_changeTimer->setSingleShot(true);
+    connect(m_changeTimer, &QTimer::timeout, this, [this](){
+        qCWarning(dcZigbeeNetwork()) << "The controller did not finish the channel change to" << m_targetChannel << "in time.";
+        finishChannelChange(false);
+    });
+
+    connect(m_network, &ZigbeeNetwork::stateChanged, this, &ZigbeeChannelManager::onNetworkStateChanged);
+    connect(m_network, &ZigbeeNetwork::channelChanged, this, &ZigbeeChannelManager::onNetworkStateChanged);
+}
+
+ZigbeeChannelManager::State ZigbeeChannelManager::state() const
+{
+    return m_state;
+}
+
+int ZigbeeChannelManager::scanInterval() const
+{
+    return m_scanInterval;
+}
+
+void ZigbeeChannelManager::setScanInterval(int scanInterval)
+{
+    m_scanInterval = qMax(0, scanInterval);
+    onNetworkStateChanged();
+}
+
+quint8 ZigbeeChannelManager::scanDuration() const
+{
+    return m_scanDuration;
+}
+
+void ZigbeeChannelManager::setScanDuration(quint8 scanDuration)
+{
+    m_scanDuration = qMin(scanDuration, static_cast<quint8>(5));
+}
+
+int ZigbeeChannelManager::scanRouters() const
+{
+    return m_scanRouters;
+}
+
+void ZigbeeChannelManager::setScanRouters(int scanRouters)
+{
+    m_scanRouters = qMax(0, scanRouters);
+}
+
+quint8 ZigbeeChannelManager::interferenceThreshold() const
+{
+    return m_interferenceThreshold;
+}
+
+void ZigbeeChannelManager::setInterferenceThreshold(quint8 interferenceThreshold)
+{
+    m_interferenceThreshold = interferenceThreshold;
+}
+
+int ZigbeeChannelManager::sustainedScans() const
+{
+    return m_sustainedScans;
+}
+
+void ZigbeeChannelManager::setSustainedScans(int sustainedScans)
+{
+    m_sustainedScans = qMax(1, sustainedScans);
+}
+
+bool ZigbeeChannelManager::automaticMigration() const
+{
+    return m_automaticMigration;
+}
+
+void ZigbeeChannelManager::setAutomaticMigration(bool automaticMigration)
+{
+    m_automaticMigration = automaticMigration;
+}
+
+int ZigbeeChannelManager::migrationCooldown() const
+{
+    return m_migrationCooldown;
+}
+
+void ZigbeeChannelManager::setMigrationCooldown(int migrationCooldown)
+{
+    m_migrationCooldown = qMax(0, migrationCooldown);
+}
+
+int ZigbeeChannelManager::historySize() const
+{
+    return m_historySize;
+}
+
+void ZigbeeChannelManager::setHistorySize(int historySize)
+{
+    m_historySize = qMax(1, historySize);
+    while (m_history.count() > m_historySize) {
+        m_history.removeFirst();
+    }
+}
+
+QList<ZigbeeChannelManager::ChannelScan> ZigbeeChannelManager::history() const
+{
+    return m_history;
+}
+
+int ZigbeeChannelManager::averageEnergy(quint8 channel, int scans) const
+{
+    int first = 0;
+    if (scans > 0)
+        first = qMax(0, m_history.count() - scans);
+
+    int sum = 0;
+    int count = 0;
+    for (int i = first; i < m_history.count(); i++) {
+        if (m_history.at(i).energy.contains(channel)) {
+            sum += m_history.at(i).energy.value(channel);
+            count++;
+        }
+    }
+
+    if (count == 0)
+        return -1;
+
+    return sum / count;
+}
+
+quint8 ZigbeeChannelManager::recommendedChannel() const
+{
+    const quint8 currentChannel = static_cast<quint8>(m_network->channel());
+    const int currentEnergy = averageEnergy(currentChannel);
+    if (currentEnergy < 0)
+        return 0;
+
+    quint8 bestChannel = 0;
+    int bestEnergy = currentEnergy - s_energyMargin;
+    const quint32 allowedChannels = m_network->channelMask().toUInt32();
+    for (quint8 channel = 11; channel <= 26; channel++) {
+        if (channel == currentChannel || !(allowedChannels & (1 << channel)))
+            continue;
+
+        const int energy = averageEnergy(channel);
+        if (energy >= 0 && energy < bestEnergy) {
+            bestChannel = channel;
+            bestEnergy = energy;
+        }
+    }
+
+    return bestChannel;
+}
+
+bool ZigbeeChannelManager::sustainedInterference() const
+{
+    if (m_history.count() < m_sustainedScans)
+        return false;
+
+    const quint8 currentChannel = static_cast<quint8>(m_network->channel());
+    for (int i = m_history.count() - m_sustainedScans; i < m_history.count(); i++) {
+        const ChannelScan &scan = m_history.at(i);
+        if (!scan.energy.contains(currentChannel) || scan.energy.value(currentChannel) < m_interferenceThreshold) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+quint8 ZigbeeChannelManager::networkUpdateId() const
+{
+    return m_networkUpdateId;
+}
+
+bool ZigbeeChannelManager::startEnergyScan()
+{
+    if (m_state != StateIdle) {
+        qCDebug(dcZigbeeNetwork()) << "Cannot start an energy scan while" << m_state;
+        return false;
+    }
+
+    if (m_network->state() != ZigbeeNetwork::StateRunning) {
+        qCWarning(dcZigbeeNetwork()) << "Cannot start an energy scan while the network is not running.";
+        return false;
+    }
+
+    QList<ZigbeeNode *> nodes = scanNodes();
+    if (nodes.isEmpty()) {
+        qCWarning(dcZigbeeNetwork()) << "There are no nodes available for an energy scan.";
+        return false;
+    }
+
+    // Scan the allowed channels and the current one
+    ZigbeeChannelMask scanChannels(m_network->channelMask().toUInt32() | (1 << m_network->channel()));
+    qCDebug(dcZigbeeNetwork()) << "Starting energy scan on" << nodes.count() << "nodes" << scanChannels;
+
+    m_currentScan = ChannelScan();
+    m_energySums.clear();
+    m_energyCounts.clear();
+    m_pendingScans = nodes.count();
+    m_lastScan.start();
+    setState(StateScanning);
+
+    foreach (ZigbeeNode *node, nodes) {
+        ZigbeeDeviceObjectReply *zdoReply = node->deviceObject()->requestMgmtNetworkUpdate(scanChannels, m_scanDuration);
+        connect(zdoReply, &ZigbeeDeviceObjectReply::finished, this, [this, node, zdoReply](){
+            if (zdoReply->error() != ZigbeeDeviceObjectReply::ErrorNoError) {
+                qCDebug(dcZigbeeNetwork()) << "Energy scan failed on" << node << zdoReply->error();
+            } else {
+                ZigbeeDeviceProfile::NetworkUpdateNotification notification = ZigbeeDeviceProfile::parseNetworkUpdateNotification(zdoReply->responseData());
+                qCDebug(dcZigbeeNetwork()) << "Energy scan finished on" << node << notification;
+                if (notification.status == ZigbeeDeviceProfile::StatusSuccess && !notification.energyValues.isEmpty()) {
+                    m_currentScan.nodes++;
+                    m_currentScan.totalTransmissions += notification.totalTransmissions;
+                    m_currentScan.transmissionFailures += notification.transmissionFailures;
+                    foreach (quint8 channel, notification.energyValues.keys()) {
+                        m_energySums[channel] += notification.energyValues.value(channel);
+                        m_energyCounts[channel]++;
+                    }
+                }
+            }
+        });
+
+        // Replies get deleted once finished or together with their node if it gets removed meanwhile
+        connect(zdoReply, &ZigbeeDeviceObjectReply::destroyed, this, [this](){
+            if (--m_pendingScans == 0) {
+                finishEnergyScan();
+            }
+        });
+    }
+
+    return true;
+}
+
+bool ZigbeeChannelManager::changeChannel(quint8 channel)
+{
+    if (m_state != StateIdle) {
+        qCWarning(dcZigbeeNetwork()) << "Cannot change the channel while" << m_state;
+        return false;
+    }
+
+    if (m_network->state() != ZigbeeNetwork::StateRunning) {
+        qCWarning(dcZigbeeNetwork()) << "Cannot change the channel while the network is not running.";
+        return false;
+    }
+
+    if (channel < 11 || channel > 26) {
+        qCWarning(dcZigbeeNetwork()) << "Cannot change to invalid channel" << channel;
+        return false;
+    }
+
+    if (static_cast<quint32>(channel) == m_network->channel()) {
+        qCDebug(dcZigbeeNetwork()) << "The network is already running on channel" << channel;
+        return false;
+    }
+
+    if (!m_network->channelChangeSupported()) {
+        qCWarning(dcZigbeeNetwork()) << "The controller of this network does not support changing the channel.";
+        return false;
+    }
+
+    m_targetChannel = channel;
+    m_lastMigration.start();
+    setState(StateChangingChannel);
+    sendChannelChange(channel);
+    return true;
+}
+
+void ZigbeeChannelManager::setState(State state)
+{
+    if (m_state == state)
+        return;
+
+    qCDebug(dcZigbeeNetwork()) << "Channel manager state changed" << state;
+    m_state = state;
+    emit stateChanged(m_state);
+}
+
+QList<ZigbeeNode *> ZigbeeChannelManager::scanNodes() const
+{
+    QList<ZigbeeNode *> nodes;
+    if (m_network->coordinatorNode())
+        nodes.append(m_network->coordinatorNode());
+
+    // The routers with the best link quality, they represent the radio environment around the coordinator
+    QList<ZigbeeNode *> routers;
+    foreach (ZigbeeNode *node, m_network->nodes()) {
+        if (node == m_network->coordinatorNode() || !node->reachable())
+            continue;
+
+        if (node->nodeDescriptor().nodeType == ZigbeeDeviceProfile::NodeTypeRouter) {
+            routers.append(node);
+        }
+    }
+
+    std::sort(routers.begin(), routers.end(), [](ZigbeeNode *first, ZigbeeNode *second){
+        return first->lqi() > second->lqi();
+    });
+
+    nodes.append(routers.mid(0, m_scanRouters));
+    return nodes;
+}
+
+void ZigbeeChannelManager::finishEnergyScan()
+{
+    m_currentScan.timestamp = QDateTime::currentDateTimeUtc();
+    foreach (quint8 channel, m_energySums.keys()) {
+        m_currentScan.energy.insert(channel, static_cast<quint8>(m_energySums.value(channel) / m_energyCounts.value(channel)));
+    }
+
+    setState(StateIdle);
+
+    if (m_currentScan.nodes == 0) {
+        qCWarning(dcZigbeeNetwork()) << "Energy scan finished without any results.";
+        return;
+    }
+
+    qCDebug(dcZigbeeNetwork()) << "Energy scan finished" << m_currentScan;
+    m_history.append(m_currentScan);
+    while (m_history.count() > m_historySize) {
+        m_history.removeFirst();
+    }
+
+    emit energyScanFinished(m_currentScan);
+    evaluateInterference();
+}
+
+void ZigbeeChannelManager::evaluateInterference()
+{
+    if (!sustainedInterference())
+        return;
+
+    const quint8 currentChannel = static_cast<quint8>(m_network->channel());
+    const int energy = averageEnergy(currentChannel, m_sustainedScans);
+    qCWarning(dcZigbeeNetwork()) << "Sustained interference on channel" << currentChannel << "energy" << energy;
+    emit interferenceDetected(currentChannel, energy);
+
+    if (!m_automaticMigration)
+        return;
+
+    if (m_lastMigration.isValid() && m_lastMigration.elapsed() < static_cast<qint64>(m_migrationCooldown) * 1000) {
+        qCDebug(dcZigbeeNetwork()) << "The channel has been changed recently, not migrating again yet.";
+        return;
+    }
+
+    const quint8 channel = recommendedChannel();
+    if (channel == 0) {
+        qCWarning(dcZigbeeNetwork()) << "There is no quieter channel available, staying on channel" << currentChannel;
+        return;
+    }
+
+    qCDebug(dcZigbeeNetwork()) << "Migrating the network from channel" << currentChannel << "to channel" << channel << "energy" << averageEnergy(channel);
+    changeChannel(channel);
+}
+
+void ZigbeeChannelManager::sendChannelChange(quint8 channel)
+{
+    // Continue from the update ID the network is currently using, it survives restarts only on the controller
+    m_network->readNetworkUpdateId([this, channel](bool success, quint8 networkUpdateId){
+        if (m_state != StateChangingChannel || m_targetChannel != channel)
+            return;
+
+        if (!success) {
+            qCWarning(dcZigbeeNetwork()) << "Failed to read the current network update ID from the controller.";
+            finishChannelChange(false);
+            return;
+        }
+
+        m_networkUpdateId = static_cast<quint8>(networkUpdateId + 1);
+
+        if (m_network->announcesChannelChange()) {
+            qCDebug(dcZigbeeNetwork()) << "Moving the controller to channel" << channel << "network update ID" << m_networkUpdateId;
+            m_changeTimer->start(s_channelChangeTimeout);
+            m_network->changeControllerChannel(channel, m_networkUpdateId);
+            return;
+        }
+
+        announceChannelChange(channel);
+    });
+}
+
+void ZigbeeChannelManager::announceChannelChange(quint8 channel)
+{
+    qCDebug(dcZigbeeNetwork()) << "Announce channel change to" << channel << "network update ID" << m_networkUpdateId;
+
+    // Mgmt_NWK_Update_req with scan duration 0xfe: change the channel to the one set in the channel mask
+    ZigbeeNetworkRequest request;
+    request.setRequestId(m_network->generateSequenceNumber());
+    request.setDestinationAddressMode(Zigbee::DestinationAddressModeShortAddress);
+    request.setDestinationShortAddress(Zigbee::BroadcastAddressAllNonSleepingNodes);
+    request.setDestinationEndpoint(0); // ZDO
+    request.setProfileId(Zigbee::ZigbeeProfileDevice); // ZDP
+    request.setClusterId(ZigbeeDeviceProfile::MgmtNetworkUpdateRequest);
+    request.setSourceEndpoint(0); // ZDO
+    request.setTxOptions(Zigbee::ZigbeeTxOptions());
+
+    QByteArray asdu;
+    QDataStream stream(&asdu, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << m_network->generateSequenceNumber() << static_cast<quint32>(1 << channel) << static_cast<quint8>(0xfe) << m_networkUpdateId;
+    request.setAsdu(asdu);
+
+    ZigbeeNetworkReply *networkReply = m_network->sendRequest(request);
+    connect(networkReply, &ZigbeeNetworkReply::finished, this, [this, networkReply, channel](){
+        if (networkReply->error() != ZigbeeNetworkReply::ErrorNoError) {
+            qCWarning(dcZigbeeNetwork()) << "Failed to announce the channel change" << networkReply->error();
+            finishChannelChange(false);
+            return;
+        }
+
+        // The routers switch after the broadcast delivery time, the controller follows at the same time
+        QTimer::singleShot(m_network->broadcastGovernor()->deliveryTime(), this, [this, channel](){
+            if (m_state != StateChangingChannel || m_targetChannel != channel)
+                return;
+
+            qCDebug(dcZigbeeNetwork()) << "Moving the controller to channel" << channel;
+            m_changeTimer->start(s_channelChangeTimeout);
+            m_network->changeControllerChannel(channel, m_networkUpdateId);
+        });
+    });
+}
+
+void ZigbeeChannelManager::finishChannelChange(bool success)
+{
+    if (m_state != StateChangingChannel)
+        return;
+
+    m_changeTimer->stop();
+    const quint8 channel = m_targetChannel;
+    m_targetChannel = 0;
+
+    if (success) {
+        qCDebug(dcZigbeeNetwork()) << "The network is running on channel" << channel << "now";
+    } else {
+        qCWarning(dcZigbeeNetwork()) << "Failed to change the network channel to" << channel;
+    }
+
+    setState(StateIdle);
+    emit channelChangeFinished(success, channel);
+}
+
+void ZigbeeChannelManager::processNetworkUpdateNotification(ZigbeeNode *node, const Zigbee::ApsdeDataIndication &indication)
+{
+    // Responses to our own scans are handled by the device object replies
+    if (m_state != StateIdle)
+        return;
+
+    ZigbeeDeviceProfile::NetworkUpdateNotification notification = ZigbeeDeviceProfile::parseNetworkUpdateNotification(indication.asdu);
+    qCDebug(dcZigbeeNetwork()) << "Network update notification from" << node << notification;
+
+    // Only check the channels if monitoring is enabled
+    if (m_scanInterval <= 0 && !m_automaticMigration)
+        return;
+
+    if (m_lastScan.isValid() && m_lastScan.elapsed() < s_reportScanInterval)
+        return;
+
+    qCDebug(dcZigbeeNetwork()) << "Interference reported by" << node << "Scanning the channels";
+    startEnergyScan();
+}
+
+void ZigbeeChannelManager::onNetworkStateChanged()
+{
+    if (m_state == StateChangingChannel && m_network->state() == ZigbeeNetwork::StateRunning && m_network->channel() == static_cast<quint32>(m_targetChannel)) {
+        finishChannelChange(true);
+    }
+
+    if (m_network->state() == ZigbeeNetwork::StateOffline || m_network->state() == ZigbeeNetwork::StateStopping) {
+        if (m_state == StateChangingChannel) {
+            finishChannelChange(false);
+        }
+    }
+
+    if (m_network->state() == ZigbeeNetwork::StateRunning && m_scanInterval > 0) {
+        if (!m_scanTimer->isActive() || m_scanTimer->interval() != m_scanInterval * 1000) {
+            m_scanTimer->start(m_scanInterval * 1000);
+        }
+    } else if (m_network->state() != ZigbeeNetwork::StateStarting) {
+        m_scanTimer->stop();
+    }
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeChannelManager::ChannelScan &scan)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "ChannelScan(" << scan.timestamp.toString(Qt::ISODate) << ", ";
+    debug.nospace() << "Nodes: " << scan.nodes << ", ";
+    debug.nospace() << "Transmissions: " << scan.totalTransmissions << ", ";
+    debug.nospace() << "Failures: " << scan.transmissionFailures << ", ";
+    debug.nospace() << "Energy: ";
+    foreach (quint8 channel, scan.energy.keys()) {
+        debug.nospace() << static_cast<int>(channel) << ":" << static_cast<int>(scan.energy.value(channel)) << " ";
+    }
+    debug.nospace() << ")";
+    return debug;
+}
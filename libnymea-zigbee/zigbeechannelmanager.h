@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEECHANNELMANAGER_H
+#define ZIGBEECHANNELMANAGER_H
+
+#include <QMap>
+#include <QDebug>
+#include <QTimer>
+#include <QObject>
+#include <QDateTime>
+#include <QElapsedTimer>
+
+#include "zigbee.h"
+
+class ZigbeeNode;
+class ZigbeeNetwork;
+
+// Monitors the energy on the channels of the network and moves the network to another channel if
+// the current one suffers from sustained interference, i.e. Wi-Fi congestion. The energy is measured
+// by the coordinator and a few routers using energy detect scans (Mgmt_NWK_Update_req). The channel
+// change is announced with a network update broadcast, afterwards the controller follows the network.
+// Controllers which announce the change on their own (i.e. Z-Stack) are only told to move.
+
+class ZigbeeChannelManager : public QObject
+{
+    Q_OBJECT
+
+    friend class ZigbeeNetwork;
+
+public:
+    enum State {
+        StateIdle,
+        StateScanning,
+        StateChangingChannel
+    };
+    Q_ENUM(State)
+
+    typedef struct ChannelScan {
+        QDateTime timestamp;
+        int nodes = 0; // Nodes which reported energy values
+        quint32 totalTransmissions = 0;
+        quint32 transmissionFailures = 0;
+        QMap<quint8, quint8> energy; // Average energy of all nodes per channel, 0x00 - 0xff
+    } ChannelScan;
+
+    State state() const;
+
+    // Interval (s) of the periodic energy scans while the network is running, 0 (default) disables them
+    int scanInterval() const;
+    void setScanInterval(int scanInterval);
+
+    // Scan time per channel: (2^n + 1) * 15.36 ms, 0 - 5
+    quint8 scanDuration() const;
+    void setScanDuration(quint8 scanDuration);
+
+    // Routers scanning in addition to the coordinator, by default only the coordinator scans
+    int scanRouters() const;
+    void setScanRouters(int scanRouters);
+
+    // Energy on the current channel which is considered as interference
+    quint8 interferenceThreshold() const;
+    void setInterferenceThreshold(quint8 interferenceThreshold);
+
+    // Consecutive scans above the threshold before the interference counts as sustained
+    int sustainedScans() const;
+    void setSustainedScans(int sustainedScans);
+
+    // Move the network to the recommended channel on sustained interference
+    bool automaticMigration() const;
+    void setAutomaticMigration(bool automaticMigration);
+
+    // Minimum time (s) between two automatic channel changes
+    int migrationCooldown() const;
+    void setMigrationCooldown(int migrationCooldown);
+
+    // Number of scans kept in the history
+    int historySize() const;
+    void setHistorySize(int historySize);
+
+    QList<ChannelScan> history() const;
+
+    // Average energy of the channel over the last scans (0 for all), -1 if the channel has not been scanned
+    int averageEnergy(quint8 channel, int scans = 0) const;
+
+    // The allowed channel with the lowest average energy, 0 if there is no better channel than the current one
+    quint8 recommendedChannel() const;
+
+    bool sustainedInterference() const;
+    quint8 networkUpdateId() const;
+
+    bool startEnergyScan();
+    bool changeChannel(quint8 channel);
+
+signals:
+    void stateChanged(State state);
+    void energyScanFinished(const ZigbeeChannelManager::ChannelScan &scan);
+    void interferenceDetected(quint8 channel, int energy);
+    void channelChangeFinished(bool success, quint8 channel);
+
+private:
+    explicit ZigbeeChannelManager(ZigbeeNetwork *network, QObject *parent = nullptr);
+
+    ZigbeeNetwork *m_network = nullptr;
+    State m_state = StateIdle;
+
+    int m_scanInterval = 0;
+    quint8 m_scanDuration = 2;
+    int m_scanRouters = 0;
+    quint8 m_interferenceThreshold = 150;
+    int m_sustainedScans = 3;
+    bool m_automaticMigration = false;
+    int m_migrationCooldown = 86400;
+    int m_historySize = 168;
+
+    QTimer *m_scanTimer = nullptr;
+    QTimer *m_changeTimer = nullptr;
+    QList<ChannelScan> m_history;
+    QElapsedTimer m_lastScan;
+    QElapsedTimer m_lastMigration;
+
+    // Scan in progress
+    int m_pendingScans = 0;
+    ChannelScan m_currentScan;
+    QMap<quint8, quint32> m_energySums;
+    QMap<quint8, int> m_energyCounts;
+
+    quint8 m_networkUpdateId = 0;
+    quint8 m_targetChannel = 0;
+
+    void setState(State state);
+    QList<ZigbeeNode *> scanNodes() const;
+    void finishEnergyScan();
+    void evaluateInterference();
+    void sendChannelChange(quint8 channel);
+    void announceChannelChange(quint8 channel);
+    void finishChannelChange(bool success);
+
+    void processNetworkUpdateNotification(ZigbeeNode *node, const Zigbee::ApsdeDataIndication &indication);
+
+private slots:
+    void onNetworkStateChanged();
+
+};
+
+QDebug operator<<(QDebug debug, const ZigbeeChannelManager::ChannelScan &scan);
+
+#endif // ZIGBEECHANNELMANAGER_H
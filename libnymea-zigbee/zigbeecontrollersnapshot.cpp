@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "zigbeecontrollersnapshot.h"
+#include "zigbeeutils.h"
+
+bool ZigbeeControllerSnapshot::isValid() const
+{
+    return !ieeeAddress.isNull() && panId != 0 && extendedPanId != 0 && channel != 0;
+}
+
+bool operator==(const ZigbeeControllerSnapshot &first, const ZigbeeControllerSnapshot &second)
+{
+    return first.ieeeAddress == second.ieeeAddress
+            && first.panId == second.panId
+            && first.extendedPanId == second.extendedPanId
+            && first.channel == second.channel
+            && first.networkKey == second.networkKey
+            && first.firmwareVersion == second.firmwareVersion;
+}
+
+bool operator!=(const ZigbeeControllerSnapshot &first, const ZigbeeControllerSnapshot &second)
+{
+    return !(first == second);
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeControllerSnapshot &snapshot)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "ZigbeeControllerSnapshot(" << snapshot.ieeeAddress.toString();
+    debug.nospace() << ", PAN ID: " << ZigbeeUtils::convertUint16ToHexString(snapshot.panId);
+    debug.nospace() << ", Extended PAN ID: " << ZigbeeUtils::convertUint64ToHexString(snapshot.extendedPanId);
+    debug.nospace() << ", Channel: " << snapshot.channel;
+    debug.nospace() << ", Firmware: " << snapshot.firmwareVersion;
+    debug.nospace() << ", " << snapshot.timestamp.toString("yyyy-MM-dd hh:mm:ss") << ")";
+    return debug;
+}
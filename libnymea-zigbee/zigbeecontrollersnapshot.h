@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef ZIGBEECONTROLLERSNAPSHOT_H
+#define ZIGBEECONTROLLERSNAPSHOT_H
+
+#include <QDebug>
+#include <QDateTime>
+
+#include "zigbeeaddress.h"
+#include "zigbeenetworkkey.h"
+
+// The controller state the network has been running with the last time. On a warm start the backends
+// compare a few controller reads with this snapshot and skip the full initialization if nothing changed.
+typedef struct ZigbeeControllerSnapshot {
+    ZigbeeAddress ieeeAddress;
+    quint16 panId = 0;
+    quint64 extendedPanId = 0;
+    quint8 channel = 0;
+    ZigbeeNetworkKey networkKey;
+    QString firmwareVersion;
+    QDateTime timestamp;
+
+    bool isValid() const;
+} ZigbeeControllerSnapshot;
+
+// Note: the timestamp is not compared
+bool operator==(const ZigbeeControllerSnapshot &first, const ZigbeeControllerSnapshot &second);
+bool operator!=(const ZigbeeControllerSnapshot &first, const ZigbeeControllerSnapshot &second);
+
+QDebug operator<<(QDebug debug, const ZigbeeControllerSnapshot &snapshot);
+
+#endif // ZIGBEECONTROLLERSNAPSHOT_H
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeeduplicatefilter.h"
+#include "zigbeeutils.h"
+#include "loggingcategory.h"
+
+ZigbeeDuplicateFilter::ZigbeeDuplicateFilter(QObject *parent) :
+    QObject(parent)
+{
+    m_clock.start();
+}
+
+int ZigbeeDuplicateFilter::window() const
+{
+    return m_window;
+}
+
+void ZigbeeDuplicateFilter::setWindow(int window)
+{
+    m_window = qMax(0, window);
+}
+
+bool ZigbeeDuplicateFilter::isDuplicate(const Zigbee::ApsdeDataIndication &indication)
+{
+    if (m_window <= 0)
+        return false;
+
+    m_checkedIndications++;
+    const qint64 now = m_clock.elapsed();
+    if (++m_checksSincePrune >= PruneInterval)
+        prune(now);
+
+    const uint seed = (static_cast<uint>(indication.sourceEndpoint) << 24) ^ (static_cast<uint>(indication.destinationEndpoint) << 16)
+            ^ (static_cast<uint>(indication.profileId) << 8) ^ indication.clusterId;
+    const quint32 hash = static_cast<quint32>(qHash(indication.asdu, seed));
+    const int length = indication.asdu.length();
+
+    Source &source = m_sources[indication.sourceShortAddress];
+    source.lastSeen = now;
+
+    for (int i = 0; i < EntriesPerSource; i++) {
+        const Entry &entry = source.entries[i];
+        if (entry.length == length && entry.hash == hash && now - entry.timestamp < m_window) {
+            source.suppressed++;
+            m_suppressedDuplicates++;
+            qCDebug(dcZigbeeNetwork()) << "Dropping duplicate indication from" << ZigbeeUtils::convertUint16ToHexString(indication.sourceShortAddress)
+                                       << "cluster" << ZigbeeUtils::convertUint16ToHexString(indication.clusterId)
+                                       << "received" << now - entry.timestamp << "ms ago";
+            return true;
+        }
+    }
+
+    Entry &entry = source.entries[source.next];
+    entry.hash = hash;
+    entry.length = length;
+    entry.timestamp = now;
+    source.next = (source.next + 1) % EntriesPerSource;
+    return false;
+}
+
+quint32 ZigbeeDuplicateFilter::checkedIndications() const
+{
+    return m_checkedIndications;
+}
+
+quint32 ZigbeeDuplicateFilter::suppressedDuplicates() const
+{
+    return m_suppressedDuplicates;
+}
+
+quint32 ZigbeeDuplicateFilter::suppressedDuplicates(quint16 shortAddress) const
+{
+    return m_sources.value(shortAddress).suppressed;
+}
+
+QHash<quint16, quint32> ZigbeeDuplicateFilter::suppressedDuplicatesPerSource() const
+{
+    QHash<quint16, quint32> suppressed;
+    for (QHash<quint16, Source>::const_iterator it = m_sources.constBegin(); it != m_sources.constEnd(); ++it) {
+        if (it.value().suppressed > 0) {
+            suppressed.insert(it.key(), it.value().suppressed);
+        }
+    }
+    return suppressed;
+}
+
+void ZigbeeDuplicateFilter::reset()
+{
+    m_sources.clear();
+    m_checkedIndications = 0;
+    m_suppressedDuplicates = 0;
+    m_checksSincePrune = 0;
+}
+
+void ZigbeeDuplicateFilter::prune(qint64 now)
+{
+    m_checksSincePrune = 0;
+
+    // Forget the windows of sources which have been quiet for a while, but keep the ones with statistics
+    QHash<quint16, Source>::iterator it = m_sources.begin();
+    while (it != m_sources.end()) {
+        if (it.value().suppressed == 0 && now - it.value().lastSeen >= m_window) {
+            it = m_sources.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
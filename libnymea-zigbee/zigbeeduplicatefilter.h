@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEDUPLICATEFILTER_H
+#define ZIGBEEDUPLICATEFILTER_H
+
+#include <QHash>
+#include <QObject>
+#include <QElapsedTimer>
+
+#include "zigbee.h"
+
+// Detects APS indications which have been received more than once, i.e. retransmissions whose
+// acknowledgement got lost or frames which arrived over multiple routes. For every source a small
+// window of recently seen frames is kept, identified by endpoints, profile, cluster and a hash of
+// the asdu, which contains the transaction sequence number and the payload.
+
+class ZigbeeDuplicateFilter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ZigbeeDuplicateFilter(QObject *parent = nullptr);
+
+    // Frames received again within this time (ms) are considered duplicates, 0 disables the filter
+    int window() const;
+    void setWindow(int window);
+
+    // Returns true if the same frame from the same source has been seen within the window
+    bool isDuplicate(const Zigbee::ApsdeDataIndication &indication);
+
+    // Statistics since the last reset
+    quint32 checkedIndications() const;
+    quint32 suppressedDuplicates() const;
+    quint32 suppressedDuplicates(quint16 shortAddress) const;
+    QHash<quint16, quint32> suppressedDuplicatesPerSource() const;
+
+    void reset();
+
+private:
+    enum {
+        EntriesPerSource = 8,
+        PruneInterval = 256
+    };
+
+    typedef struct Entry {
+        quint32 hash = 0;
+        int length = -1;
+        qint64 timestamp = 0;
+    } Entry;
+
+    typedef struct Source {
+        Entry entries[EntriesPerSource];
+        int next = 0;
+        qint64 lastSeen = 0;
+        quint32 suppressed = 0;
+    } Source;
+
+    int m_window = 3000;
+    QElapsedTimer m_clock;
+    QHash<quint16, Source> m_sources;
+
+    quint32 m_checkedIndications = 0;
+    quint32 m_suppressedDuplicates = 0;
+    int m_checksSincePrune = 0;
+
+    void prune(qint64 now);
+
+};
+
+#endif // ZIGBEEDUPLICATEFILTER_H
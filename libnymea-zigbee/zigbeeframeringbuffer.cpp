@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeeframeringbuffer.h"
+
+ZigbeeFrameRingBuffer::ZigbeeFrameRingBuffer(int capacity) :
+    m_head(0),
+    m_tail(0)
+{
+    m_entries.resize(qMax(capacity, 1) + 1);
+}
+
+int ZigbeeFrameRingBuffer::capacity() const
+{
+    return m_entries.count() - 1;
+}
+
+bool ZigbeeFrameRingBuffer::push(const QByteArray &frame, qint64 timestamp)
+{
+    int head = m_head.loadAcquire();
+    int next = nextIndex(head);
+    if (next == m_tail.loadAcquire())
+        return false;
+
+    m_entries[head].frame = frame;
+    m_entries[head].timestamp = timestamp;
+
+    // Publish the entry to the consumer
+    m_head.storeRelease(next);
+    return true;
+}
+
+bool ZigbeeFrameRingBuffer::pop(Entry *entry)
+{
+    int tail = m_tail.loadAcquire();
+    if (tail == m_head.loadAcquire())
+        return false;
+
+    // Move the data out of the slot, the producer can reuse it once the tail has been released
+    entry->frame = m_entries[tail].frame;
+    entry->timestamp = m_entries[tail].timestamp;
+    m_entries[tail].frame = QByteArray();
+
+    m_tail.storeRelease(nextIndex(tail));
+    return true;
+}
+
+bool ZigbeeFrameRingBuffer::isEmpty() const
+{
+    return m_tail.loadAcquire() == m_head.loadAcquire();
+}
+
+int ZigbeeFrameRingBuffer::nextIndex(int index) const
+{
+    return (index + 1) % m_entries.count();
+}
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEFRAMERINGBUFFER_H
+#define ZIGBEEFRAMERINGBUFFER_H
+
+#include <QVector>
+#include <QByteArray>
+#include <QAtomicInteger>
+
+// Lock-free ring buffer for handing over frames from exactly one producer
+// thread to exactly one consumer thread.
+
+class ZigbeeFrameRingBuffer
+{
+public:
+    typedef struct Entry {
+        QByteArray frame;
+        qint64 timestamp = 0;
+    } Entry;
+
+    explicit ZigbeeFrameRingBuffer(int capacity = 1024);
+
+    int capacity() const;
+
+    // Producer side, returns false if the buffer is full
+    bool push(const QByteArray &frame, qint64 timestamp);
+
+    // Consumer side, returns false if the buffer is empty
+    bool pop(Entry *entry);
+
+    bool isEmpty() const;
+
+private:
+    QVector<Entry> m_entries;
+
+    // Note: one slot stays always empty in order to distinguish between full and empty
+    QAtomicInteger<int> m_head; // Written by the producer only
+    QAtomicInteger<int> m_tail; // Written by the consumer only
+
+    int nextIndex(int index) const;
+
+};
+
+#endif // ZIGBEEFRAMERINGBUFFER_H
@@ -0,0 +1,473 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeegreenpowersink.h"
+#include "zigbeenetworkdatabase.h"
+#include "zigbeenetworkreply.h"
+#include "zigbeenetwork.h"
+#include "zigbeeutils.h"
+#include "loggingcategory.h"
+#include "zcl/zigbeeclusterlibrary.h"
+
+#include <QDataStream>
+
+// The Green Power endpoint is fixed by the specification
+static const quint8 s_endpointId = 242;
+
+// Green Power cluster commands
+static const quint8 s_notificationCommand = 0x00; // Client to server
+static const quint8 s_commissioningNotificationCommand = 0x04; // Client to server
+static const quint8 s_pairingCommand = 0x01; // Server to client
+static const quint8 s_proxyCommissioningModeCommand = 0x02; // Server to client
+
+// Copies of an unsecured frame forwarded by multiple proxies arrive within this time (ms)
+static const qint64 s_duplicateTimeout = 2000;
+
+static inline quint16 readUint16(const quint8 *data)
+{
+    return static_cast<quint16>(data[0] | (data[1] << 8));
+}
+
+static inline quint32 readUint32(const quint8 *data)
+{
+    return static_cast<quint32>(data[0]) | (static_cast<quint32>(data[1]) << 8) | (static_cast<quint32>(data[2]) << 16) | (static_cast<quint32>(data[3]) << 24);
+}
+
+ZigbeeGreenPowerSink::ZigbeeGreenPowerSink(ZigbeeNetwork *network, QObject *parent) :
+    QObject(parent),
+    m_network(network)
+{
+    m_clock.start();
+    connect(m_network, &ZigbeeNetwork::permitJoiningEnabledChanged, this, &ZigbeeGreenPowerSink::onPermitJoiningEnabledChanged);
+}
+
+quint16 ZigbeeGreenPowerSink::groupId() const
+{
+    return m_groupId;
+}
+
+void ZigbeeGreenPowerSink::setGroupId(quint16 groupId)
+{
+    m_groupId = groupId;
+}
+
+QList<ZigbeeGreenPowerSink::Device> ZigbeeGreenPowerSink::devices() const
+{
+    return m_devices.values();
+}
+
+bool ZigbeeGreenPowerSink::hasDevice(quint32 sourceId) const
+{
+    return m_devices.contains(sourceId);
+}
+
+ZigbeeGreenPowerSink::Device ZigbeeGreenPowerSink::device(quint32 sourceId) const
+{
+    return m_devices.value(sourceId);
+}
+
+void ZigbeeGreenPowerSink::removeDevice(quint32 sourceId)
+{
+    if (!m_devices.contains(sourceId))
+        return;
+
+    Device device = m_devices.take(sourceId);
+    m_lastFrameTimestamps.remove(sourceId);
+    qCDebug(dcZigbeeGreenPower()) << "Remove" << device;
+    sendPairing(device, true);
+
+    if (m_database)
+        m_database->removeGreenPowerDevice(sourceId);
+
+    emit deviceRemoved(sourceId);
+}
+
+void ZigbeeGreenPowerSink::setDatabase(ZigbeeNetworkDatabase *database)
+{
+    m_database = database;
+    if (!m_database) {
+        m_devices.clear();
+        m_lastFrameTimestamps.clear();
+    }
+}
+
+void ZigbeeGreenPowerSink::loadDevices()
+{
+    if (!m_database)
+        return;
+
+    m_devices.clear();
+    foreach (const Device &device, m_database->loadGreenPowerDevices()) {
+        m_devices.insert(device.sourceId, device);
+    }
+    qCDebug(dcZigbeeGreenPower()) << "Loaded" << m_devices.count() << "Green Power devices";
+}
+
+bool ZigbeeGreenPowerSink::processIndication(const Zigbee::ApsdeDataIndication &indication)
+{
+    if (indication.destinationEndpoint != s_endpointId)
+        return false;
+
+    // Note: this is called for every Green Power frame, parse the raw data in place
+    const quint8 *data = reinterpret_cast<const quint8 *>(indication.asdu.constData());
+    const int length = indication.asdu.length();
+
+    // ZCL header: frame control, optional manufacturer code, transaction sequence number and command
+    if (length < 3)
+        return false;
+
+    const quint8 frameControl = data[0];
+    int offset = (frameControl & 0x04) ? 3 : 1;
+    if ((frameControl & 0x03) != ZigbeeClusterLibrary::FrameTypeClusterSpecific || (frameControl & 0x08) || offset + 2 > length)
+        return false;
+
+    const quint8 zclCommand = data[offset + 1];
+    offset += 2;
+    if (zclCommand != s_notificationCommand && zclCommand != s_commissioningNotificationCommand)
+        return false;
+
+    const bool commissioningNotification = (zclCommand == s_commissioningNotificationCommand);
+
+    // Options, source ID, frame counter, GPD command and payload length
+    if (offset + 12 > length) {
+        qCDebug(dcZigbeeGreenPower()) << "Received invalid Green Power notification" << ZigbeeUtils::convertByteArrayToHexString(indication.asdu);
+        return true;
+    }
+
+    const quint16 options = readUint16(data + offset);
+    if ((options & 0x0007) != 0x0000) {
+        qCDebug(dcZigbeeGreenPower()) << "Ignoring Green Power notification of a device with IEEE address. Only devices with source ID are supported.";
+        return true;
+    }
+
+    // The commissioning notification has the security processing failed flag
+    if (commissioningNotification && (options & 0x0200)) {
+        qCDebug(dcZigbeeGreenPower()) << "Ignoring Green Power commissioning notification which failed the security processing on the proxy.";
+        return true;
+    }
+
+    const quint32 sourceId = readUint32(data + offset + 2);
+    const quint32 frameCounter = readUint32(data + offset + 6);
+    const quint8 commandId = data[offset + 10];
+    int payloadLength = data[offset + 11];
+    offset += 12;
+
+    // 0xff indicates that the payload is not included
+    if (payloadLength == 0xff)
+        payloadLength = 0;
+
+    if (offset + payloadLength > length) {
+        qCDebug(dcZigbeeGreenPower()) << "Received invalid Green Power notification" << ZigbeeUtils::convertByteArrayToHexString(indication.asdu);
+        return true;
+    }
+
+    const quint8 *payload = data + offset;
+    offset += payloadLength;
+
+    if (commandId == CommandCommissioning) {
+        processCommissioning(sourceId, frameCounter, payload, payloadLength);
+        return true;
+    }
+
+    QHash<quint32, Device>::iterator it = m_devices.find(sourceId);
+    if (it == m_devices.end()) {
+        qCDebug(dcZigbeeGreenPower()) << "Received frame from unknown Green Power device" << ZigbeeUtils::convertUint32ToHexString(sourceId) << ZigbeeUtils::convertByteToHexString(commandId);
+        return true;
+    }
+
+    if (!acceptFrame(it.value(), frameCounter))
+        return true;
+
+    const bool secured = it.value().securityLevel >= 2;
+    if (commandId == CommandDecommissioning) {
+        removeDevice(sourceId);
+        return true;
+    }
+
+    Notification notification;
+    notification.sourceId = sourceId;
+    notification.command = static_cast<Command>(commandId);
+    notification.payload = QByteArray(reinterpret_cast<const char *>(payload), payloadLength);
+    notification.frameCounter = frameCounter;
+    notification.proxyAddress = indication.sourceShortAddress;
+    notification.lqi = indication.lqi;
+
+    // The proxy which received the frame directly from the device
+    const quint16 proxyInfoFlag = commissioningNotification ? 0x0800 : 0x4000;
+    if ((options & proxyInfoFlag) && offset + 3 <= length)
+        notification.proxyAddress = readUint16(data + offset);
+
+    emit commandReceived(notification);
+
+    // Persist the frame counter of secured devices once the command has been dispatched
+    if (secured && m_database && m_devices.contains(sourceId))
+        m_database->saveGreenPowerDevice(m_devices.value(sourceId));
+
+    return true;
+}
+
+void ZigbeeGreenPowerSink::processCommissioning(quint32 sourceId, quint32 frameCounter, const quint8 *payload, int length)
+{
+    if (!m_network->permitJoiningEnabled()) {
+        qCDebug(dcZigbeeGreenPower()) << "Ignoring commissioning of Green Power device" << ZigbeeUtils::convertUint32ToHexString(sourceId) << "because the network does not permit joining.";
+        return;
+    }
+
+    // Device ID and options
+    if (length < 2) {
+        qCWarning(dcZigbeeGreenPower()) << "Received invalid commissioning command from Green Power device" << ZigbeeUtils::convertUint32ToHexString(sourceId);
+        return;
+    }
+
+    Device device;
+    device.sourceId = sourceId;
+    device.deviceType = static_cast<DeviceType>(payload[0]);
+    device.frameCounter = frameCounter;
+
+    const quint8 options = payload[1];
+    device.sequenceNumberCapabilities = (options & 0x01);
+    device.rxOnCapability = (options & 0x02);
+    int offset = 2;
+
+    if (options & 0x80) {
+        if (offset + 1 > length) {
+            qCWarning(dcZigbeeGreenPower()) << "Received invalid commissioning command from Green Power device" << ZigbeeUtils::convertUint32ToHexString(sourceId);
+            return;
+        }
+
+        const quint8 extendedOptions = payload[offset++];
+        device.securityLevel = extendedOptions & 0x03;
+        device.securityKeyType = (extendedOptions >> 2) & 0x07;
+
+        // Security key, encrypted with the default trust center link key if the MIC is present
+        if (extendedOptions & 0x20) {
+            const bool encrypted = (extendedOptions & 0x40);
+            if (offset + 16 + (encrypted ? 4 : 0) > length) {
+                qCWarning(dcZigbeeGreenPower()) << "Received invalid commissioning command from Green Power device" << ZigbeeUtils::convertUint32ToHexString(sourceId);
+                return;
+            }
+
+            device.securityKey = QByteArray(reinterpret_cast<const char *>(payload + offset), 16);
+            offset += 16;
+            if (encrypted) {
+                device.securityKey = m_network->decryptGreenPowerKey(sourceId, device.securityKey);
+                offset += 4;
+            }
+        }
+
+        // Outgoing security frame counter
+        if ((extendedOptions & 0x80) && offset + 4 <= length) {
+            device.frameCounter = readUint32(payload + offset);
+        }
+    }
+
+    const bool known = m_devices.contains(sourceId);
+    m_devices.insert(sourceId, device);
+    m_lastFrameTimestamps.insert(sourceId, m_clock.elapsed());
+
+    qCDebug(dcZigbeeGreenPower()) << "Commissioning" << device;
+    if (m_database)
+        m_database->saveGreenPowerDevice(device);
+
+    // Devices repeat the commissioning command until they see the pairing, the pairing can be sent again
+    sendPairing(device, false);
+
+    if (!known) {
+        emit deviceCommissioned(device);
+    }
+}
+
+bool ZigbeeGreenPowerSink::acceptFrame(Device &device, quint32 frameCounter)
+{
+    const qint64 now = m_clock.elapsed();
+    const qint64 lastFrame = m_lastFrameTimestamps.value(device.sourceId, -1);
+
+    if (device.securityLevel >= 2) {
+        // Secured devices increase the frame counter with every frame. This drops the copies forwarded
+        // by multiple proxies as well as replayed frames.
+        if (frameCounter <= device.frameCounter) {
+            qCDebug(dcZigbeeGreenPower()) << "Dropping frame from Green Power device" << ZigbeeUtils::convertUint32ToHexString(device.sourceId) << "with outdated frame counter" << frameCounter << "<=" << device.frameCounter;
+            return false;
+        }
+    } else {
+        // Without full security the frame counter is the MAC sequence number, which wraps around quickly.
+        // Only drop the copies of the same frame forwarded by multiple proxies.
+        if (frameCounter == device.frameCounter && lastFrame >= 0 && now - lastFrame < s_duplicateTimeout) {
+            return false;
+        }
+    }
+
+    device.frameCounter = frameCounter;
+    m_lastFrameTimestamps.insert(device.sourceId, now);
+    return true;
+}
+
+void ZigbeeGreenPowerSink::sendPairing(const Device &device, bool remove)
+{
+    // Application ID 0: the device is identified by the source ID
+    const bool groupForwarding = m_network->greenPowerGroupSupported();
+    ZigbeeNode *coordinatorNode = m_network->coordinatorNode();
+    if (!remove && !groupForwarding && !coordinatorNode) {
+        qCWarning(dcZigbeeGreenPower()) << "Cannot pair Green Power device" << ZigbeeUtils::convertUint32ToHexString(device.sourceId) << "without a coordinator node.";
+        return;
+    }
+
+    quint32 options = 0;
+    if (remove) {
+        options |= (1 << 4); // Remove GPD
+    } else {
+        options |= (1 << 3); // Add sink
+        // Groupcast forwarding to the pre-commissioned group ID, or lightweight unicast forwarding to the coordinator
+        options |= (groupForwarding ? 0x02 : 0x03) << 5;
+        if (device.sequenceNumberCapabilities)
+            options |= (1 << 8);
+
+        options |= (device.securityLevel & 0x03) << 9;
+        options |= (device.securityKeyType & 0x07) << 11;
+        options |= (1 << 14); // Security frame counter present
+        if (!device.securityKey.isEmpty())
+            options |= (1 << 15); // Security key present
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << static_cast<quint8>(options & 0xff);
+    stream << static_cast<quint8>((options >> 8) & 0xff);
+    stream << static_cast<quint8>((options >> 16) & 0xff);
+    stream << device.sourceId;
+    if (!remove) {
+        if (groupForwarding) {
+            stream << m_groupId;
+        } else {
+            stream << coordinatorNode->extendedAddress().toUInt64() << coordinatorNode->shortAddress();
+        }
+        stream << static_cast<quint8>(device.deviceType);
+        stream << device.frameCounter;
+        if (!device.securityKey.isEmpty()) {
+            stream.writeRawData(device.securityKey.constData(), device.securityKey.length());
+        }
+    }
+
+    qCDebug(dcZigbeeGreenPower()) << "Send pairing" << (remove ? "removal" : "") << "for Green Power device" << ZigbeeUtils::convertUint32ToHexString(device.sourceId);
+    sendProxyCommand(s_pairingCommand, payload);
+}
+
+void ZigbeeGreenPowerSink::sendProxyCommissioningMode(bool enabled, quint16 window)
+{
+    // Exit on commissioning window expiration or on the exit command
+    quint8 options = 0x0a;
+    if (enabled)
+        options |= 0x01;
+
+    // Without the sink group, the proxies have to send the commissioning notifications to us as unicasts
+    if (!m_network->greenPowerGroupSupported())
+        options |= 0x20;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << options;
+    stream << window;
+
+    qCDebug(dcZigbeeGreenPower()) << (enabled ? "Enter" : "Exit") << "proxy commissioning mode";
+    sendProxyCommand(s_proxyCommissioningModeCommand, payload);
+}
+
+void ZigbeeGreenPowerSink::sendProxyCommand(quint8 command, const QByteArray &payload)
+{
+    ZigbeeClusterLibrary::FrameControl frameControl;
+    frameControl.frameType = ZigbeeClusterLibrary::FrameTypeClusterSpecific;
+    frameControl.manufacturerSpecific = false;
+    frameControl.direction = ZigbeeClusterLibrary::DirectionServerToClient;
+    frameControl.disableDefaultResponse = true;
+
+    ZigbeeClusterLibrary::Header header;
+    header.frameControl = frameControl;
+    header.command = command;
+    header.transactionSequenceNumber = m_transactionSequenceNumber++;
+
+    ZigbeeClusterLibrary::Frame frame;
+    frame.header = header;
+    frame.payload = payload;
+
+    // Broadcast to the Green Power endpoint of all proxies
+    ZigbeeNetworkRequest request;
+    request.setRequestId(m_network->generateSequenceNumber());
+    request.setDestinationAddressMode(Zigbee::DestinationAddressModeShortAddress);
+    request.setDestinationShortAddress(Zigbee::BroadcastAddressAllNonSleepingNodes);
+    request.setDestinationEndpoint(s_endpointId);
+    request.setProfileId(Zigbee::ZigbeeProfileGreenPower);
+    request.setClusterId(ZigbeeClusterLibrary::ClusterIdGreenPower);
+    request.setSourceEndpoint(s_endpointId);
+    request.setRadius(30);
+    request.setAsdu(ZigbeeClusterLibrary::buildFrame(frame));
+
+    ZigbeeNetworkReply *reply = m_network->sendRequest(request);
+    connect(reply, &ZigbeeNetworkReply::finished, this, [reply, command](){
+        if (reply->error() != ZigbeeNetworkReply::ErrorNoError) {
+            qCWarning(dcZigbeeGreenPower()) << "Failed to send Green Power command" << ZigbeeUtils::convertByteToHexString(command) << reply->error();
+        }
+    });
+}
+
+void ZigbeeGreenPowerSink::onPermitJoiningEnabledChanged(bool permitJoiningEnabled)
+{
+    if (m_network->state() != ZigbeeNetwork::StateRunning)
+        return;
+
+    // Let the proxies forward commissioning frames while the network is open
+    sendProxyCommissioningMode(permitJoiningEnabled, permitJoiningEnabled ? m_network->permitJoiningDuration() : 0);
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeGreenPowerSink::Device &device)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "GreenPowerDevice(" << ZigbeeUtils::convertUint32ToHexString(device.sourceId);
+    debug.nospace() << ", " << device.deviceType;
+    debug.nospace() << ", security level: " << static_cast<int>(device.securityLevel);
+    if (!device.securityKey.isEmpty())
+        debug.nospace() << ", key type: " << static_cast<int>(device.securityKeyType);
+
+    debug.nospace() << ", frame counter: " << device.frameCounter << ")";
+    return debug;
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeGreenPowerSink::Notification &notification)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "GreenPowerNotification(" << ZigbeeUtils::convertUint32ToHexString(notification.sourceId);
+    debug.nospace() << ", " << notification.command;
+    if (!notification.payload.isEmpty())
+        debug.nospace() << ", payload: " << ZigbeeUtils::convertByteArrayToHexString(notification.payload);
+
+    debug.nospace() << ", frame counter: " << notification.frameCounter;
+    debug.nospace() << ", proxy: " << ZigbeeUtils::convertUint16ToHexString(notification.proxyAddress);
+    debug.nospace() << ", LQI: " << static_cast<int>(notification.lqi) << ")";
+    return debug;
+}
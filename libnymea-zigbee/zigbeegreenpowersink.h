@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEGREENPOWERSINK_H
+#define ZIGBEEGREENPOWERSINK_H
+
+#include <QHash>
+#include <QObject>
+#include <QElapsedTimer>
+
+#include "zigbee.h"
+
+class ZigbeeNetwork;
+class ZigbeeNetworkDatabase;
+
+// Green Power sink of the coordinator. Green Power devices (GPD) like battery-less switches are not nodes of the
+// network, the frames get forwarded by Green Power proxies (including the coordinator) as GP Notifications.
+// The sink keeps the commissioned devices with their security frame counters and emits the GPD commands
+// directly from the raw indication, without creating a ZCL frame or a node first.
+// Backends which add the coordinator Green Power endpoint to the sink group (TI) pair the proxies with groupcast
+// forwarding, all others with lightweight unicast forwarding to the coordinator. The frames the deCONZ firmware
+// receives directly from a GPD (Green Power data indications) are not handled, such devices need a proxy in range.
+
+class ZigbeeGreenPowerSink : public QObject
+{
+    Q_OBJECT
+
+    friend class ZigbeeNetwork;
+
+public:
+    enum DeviceType {
+        DeviceTypeSimpleGenericOneStateSwitch = 0x00,
+        DeviceTypeSimpleGenericTwoStateSwitch = 0x01,
+        DeviceTypeOnOffSwitch = 0x02,
+        DeviceTypeLevelControlSwitch = 0x03,
+        DeviceTypeSimpleSensor = 0x04,
+        DeviceTypeAdvancedGenericOneStateSwitch = 0x05,
+        DeviceTypeAdvancedGenericTwoStateSwitch = 0x06,
+        DeviceTypeGenericEightContactSwitch = 0x07,
+        DeviceTypeColorDimmerSwitch = 0x10,
+        DeviceTypeLightSensor = 0x11,
+        DeviceTypeOccupancySensor = 0x12,
+        DeviceTypeDoorLockController = 0x20,
+        DeviceTypeTemperatureSensor = 0x30,
+        DeviceTypePressureSensor = 0x31,
+        DeviceTypeFlowSensor = 0x32,
+        DeviceTypeIndoorEnvironmentSensor = 0x33,
+        DeviceTypeManufacturerSpecific = 0xFE
+    };
+    Q_ENUM(DeviceType)
+
+    enum Command {
+        CommandIdentify = 0x00,
+        CommandRecallScene0 = 0x10,
+        CommandRecallScene1 = 0x11,
+        CommandRecallScene2 = 0x12,
+        CommandRecallScene3 = 0x13,
+        CommandRecallScene4 = 0x14,
+        CommandRecallScene5 = 0x15,
+        CommandRecallScene6 = 0x16,
+        CommandRecallScene7 = 0x17,
+        CommandStoreScene0 = 0x18,
+        CommandStoreScene1 = 0x19,
+        CommandStoreScene2 = 0x1A,
+        CommandStoreScene3 = 0x1B,
+        CommandStoreScene4 = 0x1C,
+        CommandStoreScene5 = 0x1D,
+        CommandStoreScene6 = 0x1E,
+        CommandStoreScene7 = 0x1F,
+        CommandOff = 0x20,
+        CommandOn = 0x21,
+        CommandToggle = 0x22,
+        CommandRelease = 0x23,
+        CommandMoveUp = 0x30,
+        CommandMoveDown = 0x31,
+        CommandStepUp = 0x32,
+        CommandStepDown = 0x33,
+        CommandLevelControlStop = 0x34,
+        CommandMoveUpWithOnOff = 0x35,
+        CommandMoveDownWithOnOff = 0x36,
+        CommandStepUpWithOnOff = 0x37,
+        CommandStepDownWithOnOff = 0x38,
+        CommandMoveHueStop = 0x40,
+        CommandMoveHueUp = 0x41,
+        CommandMoveHueDown = 0x42,
+        CommandStepHueUp = 0x43,
+        CommandStepHueDown = 0x44,
+        CommandMoveSaturationStop = 0x45,
+        CommandMoveSaturationUp = 0x46,
+        CommandMoveSaturationDown = 0x47,
+        CommandStepSaturationUp = 0x48,
+        CommandStepSaturationDown = 0x49,
+        CommandMoveColor = 0x4A,
+        CommandStepColor = 0x4B,
+        CommandLockDoor = 0x50,
+        CommandUnlockDoor = 0x51,
+        CommandPress1Of1 = 0x60,
+        CommandRelease1Of1 = 0x61,
+        CommandPress1Of2 = 0x62,
+        CommandRelease1Of2 = 0x63,
+        CommandPress2Of2 = 0x64,
+        CommandRelease2Of2 = 0x65,
+        CommandShortPress1Of1 = 0x66,
+        CommandShortPress1Of2 = 0x67,
+        CommandShortPress2Of2 = 0x68,
+        CommandEightBitVectorPress = 0x69,
+        CommandEightBitVectorRelease = 0x6A,
+        CommandAttributeReporting = 0xA0,
+        CommandManufacturerSpecificAttributeReporting = 0xA1,
+        CommandMultiClusterReporting = 0xA2,
+        CommandManufacturerSpecificMultiClusterReporting = 0xA3,
+        CommandRequestAttributes = 0xA4,
+        CommandReadAttributeResponse = 0xA5,
+        CommandZclTunneling = 0xA6,
+        CommandCommissioning = 0xE0,
+        CommandDecommissioning = 0xE1,
+        CommandSuccess = 0xE2,
+        CommandChannelRequest = 0xE3
+    };
+    Q_ENUM(Command)
+
+    typedef struct Device {
+        quint32 sourceId = 0;
+        DeviceType deviceType = DeviceTypeManufacturerSpecific;
+        bool sequenceNumberCapabilities = false;
+        bool rxOnCapability = false;
+        quint8 securityLevel = 0;
+        quint8 securityKeyType = 0;
+        QByteArray securityKey;
+        quint32 frameCounter = 0;
+    } Device;
+
+    typedef struct Notification {
+        quint32 sourceId = 0;
+        Command command = CommandIdentify;
+        QByteArray payload;
+        quint32 frameCounter = 0;
+        quint16 proxyAddress = 0;
+        quint8 lqi = 0;
+    } Notification;
+
+    explicit ZigbeeGreenPowerSink(ZigbeeNetwork *network, QObject *parent = nullptr);
+
+    // The group the proxies forward the notifications to if the backend supports it. Has to be set before the network starts.
+    quint16 groupId() const;
+    void setGroupId(quint16 groupId);
+
+    QList<Device> devices() const;
+    bool hasDevice(quint32 sourceId) const;
+    Device device(quint32 sourceId) const;
+
+    // Removes the pairing from all proxies and forgets the device
+    void removeDevice(quint32 sourceId);
+
+signals:
+    // Devices can only be commissioned while the network permits joining
+    void deviceCommissioned(const ZigbeeGreenPowerSink::Device &device);
+    void deviceRemoved(quint32 sourceId);
+    void commandReceived(const ZigbeeGreenPowerSink::Notification &notification);
+
+private:
+    ZigbeeNetwork *m_network = nullptr;
+    ZigbeeNetworkDatabase *m_database = nullptr;
+    quint16 m_groupId = 0x0b84;
+    quint8 m_transactionSequenceNumber = 0;
+
+    QHash<quint32, Device> m_devices;
+
+    // Monotonic receive time of the last accepted frame for duplicate detection of unsecured devices
+    QElapsedTimer m_clock;
+    QHash<quint32, qint64> m_lastFrameTimestamps;
+
+    // Called by the network
+    void setDatabase(ZigbeeNetworkDatabase *database);
+    void loadDevices();
+
+    // Returns false if the indication is not a GP Notification or GP Commissioning Notification
+    bool processIndication(const Zigbee::ApsdeDataIndication &indication);
+
+    void processCommissioning(quint32 sourceId, quint32 frameCounter, const quint8 *payload, int length);
+    bool acceptFrame(Device &device, quint32 frameCounter);
+
+    void sendPairing(const Device &device, bool remove);
+    void sendProxyCommissioningMode(bool enabled, quint16 window);
+    void sendProxyCommand(quint8 command, const QByteArray &payload);
+
+private slots:
+    void onPermitJoiningEnabledChanged(bool permitJoiningEnabled);
+
+};
+
+QDebug operator<<(QDebug debug, const ZigbeeGreenPowerSink::Device &device);
+QDebug operator<<(QDebug debug, const ZigbeeGreenPowerSink::Notification &notification);
+
+#endif // ZIGBEEGREENPOWERSINK_H
@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeeiothread.h"
+#include "zigbeemetrics.h"
+#include "loggingcategory.h"
+
+#include <QTimer>
+#include <QSemaphore>
+
+ZigbeeIoThread::ZigbeeIoThread(const QString &name, QObject *parent) :
+    QObject(parent),
+    m_processPending(0)
+{
+    m_timer.start();
+
+    m_droppedFramesCounter = ZigbeeMetrics::instance()->counter("zigbee_interface_frames_dropped_total", "Number of received frames dropped because the network thread did not keep up.", QString("thread=\"%1\"").arg(name));
+    m_dispatchLatencyHistogram = ZigbeeMetrics::instance()->histogram("zigbee_interface_dispatch_latency_microseconds", "Time between decoding a frame in the I/O thread and processing it in the network thread.", {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000}, QString("thread=\"%1\"").arg(name));
+
+    m_thread = new QThread();
+    m_thread->setObjectName(name);
+
+    // The context object lives in the I/O thread and is used to schedule functions in it
+    m_context = new QObject();
+    m_context->moveToThread(m_thread);
+
+    m_thread->start(QThread::HighPriority);
+    qCDebug(dcZigbeeInterface()) << "Started I/O thread" << name;
+}
+
+ZigbeeIoThread::~ZigbeeIoThread()
+{
+    m_thread->quit();
+    m_thread->wait();
+    delete m_context;
+    delete m_thread;
+    qCDebug(dcZigbeeInterface()) << "I/O thread stopped";
+}
+
+bool ZigbeeIoThread::isCurrentThread() const
+{
+    return QThread::currentThread() == m_thread;
+}
+
+void ZigbeeIoThread::moveToIoThread(QObject *object)
+{
+    object->moveToThread(m_thread);
+}
+
+void ZigbeeIoThread::execute(const std::function<void()> &function)
+{
+    if (isCurrentThread()) {
+        function();
+        return;
+    }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    QMetaObject::invokeMethod(m_context, function, Qt::BlockingQueuedConnection);
+#else
+    QSemaphore semaphore;
+    QTimer::singleShot(0, m_context, [&function, &semaphore](){
+        function();
+        semaphore.release();
+    });
+    semaphore.acquire();
+#endif
+}
+
+void ZigbeeIoThread::post(const std::function<void()> &function)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    QMetaObject::invokeMethod(m_context, function, Qt::QueuedConnection);
+#else
+    QTimer::singleShot(0, m_context, function);
+#endif
+}
+
+void ZigbeeIoThread::enqueueFrame(const QByteArray &frame)
+{
+    if (!m_frames.push(frame, m_timer.nsecsElapsed() / 1000)) {
+        qCWarning(dcZigbeeInterface()) << "The frame buffer is full. The network thread does not keep up with processing the received frames. Dropping frame.";
+        m_droppedFramesCounter->increment();
+        return;
+    }
+
+    // Wake up the consumer only once until it processed the pending frames
+    if (m_processPending.testAndSetOrdered(0, 1)) {
+        QMetaObject::invokeMethod(this, "processFrames", Qt::QueuedConnection);
+    }
+}
+
+void ZigbeeIoThread::processFrames()
+{
+    // Reset before draining, frames arriving from now on will schedule a new run
+    m_processPending.storeRelease(0);
+
+    ZigbeeFrameRingBuffer::Entry entry;
+    while (m_frames.pop(&entry)) {
+        m_dispatchLatencyHistogram->observe(m_timer.nsecsElapsed() / 1000 - entry.timestamp);
+        emit frameReceived(entry.frame);
+    }
+}
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEIOTHREAD_H
+#define ZIGBEEIOTHREAD_H
+
+#include <QThread>
+#include <QObject>
+#include <QElapsedTimer>
+
+#include <functional>
+
+#include "zigbeeframeringbuffer.h"
+
+class ZigbeeMetricCounter;
+class ZigbeeMetricHistogram;
+
+// Dedicated thread for the serial communication of an interface. Received frames
+// are handed over using a lock-free ring buffer and emitted in the thread of this object.
+
+class ZigbeeIoThread : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ZigbeeIoThread(const QString &name, QObject *parent = nullptr);
+    ~ZigbeeIoThread();
+
+    bool isCurrentThread() const;
+
+    // Note: the object must not have a parent
+    void moveToIoThread(QObject *object);
+
+    // Run the given function in the I/O thread and wait until it has been executed
+    void execute(const std::function<void()> &function);
+
+    // Run the given function in the I/O thread without waiting for it
+    void post(const std::function<void()> &function);
+
+    // Called from the I/O thread only
+    void enqueueFrame(const QByteArray &frame);
+
+signals:
+    void frameReceived(const QByteArray &frame);
+
+private slots:
+    void processFrames();
+
+private:
+    QThread *m_thread = nullptr;
+    QObject *m_context = nullptr;
+    QElapsedTimer m_timer;
+
+    ZigbeeFrameRingBuffer m_frames;
+    QAtomicInteger<int> m_processPending;
+
+    ZigbeeMetricCounter *m_droppedFramesCounter = nullptr;
+    ZigbeeMetricHistogram *m_dispatchLatencyHistogram = nullptr;
+
+};
+
+#endif // ZIGBEEIOTHREAD_H
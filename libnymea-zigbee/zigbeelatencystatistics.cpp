@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeelatencystatistics.h"
+#include "loggingcategory.h"
+#include "zigbeeutils.h"
+
+#include <QtMath>
+#include <QMetaEnum>
+
+// Acks of buffered requests for sleepy nodes may take a while, anything older got lost
+static const qint64 s_acknowledgementTimeout = 30000;
+
+ZigbeeLatencyHistogram::ZigbeeLatencyHistogram()
+{
+    m_buckets.fill(0, bucketBoundaries().count() + 1);
+}
+
+QList<qint64> ZigbeeLatencyHistogram::bucketBoundaries()
+{
+    static const QList<qint64> boundaries = { 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 20000 };
+    return boundaries;
+}
+
+void ZigbeeLatencyHistogram::addSample(qint64 latency)
+{
+    if (latency < 0)
+        return;
+
+    QList<qint64> boundaries = bucketBoundaries();
+    int bucket = boundaries.count();
+    for (int i = 0; i < boundaries.count(); i++) {
+        if (latency <= boundaries.at(i)) {
+            bucket = i;
+            break;
+        }
+    }
+
+    m_buckets[bucket]++;
+
+    if (m_count == 0 || latency < m_minimum)
+        m_minimum = latency;
+
+    if (m_count == 0 || latency > m_maximum)
+        m_maximum = latency;
+
+    m_count++;
+    m_sum += latency;
+}
+
+quint32 ZigbeeLatencyHistogram::count() const
+{
+    return m_count;
+}
+
+qint64 ZigbeeLatencyHistogram::minimum() const
+{
+    return m_minimum;
+}
+
+qint64 ZigbeeLatencyHistogram::maximum() const
+{
+    return m_maximum;
+}
+
+qint64 ZigbeeLatencyHistogram::average() const
+{
+    if (m_count == 0)
+        return 0;
+
+    return m_sum / m_count;
+}
+
+qint64 ZigbeeLatencyHistogram::percentile(double percent) const
+{
+    if (m_count == 0)
+        return 0;
+
+    QList<qint64> boundaries = bucketBoundaries();
+    quint32 threshold = qCeil(m_count * qBound(0.0, percent, 100.0) / 100.0);
+    quint32 sum = 0;
+    for (int i = 0; i < m_buckets.count(); i++) {
+        sum += m_buckets.at(i);
+        if (sum >= threshold && sum > 0) {
+            // The bucket boundary is an upper bound, never report more than the real maximum
+            if (i >= boundaries.count())
+                return m_maximum;
+
+            return qMin(boundaries.at(i), m_maximum);
+        }
+    }
+
+    return m_maximum;
+}
+
+QVector<quint32> ZigbeeLatencyHistogram::buckets() const
+{
+    return m_buckets;
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeLatencyHistogram &histogram)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "LatencyHistogram(count: " << histogram.count();
+    if (histogram.count() > 0) {
+        debug.nospace() << ", min: " << histogram.minimum() << " ms";
+        debug.nospace() << ", avg: " << histogram.average() << " ms";
+        debug.nospace() << ", p50: " << histogram.percentile(50) << " ms";
+        debug.nospace() << ", p95: " << histogram.percentile(95) << " ms";
+        debug.nospace() << ", max: " << histogram.maximum() << " ms";
+    }
+    debug.nospace() << ")";
+    return debug;
+}
+
+
+ZigbeeLatencyStatistics::ZigbeeLatencyStatistics(QObject *parent) :
+    QObject(parent)
+{
+    m_totalHistograms.fill(ZigbeeLatencyHistogram(), phaseCount());
+
+    m_dumpTimer = new QTimer(this);
+    m_dumpTimer->setSingleShot(false);
+    connect(m_dumpTimer, &QTimer::timeout, this, &ZigbeeLatencyStatistics::dump);
+}
+
+QList<quint16> ZigbeeLatencyStatistics::clusterIds() const
+{
+    return m_clusterHistograms.keys();
+}
+
+QList<ZigbeeAddress> ZigbeeLatencyStatistics::nodeAddresses() const
+{
+    return m_nodeHistograms.keys();
+}
+
+ZigbeeLatencyHistogram ZigbeeLatencyStatistics::clusterHistogram(quint16 clusterId, Phase phase) const
+{
+    if (!m_clusterHistograms.contains(clusterId))
+        return ZigbeeLatencyHistogram();
+
+    return m_clusterHistograms.value(clusterId).at(phase);
+}
+
+ZigbeeLatencyHistogram ZigbeeLatencyStatistics::nodeHistogram(const ZigbeeAddress &address, Phase phase) const
+{
+    if (!m_nodeHistograms.contains(address))
+        return ZigbeeLatencyHistogram();
+
+    return m_nodeHistograms.value(address).at(phase);
+}
+
+ZigbeeLatencyHistogram ZigbeeLatencyStatistics::totalHistogram(Phase phase) const
+{
+    return m_totalHistograms.at(phase);
+}
+
+void ZigbeeLatencyStatistics::addSample(Phase phase, quint16 clusterId, const ZigbeeAddress &address, qint64 latency)
+{
+    if (latency < 0)
+        return;
+
+    m_totalHistograms[phase].addSample(latency);
+
+    if (!m_clusterHistograms.contains(clusterId))
+        m_clusterHistograms.insert(clusterId, QVector<ZigbeeLatencyHistogram>(phaseCount()));
+
+    m_clusterHistograms[clusterId][phase].addSample(latency);
+
+    // Group and broadcast requests have no node
+    if (address.isNull())
+        return;
+
+    if (!m_nodeHistograms.contains(address))
+        m_nodeHistograms.insert(address, QVector<ZigbeeLatencyHistogram>(phaseCount()));
+
+    m_nodeHistograms[address][phase].addSample(latency);
+}
+
+void ZigbeeLatencyStatistics::trackAcknowledgement(quint8 requestId, quint16 clusterId, const ZigbeeAddress &address, const QElapsedTimer &timer)
+{
+    removeExpiredAcknowledgements(requestId);
+
+    PendingAcknowledgement pendingAcknowledgement;
+    pendingAcknowledgement.clusterId = clusterId;
+    pendingAcknowledgement.address = address;
+    pendingAcknowledgement.timer = timer;
+    m_pendingAcknowledgements[requestId].append(pendingAcknowledgement);
+}
+
+void ZigbeeLatencyStatistics::processAcknowledgement(quint8 requestId, quint16 clusterId)
+{
+    removeExpiredAcknowledgements(requestId);
+    if (!m_pendingAcknowledgements.contains(requestId))
+        return;
+
+    QList<PendingAcknowledgement> &pendingAcknowledgements = m_pendingAcknowledgements[requestId];
+    for (int i = 0; i < pendingAcknowledgements.count(); i++) {
+        if (pendingAcknowledgements.at(i).clusterId != clusterId)
+            continue;
+
+        PendingAcknowledgement pendingAcknowledgement = pendingAcknowledgements.takeAt(i);
+        if (pendingAcknowledgements.isEmpty())
+            m_pendingAcknowledgements.remove(requestId);
+
+        addSample(PhaseAcknowledgement, pendingAcknowledgement.clusterId, pendingAcknowledgement.address, pendingAcknowledgement.timer.elapsed());
+        return;
+    }
+}
+
+void ZigbeeLatencyStatistics::removeExpiredAcknowledgements(quint8 requestId)
+{
+    if (!m_pendingAcknowledgements.contains(requestId))
+        return;
+
+    // Note: entries are appended in the order of the requests, the oldest ones are first
+    QList<PendingAcknowledgement> &pendingAcknowledgements = m_pendingAcknowledgements[requestId];
+    while (!pendingAcknowledgements.isEmpty() && pendingAcknowledgements.first().timer.hasExpired(s_acknowledgementTimeout))
+        pendingAcknowledgements.removeFirst();
+
+    if (pendingAcknowledgements.isEmpty())
+        m_pendingAcknowledgements.remove(requestId);
+}
+
+int ZigbeeLatencyStatistics::dumpInterval() const
+{
+    return m_dumpTimer->interval() / 1000;
+}
+
+void ZigbeeLatencyStatistics::setDumpInterval(int dumpInterval)
+{
+    if (dumpInterval <= 0) {
+        m_dumpTimer->stop();
+        return;
+    }
+
+    m_dumpTimer->setInterval(dumpInterval * 1000);
+    m_dumpTimer->start();
+}
+
+void ZigbeeLatencyStatistics::reset()
+{
+    m_totalHistograms.fill(ZigbeeLatencyHistogram(), phaseCount());
+    m_clusterHistograms.clear();
+    m_nodeHistograms.clear();
+    m_pendingAcknowledgements.clear();
+}
+
+void ZigbeeLatencyStatistics::dump() const
+{
+    QMetaEnum metaEnum = QMetaEnum::fromType<ZigbeeLatencyStatistics::Phase>();
+
+    qCDebug(dcZigbeeLatency()) << "========== Request latency statistics ==========";
+    for (int i = 0; i < phaseCount(); i++) {
+        qCDebug(dcZigbeeLatency()) << "Total" << metaEnum.valueToKey(i) << m_totalHistograms.at(i);
+    }
+
+    foreach (quint16 clusterId, m_clusterHistograms.keys()) {
+        qCDebug(dcZigbeeLatency()) << "Cluster" << ZigbeeUtils::clusterIdToString(static_cast<ZigbeeClusterLibrary::ClusterId>(clusterId));
+        QVector<ZigbeeLatencyHistogram> histograms = m_clusterHistograms.value(clusterId);
+        for (int i = 0; i < phaseCount(); i++) {
+            const ZigbeeLatencyHistogram &histogram = histograms.at(i);
+            if (histogram.count() == 0)
+                continue;
+
+            qCDebug(dcZigbeeLatency()) << "    " << metaEnum.valueToKey(i) << histogram;
+        }
+    }
+
+    foreach (const ZigbeeAddress &address, m_nodeHistograms.keys()) {
+        qCDebug(dcZigbeeLatency()) << "Node" << address;
+        QVector<ZigbeeLatencyHistogram> histograms = m_nodeHistograms.value(address);
+        for (int i = 0; i < phaseCount(); i++) {
+            const ZigbeeLatencyHistogram &histogram = histograms.at(i);
+            if (histogram.count() == 0)
+                continue;
+
+            qCDebug(dcZigbeeLatency()) << "    " << metaEnum.valueToKey(i) << histogram;
+        }
+    }
+}
+
+int ZigbeeLatencyStatistics::phaseCount()
+{
+    return QMetaEnum::fromType<ZigbeeLatencyStatistics::Phase>().keyCount();
+}
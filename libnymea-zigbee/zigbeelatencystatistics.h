@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEELATENCYSTATISTICS_H
+#define ZIGBEELATENCYSTATISTICS_H
+
+#include <QMap>
+#include <QHash>
+#include <QDebug>
+#include <QTimer>
+#include <QObject>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "zigbeeaddress.h"
+
+class ZigbeeLatencyHistogram
+{
+public:
+    ZigbeeLatencyHistogram();
+
+    // Upper bucket boundaries in ms, the last bucket collects everything above
+    static QList<qint64> bucketBoundaries();
+
+    void addSample(qint64 latency);
+
+    quint32 count() const;
+    qint64 minimum() const;
+    qint64 maximum() const;
+    qint64 average() const;
+
+    // Approximation based on the bucket boundaries
+    qint64 percentile(double percent) const;
+
+    QVector<quint32> buckets() const;
+
+private:
+    QVector<quint32> m_buckets;
+    quint32 m_count = 0;
+    qint64 m_sum = 0;
+    qint64 m_minimum = 0;
+    qint64 m_maximum = 0;
+
+};
+
+QDebug operator<<(QDebug debug, const ZigbeeLatencyHistogram &histogram);
+
+
+class ZigbeeLatencyStatistics : public QObject
+{
+    Q_OBJECT
+
+public:
+    // All phases are measured relative to the moment the request has been enqueued
+    enum Phase {
+        PhaseSerialWrite,
+        PhaseConfirm,
+        PhaseAcknowledgement,
+        PhaseResponse
+    };
+    Q_ENUM(Phase)
+
+    explicit ZigbeeLatencyStatistics(QObject *parent = nullptr);
+
+    QList<quint16> clusterIds() const;
+    QList<ZigbeeAddress> nodeAddresses() const;
+
+    ZigbeeLatencyHistogram clusterHistogram(quint16 clusterId, Phase phase) const;
+    ZigbeeLatencyHistogram nodeHistogram(const ZigbeeAddress &address, Phase phase) const;
+    ZigbeeLatencyHistogram totalHistogram(Phase phase) const;
+
+    void addSample(Phase phase, quint16 clusterId, const ZigbeeAddress &address, qint64 latency);
+
+    // APS acks arrive after the network reply has been finished, remember the
+    // start time of the request by its APS request id until the ack arrives.
+    // The request id wraps around, so the ack is matched with the oldest pending
+    // request using the same id and cluster. Entries without ack expire.
+    void trackAcknowledgement(quint8 requestId, quint16 clusterId, const ZigbeeAddress &address, const QElapsedTimer &timer);
+    void processAcknowledgement(quint8 requestId, quint16 clusterId);
+
+    // Periodic dump of the statistics into the log, 0 disables the dump
+    int dumpInterval() const;
+    void setDumpInterval(int dumpInterval);
+
+    void reset();
+
+public slots:
+    void dump() const;
+
+private:
+    typedef struct PendingAcknowledgement {
+        quint16 clusterId = 0;
+        ZigbeeAddress address;
+        QElapsedTimer timer;
+    } PendingAcknowledgement;
+
+    QTimer *m_dumpTimer = nullptr;
+
+    QVector<ZigbeeLatencyHistogram> m_totalHistograms;
+    QMap<quint16, QVector<ZigbeeLatencyHistogram>> m_clusterHistograms;
+    QMap<ZigbeeAddress, QVector<ZigbeeLatencyHistogram>> m_nodeHistograms;
+    QHash<quint8, QList<PendingAcknowledgement>> m_pendingAcknowledgements;
+
+    static int phaseCount();
+    void removeExpiredAcknowledgements(quint8 requestId);
+
+};
+
+#endif // ZIGBEELATENCYSTATISTICS_H
@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeemetrics.h"
+#include "loggingcategory.h"
+
+#include <QTextStream>
+
+#include <algorithm>
+
+void ZigbeeMetricCounter::increment(quint64 value)
+{
+    m_shards[ZigbeeMetrics::currentShard()].value.fetchAndAddRelaxed(value);
+}
+
+quint64 ZigbeeMetricCounter::value() const
+{
+    quint64 sum = 0;
+    for (const Shard &shard : m_shards) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        sum += shard.value.loadRelaxed();
+#else
+        sum += shard.value.load();
+#endif
+    }
+    return sum;
+}
+
+void ZigbeeMetricGauge::set(qint64 value)
+{
+    m_value.fetchAndStoreRelaxed(value);
+}
+
+void ZigbeeMetricGauge::add(qint64 value)
+{
+    m_value.fetchAndAddRelaxed(value);
+}
+
+qint64 ZigbeeMetricGauge::value() const
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    return m_value.loadRelaxed();
+#else
+    return m_value.load();
+#endif
+}
+
+ZigbeeMetricHistogram::ZigbeeMetricHistogram(const QList<quint64> &bucketBoundaries) :
+    m_bucketBoundaries(bucketBoundaries)
+{
+    std::sort(m_bucketBoundaries.begin(), m_bucketBoundaries.end());
+    for (int i = 0; i <= m_bucketBoundaries.count(); i++) {
+        m_buckets.append(new ZigbeeMetricCounter());
+    }
+}
+
+ZigbeeMetricHistogram::~ZigbeeMetricHistogram()
+{
+    qDeleteAll(m_buckets);
+}
+
+void ZigbeeMetricHistogram::observe(quint64 value)
+{
+    int index = 0;
+    while (index < m_bucketBoundaries.count() && value > m_bucketBoundaries.at(index)) {
+        index++;
+    }
+
+    m_buckets.at(index)->increment();
+    m_sum.increment(value);
+}
+
+QList<quint64> ZigbeeMetricHistogram::bucketBoundaries() const
+{
+    return m_bucketBoundaries;
+}
+
+quint64 ZigbeeMetricHistogram::bucketValue(int index) const
+{
+    if (index < 0 || index >= m_buckets.count())
+        return 0;
+
+    return m_buckets.at(index)->value();
+}
+
+quint64 ZigbeeMetricHistogram::count() const
+{
+    quint64 count = 0;
+    foreach (ZigbeeMetricCounter *bucket, m_buckets) {
+        count += bucket->value();
+    }
+    return count;
+}
+
+quint64 ZigbeeMetricHistogram::sum() const
+{
+    return m_sum.value();
+}
+
+ZigbeeMetrics *ZigbeeMetrics::instance()
+{
+    static ZigbeeMetrics metrics;
+    return &metrics;
+}
+
+ZigbeeMetrics::~ZigbeeMetrics()
+{
+    foreach (const MetricFamily &family, m_families) {
+        qDeleteAll(family.counters);
+        qDeleteAll(family.gauges);
+        qDeleteAll(family.histograms);
+    }
+}
+
+ZigbeeMetricCounter *ZigbeeMetrics::counter(const QString &name, const QString &help, const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!verifyFamily(name, help, MetricTypeCounter))
+        return nullptr;
+
+    MetricFamily &family = m_families[name];
+    if (!family.counters.contains(labels))
+        family.counters.insert(labels, new ZigbeeMetricCounter());
+
+    return family.counters.value(labels);
+}
+
+ZigbeeMetricGauge *ZigbeeMetrics::gauge(const QString &name, const QString &help, const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!verifyFamily(name, help, MetricTypeGauge))
+        return nullptr;
+
+    MetricFamily &family = m_families[name];
+    if (!family.gauges.contains(labels))
+        family.gauges.insert(labels, new ZigbeeMetricGauge());
+
+    return family.gauges.value(labels);
+}
+
+ZigbeeMetricHistogram *ZigbeeMetrics::histogram(const QString &name, const QString &help, const QList<quint64> &bucketBoundaries, const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!verifyFamily(name, help, MetricTypeHistogram))
+        return nullptr;
+
+    MetricFamily &family = m_families[name];
+    if (!family.histograms.contains(labels))
+        family.histograms.insert(labels, new ZigbeeMetricHistogram(bucketBoundaries));
+
+    return family.histograms.value(labels);
+}
+
+QByteArray ZigbeeMetrics::toPrometheusText() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QByteArray data;
+    QTextStream stream(&data, QIODevice::WriteOnly);
+    foreach (const QString &name, m_families.keys()) {
+        const MetricFamily &family = m_families[name];
+        stream << "# HELP " << name << " " << family.help << "\n";
+        switch (family.type) {
+        case MetricTypeCounter:
+            stream << "# TYPE " << name << " counter\n";
+            foreach (const QString &labels, family.counters.keys()) {
+                stream << name << buildLabels(labels) << " " << family.counters.value(labels)->value() << "\n";
+            }
+            break;
+        case MetricTypeGauge:
+            stream << "# TYPE " << name << " gauge\n";
+            foreach (const QString &labels, family.gauges.keys()) {
+                stream << name << buildLabels(labels) << " " << family.gauges.value(labels)->value() << "\n";
+            }
+            break;
+        case MetricTypeHistogram:
+            stream << "# TYPE " << name << " histogram\n";
+            foreach (const QString &labels, family.histograms.keys()) {
+                ZigbeeMetricHistogram *histogram = family.histograms.value(labels);
+                // Prometheus buckets are cumulative
+                quint64 cumulativeCount = 0;
+                QList<quint64> bucketBoundaries = histogram->bucketBoundaries();
+                for (int i = 0; i < bucketBoundaries.count(); i++) {
+                    cumulativeCount += histogram->bucketValue(i);
+                    stream << name << "_bucket" << buildLabels(labels, QString("le=\"%1\"").arg(bucketBoundaries.at(i))) << " " << cumulativeCount << "\n";
+                }
+                cumulativeCount += histogram->bucketValue(bucketBoundaries.count());
+                stream << name << "_bucket" << buildLabels(labels, "le=\"+Inf\"") << " " << cumulativeCount << "\n";
+                stream << name << "_sum" << buildLabels(labels) << " " << histogram->sum() << "\n";
+                stream << name << "_count" << buildLabels(labels) << " " << cumulativeCount << "\n";
+            }
+            break;
+        }
+    }
+
+    stream.flush();
+    return data;
+}
+
+int ZigbeeMetrics::currentShard()
+{
+    // Assign the shards round robin to the threads using them
+    static QAtomicInt nextShard(0);
+    static thread_local int shard = nextShard.fetchAndAddRelaxed(1) % ZigbeeMetricCounter::ShardCount;
+    return shard;
+}
+
+bool ZigbeeMetrics::verifyFamily(const QString &name, const QString &help, MetricType type)
+{
+    if (!m_families.contains(name)) {
+        MetricFamily family;
+        family.type = type;
+        family.help = help;
+        m_families.insert(name, family);
+        return true;
+    }
+
+    if (m_families.value(name).type != type) {
+        qCWarning(dcZigbeeNetwork()) << "The metric" << name << "has already been registered using a different type.";
+        return false;
+    }
+
+    return true;
+}
+
+QString ZigbeeMetrics::buildLabels(const QString &labels, const QString &additionalLabel)
+{
+    QStringList labelList;
+    if (!labels.isEmpty())
+        labelList.append(labels);
+
+    if (!additionalLabel.isEmpty())
+        labelList.append(additionalLabel);
+
+    if (labelList.isEmpty())
+        return QString();
+
+    return "{" + labelList.join(",") + "}";
+}
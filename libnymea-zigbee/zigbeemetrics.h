@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEMETRICS_H
+#define ZIGBEEMETRICS_H
+
+#include <QMap>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QAtomicInteger>
+
+// Note: the metrics are meant for hot paths like frame parsing. Updating a metric
+// never takes a lock, only registering a metric and exporting the snapshot does.
+// Counters are sharded per thread in order to avoid cache line contention.
+
+class ZigbeeMetricCounter
+{
+    friend class ZigbeeMetrics;
+    friend class ZigbeeMetricHistogram;
+
+public:
+    enum { ShardCount = 8 };
+
+    void increment(quint64 value = 1);
+    quint64 value() const;
+
+private:
+    ZigbeeMetricCounter() = default;
+    Q_DISABLE_COPY(ZigbeeMetricCounter)
+
+    // Pad each shard to a cache line
+    typedef struct Shard {
+        QAtomicInteger<quint64> value;
+        char padding[64 - sizeof(QAtomicInteger<quint64>)];
+    } Shard;
+
+    Shard m_shards[ShardCount];
+
+};
+
+class ZigbeeMetricGauge
+{
+    friend class ZigbeeMetrics;
+
+public:
+    void set(qint64 value);
+    void add(qint64 value);
+    qint64 value() const;
+
+private:
+    ZigbeeMetricGauge() = default;
+    Q_DISABLE_COPY(ZigbeeMetricGauge)
+
+    QAtomicInteger<qint64> m_value;
+
+};
+
+class ZigbeeMetricHistogram
+{
+    friend class ZigbeeMetrics;
+
+public:
+    ~ZigbeeMetricHistogram();
+
+    void observe(quint64 value);
+
+    QList<quint64> bucketBoundaries() const;
+    // Note: the last bucket contains all samples above the last boundary
+    quint64 bucketValue(int index) const;
+    quint64 count() const;
+    quint64 sum() const;
+
+private:
+    explicit ZigbeeMetricHistogram(const QList<quint64> &bucketBoundaries);
+    Q_DISABLE_COPY(ZigbeeMetricHistogram)
+
+    QList<quint64> m_bucketBoundaries;
+    QVector<ZigbeeMetricCounter *> m_buckets;
+    ZigbeeMetricCounter m_sum;
+
+};
+
+class ZigbeeMetrics
+{
+public:
+    static ZigbeeMetrics *instance();
+
+    // Returns always the same metric for the same name and labels. The labels
+    // are given in the prometheus syntax, i.e. backend="deconz",error="timeout"
+    ZigbeeMetricCounter *counter(const QString &name, const QString &help, const QString &labels = QString());
+    ZigbeeMetricGauge *gauge(const QString &name, const QString &help, const QString &labels = QString());
+    ZigbeeMetricHistogram *histogram(const QString &name, const QString &help, const QList<quint64> &bucketBoundaries, const QString &labels = QString());
+
+    // Snapshot of all registered metrics in the prometheus text exposition format
+    QByteArray toPrometheusText() const;
+
+    static int currentShard();
+
+private:
+    ZigbeeMetrics() = default;
+    ~ZigbeeMetrics();
+    Q_DISABLE_COPY(ZigbeeMetrics)
+
+    enum MetricType {
+        MetricTypeCounter,
+        MetricTypeGauge,
+        MetricTypeHistogram
+    };
+
+    typedef struct MetricFamily {
+        MetricType type = MetricTypeCounter;
+        QString help;
+        QMap<QString, ZigbeeMetricCounter *> counters;
+        QMap<QString, ZigbeeMetricGauge *> gauges;
+        QMap<QString, ZigbeeMetricHistogram *> histograms;
+    } MetricFamily;
+
+    mutable QMutex m_mutex;
+    QMap<QString, MetricFamily> m_families;
+
+    bool verifyFamily(const QString &name, const QString &help, MetricType type);
+    static QString buildLabels(const QString &labels, const QString &additionalLabel = QString());
+
+};
+
+#endif // ZIGBEEMETRICS_H
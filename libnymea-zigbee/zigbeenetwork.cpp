@@ -31,15 +31,49 @@
 #include "zdo/zigbeedeviceprofile.h"
 #include "zigbeebridgecontroller.h"
 #include "zigbeenetworkdatabase.h"
+#include "zigbeelatencystatistics.h"
+#include "zigbeemetrics.h"
+#include "zigbeetimerwheel.h"
+#include "zigbeereportingreconciler.h"
+#include "zigbeeattributehistory.h"
+#include "zigbeegreenpowersink.h"
+#include "zigbeeduplicatefilter.h"
+#include "zigbeebroadcastgovernor.h"
+#include "zigbeechannelmanager.h"
 
 #include <QDir>
 #include <QFileInfo>
+#include <QMetaEnum>
+#include <QPointer>
 #include <QDataStream>
 
+// Interval of the frame counter checkpoints in the backup journal. The margin added on restore has to cover
+// the frames the coordinator sends within one interval.
+static const int s_frameCounterJournalInterval = 600000;
+
 ZigbeeNetwork::ZigbeeNetwork(const QUuid &networkUuid, QObject *parent) :
     QObject(parent),
     m_networkUuid(networkUuid)
 {
+    m_latencyStatistics = new ZigbeeLatencyStatistics(this);
+    m_timerWheel = new ZigbeeTimerWheel(100, this);
+    m_reportingReconciler = new ZigbeeReportingReconciler(this, this);
+    m_attributeHistory = new ZigbeeAttributeHistory(this, 32, 1440, this);
+    m_greenPowerSink = new ZigbeeGreenPowerSink(this, this);
+    m_duplicateFilter = new ZigbeeDuplicateFilter(this);
+    m_broadcastGovernor = new ZigbeeBroadcastGovernor(this, this);
+    m_channelManager = new ZigbeeChannelManager(this, this);
+
+    m_requestsCounter = ZigbeeMetrics::instance()->counter("zigbee_network_requests_total", "Number of network requests created.");
+    m_zdoIndicationsCounter = ZigbeeMetrics::instance()->counter("zigbee_network_indications_total", "Number of APS data indications received.", "profile=\"zdo\"");
+    m_zclIndicationsCounter = ZigbeeMetrics::instance()->counter("zigbee_network_indications_total", "Number of APS data indications received.", "profile=\"zcl\"");
+    m_duplicateIndicationsCounter = ZigbeeMetrics::instance()->counter("zigbee_network_duplicate_indications_total", "Number of APS data indications dropped as duplicates.");
+    m_confirmLatencyHistogram = ZigbeeMetrics::instance()->histogram("zigbee_network_confirm_latency_milliseconds", "Time between creating a network request and receiving the APS confirm.", {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000});
+    QMetaEnum errorEnum = QMetaEnum::fromType<ZigbeeNetworkReply::Error>();
+    for (int i = 0; i < errorEnum.keyCount(); i++) {
+        m_replyErrorCounters.insert(errorEnum.value(i), ZigbeeMetrics::instance()->counter("zigbee_network_replies_total", "Number of finished network requests by result.", QString("error=\"%1\"").arg(QString::fromUtf8(errorEnum.key(i)))));
+    }
+
     m_permitJoinTimer = new QTimer(this);
     m_permitJoinTimer->setInterval(1000);
     m_permitJoinTimer->setSingleShot(false);
@@ -55,15 +89,21 @@ ZigbeeNetwork::ZigbeeNetwork(const QUuid &networkUuid, QObject *parent) :
     m_reachableRefreshTimer->setInterval(60000);
     connect(m_reachableRefreshTimer, &QTimer::timeout, this, &ZigbeeNetwork::evaluateNodeReachableStates);
 
+    m_frameCounterTimer = new QTimer(this);
+    m_frameCounterTimer->setInterval(s_frameCounterJournalInterval);
+    connect(m_frameCounterTimer, &QTimer::timeout, this, &ZigbeeNetwork::journalFrameCounter);
+
     connect(this, &ZigbeeNetwork::stateChanged, this, [this](ZigbeeNetwork::State state){
         if (state == ZigbeeNetwork::StateRunning) {
             refreshNeighborTables();
             m_reachableRefreshTimer->start();
+            m_frameCounterTimer->start();
         } else {
             foreach (ZigbeeNode *node, m_nodes) {
                 node->setReachable(false);
             }
             m_reachableRefreshTimer->stop();
+            m_frameCounterTimer->stop();
         }
     });
 }
@@ -125,6 +165,17 @@ void ZigbeeNetwork::setSerialBaudrate(qint32 baudrate)
     emit serialBaudrateChanged(m_serialBaudrate);
 }
 
+bool ZigbeeNetwork::ioThreadEnabled() const
+{
+    return bridgeController()->ioThreadEnabled();
+}
+
+void ZigbeeNetwork::setIoThreadEnabled(bool ioThreadEnabled)
+{
+    qCDebug(dcZigbeeNetwork()) << "Serial I/O thread" << (ioThreadEnabled ? "enabled" : "disabled");
+    bridgeController()->setIoThreadEnabled(ioThreadEnabled);
+}
+
 QString ZigbeeNetwork::serialNumber() const
 {
     return m_serialNumber;
@@ -170,6 +221,7 @@ void ZigbeeNetwork::setPanId(quint16 panId)
 
     m_panId = panId;
     emit panIdChanged(m_panId);
+    addBackupJournalEntry(ZigbeeNetworkBackup::JournalOperationNetworkChanged);
 }
 
 quint64 ZigbeeNetwork::extendedPanId() const
@@ -184,6 +236,7 @@ void ZigbeeNetwork::setExtendedPanId(quint64 extendedPanId)
 
     m_extendedPanId = extendedPanId;
     emit extendedPanIdChanged(m_extendedPanId);
+    addBackupJournalEntry(ZigbeeNetworkBackup::JournalOperationNetworkChanged);
 }
 
 quint32 ZigbeeNetwork::channel() const
@@ -198,6 +251,7 @@ void ZigbeeNetwork::setChannel(quint32 channel)
 
     m_channel = channel;
     emit channelChanged(m_channel);
+    addBackupJournalEntry(ZigbeeNetworkBackup::JournalOperationNetworkChanged);
 }
 
 ZigbeeChannelMask ZigbeeNetwork::channelMask() const
@@ -226,6 +280,7 @@ void ZigbeeNetwork::setSecurityConfiguration(const ZigbeeSecurityConfiguration &
 
     m_securityConfiguration = securityConfiguration;
     emit securityConfigurationChanged(m_securityConfiguration);
+    addBackupJournalEntry(ZigbeeNetworkBackup::JournalOperationNetworkChanged);
 }
 
 bool ZigbeeNetwork::permitJoiningEnabled() const
@@ -330,6 +385,115 @@ void ZigbeeNetwork::removeZigbeeNode(const ZigbeeAddress &address)
     });
 }
 
+bool ZigbeeNetwork::createBackup()
+{
+    if (m_state != StateRunning) {
+        qCWarning(dcZigbeeNetwork()) << "Cannot create a network backup while the network is" << m_state;
+        return false;
+    }
+
+    if (m_backupPending) {
+        qCWarning(dcZigbeeNetwork()) << "A network backup is already being created.";
+        return false;
+    }
+
+    qCDebug(dcZigbeeNetwork()) << "Reading the controller state for the network backup";
+    m_backupPending = true;
+    readControllerBackupData();
+    return true;
+}
+
+void ZigbeeNetwork::finishBackup(bool success, const QByteArray &controllerData, quint32 frameCounter)
+{
+    if (!m_backupPending)
+        return;
+
+    m_backupPending = false;
+    if (!success) {
+        qCWarning(dcZigbeeNetwork()) << "Could not read the controller state. The network backup failed.";
+        emit backupCreated(ZigbeeNetworkBackup());
+        return;
+    }
+
+    ZigbeeNetworkBackup backup;
+    backup.setBackendType(backendType());
+    backup.setTimestamp(QDateTime::currentDateTimeUtc());
+    backup.setPanId(m_panId);
+    backup.setExtendedPanId(m_extendedPanId);
+    backup.setChannel(static_cast<quint8>(m_channel));
+    backup.setChannelMask(m_channelMask);
+    backup.setSecurityConfiguration(m_securityConfiguration);
+    if (m_coordinatorNode)
+        backup.setCoordinatorAddress(m_coordinatorNode->extendedAddress());
+
+    QList<ZigbeeNetworkBackup::Node> nodes;
+    foreach (ZigbeeNode *node, m_nodes) {
+        if (node == m_coordinatorNode)
+            continue;
+
+        ZigbeeNetworkBackup::Node backupNode;
+        backupNode.ieeeAddress = node->extendedAddress();
+        backupNode.shortAddress = node->shortAddress();
+        backupNode.macCapabilities = node->macCapabilities().flag;
+        nodes.append(backupNode);
+    }
+    backup.setNodes(nodes);
+    backup.setControllerData(controllerData);
+    backup.setFrameCounter(frameCounter);
+
+    // The journal continues from this backup
+    m_backupJournal.clear();
+    m_journaledFrameCounter = frameCounter;
+
+    qCDebug(dcZigbeeNetwork()) << "Created" << backup;
+    emit backupCreated(backup);
+}
+
+QList<ZigbeeNetworkBackup::JournalEntry> ZigbeeNetwork::backupJournal() const
+{
+    return m_backupJournal;
+}
+
+bool ZigbeeNetwork::restoreBackup(const ZigbeeNetworkBackup &backup)
+{
+    if (!backup.isValid()) {
+        qCWarning(dcZigbeeNetwork()) << "Cannot restore an invalid network backup.";
+        return false;
+    }
+
+    if (m_state == StateStarting || m_state == StateUpdating || m_state == StateRunning) {
+        qCWarning(dcZigbeeNetwork()) << "Cannot restore a network backup while the network is" << m_state << "Please stop the network first.";
+        return false;
+    }
+
+    qCDebug(dcZigbeeNetwork()) << "Restoring" << backup;
+    loadNetwork();
+
+    // The coordinator will be recreated for the new controller, the backends will program it with the
+    // network configuration instead of creating a new network. The MAC address will be set once the
+    // controller runs with the coordinator address from the backup.
+    if (m_coordinatorNode) {
+        removeNode(m_coordinatorNode);
+    }
+    setMacAddress(ZigbeeAddress());
+
+    setPanId(backup.panId());
+    setExtendedPanId(backup.extendedPanId());
+    setChannel(backup.channel());
+    setSecurityConfiguration(backup.securityConfiguration());
+
+    // Form the network on the channel the nodes are listening on
+    if (backup.channel() >= 11 && backup.channel() <= 26) {
+        setChannelMask(ZigbeeChannelMask(static_cast<quint32>(1) << backup.channel()));
+    } else {
+        setChannelMask(backup.channelMask());
+    }
+
+    m_restoreBackup = backup;
+    m_backupJournal.clear();
+    return true;
+}
+
 void ZigbeeNetwork::refreshNeighborTables()
 {
     foreach (ZigbeeNode *node, m_nodes) {
@@ -340,6 +504,54 @@ void ZigbeeNetwork::refreshNeighborTables()
     fetchNextNodeLqiAndRtgTables();
 }
 
+ZigbeeLatencyStatistics *ZigbeeNetwork::latencyStatistics() const
+{
+    return m_latencyStatistics;
+}
+
+ZigbeeTimerWheel *ZigbeeNetwork::timerWheel() const
+{
+    return m_timerWheel;
+}
+
+ZigbeeReportingReconciler *ZigbeeNetwork::reportingReconciler() const
+{
+    return m_reportingReconciler;
+}
+
+ZigbeeAttributeHistory *ZigbeeNetwork::attributeHistory() const
+{
+    return m_attributeHistory;
+}
+
+ZigbeeGreenPowerSink *ZigbeeNetwork::greenPowerSink() const
+{
+    return m_greenPowerSink;
+}
+
+ZigbeeDuplicateFilter *ZigbeeNetwork::duplicateFilter() const
+{
+    return m_duplicateFilter;
+}
+
+ZigbeeBroadcastGovernor *ZigbeeNetwork::broadcastGovernor() const
+{
+    return m_broadcastGovernor;
+}
+
+ZigbeeChannelManager *ZigbeeNetwork::channelManager() const
+{
+    return m_channelManager;
+}
+
+quint16 ZigbeeNetwork::maximumAsduLength(Zigbee::DestinationAddressMode destinationAddressMode, quint16 destinationShortAddress) const
+{
+    Q_UNUSED(destinationAddressMode)
+    Q_UNUSED(destinationShortAddress)
+    // A single secured APS frame without source routing, larger payloads need APS fragmentation
+    return 82;
+}
+
 void ZigbeeNetwork::printNetwork()
 {
     qCDebug(dcZigbeeNetwork()) << this;
@@ -401,22 +613,22 @@ void ZigbeeNetwork::addNodeInternally(ZigbeeNode *node)
 
     // Update database metrics of the node
     connect(node, &ZigbeeNode::lqiChanged, this, [this, node](quint8 lqi){
-        m_database->updateNodeLqi(node, lqi);
+        m_database->updateNodeLqi(node, lqi, nullptr);
     });
 
     connect(node, &ZigbeeNode::lastSeenChanged, this, [this, node](const QDateTime &lastSeen){
-        m_database->updateNodeLastSeen(node, lastSeen);
+        m_database->updateNodeLastSeen(node, lastSeen, nullptr);
     });
 
     connect(node, &ZigbeeNode::clusterAdded, this, [this, node](ZigbeeCluster *cluster){
         if (node->state() == ZigbeeNode::StateInitialized) {
             qCWarning(dcZigbeeNetwork()) << node << "cluster" << cluster << "added on endpoint" << cluster->endpoint()->endpointId() << "but the node has already been initialized. This node is out of spec. Saving the node nethertheless...";
-            m_database->saveNode(node);
+            m_database->saveNode(node, nullptr);
         }
     });
 
-    connect(node, &ZigbeeNode::bindingTableRecordsChanged, this, [this, node](){
-        m_database->updateNodeBindingTable(node);
+    connect(node, &ZigbeeNode::bindingTableRecordsUpdated, this, [this, node](const QList<ZigbeeDeviceProfile::BindingTableListRecord> &addedRecords, const QList<ZigbeeDeviceProfile::BindingTableListRecord> &removedRecords){
+        m_database->updateNodeBindingRecords(node, addedRecords, removedRecords);
     });
 
     // Note: if a cluster shows up after initialization (out of spec devices), save the cluster and it's attributes
@@ -441,9 +653,106 @@ void ZigbeeNetwork::removeNodeInternally(ZigbeeNode *node)
 
     m_nodes.removeAll(node);
     m_uninitializedNodes.removeAll(node);
+    m_broadcastGovernor->removeGroupMember(node->extendedAddress());
     emit nodeRemoved(node);
 
-    m_database->removeNode(node);
+    m_database->removeNode(node, nullptr);
+    addBackupJournalEntry(ZigbeeNetworkBackup::JournalOperationNodeRemoved, node);
+}
+
+void ZigbeeNetwork::addBackupJournalEntry(ZigbeeNetworkBackup::JournalOperation operation, ZigbeeNode *node)
+{
+    // Network parameters are only journaled for changes of a running network, not while it gets set up or restored
+    if (operation == ZigbeeNetworkBackup::JournalOperationNetworkChanged && m_state != StateRunning)
+        return;
+
+    ZigbeeNetworkBackup::JournalEntry entry;
+    entry.operation = operation;
+    if (node) {
+        entry.node.ieeeAddress = node->extendedAddress();
+        entry.node.shortAddress = node->shortAddress();
+        entry.node.macCapabilities = node->macCapabilities().flag;
+    }
+    entry.panId = m_panId;
+    entry.extendedPanId = m_extendedPanId;
+    entry.channel = static_cast<quint8>(m_channel);
+    entry.networkKey = m_securityConfiguration.networkKey();
+
+    m_backupJournal.append(entry);
+    emit backupJournalEntryAdded(entry);
+}
+
+void ZigbeeNetwork::journalFrameCounter()
+{
+    if (m_state != StateRunning)
+        return;
+
+    readFrameCounter([this](bool success, quint32 frameCounter){
+        if (!success || frameCounter == 0 || frameCounter == m_journaledFrameCounter)
+            return;
+
+        m_journaledFrameCounter = frameCounter;
+
+        ZigbeeNetworkBackup::JournalEntry entry;
+        entry.operation = ZigbeeNetworkBackup::JournalOperationFrameCounter;
+        entry.frameCounter = frameCounter;
+        m_backupJournal.append(entry);
+        emit backupJournalEntryAdded(entry);
+    });
+}
+
+void ZigbeeNetwork::finishBackupRestore()
+{
+    if (!m_restoreBackup.isValid())
+        return;
+
+    // The nodes are still joined to the network. Nodes we don't know yet (i.e. restored on a new system)
+    // will be initialized as if they just have announced themselves.
+    qCDebug(dcZigbeeNetwork()) << "Network backup restored successfully" << m_restoreBackup;
+    foreach (const ZigbeeNetworkBackup::Node &node, m_restoreBackup.nodes()) {
+        if (node.shortAddress == 0 || node.ieeeAddress == m_restoreBackup.coordinatorAddress() || hasNode(node.ieeeAddress))
+            continue;
+
+        qCDebug(dcZigbeeNetwork()) << "Initialize restored node" << node.ieeeAddress.toString() << ZigbeeUtils::convertUint16ToHexString(node.shortAddress);
+        onDeviceAnnounced(node.shortAddress, node.ieeeAddress, node.macCapabilities);
+    }
+
+    m_restoreBackup = ZigbeeNetworkBackup();
+}
+
+ZigbeeAddress ZigbeeNetwork::replyDestinationAddress(ZigbeeNetworkReply *reply) const
+{
+    if (reply->request().destinationAddressMode() == Zigbee::DestinationAddressModeIeeeAddress)
+        return reply->request().destinationIeeeAddress();
+
+    if (reply->request().destinationAddressMode() == Zigbee::DestinationAddressModeShortAddress) {
+        ZigbeeNode *node = getZigbeeNode(reply->request().destinationShortAddress());
+        if (node) {
+            return node->extendedAddress();
+        }
+    }
+
+    return ZigbeeAddress();
+}
+
+void ZigbeeNetwork::recordReplyLatency(ZigbeeNetworkReply *reply)
+{
+    quint16 clusterId = reply->request().clusterId();
+    ZigbeeAddress address = replyDestinationAddress(reply);
+
+    if (reply->m_serialWriteLatency >= 0)
+        m_latencyStatistics->addSample(ZigbeeLatencyStatistics::PhaseSerialWrite, clusterId, address, reply->m_serialWriteLatency);
+
+    if (reply->m_confirmLatency >= 0) {
+        m_latencyStatistics->addSample(ZigbeeLatencyStatistics::PhaseConfirm, clusterId, address, reply->m_confirmLatency);
+        m_confirmLatencyHistogram->observe(reply->m_confirmLatency);
+    }
+
+    // The APS ack will arrive after the reply has been finished, keep track of it until then
+    if (reply->error() == ZigbeeNetworkReply::ErrorNoError && !address.isNull() &&
+            reply->request().txOptions().testFlag(Zigbee::ZigbeeTxOptionAckTransmission)) {
+        m_latencyStatistics->trackAcknowledgement(reply->request().requestId(), clusterId, address, reply->m_elapsedTimer);
+    }
 }
 
 void ZigbeeNetwork::initializeDatabase()
@@ -452,6 +761,8 @@ void ZigbeeNetwork::initializeDatabase()
         QString networkDatabaseFileName = settingsDirectory().absolutePath() + QDir::separator() + QString("zigbee-network-%1.db").arg(networkUuid().toString().remove('{').remove('}'));
         qCDebug(dcZigbeeNetwork()) << "Using ZigBee network database" << QFileInfo(networkDatabaseFileName).fileName();
         m_database = new ZigbeeNetworkDatabase(this, networkDatabaseFileName, this);
+        m_reportingReconciler->setDatabase(m_database);
+        m_greenPowerSink->setDatabase(m_database);
     }
 }
 
@@ -535,6 +846,8 @@ void ZigbeeNetwork::loadNetwork()
         QString networkDatabaseFileName = m_settingsDirectory.absolutePath() + QDir::separator() + QString("zigbee-network-%1.db").arg(m_networkUuid.toString().remove('{').remove('}'));
         qCDebug(dcZigbeeNetwork()) << "Using ZigBee network database" << QFileInfo(networkDatabaseFileName).fileName();
         m_database = new ZigbeeNetworkDatabase(this, networkDatabaseFileName, this);
+        m_reportingReconciler->setDatabase(m_database);
+        m_greenPowerSink->setDatabase(m_database);
     }
 
     QList<ZigbeeNode *> nodes = m_database->loadNodes();
@@ -543,6 +856,8 @@ void ZigbeeNetwork::loadNetwork()
         addNodeInternally(node);
     }
 
+    m_reportingReconciler->loadEntries();
+    m_greenPowerSink->loadDevices();
     m_networkLoaded = true;
 }
 
@@ -566,6 +881,8 @@ void ZigbeeNetwork::clearSettings()
         if (!m_database->wipeDatabase()) {
             qCWarning(dcZigbeeNetwork()) << "Failed to wipe the network database" << m_database->databaseName();
         }
+        m_reportingReconciler->setDatabase(nullptr);
+        m_greenPowerSink->setDatabase(nullptr);
         delete m_database;
         m_database = nullptr;
     }
@@ -600,8 +917,9 @@ void ZigbeeNetwork::addNode(ZigbeeNode *node)
         return;
     }
 
-    m_database->saveNode(node);
+    m_database->saveNode(node, nullptr);
     addNodeInternally(node);
+    addBackupJournalEntry(ZigbeeNetworkBackup::JournalOperationNodeAdded, node);
 }
 
 void ZigbeeNetwork::addUnitializedNode(ZigbeeNode *node)
@@ -657,7 +975,7 @@ void ZigbeeNetwork::setNodeInformation(ZigbeeNode *node, const QString &manufact
     node->m_version = version;
     emit node->versionChanged(node->version());
 
-    m_database->saveNode(m_coordinatorNode);
+    m_database->saveNode(m_coordinatorNode, nullptr);
 }
 
 void ZigbeeNetwork::setState(ZigbeeNetwork::State state)
@@ -670,8 +988,15 @@ void ZigbeeNetwork::setState(ZigbeeNetwork::State state)
 
     if (state == StateRunning) {
         printNetwork();
+        saveControllerSnapshot();
+        finishBackupRestore();
+    }
 
+    // Delayed broadcasts will not be sent any more
+    if (state == StateOffline || state == StateStopping || state == StateUninitialized) {
+        m_broadcastGovernor->clearQueue();
     }
+
     emit stateChanged(m_state);
 }
 
@@ -685,6 +1010,95 @@ void ZigbeeNetwork::setError(ZigbeeNetwork::Error error)
     emit errorOccured(m_error);
 }
 
+void ZigbeeNetwork::readControllerBackupData()
+{
+    finishBackup(true);
+}
+
+void ZigbeeNetwork::readFrameCounter(const std::function<void (bool, quint32)> &callback)
+{
+    // Not all controllers expose the frame counter
+    callback(false, 0);
+}
+
+QByteArray ZigbeeNetwork::decryptGreenPowerKey(quint32 sourceId, const QByteArray &encryptedKey) const
+{
+    Q_UNUSED(sourceId)
+    qCWarning(dcZigbeeNetwork()) << "Decrypting Green Power keys is not supported by this backend. Using the key as received.";
+    return encryptedKey;
+}
+
+bool ZigbeeNetwork::greenPowerGroupSupported() const
+{
+    return false;
+}
+
+bool ZigbeeNetwork::channelChangeSupported() const
+{
+    return false;
+}
+
+bool ZigbeeNetwork::announcesChannelChange() const
+{
+    return false;
+}
+
+void ZigbeeNetwork::readNetworkUpdateId(const std::function<void (bool, quint8)> &callback)
+{
+    qCWarning(dcZigbeeNetwork()) << "Reading the network update ID is not supported by this backend.";
+    callback(false, 0);
+}
+
+void ZigbeeNetwork::changeControllerChannel(quint8 channel, quint8 networkUpdateId)
+{
+    Q_UNUSED(networkUpdateId)
+    qCWarning(dcZigbeeNetwork()) << "Changing the channel to" << channel << "is not supported by this backend.";
+    finishControllerChannelChange(false);
+}
+
+void ZigbeeNetwork::finishControllerChannelChange(bool success)
+{
+    m_channelManager->finishChannelChange(success);
+}
+
+ZigbeeControllerSnapshot ZigbeeNetwork::warmStartSnapshot()
+{
+    if (!m_database || !m_coordinatorNode)
+        return ZigbeeControllerSnapshot();
+
+    ZigbeeControllerSnapshot snapshot = m_database->loadControllerSnapshot();
+    if (!snapshot.isValid()) {
+        qCDebug(dcZigbeeNetwork()) << "There is no controller snapshot available. A full controller initialization is required.";
+        return ZigbeeControllerSnapshot();
+    }
+
+    // The network configuration might have changed since the snapshot has been taken, i.e. a factory reset or a restored backup
+    if (snapshot.ieeeAddress != m_coordinatorNode->extendedAddress() || snapshot.panId != m_panId || snapshot.extendedPanId != m_extendedPanId
+            || snapshot.channel != m_channel || snapshot.networkKey != m_securityConfiguration.networkKey()) {
+        qCDebug(dcZigbeeNetwork()) << "The controller snapshot does not match the network configuration. A full controller initialization is required." << snapshot;
+        return ZigbeeControllerSnapshot();
+    }
+
+    return snapshot;
+}
+
+void ZigbeeNetwork::saveControllerSnapshot()
+{
+    // The snapshot will be taken on the next start if the coordinator is not known yet
+    if (!m_database || !m_coordinatorNode || !bridgeController())
+        return;
+
+    ZigbeeControllerSnapshot snapshot;
+    snapshot.ieeeAddress = m_coordinatorNode->extendedAddress();
+    snapshot.panId = m_panId;
+    snapshot.extendedPanId = m_extendedPanId;
+    snapshot.channel = static_cast<quint8>(m_channel);
+    snapshot.networkKey = m_securityConfiguration.networkKey();
+    snapshot.firmwareVersion = bridgeController()->firmwareVersion();
+    snapshot.timestamp = QDateTime::currentDateTimeUtc();
+    m_database->saveControllerSnapshot(snapshot);
+}
+
 bool ZigbeeNetwork::networkConfigurationAvailable() const
 {
     return m_extendedPanId != 0 && m_channel != 0 && m_coordinatorNode;
@@ -697,6 +1111,14 @@ void ZigbeeNetwork::handleNodeIndication(ZigbeeNode *node, const Zigbee::ApsdeDa
 
 void ZigbeeNetwork::handleZigbeeDeviceProfileIndication(const Zigbee::ApsdeDataIndication &indication)
 {
+    m_zdoIndicationsCounter->increment();
+
+    // Device announcements are broadcasted, retransmitted copies would start the node handling again
+    if (m_duplicateFilter->isDuplicate(indication)) {
+        m_duplicateIndicationsCounter->increment();
+        return;
+    }
+
     // Check if this is a device announcement
     if (indication.clusterId == ZigbeeDeviceProfile::DeviceAnnounce) {
         QDataStream stream(indication.asdu);
@@ -726,12 +1148,28 @@ void ZigbeeNetwork::handleZigbeeDeviceProfileIndication(const Zigbee::ApsdeDataI
         return;
     }
 
+    // Routers acting on interference report it with unsolicited update notifications
+    if (indication.clusterId == ZigbeeDeviceProfile::MgmtNetworkUpdateResponse)
+        m_channelManager->processNetworkUpdateNotification(node, indication);
+
     // Let the node handle this indication
     handleNodeIndication(node, indication);
 }
 
 void ZigbeeNetwork::handleZigbeeClusterLibraryIndication(const Zigbee::ApsdeDataIndication &indication)
 {
+    m_zclIndicationsCounter->increment();
+
+    // Retransmissions and frames received over multiple routes are dropped before parsing, attribute updates and database writes
+    if (m_duplicateFilter->isDuplicate(indication)) {
+        m_duplicateIndicationsCounter->increment();
+        return;
+    }
+
+    // Green Power notifications are forwarded by the proxies and handled by the sink without a node
+    if (indication.clusterId == ZigbeeClusterLibrary::ClusterIdGreenPower && m_greenPowerSink->processIndication(indication))
+        return;
+
     ZigbeeClusterLibrary::Frame frame = ZigbeeClusterLibrary::parseFrameData(indication.asdu);
     //qCDebug(dcZigbeeNetwork()) << "Handle ZCL indication" << indication << frame;
 
@@ -767,10 +1205,13 @@ void ZigbeeNetwork::onDeviceAnnounced(quint16 shortAddress, ZigbeeAddress ieeeAd
         if (shortAddress == node->shortAddress()) {
             qCDebug(dcZigbeeNetwork()) << "Already known device announced and is reachable again" << node;
             setNodeReachable(node, true);
+            // The node might have lost its reporting configurations
+            m_reportingReconciler->verifyNode(node);
             return;
         } else {
             qCDebug(dcZigbeeNetwork()) << "Already known device announced with different network address. Updating the network address internally of this node...";
             updateNodeNetworkAddress(node, shortAddress);
+            m_reportingReconciler->verifyNode(node);
             return;
         }
     }
@@ -863,13 +1304,15 @@ void ZigbeeNetwork::updateNodeNetworkAddress(ZigbeeNode *node, quint16 shortAddr
     node->m_shortAddress = shortAddress;
     emit node->shortAddressChanged(shortAddress);
 
-    m_database->updateNodeNetworkAddress(node, shortAddress);
+    m_database->updateNodeNetworkAddress(node, shortAddress, nullptr);
     setNodeReachable(node, true);
+    addBackupJournalEntry(ZigbeeNetworkBackup::JournalOperationNodeAddressChanged, node);
 }
 
 ZigbeeNetworkReply *ZigbeeNetwork::createNetworkReply(const ZigbeeNetworkRequest &request)
 {
     ZigbeeNetworkReply *reply = new ZigbeeNetworkReply(request, this);
+    m_requestsCounter->increment();
     // Make sure the reply will be deleted
     connect(reply, &ZigbeeNetworkReply::finished, reply, &ZigbeeNetworkReply::deleteLater, Qt::QueuedConnection);
     return reply;
@@ -877,6 +1320,9 @@ ZigbeeNetworkReply *ZigbeeNetwork::createNetworkReply(const ZigbeeNetworkRequest
 
 void ZigbeeNetwork::setReplyResponseError(ZigbeeNetworkReply *reply, quint8 zigbeeStatus)
 {
+    if (reply->m_confirmLatency < 0)
+        reply->m_confirmLatency = reply->m_elapsedTimer.elapsed();
+
     if (zigbeeStatus == Zigbee::ZigbeeApsStatusSuccess) {
         // The request has been sent successfully to the device
         finishNetworkReply(reply);
@@ -895,6 +1341,25 @@ void ZigbeeNetwork::setReplyResponseError(ZigbeeNetworkReply *reply, quint8 zigb
     }
 }
 
+bool ZigbeeNetwork::verifyRequestLength(ZigbeeNetworkReply *reply)
+{
+    const ZigbeeNetworkRequest &request = reply->request();
+    quint16 maximumLength = maximumAsduLength(request.destinationAddressMode(), request.destinationShortAddress());
+    if (request.asdu().length() <= maximumLength)
+        return true;
+
+    // Without fragmentation the limit is only an estimate, smaller security or routing overhead
+    // may still let the frame through. Leave the decision to the controller like before.
+    if (maximumLength <= ZigbeeNetwork::maximumAsduLength(request.destinationAddressMode(), request.destinationShortAddress())) {
+        qCWarning(dcZigbeeNetwork()) << "The payload of" << request.asdu().length() << "bytes exceeds the" << maximumLength << "bytes which fit into a single frame. Sending anyways.";
+        return true;
+    }
+
+    qCWarning(dcZigbeeNetwork()) << "The payload of" << request.asdu().length() << "bytes exceeds the maximum of" << maximumLength << "bytes supported by the" << backendType() << "backend.";
+    setReplyResponseError(reply, Zigbee::ZigbeeApsStatusAsduTooLong);
+    return false;
+}
+
 void ZigbeeNetwork::finishNetworkReply(ZigbeeNetworkReply *reply, ZigbeeNetworkReply::Error error)
 {
     reply->m_error = error;
@@ -917,7 +1382,13 @@ void ZigbeeNetwork::finishNetworkReply(ZigbeeNetworkReply *reply, ZigbeeNetworkR
     }
 
     // Stop the timer
-    reply->m_timer->stop();
+    m_timerWheel->cancel(reply->m_timeoutTimerId);
+    reply->m_timeoutTimerId = 0;
+
+    if (m_replyErrorCounters.contains(reply->error()))
+        m_replyErrorCounters.value(reply->error())->increment();
+
+    recordReplyLatency(reply);
 
     // Finish the reply
     reply->finished();
@@ -925,7 +1396,26 @@ void ZigbeeNetwork::finishNetworkReply(ZigbeeNetworkReply *reply, ZigbeeNetworkR
 
 void ZigbeeNetwork::startWaitingReply(ZigbeeNetworkReply *reply)
 {
-    reply->m_timer->start();
+    setReplySent(reply);
+
+    m_timerWheel->cancel(reply->m_timeoutTimerId);
+    QPointer<ZigbeeNetworkReply> replyPointer(reply);
+    reply->m_timeoutTimerId = m_timerWheel->schedule(20000, [replyPointer](){
+        if (replyPointer.isNull())
+            return;
+
+        static ZigbeeMetricCounter *timeoutCounter = ZigbeeMetrics::instance()->counter("zigbee_network_replies_total", "Number of finished network requests by result.", "error=\"ErrorTimeout\"");
+        timeoutCounter->increment();
+        replyPointer->m_timeoutTimerId = 0;
+        replyPointer->m_error = ZigbeeNetworkReply::ErrorTimeout;
+        emit replyPointer->finished();
+    });
+}
+
+void ZigbeeNetwork::setReplySent(ZigbeeNetworkReply *reply)
+{
+    if (reply->m_serialWriteLatency < 0)
+        reply->m_serialWriteLatency = reply->m_elapsedTimer.elapsed();
 }
 
 void ZigbeeNetwork::onNodeStateChanged(ZigbeeNode::State state)
@@ -941,7 +1431,7 @@ void ZigbeeNetwork::onNodeStateChanged(ZigbeeNode::State state)
 
 void ZigbeeNetwork::onNodeClusterAttributeChanged(ZigbeeCluster *cluster, const ZigbeeClusterAttribute &attribute)
 {
-    m_database->saveAttribute(cluster, attribute);
+    m_database->saveAttribute(cluster, attribute, nullptr);
 }
 
 void ZigbeeNetwork::evaluateNodeReachableStates()
@@ -33,17 +33,35 @@
 #include <QObject>
 #include <QSettings>
 
+#include <functional>
+
 #include "zigbeenode.h"
 #include "zigbeechannelmask.h"
+#include "zigbeecontrollersnapshot.h"
+#include "zigbeenetworkbackup.h"
 #include "zigbeesecurityconfiguration.h"
 
 class ZigbeeNetworkDatabase;
+class ZigbeeLatencyStatistics;
+class ZigbeeTimerWheel;
+class ZigbeeReportingReconciler;
+class ZigbeeAttributeHistory;
+class ZigbeeGreenPowerSink;
+class ZigbeeDuplicateFilter;
+class ZigbeeBroadcastGovernor;
+class ZigbeeChannelManager;
+class ZigbeeMetricCounter;
+class ZigbeeMetricHistogram;
 class ZigbeeBridgeController;
 
 class ZigbeeNetwork : public QObject
 {
     Q_OBJECT
 
+    friend class ZigbeeGreenPowerSink;
+    friend class ZigbeeBroadcastGovernor;
+    friend class ZigbeeChannelManager;
+
 public:
     enum State {
         StateUninitialized,
@@ -84,6 +102,10 @@ public:
     qint32 serialBaudrate() const;
     void setSerialBaudrate(qint32 baudrate);
 
+    // Handle the serial communication in a dedicated thread, must be set before starting the network
+    bool ioThreadEnabled() const;
+    void setIoThreadEnabled(bool ioThreadEnabled);
+
     QString serialNumber() const;
     void setSerialNumber(const QString &serialNumber);
 
@@ -128,12 +150,48 @@ public:
 
     virtual ZigbeeNetworkReply *sendRequest(const ZigbeeNetworkRequest &request) = 0;
 
+    // The largest asdu which can be sent with a single request to the given destination.
+    // Backends which support APS fragmentation allow larger unicast payloads, the controller
+    // transmits them as acknowledged blocks and reassembles fragmented responses.
+    virtual quint16 maximumAsduLength(Zigbee::DestinationAddressMode destinationAddressMode = Zigbee::DestinationAddressModeShortAddress, quint16 destinationShortAddress = 0x0000) const;
+
     void loadNetwork();
 
     void removeZigbeeNode(const ZigbeeAddress &address);
 
+    // Network backup: createBackup() reads the current state of the controller and emits backupCreated() with a full snapshot,
+    // which also starts a new journal. backupJournal() contains the changes since then. Backups can only be created while the
+    // network is running and only be restored while it is not, the controller will be programmed on the next start.
+    // Backends which support it (deCONZ, TI) program the IEEE address of the previous coordinator into the new controller.
+    bool createBackup();
+    QList<ZigbeeNetworkBackup::JournalEntry> backupJournal() const;
+    bool restoreBackup(const ZigbeeNetworkBackup &backup);
+
     void refreshNeighborTables();
 
+    ZigbeeLatencyStatistics *latencyStatistics() const;
+
+    // Manages the timeouts of all pending replies of this network
+    ZigbeeTimerWheel *timerWheel() const;
+
+    // Keeps the attribute reporting configurations of the nodes in sync with the desired ones
+    ZigbeeReportingReconciler *reportingReconciler() const;
+
+    // Optional in memory history of selected numeric attributes
+    ZigbeeAttributeHistory *attributeHistory() const;
+
+    // Commissioned Green Power devices and their commands
+    ZigbeeGreenPowerSink *greenPowerSink() const;
+
+    // Drops indications which have been received more than once before they get processed
+    ZigbeeDuplicateFilter *duplicateFilter() const;
+
+    // Keeps broadcasts and group casts within the broadcast transaction table budget
+    ZigbeeBroadcastGovernor *broadcastGovernor() const;
+
+    // Energy scans, channel quality history and channel changes
+    ZigbeeChannelManager *channelManager() const;
+
 private:
     QUuid m_networkUuid;
     State m_state = StateUninitialized;
@@ -147,6 +205,23 @@ private:
     ZigbeeNetworkDatabase *m_database = nullptr;
     bool m_networkLoaded = false;
 
+    ZigbeeLatencyStatistics *m_latencyStatistics = nullptr;
+    ZigbeeTimerWheel *m_timerWheel = nullptr;
+    ZigbeeReportingReconciler *m_reportingReconciler = nullptr;
+    ZigbeeAttributeHistory *m_attributeHistory = nullptr;
+    ZigbeeGreenPowerSink *m_greenPowerSink = nullptr;
+    ZigbeeDuplicateFilter *m_duplicateFilter = nullptr;
+    ZigbeeBroadcastGovernor *m_broadcastGovernor = nullptr;
+    ZigbeeChannelManager *m_channelManager = nullptr;
+
+    // Metrics
+    ZigbeeMetricCounter *m_requestsCounter = nullptr;
+    ZigbeeMetricCounter *m_zdoIndicationsCounter = nullptr;
+    ZigbeeMetricCounter *m_zclIndicationsCounter = nullptr;
+    ZigbeeMetricCounter *m_duplicateIndicationsCounter = nullptr;
+    ZigbeeMetricHistogram *m_confirmLatencyHistogram = nullptr;
+    QHash<int, ZigbeeMetricCounter *> m_replyErrorCounters;
+
     // Continuous ASP sequence number for network requests
     quint8 m_sequenceNumber = 0;
 
@@ -163,6 +238,12 @@ private:
     QList<ZigbeeNode *> m_uninitializedNodes;
     QList<ZigbeeNode *> m_temporaryNodes;
 
+    // Backup journal since the last full backup
+    QList<ZigbeeNetworkBackup::JournalEntry> m_backupJournal;
+    bool m_backupPending = false;
+    QTimer *m_frameCounterTimer = nullptr;
+    quint32 m_journaledFrameCounter = 0;
+
     void printNetwork();
 
     // Permit join
@@ -175,11 +256,45 @@ private:
     void addNodeInternally(ZigbeeNode *node);
     void removeNodeInternally(ZigbeeNode *node);
 
+    ZigbeeAddress replyDestinationAddress(ZigbeeNetworkReply *reply) const;
+
+    void addBackupJournalEntry(ZigbeeNetworkBackup::JournalOperation operation, ZigbeeNode *node = nullptr);
+    void journalFrameCounter();
+    void finishBackupRestore();
+    void recordReplyLatency(ZigbeeNetworkReply *reply);
+
 protected:
     Error m_error = ErrorNoError;
     ZigbeeNode *m_coordinatorNode = nullptr;
     ZigbeeSecurityConfiguration m_securityConfiguration;
 
+    // The backup which will be restored on the next network start
+    ZigbeeNetworkBackup m_restoreBackup;
+
+    // Reads the controller specific data for a network backup (i.e. the NV items of a TI controller) and the outgoing
+    // NWK frame counter. Backends have to call finishBackup() once done, also if reading from the controller failed.
+    virtual void readControllerBackupData();
+    void finishBackup(bool success, const QByteArray &controllerData = QByteArray(), quint32 frameCounter = 0);
+
+    // Reads the outgoing NWK frame counter of the controller, which gets checkpointed in the backup journal
+    virtual void readFrameCounter(const std::function<void(bool success, quint32 frameCounter)> &callback);
+
+    // Decrypts the key of a commissioning Green Power device, which is encrypted with the default trust center link key (AES-128-CCM)
+    virtual QByteArray decryptGreenPowerKey(quint32 sourceId, const QByteArray &encryptedKey) const;
+    // Whether the Green Power endpoint of the coordinator is a member of the Green Power sink group. Otherwise
+    // the proxies get paired to forward the notifications as unicasts to the coordinator.
+    virtual bool greenPowerGroupSupported() const;
+
+    // Moves the controller to the channel the network has been told to change to. Once done, the
+    // network has to be running on the new channel, otherwise finishControllerChannelChange(false)
+    // aborts the change. Controllers announcing the channel change on their own return true in
+    // announcesChannelChange(), the network does not broadcast the update then.
+    virtual bool channelChangeSupported() const;
+    virtual bool announcesChannelChange() const;
+    virtual void readNetworkUpdateId(const std::function<void(bool success, quint8 networkUpdateId)> &callback);
+    virtual void changeControllerChannel(quint8 channel, quint8 networkUpdateId);
+    void finishControllerChannelChange(bool success);
+
     void initializeDatabase();
 
     ZigbeeNode *createNode(quint16 shortAddress, const ZigbeeAddress &extendedAddress, QObject *parent);
@@ -213,6 +328,10 @@ protected:
 
     bool networkConfigurationAvailable() const;
 
+    // Warm start: returns the stored controller snapshot if it still matches the network configuration, otherwise an invalid snapshot
+    ZigbeeControllerSnapshot warmStartSnapshot();
+    void saveControllerSnapshot();
+
     void handleNodeIndication(ZigbeeNode *node, const Zigbee::ApsdeDataIndication indication);
 
     // ZDO
@@ -231,6 +350,8 @@ protected:
     void setReplyResponseError(ZigbeeNetworkReply *reply, quint8 zigbeeStatus = Zigbee::ZigbeeApsStatusSuccess);
     void finishNetworkReply(ZigbeeNetworkReply *reply, ZigbeeNetworkReply::Error error = ZigbeeNetworkReply::ErrorNoError);
     void startWaitingReply(ZigbeeNetworkReply *reply);
+    void setReplySent(ZigbeeNetworkReply *reply);
+    bool verifyRequestLength(ZigbeeNetworkReply *reply);
 
 signals:
     void settingsDirectoryChanged(const QDir &settingsDirectory);
@@ -244,6 +365,9 @@ signals:
     void channelChanged(uint channel);
     void channelMaskChanged(const ZigbeeChannelMask &channelMask);
     void securityConfigurationChanged(const ZigbeeSecurityConfiguration &securityConfiguration);
+    void backupJournalEntryAdded(const ZigbeeNetworkBackup::JournalEntry &entry);
+    // The backup is invalid if it could not be created
+    void backupCreated(const ZigbeeNetworkBackup &backup);
 
     // Will be emitted if node has joined and the initialization has been finished
     void nodeAdded(ZigbeeNode *node);
@@ -0,0 +1,436 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeenetworkbackup.h"
+#include "zigbeeutils.h"
+#include "loggingcategory.h"
+
+#include <QDataStream>
+
+#include <limits>
+
+// "NZBK"
+static const quint32 backupMagic = 0x4b425a4e;
+static const quint8 backupFormatVersion = 2;
+static const int keyLength = 16;
+// Covers the frames a busy coordinator sends between two frame counter checkpoints of the journal
+static const quint32 frameCounterMargin = 0x4000;
+
+static void writeKey(QDataStream &stream, const ZigbeeNetworkKey &key)
+{
+    QByteArray keyData = key.isNull() ? QByteArray(keyLength, 0) : key.toByteArray();
+    stream.writeRawData(keyData.constData(), keyLength);
+}
+
+static ZigbeeNetworkKey readKey(QDataStream &stream)
+{
+    QByteArray keyData(keyLength, 0);
+    stream.readRawData(keyData.data(), keyLength);
+    if (keyData == QByteArray(keyLength, 0))
+        return ZigbeeNetworkKey();
+
+    return ZigbeeNetworkKey(keyData);
+}
+
+static void writeNode(QDataStream &stream, const ZigbeeNetworkBackup::Node &node)
+{
+    stream << node.ieeeAddress.toUInt64() << node.shortAddress << node.macCapabilities;
+}
+
+static ZigbeeNetworkBackup::Node readNode(QDataStream &stream)
+{
+    ZigbeeNetworkBackup::Node node;
+    quint64 ieeeAddress = 0;
+    stream >> ieeeAddress >> node.shortAddress >> node.macCapabilities;
+    node.ieeeAddress = ZigbeeAddress(ieeeAddress);
+    return node;
+}
+
+ZigbeeNetworkBackup::ZigbeeNetworkBackup()
+{
+
+}
+
+bool ZigbeeNetworkBackup::isValid() const
+{
+    return m_valid && m_extendedPanId != 0 && !m_securityConfiguration.networkKey().isNull();
+}
+
+Zigbee::ZigbeeBackendType ZigbeeNetworkBackup::backendType() const
+{
+    return m_backendType;
+}
+
+void ZigbeeNetworkBackup::setBackendType(Zigbee::ZigbeeBackendType backendType)
+{
+    m_backendType = backendType;
+}
+
+QDateTime ZigbeeNetworkBackup::timestamp() const
+{
+    return m_timestamp;
+}
+
+void ZigbeeNetworkBackup::setTimestamp(const QDateTime &timestamp)
+{
+    m_timestamp = timestamp;
+}
+
+quint16 ZigbeeNetworkBackup::panId() const
+{
+    return m_panId;
+}
+
+void ZigbeeNetworkBackup::setPanId(quint16 panId)
+{
+    m_panId = panId;
+    m_valid = true;
+}
+
+quint64 ZigbeeNetworkBackup::extendedPanId() const
+{
+    return m_extendedPanId;
+}
+
+void ZigbeeNetworkBackup::setExtendedPanId(quint64 extendedPanId)
+{
+    m_extendedPanId = extendedPanId;
+    m_valid = true;
+}
+
+quint8 ZigbeeNetworkBackup::channel() const
+{
+    return m_channel;
+}
+
+void ZigbeeNetworkBackup::setChannel(quint8 channel)
+{
+    m_channel = channel;
+}
+
+ZigbeeChannelMask ZigbeeNetworkBackup::channelMask() const
+{
+    return m_channelMask;
+}
+
+void ZigbeeNetworkBackup::setChannelMask(const ZigbeeChannelMask &channelMask)
+{
+    m_channelMask = channelMask;
+}
+
+ZigbeeSecurityConfiguration ZigbeeNetworkBackup::securityConfiguration() const
+{
+    return m_securityConfiguration;
+}
+
+void ZigbeeNetworkBackup::setSecurityConfiguration(const ZigbeeSecurityConfiguration &securityConfiguration)
+{
+    m_securityConfiguration = securityConfiguration;
+}
+
+ZigbeeAddress ZigbeeNetworkBackup::coordinatorAddress() const
+{
+    return m_coordinatorAddress;
+}
+
+void ZigbeeNetworkBackup::setCoordinatorAddress(const ZigbeeAddress &coordinatorAddress)
+{
+    m_coordinatorAddress = coordinatorAddress;
+}
+
+quint32 ZigbeeNetworkBackup::frameCounter() const
+{
+    return m_frameCounter;
+}
+
+void ZigbeeNetworkBackup::setFrameCounter(quint32 frameCounter)
+{
+    m_frameCounter = frameCounter;
+}
+
+quint32 ZigbeeNetworkBackup::restoreFrameCounter() const
+{
+    if (m_frameCounter > std::numeric_limits<quint32>::max() - frameCounterMargin)
+        return std::numeric_limits<quint32>::max();
+
+    return m_frameCounter + frameCounterMargin;
+}
+
+QList<ZigbeeNetworkBackup::Node> ZigbeeNetworkBackup::nodes() const
+{
+    return m_nodes;
+}
+
+void ZigbeeNetworkBackup::setNodes(const QList<Node> &nodes)
+{
+    m_nodes = nodes;
+}
+
+QByteArray ZigbeeNetworkBackup::controllerData() const
+{
+    return m_controllerData;
+}
+
+void ZigbeeNetworkBackup::setControllerData(const QByteArray &controllerData)
+{
+    m_controllerData = controllerData;
+}
+
+void ZigbeeNetworkBackup::applyJournal(const QList<JournalEntry> &entries)
+{
+    foreach (const JournalEntry &entry, entries) {
+        switch (entry.operation) {
+        case JournalOperationNodeAdded:
+        case JournalOperationNodeAddressChanged: {
+            bool found = false;
+            for (int i = 0; i < m_nodes.count(); i++) {
+                if (m_nodes.at(i).ieeeAddress == entry.node.ieeeAddress) {
+                    m_nodes[i].shortAddress = entry.node.shortAddress;
+                    if (entry.operation == JournalOperationNodeAdded)
+                        m_nodes[i].macCapabilities = entry.node.macCapabilities;
+
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                m_nodes.append(entry.node);
+            }
+            break;
+        }
+        case JournalOperationNodeRemoved:
+            for (int i = 0; i < m_nodes.count(); i++) {
+                if (m_nodes.at(i).ieeeAddress == entry.node.ieeeAddress) {
+                    m_nodes.removeAt(i);
+                    break;
+                }
+            }
+            break;
+        case JournalOperationNetworkChanged:
+            m_panId = entry.panId;
+            m_extendedPanId = entry.extendedPanId;
+            m_channel = entry.channel;
+            m_securityConfiguration.setNetworkKey(entry.networkKey);
+            // The controller specific data describes the previous network
+            m_controllerData.clear();
+            break;
+        case JournalOperationFrameCounter:
+            // The frame counter only moves forward, unless the network has been formed again
+            m_frameCounter = qMax(m_frameCounter, entry.frameCounter);
+            break;
+        }
+    }
+}
+
+QByteArray ZigbeeNetworkBackup::toByteArray() const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << backupMagic << backupFormatVersion;
+    stream << static_cast<quint8>(m_backendType);
+    stream << static_cast<qint64>(m_timestamp.toMSecsSinceEpoch() / 1000);
+    stream << m_panId << m_extendedPanId << m_channel << m_channelMask.toUInt32();
+    stream << static_cast<quint8>(m_securityConfiguration.zigbeeSecurityMode());
+    writeKey(stream, m_securityConfiguration.networkKey());
+    writeKey(stream, m_securityConfiguration.globalTrustCenterLinkKey());
+    stream << m_coordinatorAddress.toUInt64();
+    stream << m_frameCounter;
+
+    stream << static_cast<quint16>(m_nodes.count());
+    foreach (const Node &node, m_nodes) {
+        writeNode(stream, node);
+    }
+
+    stream << static_cast<quint32>(m_controllerData.length());
+    stream.writeRawData(m_controllerData.constData(), m_controllerData.length());
+    return data;
+}
+
+ZigbeeNetworkBackup ZigbeeNetworkBackup::fromByteArray(const QByteArray &data)
+{
+    ZigbeeNetworkBackup backup;
+
+    QDataStream stream(data);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    quint32 magic = 0; quint8 formatVersion = 0;
+    stream >> magic >> formatVersion;
+    // Version 1 didn't contain the frame counter yet
+    if (magic != backupMagic || formatVersion < 1 || formatVersion > backupFormatVersion) {
+        qCWarning(dcZigbeeNetwork()) << "Invalid network backup. Unknown format" << ZigbeeUtils::convertByteArrayToHexString(data.left(5));
+        return ZigbeeNetworkBackup();
+    }
+
+    quint8 backendType = 0; qint64 timestamp = 0; quint32 channelMask = 0; quint8 securityMode = 0;
+    quint64 coordinatorAddress = 0;
+    stream >> backendType >> timestamp;
+    stream >> backup.m_panId >> backup.m_extendedPanId >> backup.m_channel >> channelMask;
+    stream >> securityMode;
+    backup.m_backendType = static_cast<Zigbee::ZigbeeBackendType>(backendType);
+    backup.m_timestamp = QDateTime::fromMSecsSinceEpoch(timestamp * 1000);
+    backup.m_channelMask = ZigbeeChannelMask(channelMask);
+    backup.m_securityConfiguration.setZigbeeSecurityMode(static_cast<ZigbeeSecurityConfiguration::ZigbeeSecurityMode>(securityMode));
+    backup.m_securityConfiguration.setNetworkKey(readKey(stream));
+    backup.m_securityConfiguration.setGlobalTrustCenterlinkKey(readKey(stream));
+    stream >> coordinatorAddress;
+    backup.m_coordinatorAddress = ZigbeeAddress(coordinatorAddress);
+    if (formatVersion >= 2) {
+        stream >> backup.m_frameCounter;
+    }
+
+    quint16 nodeCount = 0;
+    stream >> nodeCount;
+    for (int i = 0; i < nodeCount; i++) {
+        backup.m_nodes.append(readNode(stream));
+    }
+
+    quint32 controllerDataLength = 0;
+    stream >> controllerDataLength;
+    if (stream.status() != QDataStream::Ok || controllerDataLength > static_cast<quint32>(data.length())) {
+        qCWarning(dcZigbeeNetwork()) << "Invalid network backup. The data is truncated.";
+        return ZigbeeNetworkBackup();
+    }
+
+    backup.m_controllerData = QByteArray(static_cast<int>(controllerDataLength), 0);
+    if (stream.readRawData(backup.m_controllerData.data(), backup.m_controllerData.length()) != backup.m_controllerData.length()) {
+        qCWarning(dcZigbeeNetwork()) << "Invalid network backup. The controller data is truncated.";
+        return ZigbeeNetworkBackup();
+    }
+
+    backup.m_valid = true;
+    return backup;
+}
+
+QByteArray ZigbeeNetworkBackup::journalEntryToByteArray(const JournalEntry &entry)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << static_cast<quint8>(entry.operation);
+    switch (entry.operation) {
+    case JournalOperationNodeAdded:
+    case JournalOperationNodeAddressChanged:
+        writeNode(stream, entry.node);
+        break;
+    case JournalOperationNodeRemoved:
+        stream << entry.node.ieeeAddress.toUInt64();
+        break;
+    case JournalOperationNetworkChanged:
+        stream << entry.panId << entry.extendedPanId << entry.channel;
+        writeKey(stream, entry.networkKey);
+        break;
+    case JournalOperationFrameCounter:
+        stream << entry.frameCounter;
+        break;
+    }
+    return data;
+}
+
+QList<ZigbeeNetworkBackup::JournalEntry> ZigbeeNetworkBackup::journalFromByteArray(const QByteArray &data)
+{
+    QList<JournalEntry> entries;
+    QDataStream stream(data);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    while (!stream.atEnd()) {
+        JournalEntry entry;
+        quint8 operation = 0;
+        stream >> operation;
+        entry.operation = static_cast<JournalOperation>(operation);
+        switch (entry.operation) {
+        case JournalOperationNodeAdded:
+        case JournalOperationNodeAddressChanged:
+            entry.node = readNode(stream);
+            break;
+        case JournalOperationNodeRemoved: {
+            quint64 ieeeAddress = 0;
+            stream >> ieeeAddress;
+            entry.node.ieeeAddress = ZigbeeAddress(ieeeAddress);
+            break;
+        }
+        case JournalOperationNetworkChanged:
+            stream >> entry.panId >> entry.extendedPanId >> entry.channel;
+            entry.networkKey = readKey(stream);
+            break;
+        case JournalOperationFrameCounter:
+            stream >> entry.frameCounter;
+            break;
+        default:
+            qCWarning(dcZigbeeNetwork()) << "Unknown network backup journal operation" << operation << "Ignoring the rest of the journal.";
+            return entries;
+        }
+
+        if (stream.status() != QDataStream::Ok) {
+            qCWarning(dcZigbeeNetwork()) << "The network backup journal ends with a truncated entry. Ignoring it.";
+            break;
+        }
+        entries.append(entry);
+    }
+    return entries;
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeNetworkBackup &backup)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "ZigbeeNetworkBackup(" << backup.backendType()
+                    << ", PAN ID: " << ZigbeeUtils::convertUint16ToHexString(backup.panId())
+                    << ", Extended PAN ID: " << ZigbeeUtils::convertUint64ToHexString(backup.extendedPanId())
+                    << ", Channel: " << backup.channel()
+                    << ", Coordinator: " << backup.coordinatorAddress().toString()
+                    << ", Frame counter: " << backup.frameCounter()
+                    << ", Nodes: " << backup.nodes().count()
+                    << ", Controller data: " << backup.controllerData().length() << " bytes"
+                    << ", " << backup.timestamp().toString(Qt::ISODate) << ")";
+    return debug;
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeNetworkBackup::JournalEntry &entry)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "JournalEntry(";
+    switch (entry.operation) {
+    case ZigbeeNetworkBackup::JournalOperationNodeAdded:
+        debug.nospace() << "Node added: " << entry.node.ieeeAddress.toString() << ", " << ZigbeeUtils::convertUint16ToHexString(entry.node.shortAddress);
+        break;
+    case ZigbeeNetworkBackup::JournalOperationNodeRemoved:
+        debug.nospace() << "Node removed: " << entry.node.ieeeAddress.toString();
+        break;
+    case ZigbeeNetworkBackup::JournalOperationNodeAddressChanged:
+        debug.nospace() << "Node address changed: " << entry.node.ieeeAddress.toString() << ", " << ZigbeeUtils::convertUint16ToHexString(entry.node.shortAddress);
+        break;
+    case ZigbeeNetworkBackup::JournalOperationNetworkChanged:
+        debug.nospace() << "Network changed: PAN ID " << ZigbeeUtils::convertUint16ToHexString(entry.panId)
+                        << ", Extended PAN ID " << ZigbeeUtils::convertUint64ToHexString(entry.extendedPanId)
+                        << ", Channel " << entry.channel;
+        break;
+    case ZigbeeNetworkBackup::JournalOperationFrameCounter:
+        debug.nospace() << "Frame counter: " << entry.frameCounter;
+        break;
+    }
+    debug.nospace() << ")";
+    return debug;
+}
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEENETWORKBACKUP_H
+#define ZIGBEENETWORKBACKUP_H
+
+#include <QList>
+#include <QDebug>
+#include <QDateTime>
+#include <QByteArray>
+
+#include "zigbee.h"
+#include "zigbeeaddress.h"
+#include "zigbeechannelmask.h"
+#include "zigbeesecurityconfiguration.h"
+
+// A compact binary snapshot of everything required to move a network to another controller without re-pairing
+// the devices: the network parameters, the keys and the node table. Changes after a snapshot has been taken can be
+// recorded as journal entries, so a snapshot only has to be rewritten occasionally.
+class ZigbeeNetworkBackup
+{
+public:
+    typedef struct Node {
+        ZigbeeAddress ieeeAddress;
+        quint16 shortAddress = 0;
+        quint8 macCapabilities = 0;
+    } Node;
+
+    enum JournalOperation {
+        JournalOperationNodeAdded = 0x01,
+        JournalOperationNodeRemoved = 0x02,
+        JournalOperationNodeAddressChanged = 0x03,
+        JournalOperationNetworkChanged = 0x04,
+        JournalOperationFrameCounter = 0x05
+    };
+
+    // Node operations use the node, network changes the network parameters. Frame counter
+    // entries are checkpoints of the outgoing NWK frame counter of the running coordinator.
+    typedef struct JournalEntry {
+        JournalOperation operation = JournalOperationNodeAdded;
+        Node node;
+        quint16 panId = 0;
+        quint64 extendedPanId = 0;
+        quint8 channel = 0;
+        ZigbeeNetworkKey networkKey;
+        quint32 frameCounter = 0;
+    } JournalEntry;
+
+    ZigbeeNetworkBackup();
+
+    bool isValid() const;
+
+    Zigbee::ZigbeeBackendType backendType() const;
+    void setBackendType(Zigbee::ZigbeeBackendType backendType);
+
+    QDateTime timestamp() const;
+    void setTimestamp(const QDateTime &timestamp);
+
+    quint16 panId() const;
+    void setPanId(quint16 panId);
+
+    quint64 extendedPanId() const;
+    void setExtendedPanId(quint64 extendedPanId);
+
+    quint8 channel() const;
+    void setChannel(quint8 channel);
+
+    ZigbeeChannelMask channelMask() const;
+    void setChannelMask(const ZigbeeChannelMask &channelMask);
+
+    ZigbeeSecurityConfiguration securityConfiguration() const;
+    void setSecurityConfiguration(const ZigbeeSecurityConfiguration &securityConfiguration);
+
+    ZigbeeAddress coordinatorAddress() const;
+    void setCoordinatorAddress(const ZigbeeAddress &coordinatorAddress);
+
+    // The outgoing NWK frame counter of the coordinator. The nodes drop frames with a counter they have seen
+    // already, so a restored controller has to continue above it. Frame counter journal entries keep it up to
+    // date, restoreFrameCounter() adds a safety margin for the frames sent after the last checkpoint.
+    quint32 frameCounter() const;
+    void setFrameCounter(quint32 frameCounter);
+    quint32 restoreFrameCounter() const;
+
+    QList<Node> nodes() const;
+    void setNodes(const QList<Node> &nodes);
+
+    // Opaque controller specific data (i.e. the NV items of a TI controller), only valid for the same backend type
+    QByteArray controllerData() const;
+    void setControllerData(const QByteArray &controllerData);
+
+    void applyJournal(const QList<JournalEntry> &entries);
+
+    QByteArray toByteArray() const;
+    static ZigbeeNetworkBackup fromByteArray(const QByteArray &data);
+
+    // Journal entries are self contained and can be appended to each other. A truncated
+    // last entry, i.e. from an interrupted write, will be ignored when parsing the journal.
+    static QByteArray journalEntryToByteArray(const JournalEntry &entry);
+    static QList<JournalEntry> journalFromByteArray(const QByteArray &data);
+
+private:
+    bool m_valid = false;
+    Zigbee::ZigbeeBackendType m_backendType = Zigbee::ZigbeeBackendTypeDeconz;
+    QDateTime m_timestamp;
+    quint16 m_panId = 0;
+    quint64 m_extendedPanId = 0;
+    quint8 m_channel = 0;
+    ZigbeeChannelMask m_channelMask;
+    ZigbeeSecurityConfiguration m_securityConfiguration;
+    ZigbeeAddress m_coordinatorAddress;
+    quint32 m_frameCounter = 0;
+    QList<Node> m_nodes;
+    QByteArray m_controllerData;
+
+};
+
+QDebug operator<<(QDebug debug, const ZigbeeNetworkBackup &backup);
+QDebug operator<<(QDebug debug, const ZigbeeNetworkBackup::JournalEntry &entry);
+
+#endif // ZIGBEENETWORKBACKUP_H
@@ -31,6 +31,7 @@
 #include "zigbeeutils.h"
 #include "zigbeenode.h"
 
+#include <QCoreApplication>
 #include <QSqlError>
 #include <QSqlQuery>
 
@@ -43,6 +44,9 @@ ZigbeeNetworkDatabase::ZigbeeNetworkDatabase(ZigbeeNetwork *network, const QStri
     m_db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), m_connectionName);
     m_db.setDatabaseName(m_databaseName);
 
+    m_worker = new ZigbeeNetworkDatabaseWorker(m_databaseName, this);
+    connect(m_worker, &ZigbeeNetworkDatabaseWorker::jobFinished, this, &ZigbeeNetworkDatabase::onJobFinished, Qt::QueuedConnection);
+
     if (!m_db.isValid()) {
         qCWarning(dcZigbeeNetworkDatabase()) << "The zigbee network database is not valid" << m_db.databaseName();
         // FIXME: rotate database
@@ -55,10 +59,15 @@ ZigbeeNetworkDatabase::ZigbeeNetworkDatabase(ZigbeeNetwork *network, const QStri
         // FIXME: rotate database
         return;
     }
+
+    m_worker->start();
 }
 
 ZigbeeNetworkDatabase::~ZigbeeNetworkDatabase()
 {
+    // Write all pending jobs before closing the database
+    m_worker->shutdown();
+
     m_db.close();
     m_db = QSqlDatabase();
     QSqlDatabase::removeDatabase(m_connectionName);
@@ -72,6 +81,10 @@ QString ZigbeeNetworkDatabase::databaseName() const
 QList<ZigbeeNode *> ZigbeeNetworkDatabase::loadNodes()
 {
     qCDebug(dcZigbeeNetworkDatabase()) << "Loading nodes from database" << m_db.databaseName();
+
+    // Make sure we read what has been written so far
+    flush();
+
     QList<ZigbeeNode *> nodes;
     QString query("SELECT * FROM nodes;");
     QSqlQuery nodesQuery(query, m_db);
@@ -231,9 +244,153 @@ QList<ZigbeeNode *> ZigbeeNetworkDatabase::loadNodes()
     return nodes;
 }
 
+QList<ZigbeeReportingReconciler::Entry> ZigbeeNetworkDatabase::loadReportingConfigurations()
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Loading reporting configurations from database" << m_db.databaseName();
+
+    // Make sure we read what has been written so far
+    flush();
+
+    // Configurations of nodes which never finished the initialization and got removed again
+    QSqlQuery orphanQuery("DELETE FROM reportingConfigurations WHERE ieeeAddress NOT IN (SELECT ieeeAddress FROM nodes);", m_db);
+    if (!orphanQuery.exec()) {
+        qCWarning(dcZigbeeNetworkDatabase()) << "Unable to execute SQL query" << orphanQuery.lastQuery() << m_db.lastError().databaseText() << m_db.lastError().driverText();
+    }
+
+    QList<ZigbeeReportingReconciler::Entry> entries;
+    QString query("SELECT * FROM reportingConfigurations;");
+    QSqlQuery reportingQuery(query, m_db);
+    if (!reportingQuery.exec()) {
+        qCWarning(dcZigbeeNetworkDatabase()) << "Unable to execute SQL query" << query << m_db.lastError().databaseText() << m_db.lastError().driverText();
+        return entries;
+    }
+
+    while (reportingQuery.next()) {
+        ZigbeeReportingReconciler::Entry entry;
+        entry.extendedAddress = ZigbeeAddress(reportingQuery.value("ieeeAddress").toString());
+        entry.endpointId = reportingQuery.value("endpointId").toUInt();
+        entry.clusterId = static_cast<ZigbeeClusterLibrary::ClusterId>(reportingQuery.value("clusterId").toUInt());
+        entry.manufacturerCode = reportingQuery.value("manufacturerCode").toUInt();
+        entry.configuration.attributeId = reportingQuery.value("attributeId").toUInt();
+        entry.configuration.direction = static_cast<ZigbeeClusterLibrary::ReportingDirection>(reportingQuery.value("direction").toUInt());
+        entry.configuration.dataType = static_cast<Zigbee::DataType>(reportingQuery.value("dataType").toUInt());
+        entry.configuration.minReportingInterval = reportingQuery.value("minInterval").toUInt();
+        entry.configuration.maxReportingInterval = reportingQuery.value("maxInterval").toUInt();
+        entry.configuration.reportableChange = QByteArray::fromBase64(reportingQuery.value("reportableChange").toByteArray());
+        entry.configuration.timeoutPeriod = reportingQuery.value("timeoutPeriod").toUInt();
+        entry.state = static_cast<ZigbeeReportingReconciler::State>(reportingQuery.value("state").toUInt());
+        qint64 timestamp = reportingQuery.value("timestamp").toLongLong();
+        if (timestamp > 0)
+            entry.timestamp = QDateTime::fromMSecsSinceEpoch(timestamp * 1000);
+
+        entries.append(entry);
+    }
+
+    return entries;
+}
+
+ZigbeeControllerSnapshot ZigbeeNetworkDatabase::loadControllerSnapshot()
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Loading controller snapshot from database" << m_db.databaseName();
+
+    // Make sure we read what has been written so far
+    flush();
+
+    ZigbeeControllerSnapshot snapshot;
+    QString query("SELECT * FROM controllerSnapshot WHERE id = 0;");
+    QSqlQuery snapshotQuery(query, m_db);
+    if (!snapshotQuery.exec()) {
+        qCWarning(dcZigbeeNetworkDatabase()) << "Unable to execute SQL query" << query << m_db.lastError().databaseText() << m_db.lastError().driverText();
+        return snapshot;
+    }
+
+    if (!snapshotQuery.next())
+        return snapshot;
+
+    snapshot.ieeeAddress = ZigbeeAddress(snapshotQuery.value("ieeeAddress").toString());
+    snapshot.panId = snapshotQuery.value("panId").toUInt();
+    // SQLite integers are signed 64 bit, the extended PAN ID is stored with the same bits as qint64
+    snapshot.extendedPanId = static_cast<quint64>(snapshotQuery.value("extendedPanId").toLongLong());
+    snapshot.channel = snapshotQuery.value("channel").toUInt();
+    snapshot.networkKey = ZigbeeNetworkKey(snapshotQuery.value("networkKey").toString());
+    snapshot.firmwareVersion = snapshotQuery.value("firmwareVersion").toString();
+    snapshot.timestamp = QDateTime::fromMSecsSinceEpoch(snapshotQuery.value("timestamp").toLongLong() * 1000);
+    return snapshot;
+}
+
+void ZigbeeNetworkDatabase::saveControllerSnapshot(const ZigbeeControllerSnapshot &snapshot, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << snapshot;
+    enqueue("save controller snapshot",
+            { { "INSERT OR REPLACE INTO controllerSnapshot (id, ieeeAddress, panId, extendedPanId, channel, networkKey, firmwareVersion, timestamp) "
+                "VALUES (0, ?, ?, ?, ?, ?, ?, ?);",
+                { snapshot.ieeeAddress.toString(),
+                  snapshot.panId,
+                  static_cast<qint64>(snapshot.extendedPanId),
+                  snapshot.channel,
+                  snapshot.networkKey.toString(),
+                  snapshot.firmwareVersion,
+                  snapshot.timestamp.toMSecsSinceEpoch() / 1000 } } }, callback);
+}
+
+QList<ZigbeeGreenPowerSink::Device> ZigbeeNetworkDatabase::loadGreenPowerDevices()
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Loading Green Power devices from database" << m_db.databaseName();
+
+    // Make sure we read what has been written so far
+    flush();
+
+    QList<ZigbeeGreenPowerSink::Device> devices;
+    QString query("SELECT * FROM greenPowerDevices;");
+    QSqlQuery devicesQuery(query, m_db);
+    if (!devicesQuery.exec()) {
+        qCWarning(dcZigbeeNetworkDatabase()) << "Unable to execute SQL query" << query << m_db.lastError().databaseText() << m_db.lastError().driverText();
+        return devices;
+    }
+
+    while (devicesQuery.next()) {
+        ZigbeeGreenPowerSink::Device device;
+        device.sourceId = devicesQuery.value("sourceId").toUInt();
+        device.deviceType = static_cast<ZigbeeGreenPowerSink::DeviceType>(devicesQuery.value("deviceType").toUInt());
+        device.sequenceNumberCapabilities = devicesQuery.value("sequenceNumberCapabilities").toBool();
+        device.rxOnCapability = devicesQuery.value("rxOnCapability").toBool();
+        device.securityLevel = devicesQuery.value("securityLevel").toUInt();
+        device.securityKeyType = devicesQuery.value("securityKeyType").toUInt();
+        device.securityKey = QByteArray::fromBase64(devicesQuery.value("securityKey").toByteArray());
+        device.frameCounter = devicesQuery.value("frameCounter").toUInt();
+        devices.append(device);
+    }
+
+    return devices;
+}
+
+void ZigbeeNetworkDatabase::saveGreenPowerDevice(const ZigbeeGreenPowerSink::Device &device, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << device;
+    enqueue(QString("save Green Power device %1").arg(ZigbeeUtils::convertUint32ToHexString(device.sourceId)),
+            { { "INSERT OR REPLACE INTO greenPowerDevices (sourceId, deviceType, sequenceNumberCapabilities, rxOnCapability, securityLevel, securityKeyType, securityKey, frameCounter) "
+                "VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+                { device.sourceId,
+                  static_cast<quint8>(device.deviceType),
+                  device.sequenceNumberCapabilities,
+                  device.rxOnCapability,
+                  device.securityLevel,
+                  device.securityKeyType,
+                  QString::fromLatin1(device.securityKey.toBase64()),
+                  device.frameCounter } } }, callback);
+}
+
+void ZigbeeNetworkDatabase::removeGreenPowerDevice(quint32 sourceId, const Callback &callback)
+{
+    enqueue(QString("remove Green Power device %1").arg(ZigbeeUtils::convertUint32ToHexString(sourceId)),
+            { { "DELETE FROM greenPowerDevices WHERE sourceId = ?;", { sourceId } } }, callback);
+}
+
 bool ZigbeeNetworkDatabase::wipeDatabase()
 {
     qCDebug(dcZigbeeNetworkDatabase()) << "Wipe all database entries from" << m_db.databaseName();
+    m_worker->shutdown();
+
     // Note: cascade will clean all other tables
     QSqlQuery deleteQuery("DELETE FROM nodes;", m_db);
     if (!deleteQuery.exec()) {
@@ -250,12 +407,14 @@ bool ZigbeeNetworkDatabase::wipeDatabase()
     m_db = QSqlDatabase();
     QSqlDatabase::removeDatabase(m_connectionName);
 
-    // Delete database file
-    QFile databaseFile(m_databaseName);
-    if (databaseFile.exists()) {
-        if (!databaseFile.remove()) {
-            qCWarning(dcZigbeeNetworkDatabase()) << "Could not delete database file" << m_databaseName;
-            return false;
+    // Delete database file and the write-ahead log
+    foreach (const QString &fileName, QStringList() << m_databaseName << m_databaseName + "-wal" << m_databaseName + "-shm") {
+        QFile databaseFile(fileName);
+        if (databaseFile.exists()) {
+            if (!databaseFile.remove()) {
+                qCWarning(dcZigbeeNetworkDatabase()) << "Could not delete database file" << fileName;
+                return false;
+            }
         }
     }
 
@@ -271,6 +430,12 @@ bool ZigbeeNetworkDatabase::initDatabase()
         return false;
     }
 
+    // Use the write-ahead log, so the worker connection can write while this connection reads
+    QSqlQuery journalModeQuery("PRAGMA journal_mode = WAL;", m_db);
+    if (!journalModeQuery.exec()) {
+        qCWarning(dcZigbeeNetworkDatabase()) << "Unable to execute SQL query" << journalModeQuery.lastQuery() << m_db.lastError().databaseText() << m_db.lastError().driverText();
+    }
+
     // TODO: check schema version fro compatibility or migration
 
     qCDebug(dcZigbeeNetworkDatabase()) << "Tables" << m_db.tables();
@@ -346,6 +511,60 @@ bool ZigbeeNetworkDatabase::initDatabase()
         createIndices("attributesIndex", "attributes", "clusterId, attributeId");
     }
 
+    // Note: reporting configurations get saved while the node is still being initialized and not in the nodes table yet,
+    // so there is no foreign key. Entries get removed together with the node. The table only caches what has been
+    // configured on the nodes, an older schema with foreign key can be recreated.
+    QSqlQuery reportingSchemaQuery("SELECT sql FROM sqlite_master WHERE type = 'table' AND name = 'reportingConfigurations';", m_db);
+    if (reportingSchemaQuery.exec() && reportingSchemaQuery.next() && reportingSchemaQuery.value("sql").toString().contains("REFERENCES")) {
+        qCDebug(dcZigbeeNetworkDatabase()) << "Recreating the reportingConfigurations table without foreign key";
+        QSqlQuery dropQuery("DROP TABLE reportingConfigurations;", m_db);
+        if (!dropQuery.exec()) {
+            qCWarning(dcZigbeeNetworkDatabase()) << "Unable to execute SQL query" << dropQuery.lastQuery() << m_db.lastError().databaseText() << m_db.lastError().driverText();
+        }
+    }
+
+    if (!m_db.tables().contains("reportingConfigurations")) {
+        createTable("reportingConfigurations",
+                    "(ieeeAddress TEXT NOT NULL, " // nodes.ieeeAddress, the node might not be stored yet
+                    "endpointId INTEGER NOT NULL, " // uint8
+                    "clusterId INTEGER NOT NULL, " // uint16
+                    "manufacturerCode INTEGER NOT NULL, " // uint16
+                    "attributeId INTEGER NOT NULL, " // uint16
+                    "direction INTEGER NOT NULL, " // uint8
+                    "dataType INTEGER NOT NULL, " // uint8
+                    "minInterval INTEGER NOT NULL, " // uint16
+                    "maxInterval INTEGER NOT NULL, " // uint16
+                    "reportableChange TEXT, " // base64 encoded raw data
+                    "timeoutPeriod INTEGER NOT NULL, " // uint16
+                    "state INTEGER NOT NULL, " // ZigbeeReportingReconciler::State
+                    "timestamp INTEGER NOT NULL, " // unix timestamp of the last verification or attempt
+                    "PRIMARY KEY(ieeeAddress, endpointId, clusterId, manufacturerCode, attributeId))");
+    }
+
+    if (!m_db.tables().contains("controllerSnapshot")) {
+        createTable("controllerSnapshot",
+                    "(id INTEGER PRIMARY KEY CHECK (id = 0), " // there is only one snapshot
+                    "ieeeAddress TEXT NOT NULL, " // ieeeAddress to string
+                    "panId INTEGER NOT NULL, " // uint16
+                    "extendedPanId INTEGER NOT NULL, " // uint64 stored as int64
+                    "channel INTEGER NOT NULL, " // uint8
+                    "networkKey TEXT NOT NULL, " // network key to string
+                    "firmwareVersion TEXT NOT NULL, "
+                    "timestamp INTEGER NOT NULL)"); // unix timestamp of the last successful start
+    }
+
+    if (!m_db.tables().contains("greenPowerDevices")) {
+        createTable("greenPowerDevices",
+                    "(sourceId INTEGER PRIMARY KEY, " // uint32
+                    "deviceType INTEGER NOT NULL, " // uint8
+                    "sequenceNumberCapabilities INTEGER NOT NULL, " // bool
+                    "rxOnCapability INTEGER NOT NULL, " // bool
+                    "securityLevel INTEGER NOT NULL, " // uint8
+                    "securityKeyType INTEGER NOT NULL, " // uint8
+                    "securityKey TEXT, " // base64 encoded key
+                    "frameCounter INTEGER NOT NULL)"); // last accepted security frame counter
+    }
+
     if (!m_db.tables().contains("bindings")) {
         createTable("bindings", "(sourceAddress TEXT NOT NULL, "
                                 "sourceEndpointId INTEGER NOT NULL, "
@@ -386,240 +605,319 @@ void ZigbeeNetworkDatabase::createIndices(const QString &indexName, const QStrin
     }
 }
 
-bool ZigbeeNetworkDatabase::saveNodeEndpoint(ZigbeeNodeEndpoint *endpoint)
+void ZigbeeNetworkDatabase::saveNodeEndpoint(ZigbeeNodeEndpoint *endpoint, const Callback &callback)
 {
     qCDebug(dcZigbeeNetworkDatabase()) << "Save" << endpoint;
-    QString queryString = QString("INSERT OR REPLACE INTO endpoints (ieeeAddress, endpointId, profileId, deviceId, deviceVersion) "
-                                  "VALUES (\"%1\", \"%2\", \"%3\", \"%4\", \"%5\");")
-            .arg(endpoint->node()->extendedAddress().toString())
-            .arg(endpoint->endpointId())
-            .arg(static_cast<quint16>(endpoint->profile()))
-            .arg(static_cast<quint16>(endpoint->deviceId()))
-            .arg(static_cast<quint8>(endpoint->deviceVersion()));
-
-    qCDebug(dcZigbeeNetworkDatabase()) << queryString;
-    QSqlQuery saveNodeEndpointQuery(queryString, m_db);
-    saveNodeEndpointQuery.exec();
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Could not save endpoint into database." << queryString << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return false;
-    }
+    enqueue(QString("save endpoint 0x%1 of %2").arg(endpoint->endpointId(), 2, 16, QChar('0')).arg(endpoint->node()->extendedAddress().toString()), nodeEndpointStatements(endpoint), callback);
+}
 
-    // Save input/output clusters
-    foreach(ZigbeeCluster *cluster, endpoint->inputClusters()) {
-        if (!saveInputCluster(cluster)) {
-            return false;
-        }
+void ZigbeeNetworkDatabase::saveInputCluster(ZigbeeCluster *cluster, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << cluster;
+    enqueue(QString("save input cluster %1 of %2").arg(ZigbeeUtils::convertUint16ToHexString(cluster->clusterId())).arg(cluster->node()->extendedAddress().toString()), { inputClusterStatement(cluster) }, callback);
+}
 
-        foreach(const ZigbeeClusterAttribute &attribute, cluster->attributes()) {
-            if (!saveAttribute(cluster, attribute)) {
-                return false;
-            }
-        }
-    }
+void ZigbeeNetworkDatabase::saveOutputCluster(ZigbeeCluster *cluster, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << cluster;
+    enqueue(QString("save output cluster %1 of %2").arg(ZigbeeUtils::convertUint16ToHexString(cluster->clusterId())).arg(cluster->node()->extendedAddress().toString()), { outputClusterStatement(cluster) }, callback);
+}
 
-    foreach(ZigbeeCluster *cluster, endpoint->outputClusters()) {
-        if (!saveOutputCluster(cluster)) {
-            return false;
-        }
+void ZigbeeNetworkDatabase::saveAttribute(ZigbeeCluster *cluster, const ZigbeeClusterAttribute &attribute, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << attribute;
+    enqueue(QString("save attribute %1 of %2").arg(ZigbeeUtils::convertUint16ToHexString(attribute.id())).arg(cluster->node()->extendedAddress().toString()), { attributeStatement(cluster, attribute) }, callback);
+}
+
+void ZigbeeNetworkDatabase::saveNode(ZigbeeNode *node, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << node;
+    QList<ZigbeeNetworkDatabaseWorker::Statement> statements;
+    statements.append({ "INSERT OR REPLACE INTO nodes (ieeeAddress, shortAddress, nodeDescriptor, powerDescriptor, lqi, timestamp) VALUES (?, ?, ?, ?, ?, ?);",
+                        { node->extendedAddress().toString(),
+                          node->shortAddress(),
+                          QString::fromLatin1(node->nodeDescriptor().descriptorRawData.toBase64()), // Note: convert to base64 for saving zeros as string
+                          node->powerDescriptor().powerDescriptoFlag,
+                          node->lqi(),
+                          node->lastSeen().toMSecsSinceEpoch() / 1000 } });
+
+    // Save endpoints
+    foreach (ZigbeeNodeEndpoint *endpoint, node->endpoints()) {
+        statements.append(nodeEndpointStatements(endpoint));
     }
 
-    return true;
+    statements.append(bindingTableStatements(node));
+    enqueue(QString("save node %1").arg(node->extendedAddress().toString()), statements, callback);
 }
 
-bool ZigbeeNetworkDatabase::saveInputCluster(ZigbeeCluster *cluster)
+void ZigbeeNetworkDatabase::updateNodeLqi(ZigbeeNode *node, quint8 lqi, const Callback &callback)
 {
-    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << cluster;
-    QString endpointIdReferenceQuery = QString("(SELECT id FROM endpoints WHERE ieeeAddress = \"%1\" AND endpointId = \"%2\")")
-            .arg(cluster->node()->extendedAddress().toString())
-            .arg(cluster->endpoint()->endpointId());
-    QString queryString = QString("INSERT OR REPLACE INTO serverClusters (endpointId, clusterId) VALUES (%1, \"%2\");")
-            .arg(endpointIdReferenceQuery)
-            .arg(static_cast<quint16>(cluster->clusterId()));
-
-    QSqlQuery saveInputClusterQuery(queryString, m_db);
-    saveInputClusterQuery.exec();
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Could not save input cluster into database." << queryString << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return false;
-    }
+    qCDebug(dcZigbeeNetworkDatabase()) << "Update node LQI" << node << lqi;
+    enqueue(QString("update LQI of %1").arg(node->extendedAddress().toString()),
+            { { "UPDATE nodes SET lqi = ? WHERE ieeeAddress = ?;", { lqi, node->extendedAddress().toString() } } }, callback);
+}
 
-    return true;
+void ZigbeeNetworkDatabase::updateNodeNetworkAddress(ZigbeeNode *node, quint16 networkAddress, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Update node network address" << node << ZigbeeUtils::convertUint16ToHexString(networkAddress);
+    enqueue(QString("update network address of %1").arg(node->extendedAddress().toString()),
+            { { "UPDATE nodes SET shortAddress = ? WHERE ieeeAddress = ?;", { networkAddress, node->extendedAddress().toString() } } }, callback);
 }
 
-bool ZigbeeNetworkDatabase::saveOutputCluster(ZigbeeCluster *cluster)
+void ZigbeeNetworkDatabase::updateNodeLastSeen(ZigbeeNode *node, const QDateTime &lastSeen, const Callback &callback)
 {
-    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << cluster;
-    QString endpointIdReferenceQuery = QString("(SELECT id FROM endpoints WHERE ieeeAddress = \"%1\" AND endpointId = \"%2\")")
-            .arg(cluster->node()->extendedAddress().toString())
-            .arg(cluster->endpoint()->endpointId());
-    QString queryString = QString("INSERT OR REPLACE INTO clientClusters (endpointId, clusterId) VALUES (%1, \"%2\");")
-            .arg(endpointIdReferenceQuery)
-            .arg(static_cast<quint16>(cluster->clusterId()));
-
-    QSqlQuery saveOutputClusterQuery(queryString, m_db);
-    saveOutputClusterQuery.exec();
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Could not save output cluster into database." << queryString << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return false;
-    }
+    qint64 timestamp = lastSeen.toMSecsSinceEpoch() / 1000;
+    qCDebug(dcZigbeeNetworkDatabase()) << "Update node last seen UTC timestamp" << node << timestamp;
+    enqueue(QString("update last seen timestamp of %1").arg(node->extendedAddress().toString()),
+            { { "UPDATE nodes SET timestamp = ? WHERE ieeeAddress = ?;", { timestamp, node->extendedAddress().toString() } } }, callback);
+}
 
-    return true;
+void ZigbeeNetworkDatabase::updateNodeBindingTable(ZigbeeNode *node, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Update binding table of" << node;
+    enqueue(QString("update binding table of %1").arg(node->extendedAddress().toString()), bindingTableStatements(node), callback);
 }
 
-bool ZigbeeNetworkDatabase::saveAttribute(ZigbeeCluster *cluster, const ZigbeeClusterAttribute &attribute)
+void ZigbeeNetworkDatabase::updateNodeBindingRecords(ZigbeeNode *node, const QList<ZigbeeDeviceProfile::BindingTableListRecord> &addedRecords, const QList<ZigbeeDeviceProfile::BindingTableListRecord> &removedRecords, const Callback &callback)
 {
-    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << attribute;
-    QString serverClusterIdReferenceQuery = QString("(SELECT id FROM serverClusters "
-                                                    "WHERE endpointId = (SELECT id FROM endpoints WHERE ieeeAddress = \"%1\" AND endpointId = \"%2\")"
-                                                    "AND clusterId = \"%3\")")
-            .arg(cluster->node()->extendedAddress().toString())
-            .arg(cluster->endpoint()->endpointId())
-            .arg(cluster->clusterId());
-
-    QString queryString = QString("INSERT OR REPLACE INTO attributes (clusterId, attributeId, dataType, data) "
-                                  "VALUES (%1, \"%2\", \"%3\", \"%4\");")
-            .arg(serverClusterIdReferenceQuery)
-            .arg(static_cast<quint16>(attribute.id()))
-            .arg(static_cast<quint8>(attribute.dataType().dataType()))
-            .arg((attribute.dataType().data().toBase64().data()));
-
-    QSqlQuery saveClusterAttributeQuery(queryString, m_db);
-    saveClusterAttributeQuery.exec();
+    qCDebug(dcZigbeeNetworkDatabase()) << "Update binding records of" << node << "added:" << addedRecords.count() << "removed:" << removedRecords.count();
+    QList<ZigbeeNetworkDatabaseWorker::Statement> statements;
+    foreach (const ZigbeeDeviceProfile::BindingTableListRecord &record, removedRecords) {
+        statements.append(removeBindingStatement(record));
+    }
 
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Could not save cluster attribute into database." << queryString << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return false;
+    foreach (const ZigbeeDeviceProfile::BindingTableListRecord &record, addedRecords) {
+        statements.append(insertBindingStatement(record));
     }
 
-    return true;
+    enqueue(QString("update binding records of %1").arg(node->extendedAddress().toString()), statements, callback);
 }
 
-bool ZigbeeNetworkDatabase::saveNode(ZigbeeNode *node)
+void ZigbeeNetworkDatabase::removeNode(ZigbeeNode *node, const Callback &callback)
 {
-    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << node;
-    QString queryString = QString("INSERT OR REPLACE INTO nodes (ieeeAddress, shortAddress, nodeDescriptor, powerDescriptor, lqi, timestamp) "
-                                  "VALUES (\"%1\", \"%2\", \"%3\", \"%4\", \"%5\", \"%6\");")
-            .arg(node->extendedAddress().toString())
-            .arg(node->shortAddress())
-            .arg(node->nodeDescriptor().descriptorRawData.toBase64().data()) // Note: convert to base64 for saving zeros as string
-            .arg(node->powerDescriptor().powerDescriptoFlag)
-            .arg(node->lqi())
-            .arg(node->lastSeen().toMSecsSinceEpoch() / 1000);
+    qCDebug(dcZigbeeNetworkDatabase()) << "Remove" << node;
+    // Note: cascade delete will clean up all other tables except the reporting configurations
+    enqueue(QString("remove node %1").arg(node->extendedAddress().toString()),
+            { { "DELETE FROM nodes WHERE ieeeAddress = ?;", { node->extendedAddress().toString() } },
+              { "DELETE FROM reportingConfigurations WHERE ieeeAddress = ?;", { node->extendedAddress().toString() } } }, callback);
+}
+
+void ZigbeeNetworkDatabase::saveReportingConfiguration(const ZigbeeReportingReconciler::Entry &entry, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Save" << entry;
+    enqueue(QString("save reporting configuration %1 of %2").arg(ZigbeeUtils::convertUint16ToHexString(entry.configuration.attributeId)).arg(entry.extendedAddress.toString()),
+            { { "INSERT OR REPLACE INTO reportingConfigurations (ieeeAddress, endpointId, clusterId, manufacturerCode, attributeId, direction, dataType, minInterval, maxInterval, reportableChange, timeoutPeriod, state, timestamp) "
+                "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+                { entry.extendedAddress.toString(),
+                  entry.endpointId,
+                  static_cast<quint16>(entry.clusterId),
+                  entry.manufacturerCode,
+                  entry.configuration.attributeId,
+                  static_cast<quint8>(entry.configuration.direction),
+                  static_cast<quint8>(entry.configuration.dataType),
+                  entry.configuration.minReportingInterval,
+                  entry.configuration.maxReportingInterval,
+                  QString::fromLatin1(entry.configuration.reportableChange.toBase64()),
+                  entry.configuration.timeoutPeriod,
+                  static_cast<quint8>(entry.state),
+                  entry.timestamp.isValid() ? entry.timestamp.toMSecsSinceEpoch() / 1000 : 0 } } }, callback);
+}
 
-    qCDebug(dcZigbeeNetworkDatabase()) << queryString;
+void ZigbeeNetworkDatabase::removeReportingConfiguration(const ZigbeeReportingReconciler::Entry &entry, const Callback &callback)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Remove" << entry;
+    enqueue(QString("remove reporting configuration %1 of %2").arg(ZigbeeUtils::convertUint16ToHexString(entry.configuration.attributeId)).arg(entry.extendedAddress.toString()),
+            { { "DELETE FROM reportingConfigurations WHERE ieeeAddress = ? AND endpointId = ? AND clusterId = ? AND manufacturerCode = ? AND attributeId = ?;",
+                { entry.extendedAddress.toString(),
+                  entry.endpointId,
+                  static_cast<quint16>(entry.clusterId),
+                  entry.manufacturerCode,
+                  entry.configuration.attributeId } } }, callback);
+}
 
-    QSqlQuery saveNodeQuery(queryString, m_db);
-    saveNodeQuery.exec();
+int ZigbeeNetworkDatabase::pendingJobs() const
+{
+    return m_worker->pendingJobs();
+}
 
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Could not save node into database." << queryString << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return false;
+void ZigbeeNetworkDatabase::flush()
+{
+    m_worker->waitForPendingJobs();
+}
+
+void ZigbeeNetworkDatabase::enqueue(const QString &description, const QList<ZigbeeNetworkDatabaseWorker::Statement> &statements, const Callback &callback)
+{
+    quint32 jobId = m_worker->enqueue(description, statements);
+    if (jobId == 0) {
+        if (callback) {
+            callback(false);
+        }
+        return;
     }
 
-    // Save endpoints
-    foreach (ZigbeeNodeEndpoint *endpoint, node->endpoints()) {
-        if (!saveNodeEndpoint(endpoint)) {
-            return false;
+    if (callback) {
+        m_callbacks.insert(jobId, callback);
+    }
+}
+
+QList<ZigbeeNetworkDatabaseWorker::Statement> ZigbeeNetworkDatabase::nodeEndpointStatements(ZigbeeNodeEndpoint *endpoint)
+{
+    QList<ZigbeeNetworkDatabaseWorker::Statement> statements;
+    statements.append({ "INSERT OR REPLACE INTO endpoints (ieeeAddress, endpointId, profileId, deviceId, deviceVersion) VALUES (?, ?, ?, ?, ?);",
+                        { endpoint->node()->extendedAddress().toString(),
+                          endpoint->endpointId(),
+                          static_cast<quint16>(endpoint->profile()),
+                          static_cast<quint16>(endpoint->deviceId()),
+                          static_cast<quint8>(endpoint->deviceVersion()) } });
+
+    // Save input/output clusters
+    foreach(ZigbeeCluster *cluster, endpoint->inputClusters()) {
+        statements.append(inputClusterStatement(cluster));
+        foreach(const ZigbeeClusterAttribute &attribute, cluster->attributes()) {
+            statements.append(attributeStatement(cluster, attribute));
         }
     }
 
-    updateNodeBindingTable(node);
+    foreach(ZigbeeCluster *cluster, endpoint->outputClusters()) {
+        statements.append(outputClusterStatement(cluster));
+    }
 
-    return true;
+    return statements;
 }
 
-bool ZigbeeNetworkDatabase::updateNodeLqi(ZigbeeNode *node, quint8 lqi)
+ZigbeeNetworkDatabaseWorker::Statement ZigbeeNetworkDatabase::inputClusterStatement(ZigbeeCluster *cluster)
 {
-    qCDebug(dcZigbeeNetworkDatabase()) << "Update node LQI" << node << lqi;
-    QString queryString = QString("UPDATE nodes SET lqi = \"%1\" WHERE ieeeAddress = \"%2\";").arg(lqi).arg(node->extendedAddress().toString());
-    QSqlQuery updateNodeLqiQuery(queryString, m_db);
-    updateNodeLqiQuery.exec();
+    return { "INSERT OR REPLACE INTO serverClusters (endpointId, clusterId) "
+             "VALUES ((SELECT id FROM endpoints WHERE ieeeAddress = ? AND endpointId = ?), ?);",
+             { cluster->node()->extendedAddress().toString(),
+               cluster->endpoint()->endpointId(),
+               static_cast<quint16>(cluster->clusterId()) } };
+}
 
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Could not update node LQI value in the database." << queryString << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return false;
+ZigbeeNetworkDatabaseWorker::Statement ZigbeeNetworkDatabase::outputClusterStatement(ZigbeeCluster *cluster)
+{
+    return { "INSERT OR REPLACE INTO clientClusters (endpointId, clusterId) "
+             "VALUES ((SELECT id FROM endpoints WHERE ieeeAddress = ? AND endpointId = ?), ?);",
+             { cluster->node()->extendedAddress().toString(),
+               cluster->endpoint()->endpointId(),
+               static_cast<quint16>(cluster->clusterId()) } };
+}
+
+ZigbeeNetworkDatabaseWorker::Statement ZigbeeNetworkDatabase::attributeStatement(ZigbeeCluster *cluster, const ZigbeeClusterAttribute &attribute)
+{
+    return { "INSERT OR REPLACE INTO attributes (clusterId, attributeId, dataType, data) "
+             "VALUES ((SELECT id FROM serverClusters WHERE endpointId = (SELECT id FROM endpoints WHERE ieeeAddress = ? AND endpointId = ?) AND clusterId = ?), ?, ?, ?);",
+             { cluster->node()->extendedAddress().toString(),
+               cluster->endpoint()->endpointId(),
+               static_cast<quint16>(cluster->clusterId()),
+               static_cast<quint16>(attribute.id()),
+               static_cast<quint8>(attribute.dataType().dataType()),
+               QString::fromLatin1(attribute.dataType().data().toBase64()) } };
+}
+
+QList<ZigbeeNetworkDatabaseWorker::Statement> ZigbeeNetworkDatabase::bindingTableStatements(ZigbeeNode *node)
+{
+    QList<ZigbeeNetworkDatabaseWorker::Statement> statements;
+    statements.append({ "DELETE FROM bindings WHERE sourceAddress = ?;", { node->extendedAddress().toString() } });
+    foreach (const ZigbeeDeviceProfile::BindingTableListRecord &record, node->bindingTableRecords()) {
+        statements.append(insertBindingStatement(record));
     }
 
-    return true;
+    return statements;
 }
 
-bool ZigbeeNetworkDatabase::updateNodeNetworkAddress(ZigbeeNode *node, quint16 networkAddress)
+ZigbeeNetworkDatabaseWorker::Statement ZigbeeNetworkDatabase::insertBindingStatement(const ZigbeeDeviceProfile::BindingTableListRecord &record)
 {
-    qCDebug(dcZigbeeNetworkDatabase()) << "Update node network address" << node << ZigbeeUtils::convertUint16ToHexString(networkAddress);
-    QString queryString = QString("UPDATE nodes SET shortAddress = \"%1\" WHERE ieeeAddress = \"%2\";").arg(networkAddress).arg(node->extendedAddress().toString());
-    QSqlQuery updateNodeNetworkAddressQuery(queryString, m_db);
-    updateNodeNetworkAddressQuery.exec();
+    return { "INSERT INTO bindings (sourceAddress, sourceEndpointId, clusterId, destinationAddressMode, destinationShortAddress, destinationIeeeAddress, destinationEndpointId) VALUES(?, ?, ?, ?, ?, ?, ?);",
+             { record.sourceAddress.toString(),
+               record.sourceEndpoint,
+               record.clusterId,
+               static_cast<quint8>(record.destinationAddressMode),
+               record.destinationShortAddress,
+               record.destinationIeeeAddress.toString(),
+               record.destinationEndpoint } };
+}
 
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Could not update node LQI value in the database." << queryString << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return false;
-    }
+ZigbeeNetworkDatabaseWorker::Statement ZigbeeNetworkDatabase::removeBindingStatement(const ZigbeeDeviceProfile::BindingTableListRecord &record)
+{
+    // Note: the removed record is the cached one, so it matches exactly what has been stored
+    return { "DELETE FROM bindings WHERE sourceAddress = ? AND sourceEndpointId = ? AND clusterId = ? AND destinationAddressMode = ? "
+             "AND destinationShortAddress = ? AND destinationIeeeAddress = ? AND destinationEndpointId = ?;",
+             { record.sourceAddress.toString(),
+               record.sourceEndpoint,
+               record.clusterId,
+               static_cast<quint8>(record.destinationAddressMode),
+               record.destinationShortAddress,
+               record.destinationIeeeAddress.toString(),
+               record.destinationEndpoint } };
+}
 
-    return true;
+bool ZigbeeNetworkDatabase::executeBlocking(const std::function<void (const Callback &)> &job)
+{
+    bool result = false;
+    job([&result](bool success){ result = success; });
+    flush();
+
+    // The worker has finished the job, deliver the queued result to the callback
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+    return result;
 }
 
-bool ZigbeeNetworkDatabase::updateNodeLastSeen(ZigbeeNode *node, const QDateTime &lastSeen)
+bool ZigbeeNetworkDatabase::saveNodeEndpoint(ZigbeeNodeEndpoint *endpoint)
 {
-    quint64 timestamp = lastSeen.toMSecsSinceEpoch() / 1000;
-    qCDebug(dcZigbeeNetworkDatabase()) << "Update node last seen UTC timestamp" << node << timestamp;
-    QString queryString = QString("UPDATE nodes SET timestamp = \"%1\" WHERE ieeeAddress = \"%2\";").arg(timestamp).arg(node->extendedAddress().toString());
-    QSqlQuery updateNodeLastSeenQuery(queryString, m_db);
-    updateNodeLastSeenQuery.exec();
+    return executeBlocking([=](const Callback &callback){ saveNodeEndpoint(endpoint, callback); });
+}
 
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Could not update node timestamp value in the database." << queryString << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return false;
-    }
+bool ZigbeeNetworkDatabase::saveInputCluster(ZigbeeCluster *cluster)
+{
+    return executeBlocking([=](const Callback &callback){ saveInputCluster(cluster, callback); });
+}
 
-    return true;
+bool ZigbeeNetworkDatabase::saveOutputCluster(ZigbeeCluster *cluster)
+{
+    return executeBlocking([=](const Callback &callback){ saveOutputCluster(cluster, callback); });
 }
 
-bool ZigbeeNetworkDatabase::updateNodeBindingTable(ZigbeeNode *node)
+bool ZigbeeNetworkDatabase::saveAttribute(ZigbeeCluster *cluster, const ZigbeeClusterAttribute &attribute)
 {
-    bool error = false;
-    QSqlQuery query(m_db);
-    query.prepare("DELETE FROM bindings WHERE sourceAddress = ?");
-    query.addBindValue(node->extendedAddress().toString());
-    query.exec();
-    if (query.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Error clearing old binding table:" << query.executedQuery() << query.lastError().databaseText() << query.lastError().driverText();
-        error = true;
-    }
+    return executeBlocking([=](const Callback &callback){ saveAttribute(cluster, attribute, callback); });
+}
 
-    foreach (const ZigbeeDeviceProfile::BindingTableListRecord &record, node->bindingTableRecords()) {
-        QSqlQuery insertQuery(m_db);
-        insertQuery.prepare("INSERT INTO bindings (sourceAddress, sourceEndpointId, clusterId, destinationAddressMode, destinationShortAddress, destinationIeeeAddress, destinationEndpointId) VALUES(?, ?, ?, ?, ?, ?, ?)");
-        insertQuery.addBindValue(record.sourceAddress.toString());
-        insertQuery.addBindValue(record.sourceEndpoint);
-        insertQuery.addBindValue(record.clusterId);
-        insertQuery.addBindValue(record.destinationAddressMode);
-        insertQuery.addBindValue(record.destinationShortAddress);
-        insertQuery.addBindValue(record.destinationIeeeAddress.toString());
-        insertQuery.addBindValue(record.destinationEndpoint);
-        insertQuery.exec();
-        if (insertQuery.lastError().type() != QSqlError::NoError) {
-            qCWarning(dcZigbeeNetworkDatabase()) << "Error inserting into binding table:" << query.executedQuery() << query.lastError().databaseText() << query.lastError().driverText();
-            error = true;
-        }
-    }
-    return error;
+bool ZigbeeNetworkDatabase::saveNode(ZigbeeNode *node)
+{
+    return executeBlocking([=](const Callback &callback){ saveNode(node, callback); });
 }
 
-bool ZigbeeNetworkDatabase::removeNode(ZigbeeNode *node)
+bool ZigbeeNetworkDatabase::updateNodeLqi(ZigbeeNode *node, quint8 lqi)
 {
-    qCDebug(dcZigbeeNetworkDatabase()) << "Remove" << node;
-    // Note: cascade delete will clean up all other tables
-    QString queryString = QString("DELETE FROM nodes WHERE ieeeAddress = \"%1\";").arg(node->extendedAddress().toString());
-    QSqlQuery removeNodeQuery(queryString, m_db);
-    removeNodeQuery.exec();
+    return executeBlocking([=](const Callback &callback){ updateNodeLqi(node, lqi, callback); });
+}
 
-    if (m_db.lastError().type() != QSqlError::NoError) {
-        qCWarning(dcZigbeeNetworkDatabase()) << "Could not remove node from database." << queryString << m_db.lastError().databaseText() << m_db.lastError().driverText();
-        return false;
-    }
+bool ZigbeeNetworkDatabase::updateNodeNetworkAddress(ZigbeeNode *node, quint16 networkAddress)
+{
+    return executeBlocking([=](const Callback &callback){ updateNodeNetworkAddress(node, networkAddress, callback); });
+}
 
-    return true;
+bool ZigbeeNetworkDatabase::updateNodeLastSeen(ZigbeeNode *node, const QDateTime &lastSeen)
+{
+    return executeBlocking([=](const Callback &callback){ updateNodeLastSeen(node, lastSeen, callback); });
+}
+
+bool ZigbeeNetworkDatabase::updateNodeBindingTable(ZigbeeNode *node)
+{
+    return executeBlocking([=](const Callback &callback){ updateNodeBindingTable(node, callback); });
 }
 
+bool ZigbeeNetworkDatabase::removeNode(ZigbeeNode *node)
+{
+    return executeBlocking([=](const Callback &callback){ removeNode(node, callback); });
+}
 
+void ZigbeeNetworkDatabase::onJobFinished(quint32 jobId, bool success)
+{
+    if (!m_callbacks.contains(jobId))
+        return;
+
+    Callback callback = m_callbacks.take(jobId);
+    callback(success);
+}
@@ -28,9 +28,18 @@
 #ifndef ZIGBEENETWORKDATABASE_H
 #define ZIGBEENETWORKDATABASE_H
 
+#include <QHash>
 #include <QObject>
 #include <QSqlDatabase>
 
+#include <functional>
+
+#include "zigbeenetworkdatabaseworker.h"
+#include "zigbeereportingreconciler.h"
+#include "zigbeegreenpowersink.h"
+#include "zigbeecontrollersnapshot.h"
+#include "zdo/zigbeedeviceprofile.h"
+
 #define DB_VERSION 1
 
 class ZigbeeNode;
@@ -45,6 +54,9 @@ class ZigbeeNetworkDatabase : public QObject
 {
     Q_OBJECT
 public:
+    // Called in the thread of the database object once the job has been written
+    typedef std::function<void(bool success)> Callback;
+
     explicit ZigbeeNetworkDatabase(ZigbeeNetwork *network, const QString &databaseName, QObject *parent = nullptr);
     ~ZigbeeNetworkDatabase();
 
@@ -54,17 +66,67 @@ public:
 
     bool wipeDatabase();
 
+    // Write jobs are executed asynchronously in the database worker thread in the order they have been called.
+    // The callback may be empty, the blocking overloads below are kept for compatibility.
+    void saveNodeEndpoint(ZigbeeNodeEndpoint *endpoint, const Callback &callback);
+    void saveInputCluster(ZigbeeCluster *cluster, const Callback &callback);
+    void saveOutputCluster(ZigbeeCluster *cluster, const Callback &callback);
+    void saveAttribute(ZigbeeCluster *cluster, const ZigbeeClusterAttribute &attribute, const Callback &callback);
+    void saveNode(ZigbeeNode *node, const Callback &callback);
+    void updateNodeLqi(ZigbeeNode *node, quint8 lqi, const Callback &callback);
+    void updateNodeNetworkAddress(ZigbeeNode *node, quint16 networkAddress, const Callback &callback);
+    void updateNodeLastSeen(ZigbeeNode *node, const QDateTime &lastSeen, const Callback &callback);
+    void updateNodeBindingTable(ZigbeeNode *node, const Callback &callback);
+    void updateNodeBindingRecords(ZigbeeNode *node, const QList<ZigbeeDeviceProfile::BindingTableListRecord> &addedRecords, const QList<ZigbeeDeviceProfile::BindingTableListRecord> &removedRecords, const Callback &callback = Callback());
+    void removeNode(ZigbeeNode *node, const Callback &callback);
+
+    // Desired attribute reporting configurations and their state on the node
+    QList<ZigbeeReportingReconciler::Entry> loadReportingConfigurations();
+    void saveReportingConfiguration(const ZigbeeReportingReconciler::Entry &entry, const Callback &callback = Callback());
+    void removeReportingConfiguration(const ZigbeeReportingReconciler::Entry &entry, const Callback &callback = Callback());
+
+    // The controller state of the last successful network start, used for the warm start
+    ZigbeeControllerSnapshot loadControllerSnapshot();
+    void saveControllerSnapshot(const ZigbeeControllerSnapshot &snapshot, const Callback &callback = Callback());
+
+    // Commissioned Green Power devices, including the last security frame counter
+    QList<ZigbeeGreenPowerSink::Device> loadGreenPowerDevices();
+    void saveGreenPowerDevice(const ZigbeeGreenPowerSink::Device &device, const Callback &callback = Callback());
+    void removeGreenPowerDevice(quint32 sourceId, const Callback &callback = Callback());
+
+    int pendingJobs() const;
+
+    // Blocks until all pending write jobs have been executed
+    void flush();
+
 private:
     ZigbeeNetwork *m_network = nullptr;
     QString m_databaseName;
     QString m_connectionName;
     QSqlDatabase m_db;
 
+    // Note: the connection of this object is only used for the schema and for loading, all writes happen in the worker
+    ZigbeeNetworkDatabaseWorker *m_worker = nullptr;
+    QHash<quint32, Callback> m_callbacks;
+
     bool initDatabase();
     void createTable(const QString &tableName, const QString &schema);
     void createIndices(const QString &indexName, const QString &tableName, const QString &columns);
 
+    void enqueue(const QString &description, const QList<ZigbeeNetworkDatabaseWorker::Statement> &statements, const Callback &callback);
+
+    QList<ZigbeeNetworkDatabaseWorker::Statement> nodeEndpointStatements(ZigbeeNodeEndpoint *endpoint);
+    ZigbeeNetworkDatabaseWorker::Statement inputClusterStatement(ZigbeeCluster *cluster);
+    ZigbeeNetworkDatabaseWorker::Statement outputClusterStatement(ZigbeeCluster *cluster);
+    ZigbeeNetworkDatabaseWorker::Statement attributeStatement(ZigbeeCluster *cluster, const ZigbeeClusterAttribute &attribute);
+    QList<ZigbeeNetworkDatabaseWorker::Statement> bindingTableStatements(ZigbeeNode *node);
+    ZigbeeNetworkDatabaseWorker::Statement insertBindingStatement(const ZigbeeDeviceProfile::BindingTableListRecord &record);
+    ZigbeeNetworkDatabaseWorker::Statement removeBindingStatement(const ZigbeeDeviceProfile::BindingTableListRecord &record);
+
+    bool executeBlocking(const std::function<void(const Callback &callback)> &job);
+
 public slots:
+    // Compatibility: block until the job has been written and return the result
     bool saveNodeEndpoint(ZigbeeNodeEndpoint *endpoint);
     bool saveInputCluster(ZigbeeCluster *cluster);
     bool saveOutputCluster(ZigbeeCluster *cluster);
@@ -76,6 +138,9 @@ public slots:
     bool updateNodeBindingTable(ZigbeeNode *node);
     bool removeNode(ZigbeeNode *node);
 
+private slots:
+    void onJobFinished(quint32 jobId, bool success);
+
 };
 
 #endif // ZIGBEENETWORKDATABASE_H
@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeenetworkdatabaseworker.h"
+#include "zigbeemetrics.h"
+#include "loggingcategory.h"
+
+#include <QFileInfo>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlDatabase>
+
+ZigbeeNetworkDatabaseWorker::ZigbeeNetworkDatabaseWorker(const QString &databaseName, QObject *parent) :
+    QThread(parent),
+    m_databaseName(databaseName)
+{
+    setObjectName("zigbee-database");
+
+    m_queueDepthGauge = ZigbeeMetrics::instance()->gauge("zigbee_database_queue_depth", "Number of database jobs waiting to be written.");
+    m_jobsCounter = ZigbeeMetrics::instance()->counter("zigbee_database_jobs_total", "Number of executed database jobs.");
+    m_failedJobsCounter = ZigbeeMetrics::instance()->counter("zigbee_database_jobs_failed_total", "Number of database jobs which have been rolled back.");
+}
+
+ZigbeeNetworkDatabaseWorker::~ZigbeeNetworkDatabaseWorker()
+{
+    shutdown();
+}
+
+quint32 ZigbeeNetworkDatabaseWorker::enqueue(const QString &description, const QList<Statement> &statements)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_stopping) {
+        qCWarning(dcZigbeeNetworkDatabase()) << "The database worker has been shut down. Discarding" << description;
+        return 0;
+    }
+
+    // Note: 0 is reserved for invalid jobs
+    m_jobId++;
+    if (m_jobId == 0)
+        m_jobId++;
+
+    Job job;
+    job.id = m_jobId;
+    job.description = description;
+    job.statements = statements;
+    m_jobs.enqueue(job);
+    m_queueDepthGauge->set(m_jobs.count());
+    m_jobsAvailable.wakeOne();
+    return job.id;
+}
+
+int ZigbeeNetworkDatabaseWorker::pendingJobs() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_jobs.count() + (m_busy ? 1 : 0);
+}
+
+void ZigbeeNetworkDatabaseWorker::waitForPendingJobs()
+{
+    if (!isRunning())
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    while (!m_jobs.isEmpty() || m_busy) {
+        m_jobsProcessed.wait(&m_mutex);
+    }
+}
+
+void ZigbeeNetworkDatabaseWorker::shutdown()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_stopping)
+            return;
+
+        m_stopping = true;
+        m_jobsAvailable.wakeOne();
+    }
+
+    if (isRunning()) {
+        qCDebug(dcZigbeeNetworkDatabase()) << "Shutting down database worker. Pending jobs:" << pendingJobs();
+        wait();
+    }
+}
+
+void ZigbeeNetworkDatabaseWorker::run()
+{
+    QString connectionName = QFileInfo(m_databaseName).baseName() + "-worker";
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), connectionName);
+        db.setDatabaseName(m_databaseName);
+        if (!db.open()) {
+            qCWarning(dcZigbeeNetworkDatabase()) << "Could not open database worker connection" << m_databaseName << db.lastError().databaseText() << db.lastError().driverText();
+        } else {
+            // Note: foreign keys are a property of the connection and are required for the cascading deletes
+            executeQuery(db, "PRAGMA foreign_keys = ON;");
+            executeQuery(db, "PRAGMA synchronous = NORMAL;");
+        }
+
+        while (true) {
+            QQueue<Job> jobs;
+            {
+                QMutexLocker locker(&m_mutex);
+                while (m_jobs.isEmpty() && !m_stopping) {
+                    m_jobsAvailable.wait(&m_mutex);
+                }
+
+                // Stop only once everything has been written
+                if (m_jobs.isEmpty())
+                    break;
+
+                jobs.swap(m_jobs);
+                m_busy = true;
+                m_queueDepthGauge->set(0);
+            }
+
+            // Write all jobs which piled up within one transaction in order to minimize the disk syncs
+            bool transaction = db.isOpen() && db.transaction();
+            QList<bool> results;
+            foreach (const Job &job, jobs) {
+                results.append(db.isOpen() && executeJob(db, job));
+            }
+
+            // Nothing has been written before the commit, if it fails none of the jobs succeeded
+            if (transaction && !db.commit()) {
+                qCWarning(dcZigbeeNetworkDatabase()) << "Could not commit database transaction" << db.lastError().databaseText() << db.lastError().driverText();
+                db.rollback();
+                for (int i = 0; i < results.count(); i++) {
+                    results[i] = false;
+                }
+            }
+
+            for (int i = 0; i < jobs.count(); i++) {
+                m_jobsCounter->increment();
+                if (!results.at(i))
+                    m_failedJobsCounter->increment();
+
+                emit jobFinished(jobs.at(i).id, results.at(i));
+            }
+
+            {
+                QMutexLocker locker(&m_mutex);
+                m_busy = false;
+                m_jobsProcessed.wakeAll();
+            }
+        }
+
+        db.close();
+    }
+
+    QSqlDatabase::removeDatabase(connectionName);
+
+    // Wake up any waiting caller in case the database connection could not be used
+    QMutexLocker locker(&m_mutex);
+    m_jobsProcessed.wakeAll();
+    qCDebug(dcZigbeeNetworkDatabase()) << "Database worker finished";
+}
+
+bool ZigbeeNetworkDatabaseWorker::executeQuery(QSqlDatabase &db, const QString &query, const QVariantList &bindValues)
+{
+    QSqlQuery sqlQuery(db);
+    sqlQuery.prepare(query);
+    foreach (const QVariant &value, bindValues) {
+        sqlQuery.addBindValue(value);
+    }
+
+    if (!sqlQuery.exec()) {
+        qCWarning(dcZigbeeNetworkDatabase()) << "Unable to execute SQL query" << query << bindValues << sqlQuery.lastError().databaseText() << sqlQuery.lastError().driverText();
+        return false;
+    }
+
+    return true;
+}
+
+bool ZigbeeNetworkDatabaseWorker::executeJob(QSqlDatabase &db, const Job &job)
+{
+    qCDebug(dcZigbeeNetworkDatabase()) << "Execute" << job.description;
+    if (!executeQuery(db, "SAVEPOINT job;"))
+        return false;
+
+    foreach (const Statement &statement, job.statements) {
+        if (!executeQuery(db, statement.query, statement.bindValues)) {
+            qCWarning(dcZigbeeNetworkDatabase()) << "Failed to execute" << job.description << "Rolling back changes.";
+            executeQuery(db, "ROLLBACK TO job;");
+            executeQuery(db, "RELEASE job;");
+            return false;
+        }
+    }
+
+    return executeQuery(db, "RELEASE job;");
+}
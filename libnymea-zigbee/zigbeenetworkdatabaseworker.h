@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEENETWORKDATABASEWORKER_H
+#define ZIGBEENETWORKDATABASEWORKER_H
+
+#include <QQueue>
+#include <QMutex>
+#include <QThread>
+#include <QVariant>
+#include <QWaitCondition>
+
+class ZigbeeMetricGauge;
+class ZigbeeMetricCounter;
+
+class QSqlDatabase;
+
+// Executes the write jobs of the network database in a dedicated thread using its own
+// database connection. Jobs are executed in the order they have been enqueued. The jobs which
+// piled up meanwhile are written in one transaction, each job within its own savepoint so a
+// failing job does not affect the others. Jobs are reported finished once the transaction has
+// been committed, if the commit fails all jobs of the batch are reported as failed.
+
+class ZigbeeNetworkDatabaseWorker : public QThread
+{
+    Q_OBJECT
+public:
+    typedef struct Statement {
+        QString query;
+        QVariantList bindValues;
+    } Statement;
+
+    explicit ZigbeeNetworkDatabaseWorker(const QString &databaseName, QObject *parent = nullptr);
+    ~ZigbeeNetworkDatabaseWorker() override;
+
+    // Returns the job id or 0 if the worker does not accept any jobs any more
+    quint32 enqueue(const QString &description, const QList<Statement> &statements);
+
+    int pendingJobs() const;
+
+    // Blocks until all jobs enqueued so far have been executed
+    void waitForPendingJobs();
+
+    // Executes all pending jobs and stops the thread
+    void shutdown();
+
+signals:
+    void jobFinished(quint32 jobId, bool success);
+
+protected:
+    void run() override;
+
+private:
+    typedef struct Job {
+        quint32 id = 0;
+        QString description;
+        QList<Statement> statements;
+    } Job;
+
+    QString m_databaseName;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_jobsAvailable;
+    QWaitCondition m_jobsProcessed;
+    QQueue<Job> m_jobs;
+    quint32 m_jobId = 0;
+    bool m_busy = false;
+    bool m_stopping = false;
+
+    ZigbeeMetricGauge *m_queueDepthGauge = nullptr;
+    ZigbeeMetricCounter *m_jobsCounter = nullptr;
+    ZigbeeMetricCounter *m_failedJobsCounter = nullptr;
+
+    bool executeQuery(QSqlDatabase &db, const QString &query, const QVariantList &bindValues = QVariantList());
+    bool executeJob(QSqlDatabase &db, const Job &job);
+
+};
+
+#endif // ZIGBEENETWORKDATABASEWORKER_H
@@ -56,12 +56,6 @@ ZigbeeNetworkReply::ZigbeeNetworkReply(const ZigbeeNetworkRequest &request, QObj
     QObject(parent),
     m_request(request)
 {
-    m_timer = new QTimer(this);
-    m_timer->setSingleShot(true);
-    m_timer->setInterval(20000);
-    connect(m_timer, &QTimer::timeout, this, [this](){
-        m_error = ErrorTimeout;
-        emit finished();
-    });
+    m_elapsedTimer.start();
 }
 
@@ -30,6 +30,7 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QElapsedTimer>
 
 #include "zigbee.h"
 #include "zigbeenetworkrequest.h"
@@ -63,7 +64,14 @@ public:
 private:
     explicit ZigbeeNetworkReply(const ZigbeeNetworkRequest &request, QObject *parent = nullptr);
     ZigbeeNetworkRequest m_request;
-    QTimer *m_timer = nullptr;
+
+    // Timeout managed by the timer wheel of the network, 0 if not waiting
+    quint32 m_timeoutTimerId = 0;
+
+    // Latency measurement, relative to the creation of the reply, -1 if not reached
+    QElapsedTimer m_elapsedTimer;
+    qint64 m_serialWriteLatency = -1;
+    qint64 m_confirmLatency = -1;
 
     Error m_error = ErrorNoError;
     Zigbee::ZigbeeMacLayerStatus m_zigbeeMacStatus = Zigbee::ZigbeeMacLayerStatusSuccess;
@@ -29,6 +29,7 @@
 #include "zigbeeutils.h"
 #include "zigbeenetwork.h"
 #include "loggingcategory.h"
+#include "zigbeenodemailbox.h"
 
 #include <QDataStream>
 
@@ -39,6 +40,7 @@ ZigbeeNode::ZigbeeNode(ZigbeeNetwork *network, quint16 shortAddress, const Zigbe
     m_extendedAddress(extendedAddress)
 {
     m_deviceObject = new ZigbeeDeviceObject(m_network, this, this);
+    m_mailbox = new ZigbeeNodeMailbox(m_network, this, this);
 }
 
 ZigbeeNode::State ZigbeeNode::state() const
@@ -56,11 +58,21 @@ QUuid ZigbeeNode::networkUuid() const
     return m_network->networkUuid();
 }
 
+ZigbeeNetwork *ZigbeeNode::network() const
+{
+    return m_network;
+}
+
 ZigbeeDeviceObject *ZigbeeNode::deviceObject() const
 {
     return m_deviceObject;
 }
 
+ZigbeeNodeMailbox *ZigbeeNode::mailbox() const
+{
+    return m_mailbox;
+}
+
 quint16 ZigbeeNode::shortAddress() const
 {
     return m_shortAddress;
@@ -157,6 +169,74 @@ QList<ZigbeeDeviceProfile::RoutingTableListRecord> ZigbeeNode::routingTableRecor
     return m_routingTableRecords.values();
 }
 
+ZigbeeRttEstimator ZigbeeNode::rttEstimator() const
+{
+    return m_rttEstimator;
+}
+
+bool ZigbeeNode::isSleepy() const
+{
+    // The MAC capabilities from the node descriptor are more reliable than the ones from the device announcement
+    ZigbeeDeviceProfile::MacCapabilities capabilities = m_nodeDescriptorAvailable ? m_nodeDescriptor.macCapabilities : m_macCapabilities;
+    if (!m_nodeDescriptorAvailable && capabilities.flag == 0x00) {
+        // Nothing known yet, only the power descriptor can tell us something
+        return m_powerDescriptorAvailable && m_powerDescriptor.powerMode != ZigbeeDeviceProfile::PowerModeAlwaysOn;
+    }
+
+    return !capabilities.receiverOnWhenIdle;
+}
+
+int ZigbeeNode::replyTimeout() const
+{
+    // Sleepy end devices poll their parent only every few seconds, so the request
+    // might sit in the indirect queue of the parent for a while (~7.5 s by default).
+    qint64 minimumTimeout = 2000;
+    qint64 maximumTimeout = 20000;
+    qint64 initialTimeout = 10000;
+    if (isSleepy()) {
+        minimumTimeout = 8000;
+        maximumTimeout = 60000;
+        initialTimeout = 20000;
+    } else if (m_powerDescriptorAvailable && m_powerDescriptor.powerSource != ZigbeeDeviceProfile::PowerSourcePermanentMainSupply) {
+        // Battery powered devices with receiver on when idle tend to respond slower
+        maximumTimeout = 30000;
+    }
+
+    return static_cast<int>(qBound(minimumTimeout, m_rttEstimator.retransmissionTimeout(initialTimeout), maximumTimeout));
+}
+
+int ZigbeeNode::requestRetriesMax() const
+{
+    // Each retry on a sleepy device costs at least one poll period, don't hammer the parent
+    if (isSleepy())
+        return 2;
+
+    return 3;
+}
+
+int ZigbeeNode::retryDelay(int attempt) const
+{
+    // Exponential backoff based on the smoothed round trip time
+    qint64 baseDelay = 500;
+    if (m_rttEstimator.hasSamples())
+        baseDelay = qBound(static_cast<qint64>(500), m_rttEstimator.smoothedRtt(), static_cast<qint64>(5000));
+
+    int shift = qBound(0, attempt - 1, 4);
+    return static_cast<int>(qMin(baseDelay << shift, static_cast<qint64>(replyTimeout())));
+}
+
+void ZigbeeNode::addResponseTimeSample(qint64 responseTime)
+{
+    m_rttEstimator.addSample(responseTime);
+    qCDebug(dcZigbeeNode()) << "Response time" << responseTime << "ms from" << this << m_rttEstimator << "timeout" << replyTimeout() << "ms";
+}
+
+void ZigbeeNode::handleResponseTimeout()
+{
+    m_rttEstimator.backoff();
+    qCDebug(dcZigbeeNode()) << "Request timeout for" << this << m_rttEstimator << "next timeout" << replyTimeout() << "ms";
+}
+
 void ZigbeeNode::setState(ZigbeeNode::State state)
 {
     if (m_state == state)
@@ -248,7 +328,7 @@ ZigbeeReply *ZigbeeNode::addBinding(quint8 sourceEndpointId, quint16 clusterId,
 {
     ZigbeeReply *reply = new ZigbeeReply(this);
     ZigbeeDeviceObjectReply *zdoReply = deviceObject()->requestBindIeeeAddress(sourceEndpointId, clusterId, destinationAddress, destinationEndpoint);
-    connect(zdoReply, &ZigbeeDeviceObjectReply::finished, reply, [this, zdoReply, reply](){
+    connect(zdoReply, &ZigbeeDeviceObjectReply::finished, reply, [=](){
         if (zdoReply->error() != ZigbeeDeviceObjectReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Failed to configure binding on node" << this;
             reply->finishReply(ZigbeeReply::ErrorZigbeeError);
@@ -256,8 +336,18 @@ ZigbeeReply *ZigbeeNode::addBinding(quint8 sourceEndpointId, quint16 clusterId,
         }
         qCDebug(dcZigbeeNode) << "Binding added";
 
+        ZigbeeDeviceProfile::BindingTableListRecord record;
+        record.sourceAddress = extendedAddress();
+        record.sourceEndpoint = sourceEndpointId;
+        record.clusterId = clusterId;
+        record.destinationAddressMode = Zigbee::DestinationAddressModeIeeeAddress;
+        record.destinationIeeeAddress = destinationAddress;
+        record.destinationEndpoint = destinationEndpoint;
+        updateBindingTableRecords({ record }, {});
+
         reply->finishReply();
 
+        // Verify the binding table, this will stop after the first chunk if the device agrees with us
         readBindingTableEntries();
     });
     return reply;
@@ -267,7 +357,7 @@ ZigbeeReply *ZigbeeNode::addBinding(quint8 sourceEndpointId, quint16 clusterId,
 {
     ZigbeeReply *reply = new ZigbeeReply(this);
     ZigbeeDeviceObjectReply *zdoReply = deviceObject()->requestBindGroupAddress(sourceEndpointId, clusterId, destinationGroupAddress);
-    connect(zdoReply, &ZigbeeDeviceObjectReply::finished, reply, [this, zdoReply, reply](){
+    connect(zdoReply, &ZigbeeDeviceObjectReply::finished, reply, [=](){
         if (zdoReply->error() != ZigbeeDeviceObjectReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Failed to configure binding on node" << this;
             reply->finishReply(ZigbeeReply::ErrorZigbeeError);
@@ -275,8 +365,17 @@ ZigbeeReply *ZigbeeNode::addBinding(quint8 sourceEndpointId, quint16 clusterId,
         }
         qCDebug(dcZigbeeNode) << "Binding added";
 
+        ZigbeeDeviceProfile::BindingTableListRecord record;
+        record.sourceAddress = extendedAddress();
+        record.sourceEndpoint = sourceEndpointId;
+        record.clusterId = clusterId;
+        record.destinationAddressMode = Zigbee::DestinationAddressModeGroup;
+        record.destinationShortAddress = destinationGroupAddress;
+        updateBindingTableRecords({ record }, {});
+
         reply->finishReply();
 
+        // Verify the binding table, this will stop after the first chunk if the device agrees with us
         readBindingTableEntries();
     });
     return reply;
@@ -286,7 +385,7 @@ ZigbeeReply *ZigbeeNode::removeBinding(const ZigbeeDeviceProfile::BindingTableLi
 {
     ZigbeeReply *reply = new ZigbeeReply(this);
     ZigbeeDeviceObjectReply *zdoReply = deviceObject()->requestUnbind(binding);
-    connect(zdoReply, &ZigbeeDeviceObjectReply::finished, reply, [this, zdoReply, reply](){
+    connect(zdoReply, &ZigbeeDeviceObjectReply::finished, reply, [this, zdoReply, reply, binding](){
         if (zdoReply->error() != ZigbeeDeviceObjectReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Failed to rebinding binding on node" << this;
             reply->finishReply(ZigbeeReply::ErrorZigbeeError);
@@ -294,8 +393,11 @@ ZigbeeReply *ZigbeeNode::removeBinding(const ZigbeeDeviceProfile::BindingTableLi
         }
         qCDebug(dcZigbeeNode) << "Binding removed";
 
+        updateBindingTableRecords({}, { binding });
+
         reply->finishReply();
 
+        // Verify the binding table, this will stop after the first chunk if the device agrees with us
         readBindingTableEntries();
     });
     return reply;
@@ -309,11 +411,11 @@ void ZigbeeNode::initNodeDescriptor()
         if (reply->error() != ZigbeeDeviceObjectReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Error occured during initialization of" << this << "Failed to read node descriptor" << reply->error();
             m_requestRetry++;
-            if (m_requestRetry < m_requestRetriesMax) {
-                qCDebug(dcZigbeeNode()) << "Retrying to request node descriptor" << m_requestRetry << "/" << m_requestRetriesMax;
-                QTimer::singleShot(500, this, [=](){ initNodeDescriptor(); });
+            if (m_requestRetry < requestRetriesMax()) {
+                qCDebug(dcZigbeeNode()) << "Retrying to request node descriptor" << m_requestRetry << "/" << requestRetriesMax();
+                QTimer::singleShot(retryDelay(m_requestRetry), this, [=](){ initNodeDescriptor(); });
             } else {
-                qCWarning(dcZigbeeNode()) << "Failed to read node descriptor from" << this << "after" << m_requestRetriesMax << "attempts.";
+                qCWarning(dcZigbeeNode()) << "Failed to read node descriptor from" << this << "after" << requestRetriesMax() << "attempts.";
                 m_requestRetry = 0;
                 qCWarning(dcZigbeeNode()) << this << "is out of spec. A device must implement the node descriptor. Continue anyways with the power decriptor...";
                 initPowerDescriptor();
@@ -339,12 +441,12 @@ void ZigbeeNode::initPowerDescriptor()
     connect(reply, &ZigbeeDeviceObjectReply::finished, this, [this, reply](){
         if (reply->error() != ZigbeeDeviceObjectReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Error occured during initialization of" << this << "Failed to read power descriptor" << reply->error();
-            if (m_requestRetry < m_requestRetriesMax) {
+            if (m_requestRetry < requestRetriesMax()) {
                 m_requestRetry++;
-                qCDebug(dcZigbeeNode()) << "Retry to request power descriptor from" << this << m_requestRetry << "/" << m_requestRetriesMax << "attempts.";
-                QTimer::singleShot(500, this, [=](){ initPowerDescriptor(); });
+                qCDebug(dcZigbeeNode()) << "Retry to request power descriptor from" << this << m_requestRetry << "/" << requestRetriesMax() << "attempts.";
+                QTimer::singleShot(retryDelay(m_requestRetry), this, [=](){ initPowerDescriptor(); });
             } else {
-                qCWarning(dcZigbeeNode()) << "Failed to read power descriptor from" << this << "after" << m_requestRetriesMax << "attempts. Giving up reading power descriptor.";
+                qCWarning(dcZigbeeNode()) << "Failed to read power descriptor from" << this << "after" << requestRetriesMax() << "attempts. Giving up reading power descriptor.";
                 qCWarning(dcZigbeeNode()) << this << "is out of spec. A device must implement the power descriptor. Continue anyways with the endpoint initialization...";
                 initEndpoints();
             }
@@ -373,12 +475,12 @@ void ZigbeeNode::initEndpoints()
     connect(reply, &ZigbeeDeviceObjectReply::finished, this, [this, reply](){
         if (reply->error() != ZigbeeDeviceObjectReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Error occured during initialization of" << this << "Failed to read active endpoints" << reply->error();
-            if (m_requestRetry < m_requestRetriesMax) {
+            if (m_requestRetry < requestRetriesMax()) {
                 m_requestRetry++;
-                qCDebug(dcZigbeeNode()) << "Retry to request active endpoints from" << this << m_requestRetry << "/" << m_requestRetriesMax << "attempts.";
-                QTimer::singleShot(500, this, [=](){ initEndpoints(); });
+                qCDebug(dcZigbeeNode()) << "Retry to request active endpoints from" << this << m_requestRetry << "/" << requestRetriesMax() << "attempts.";
+                QTimer::singleShot(retryDelay(m_requestRetry), this, [=](){ initEndpoints(); });
             } else {
-                qCWarning(dcZigbeeNode()) << "Failed to read active endpoints from" << this << "after" << m_requestRetriesMax << "attempts. Giving up reading endpoints.";
+                qCWarning(dcZigbeeNode()) << "Failed to read active endpoints from" << this << "after" << requestRetriesMax() << "attempts. Giving up reading endpoints.";
                 m_requestRetry = 0;
                 setState(StateInitialized);
             }
@@ -423,12 +525,12 @@ void ZigbeeNode::initEndpoint(quint8 endpointId)
     connect(reply, &ZigbeeDeviceObjectReply::finished, this, [this, reply, endpointId](){
         if (reply->error() != ZigbeeDeviceObjectReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Error occured during initialization of" << this << "Failed to read simple descriptor for endpoint" << endpointId << reply->error();
-            if (m_requestRetry < m_requestRetriesMax) {
+            if (m_requestRetry < requestRetriesMax()) {
                 m_requestRetry++;
-                qCDebug(dcZigbeeNode()) << "Retry to request simple descriptor from" << this << ZigbeeUtils::convertByteToHexString(endpointId) << m_requestRetry << "/" << m_requestRetriesMax << "attempts.";
-                QTimer::singleShot(500, this, [=](){ initEndpoint(endpointId); });
+                qCDebug(dcZigbeeNode()) << "Retry to request simple descriptor from" << this << ZigbeeUtils::convertByteToHexString(endpointId) << m_requestRetry << "/" << requestRetriesMax() << "attempts.";
+                QTimer::singleShot(retryDelay(m_requestRetry), this, [=](){ initEndpoint(endpointId); });
             } else {
-                qCWarning(dcZigbeeNode()) << "Failed to read simple descriptor from" << this << ZigbeeUtils::convertByteToHexString(endpointId) << "after" << m_requestRetriesMax << "attempts. Giving up initializing endpoint" << endpointId;
+                qCWarning(dcZigbeeNode()) << "Failed to read simple descriptor from" << this << ZigbeeUtils::convertByteToHexString(endpointId) << "after" << requestRetriesMax() << "attempts. Giving up initializing endpoint" << endpointId;
                 m_requestRetry = 0;
                 if (m_uninitializedEndpoints.isEmpty()) {
                     // Continue with the basic cluster attributes
@@ -540,8 +642,7 @@ void ZigbeeNode::removeNextBinding(ZigbeeReply *reply)
         }
 
         // Successfully removed
-        m_bindingTableRecords.removeLast();
-        emit bindingTableRecordsChanged();
+        updateBindingTableRecords({}, { record });
 
         removeNextBinding(reply);
     });
@@ -567,6 +668,16 @@ void ZigbeeNode::readBindingTableChunk(ZigbeeReply *reply, quint8 startIndex)
         ZigbeeDeviceProfile::BindingTable bindingTable = ZigbeeDeviceProfile::parseBindingTable(zdoReply->responseData());
         if (bindingTable.startIndex == 0) {
             m_bindingTable = bindingTable;
+
+            // If the table size matches our cached state and the first chunk matches the cached records at
+            // the same positions, there is no need to fetch the rest. Any other difference requires a full read.
+            if (m_bindingTable.records.count() < m_bindingTable.tableSize && m_bindingTable.tableSize == m_bindingTableRecords.count()
+                    && m_bindingTableRecords.mid(0, m_bindingTable.records.count()) == m_bindingTable.records) {
+                qCDebug(dcZigbeeNode()) << "Binding table of" << this << "matches the cached state (" << m_bindingTable.tableSize << "records). Skipping remaining chunks.";
+                m_bindingTable.records = m_bindingTableRecords;
+                reply->finishReply(ZigbeeReply::ErrorNoError);
+                return;
+            }
         } else if (m_bindingTable.records.count() == bindingTable.startIndex) {
             m_bindingTable.records.append(bindingTable.records);
         } else {
@@ -580,57 +691,53 @@ void ZigbeeNode::readBindingTableChunk(ZigbeeReply *reply, quint8 startIndex)
             return;
         }
 
-        bool changed = false;
-        QMutableListIterator<ZigbeeDeviceProfile::BindingTableListRecord> it(m_bindingTableRecords);
-        while (it.hasNext()) {
-            ZigbeeDeviceProfile::BindingTableListRecord oldRecord = it.next();
-            bool found = false;
-            foreach (const ZigbeeDeviceProfile::BindingTableListRecord &record, m_bindingTable.records) {
-                if (record.sourceAddress == oldRecord.sourceAddress
-                        && record.sourceEndpoint == oldRecord.sourceEndpoint
-                        && record.clusterId == oldRecord.clusterId
-                        && record.destinationAddressMode == oldRecord.destinationAddressMode
-                        && record.destinationShortAddress == oldRecord.destinationShortAddress
-                        && record.destinationIeeeAddress == oldRecord.destinationIeeeAddress
-                        && record.destinationEndpoint == oldRecord.destinationEndpoint) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                it.remove();
-                changed = true;
+        QList<ZigbeeDeviceProfile::BindingTableListRecord> removedRecords;
+        foreach (const ZigbeeDeviceProfile::BindingTableListRecord &oldRecord, m_bindingTableRecords) {
+            if (!m_bindingTable.records.contains(oldRecord)) {
+                removedRecords.append(oldRecord);
             }
         }
 
+        QList<ZigbeeDeviceProfile::BindingTableListRecord> addedRecords;
         foreach (const ZigbeeDeviceProfile::BindingTableListRecord &record, m_bindingTable.records) {
             qCDebug(dcZigbeeNode()) << "Binding table record fetched" << record;
-            bool found = false;
-            foreach (const ZigbeeDeviceProfile::BindingTableListRecord &oldRecord, m_bindingTableRecords) {
-                if (record.sourceAddress == oldRecord.sourceAddress
-                        && record.sourceEndpoint == oldRecord.sourceEndpoint
-                        && record.clusterId == oldRecord.clusterId
-                        && record.destinationAddressMode == oldRecord.destinationAddressMode
-                        && record.destinationShortAddress == oldRecord.destinationShortAddress
-                        && record.destinationIeeeAddress == oldRecord.destinationIeeeAddress
-                        && record.destinationEndpoint == oldRecord.destinationEndpoint) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
+            if (!m_bindingTableRecords.contains(record)) {
                 qCDebug(dcZigbeeNode()) << "New binding table record:" << record;
-                m_bindingTableRecords.append(record);
-                changed = true;
+                addedRecords.append(record);
             }
         }
-        if (changed) {
-            emit bindingTableRecordsChanged();
-        }
+
+        updateBindingTableRecords(addedRecords, removedRecords);
         reply->finishReply(ZigbeeReply::ErrorNoError);
     });
 }
 
+void ZigbeeNode::updateBindingTableRecords(const QList<ZigbeeDeviceProfile::BindingTableListRecord> &addedRecords, const QList<ZigbeeDeviceProfile::BindingTableListRecord> &removedRecords)
+{
+    QList<ZigbeeDeviceProfile::BindingTableListRecord> removed;
+    foreach (const ZigbeeDeviceProfile::BindingTableListRecord &record, removedRecords) {
+        // Note: keep the cached record, it contains exactly what has been stored
+        int index = m_bindingTableRecords.indexOf(record);
+        if (index >= 0) {
+            removed.append(m_bindingTableRecords.takeAt(index));
+        }
+    }
+
+    QList<ZigbeeDeviceProfile::BindingTableListRecord> added;
+    foreach (const ZigbeeDeviceProfile::BindingTableListRecord &record, addedRecords) {
+        if (!m_bindingTableRecords.contains(record)) {
+            m_bindingTableRecords.append(record);
+            added.append(record);
+        }
+    }
+
+    if (added.isEmpty() && removed.isEmpty())
+        return;
+
+    emit bindingTableRecordsUpdated(added, removed);
+    emit bindingTableRecordsChanged();
+}
+
 void ZigbeeNode::readNeighborTableChunk(ZigbeeReply *reply, quint8 startIndex)
 {
     ZigbeeDeviceObjectReply *zdoReply = deviceObject()->requestMgmtLqi(startIndex);
@@ -870,12 +977,12 @@ void ZigbeeNode::readManufacturerName(ZigbeeClusterBasic *basicCluster)
     connect(reply, &ZigbeeClusterReply::finished, this, [this, basicCluster, reply, attributeId](){
         if (reply->error() != ZigbeeClusterReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Error occured during initialization of" << this << "Failed to read basic cluster attribute" << attributeId << reply->error();
-            if (m_requestRetry < m_requestRetriesMax) {
+            if (m_requestRetry < requestRetriesMax()) {
                 m_requestRetry++;
-                qCDebug(dcZigbeeNode()) << "Retry to read manufacturer name from" << this << basicCluster << m_requestRetry << "/" << m_requestRetriesMax << "attempts.";
-                QTimer::singleShot(500, this, [=](){ readManufacturerName(basicCluster); });
+                qCDebug(dcZigbeeNode()) << "Retry to read manufacturer name from" << this << basicCluster << m_requestRetry << "/" << requestRetriesMax() << "attempts.";
+                QTimer::singleShot(retryDelay(m_requestRetry), this, [=](){ readManufacturerName(basicCluster); });
             } else {
-                qCWarning(dcZigbeeNode()) << "Failed to read manufacturer name from" << this << basicCluster << "after" << m_requestRetriesMax << "attempts. Giving up and continue...";
+                qCWarning(dcZigbeeNode()) << "Failed to read manufacturer name from" << this << basicCluster << "after" << requestRetriesMax() << "attempts. Giving up and continue...";
                 m_requestRetry = 0;
                 readModelIdentifier(basicCluster);
             }
@@ -933,12 +1040,12 @@ void ZigbeeNode::readModelIdentifier(ZigbeeClusterBasic *basicCluster)
     connect(reply, &ZigbeeClusterReply::finished, this, [this, basicCluster, reply, attributeId](){
         if (reply->error() != ZigbeeClusterReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Error occured during initialization of" << this << "Failed to read basic cluster attribute" << attributeId << reply->error();
-            if (m_requestRetry < m_requestRetriesMax) {
+            if (m_requestRetry < requestRetriesMax()) {
                 m_requestRetry++;
-                qCDebug(dcZigbeeNode()) << "Retry to read model identifier from" << this << basicCluster << m_requestRetry << "/" << m_requestRetriesMax << "attempts.";
-                QTimer::singleShot(500, this, [=](){ readModelIdentifier(basicCluster); });
+                qCDebug(dcZigbeeNode()) << "Retry to read model identifier from" << this << basicCluster << m_requestRetry << "/" << requestRetriesMax() << "attempts.";
+                QTimer::singleShot(retryDelay(m_requestRetry), this, [=](){ readModelIdentifier(basicCluster); });
             } else {
-                qCWarning(dcZigbeeNode()) << "Failed to read model identifier from" << this << basicCluster << "after" << m_requestRetriesMax << "attempts. Giving up and continue...";
+                qCWarning(dcZigbeeNode()) << "Failed to read model identifier from" << this << basicCluster << "after" << requestRetriesMax() << "attempts. Giving up and continue...";
                 m_requestRetry = 0;
                 readSoftwareBuildId(basicCluster);
             }
@@ -976,12 +1083,12 @@ void ZigbeeNode::readSoftwareBuildId(ZigbeeClusterBasic *basicCluster)
     connect(reply, &ZigbeeClusterReply::finished, this, [this, basicCluster, reply, attributeId](){
         if (reply->error() != ZigbeeClusterReply::ErrorNoError) {
             qCWarning(dcZigbeeNode()) << "Error occured during initialization of" << this << "Failed to read basic cluster attribute" << attributeId << reply->error();
-            if (m_requestRetry < m_requestRetriesMax) {
+            if (m_requestRetry < requestRetriesMax()) {
                 m_requestRetry++;
-                qCDebug(dcZigbeeNode()) << "Retry to read model identifier from" << this << basicCluster << m_requestRetry << "/" << m_requestRetriesMax << "attempts.";
-                QTimer::singleShot(500, this, [=](){ readSoftwareBuildId(basicCluster); });
+                qCDebug(dcZigbeeNode()) << "Retry to read model identifier from" << this << basicCluster << m_requestRetry << "/" << requestRetriesMax() << "attempts.";
+                QTimer::singleShot(retryDelay(m_requestRetry), this, [=](){ readSoftwareBuildId(basicCluster); });
             } else {
-                qCWarning(dcZigbeeNode()) << "Failed to read model identifier from" << this << basicCluster << "after" << m_requestRetriesMax << "attempts. Giving up and continue...";
+                qCWarning(dcZigbeeNode()) << "Failed to read model identifier from" << this << basicCluster << "after" << requestRetriesMax() << "attempts. Giving up and continue...";
                 m_requestRetry = 0;
                 setState(StateInitialized);
             }
@@ -1029,6 +1136,9 @@ void ZigbeeNode::handleDataIndication(const Zigbee::ApsdeDataIndication &indicat
         emit lastSeenChanged(m_lastSeen);
     }
 
+    // The node is awake right now, deliver what has been held back for it
+    m_mailbox->handleNodeHeard();
+
     // Check if this indocation is related to any pending reply
     if (indication.profileId == Zigbee::ZigbeeProfileDevice) {
         deviceObject()->processApsDataIndication(indication);
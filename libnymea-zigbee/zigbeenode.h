@@ -34,18 +34,23 @@
 #include "zigbee.h"
 #include "zigbeereply.h"
 #include "zigbeeaddress.h"
+#include "zigbeerttestimator.h"
+#include "zigbeesequencenumberallocator.h"
 #include "zigbeenodeendpoint.h"
 #include "zdo/zigbeedeviceobject.h"
 #include "zdo/zigbeedeviceprofile.h"
 #include "zcl/general/zigbeeclusterbasic.h"
 
 class ZigbeeNetwork;
+class ZigbeeNodeMailbox;
 
 class ZigbeeNode : public QObject
 {
     Q_OBJECT
 
+    friend class ZigbeeCluster;
     friend class ZigbeeNetwork;
+    friend class ZigbeeDeviceObject;
     friend class ZigbeeNetworkDatabase;
 
 public:
@@ -63,8 +68,10 @@ public:
     bool reachable() const;
 
     QUuid networkUuid() const;
+    ZigbeeNetwork *network() const;
 
     ZigbeeDeviceObject *deviceObject() const;
+    ZigbeeNodeMailbox *mailbox() const;
 
     quint16 shortAddress() const;
     ZigbeeAddress extendedAddress() const;
@@ -95,6 +102,14 @@ public:
     QList<ZigbeeDeviceProfile::NeighborTableListRecord> neighborTableRecords() const;
     QList<ZigbeeDeviceProfile::RoutingTableListRecord> routingTableRecords() const;
 
+    // Timeout and retry policy for requests to this node, derived from the measured
+    // round trip times and limited according to the power/receiver capabilities
+    ZigbeeRttEstimator rttEstimator() const;
+    bool isSleepy() const;
+    int replyTimeout() const;
+    int requestRetriesMax() const;
+    int retryDelay(int attempt) const;
+
     // This method starts the node initialization phase (read descriptors and endpoints)
     void startInitialization();
 
@@ -120,6 +135,7 @@ private:
     QString m_version;
 
     ZigbeeDeviceObject *m_deviceObject = nullptr;
+    ZigbeeNodeMailbox *m_mailbox = nullptr;
     QList<ZigbeeNodeEndpoint *> m_endpoints;
     bool m_reachable = false;
     State m_state = StateUninitialized;
@@ -133,6 +149,9 @@ private:
     bool m_nodeDescriptorAvailable = false;
     bool m_powerDescriptorAvailable = false;
 
+    ZigbeeRttEstimator m_rttEstimator;
+    ZigbeeSequenceNumberAllocator m_zclSequenceNumbers;
+
     QList<ZigbeeDeviceProfile::BindingTableListRecord> m_bindingTableRecords;
     QHash<quint16, ZigbeeDeviceProfile::NeighborTableListRecord> m_neighborTableRecords;
     QHash<quint16, ZigbeeDeviceProfile::RoutingTableListRecord> m_routingTableRecords;
@@ -143,9 +162,12 @@ private:
     void setState(State state);
     void setReachable(bool reachable);
 
+    // Called by the ZDO and the clusters for each matched response or expired request
+    void addResponseTimeSample(qint64 responseTime);
+    void handleResponseTimeout();
+
     // Init methods
     int m_requestRetry = 0;
-    int m_requestRetriesMax = 2;
     QList<quint8> m_uninitializedEndpoints;
     void initNodeDescriptor();
     void initPowerDescriptor();
@@ -154,6 +176,7 @@ private:
 
     void removeNextBinding(ZigbeeReply *reply);
     void readBindingTableChunk(ZigbeeReply *reply, quint8 startIndex);
+    void updateBindingTableRecords(const QList<ZigbeeDeviceProfile::BindingTableListRecord> &addedRecords, const QList<ZigbeeDeviceProfile::BindingTableListRecord> &removedRecords);
     void readNeighborTableChunk(ZigbeeReply *reply, quint8 startIndex);
     void readRoutingTableChunk(ZigbeeReply *reply, quint8 startIndex);
 
@@ -179,6 +202,7 @@ signals:
     void versionChanged(const QString &version);
     void reachableChanged(bool reachable);
     void bindingTableRecordsChanged();
+    void bindingTableRecordsUpdated(const QList<ZigbeeDeviceProfile::BindingTableListRecord> &addedRecords, const QList<ZigbeeDeviceProfile::BindingTableListRecord> &removedRecords);
     void neighborTableRecordsChanged();
     void routingTableRecordsChanged();
     void clusterAdded(ZigbeeCluster *cluster);
@@ -57,6 +57,8 @@
 #include "zcl/measurement/zigbeeclusterrelativehumiditymeasurement.h"
 #include "zcl/measurement/zigbeeclusterpressuremeasurement.h"
 #include "zcl/measurement/zigbeeclusterelectricalmeasurement.h"
+#include "zcl/generated/zigbeeclusterflowmeasurement.h"
+#include "zcl/generated/zigbeeclusterilluminancelevelsensing.h"
 
 #include "zcl/lighting/zigbeeclustercolorcontrol.h"
 
@@ -255,6 +257,10 @@ ZigbeeCluster *ZigbeeNodeEndpoint::createCluster(ZigbeeClusterLibrary::ClusterId
         return new ZigbeeClusterPressureMeasurement(m_network, m_node, this, direction, this);
     case ZigbeeClusterLibrary::ClusterIdElectricalMeasurement:
         return new ZigbeeClusterElectricalMeasurement(m_network, m_node, this, direction, this);
+    case ZigbeeClusterLibrary::ClusterIdFlowMeasurement:
+        return new ZigbeeClusterFlowMeasurement(m_network, m_node, this, direction, this);
+    case ZigbeeClusterLibrary::ClusterIdIlluminanceLevelSensing:
+        return new ZigbeeClusterIlluminanceLevelSensing(m_network, m_node, this, direction, this);
 
         // Colsures
     case ZigbeeClusterLibrary::ClusterIdDoorLock:
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeenodemailbox.h"
+#include "zigbeenetwork.h"
+#include "zigbeetimerwheel.h"
+#include "loggingcategory.h"
+#include "zcl/zigbeecluster.h"
+#include "zcl/zigbeeclusterreply.h"
+
+ZigbeeNodeMailbox::ZigbeeNodeMailbox(ZigbeeNetwork *network, ZigbeeNode *node, QObject *parent) :
+    QObject(parent),
+    m_network(network),
+    m_node(node)
+{
+
+}
+
+bool ZigbeeNodeMailbox::enabled() const
+{
+    return m_enabled;
+}
+
+void ZigbeeNodeMailbox::setEnabled(bool enabled)
+{
+    if (m_enabled == enabled)
+        return;
+
+    m_enabled = enabled;
+    if (!m_enabled) {
+        // Nothing will be held back any more
+        flush();
+    }
+}
+
+int ZigbeeNodeMailbox::awakeWindow() const
+{
+    return m_awakeWindow;
+}
+
+void ZigbeeNodeMailbox::setAwakeWindow(int awakeWindow)
+{
+    m_awakeWindow = qMax(0, awakeWindow);
+}
+
+int ZigbeeNodeMailbox::expirationTimeout() const
+{
+    return m_expirationTimeout;
+}
+
+void ZigbeeNodeMailbox::setExpirationTimeout(int expirationTimeout)
+{
+    m_expirationTimeout = qMax(0, expirationTimeout);
+}
+
+bool ZigbeeNodeMailbox::active() const
+{
+    // Note: during the initialization the node is awake and waiting for our requests
+    return m_enabled && m_node->state() == ZigbeeNode::StateInitialized && m_node->isSleepy();
+}
+
+bool ZigbeeNodeMailbox::nodeAwake() const
+{
+    return m_lastHeard.isValid() && m_lastHeard.elapsed() < m_awakeWindow;
+}
+
+int ZigbeeNodeMailbox::pendingRequests() const
+{
+    return m_entries.count();
+}
+
+bool ZigbeeNodeMailbox::enqueue(ZigbeeCluster *cluster, ZigbeeClusterReply *zclReply)
+{
+    // Keep the order of the requests, even if the node is awake right now
+    if (!active() || (nodeAwake() && m_entries.isEmpty()))
+        return false;
+
+    if (!zclReply->m_writeAttributeRecords.isEmpty())
+        mergeWriteAttributes(cluster, zclReply);
+
+    Entry entry;
+    entry.cluster = cluster;
+    entry.reply = zclReply;
+    if (m_expirationTimeout > 0) {
+        QPointer<ZigbeeNodeMailbox> mailboxPointer(this);
+        QPointer<ZigbeeClusterReply> replyPointer(zclReply);
+        entry.expirationTimerId = m_network->timerWheel()->schedule(m_expirationTimeout, [mailboxPointer, replyPointer](){
+            if (mailboxPointer.isNull() || replyPointer.isNull())
+                return;
+
+            mailboxPointer->expire(replyPointer.data());
+        });
+    }
+
+    m_entries.append(entry);
+    qCDebug(dcZigbeeNode()) << "Holding back request for sleepy" << m_node << cluster << "until the node is awake. Pending requests:" << m_entries.count();
+    emit pendingRequestsChanged(m_entries.count());
+    return true;
+}
+
+void ZigbeeNodeMailbox::flush()
+{
+    if (m_entries.isEmpty())
+        return;
+
+    QList<Entry> entries = m_entries;
+    m_entries.clear();
+    qCDebug(dcZigbeeNode()) << "Delivering" << entries.count() << "pending requests to" << m_node;
+    foreach (const Entry &entry, entries) {
+        m_network->timerWheel()->cancel(entry.expirationTimerId);
+        if (entry.cluster.isNull() || entry.reply.isNull())
+            continue;
+
+        // The node might have rejoined with a new short address in the meantime
+        if (entry.reply->m_request.destinationAddressMode() == Zigbee::DestinationAddressModeShortAddress)
+            entry.reply->m_request.setDestinationShortAddress(m_node->shortAddress());
+
+        entry.reply->m_elapsedTimer.restart();
+        entry.cluster->transmitClusterRequest(entry.reply);
+    }
+
+    emit pendingRequestsChanged(m_entries.count());
+}
+
+void ZigbeeNodeMailbox::mergeWriteAttributes(ZigbeeCluster *cluster, ZigbeeClusterReply *zclReply)
+{
+    QList<quint16> attributeIds;
+    foreach (const ZigbeeClusterLibrary::WriteAttributeRecord &record, zclReply->m_writeAttributeRecords) {
+        attributeIds.append(record.attributeId);
+    }
+
+    for (int i = m_entries.count() - 1; i >= 0; i--) {
+        Entry entry = m_entries.at(i);
+        if (entry.cluster != cluster || entry.reply.isNull() || entry.reply->m_writeAttributeRecords.isEmpty())
+            continue;
+
+        if (entry.reply->m_requestFrame.header.manufacturerCode != zclReply->m_requestFrame.header.manufacturerCode)
+            continue;
+
+        QList<ZigbeeClusterLibrary::WriteAttributeRecord> remainingRecords;
+        foreach (const ZigbeeClusterLibrary::WriteAttributeRecord &record, entry.reply->m_writeAttributeRecords) {
+            if (!attributeIds.contains(record.attributeId)) {
+                remainingRecords.append(record);
+            }
+        }
+
+        if (remainingRecords.count() == entry.reply->m_writeAttributeRecords.count())
+            continue;
+
+        ZigbeeClusterReply *supersededReply = entry.reply.data();
+        if (!remainingRecords.isEmpty()) {
+            // Only write the attributes which have not been written again
+            QByteArray payload;
+            foreach (const ZigbeeClusterLibrary::WriteAttributeRecord &record, remainingRecords) {
+                payload += ZigbeeClusterLibrary::buildWriteAttributeRecord(record);
+            }
+
+            supersededReply->m_writeAttributeRecords = remainingRecords;
+            supersededReply->m_requestFrame.payload = payload;
+            supersededReply->m_request.setAsdu(ZigbeeClusterLibrary::buildFrame(supersededReply->m_requestFrame));
+            qCDebug(dcZigbeeNode()) << "Removed superseded attribute writes from pending request for" << m_node << cluster;
+            continue;
+        }
+
+        // Completely superseded, finish together with the newer request
+        qCDebug(dcZigbeeNode()) << "Merged pending attribute write into newer request for" << m_node << cluster;
+        m_network->timerWheel()->cancel(entry.expirationTimerId);
+        m_entries.removeAt(i);
+        connect(zclReply, &ZigbeeClusterReply::finished, supersededReply, [zclReply, supersededReply](){
+            supersededReply->m_error = zclReply->m_error;
+            supersededReply->m_apsConfirmReceived = zclReply->m_apsConfirmReceived;
+            supersededReply->m_zigbeeApsStatus = zclReply->m_zigbeeApsStatus;
+            supersededReply->m_zigbeeNwkStatus = zclReply->m_zigbeeNwkStatus;
+            supersededReply->m_zigbeeMacStatus = zclReply->m_zigbeeMacStatus;
+            supersededReply->m_zigbeeClusterLibraryStatus = zclReply->m_zigbeeClusterLibraryStatus;
+            supersededReply->m_zclIndicationReceived = zclReply->m_zclIndicationReceived;
+            supersededReply->m_responseData = zclReply->m_responseData;
+            supersededReply->m_responseFrame = zclReply->m_responseFrame;
+            emit supersededReply->finished();
+        });
+    }
+}
+
+void ZigbeeNodeMailbox::expire(ZigbeeClusterReply *zclReply)
+{
+    for (int i = 0; i < m_entries.count(); i++) {
+        if (m_entries.at(i).reply != zclReply)
+            continue;
+
+        m_entries.removeAt(i);
+        qCWarning(dcZigbeeNode()) << "Pending request for" << m_node << "expired. The node has not been heard from within" << m_expirationTimeout << "ms";
+        emit pendingRequestsChanged(m_entries.count());
+        zclReply->m_error = ZigbeeClusterReply::ErrorTimeout;
+        emit zclReply->finished();
+        return;
+    }
+}
+
+void ZigbeeNodeMailbox::handleNodeHeard()
+{
+    m_lastHeard.start();
+    flush();
+}
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEENODEMAILBOX_H
+#define ZIGBEENODEMAILBOX_H
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+
+class ZigbeeNode;
+class ZigbeeNetwork;
+class ZigbeeCluster;
+class ZigbeeClusterReply;
+
+// Outbound mailbox for sleepy end devices. ZCL requests for a node with the receiver off
+// when idle are held back until the node has been heard from and get sent in one burst
+// while the node is polling its parent. Pending attribute writes superseded by a newer
+// write of the same attributes will be merged into the newer request.
+
+class ZigbeeNodeMailbox : public QObject
+{
+    Q_OBJECT
+
+    friend class ZigbeeNode;
+
+public:
+    explicit ZigbeeNodeMailbox(ZigbeeNetwork *network, ZigbeeNode *node, QObject *parent = nullptr);
+
+    bool enabled() const;
+    void setEnabled(bool enabled);
+
+    // Time in ms the node is assumed to be awake after receiving data from it
+    int awakeWindow() const;
+    void setAwakeWindow(int awakeWindow);
+
+    // Time in ms after which pending requests will finish with a timeout
+    int expirationTimeout() const;
+    void setExpirationTimeout(int expirationTimeout);
+
+    bool active() const;
+    bool nodeAwake() const;
+    int pendingRequests() const;
+
+    // Returns false if the request should be sent right away
+    bool enqueue(ZigbeeCluster *cluster, ZigbeeClusterReply *zclReply);
+    void flush();
+
+signals:
+    void pendingRequestsChanged(int pendingRequests);
+
+private:
+    typedef struct Entry {
+        QPointer<ZigbeeCluster> cluster;
+        QPointer<ZigbeeClusterReply> reply;
+        quint32 expirationTimerId = 0;
+    } Entry;
+
+    ZigbeeNetwork *m_network = nullptr;
+    ZigbeeNode *m_node = nullptr;
+    bool m_enabled = true;
+    int m_awakeWindow = 3000;
+    int m_expirationTimeout = 3600000;
+
+    QList<Entry> m_entries;
+    QElapsedTimer m_lastHeard;
+
+    void mergeWriteAttributes(ZigbeeCluster *cluster, ZigbeeClusterReply *zclReply);
+    void expire(ZigbeeClusterReply *zclReply);
+
+    // Called by the node on any data received from it
+    void handleNodeHeard();
+
+};
+
+#endif // ZIGBEENODEMAILBOX_H
@@ -0,0 +1,503 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeereportingreconciler.h"
+#include "zigbeenetworkdatabase.h"
+#include "zigbeenetwork.h"
+#include "zigbeenode.h"
+#include "zigbeeutils.h"
+#include "loggingcategory.h"
+#include "zcl/zigbeecluster.h"
+#include "zcl/zigbeeclusterreply.h"
+
+// Configure reporting records can be up to 16 bytes, keep the requests small
+static const int s_maxAttributesPerJob = 4;
+
+// Failed configurations will be retried after this time (seconds)
+static const int s_retryInterval = 3600;
+
+ZigbeeReportingReconciler::ZigbeeReportingReconciler(ZigbeeNetwork *network, QObject *parent) :
+    QObject(parent),
+    m_network(network)
+{
+    m_timer = new QTimer(this);
+    m_timer->setInterval(15 * 60 * 1000);
+    m_timer->setSingleShot(false);
+    connect(m_timer, &QTimer::timeout, this, &ZigbeeReportingReconciler::reconcile);
+
+    connect(m_network, &ZigbeeNetwork::nodeRemoved, this, &ZigbeeReportingReconciler::onNodeRemoved);
+    connect(m_network, &ZigbeeNetwork::stateChanged, this, [this](ZigbeeNetwork::State state){
+        if (state == ZigbeeNetwork::StateRunning) {
+            m_timer->start();
+            reconcile();
+        } else {
+            m_timer->stop();
+        }
+    });
+}
+
+int ZigbeeReportingReconciler::maxConcurrentNodes() const
+{
+    return m_maxConcurrentNodes;
+}
+
+void ZigbeeReportingReconciler::setMaxConcurrentNodes(int maxConcurrentNodes)
+{
+    m_maxConcurrentNodes = qMax(1, maxConcurrentNodes);
+    startNextJobs();
+}
+
+int ZigbeeReportingReconciler::verificationInterval() const
+{
+    return m_verificationInterval;
+}
+
+void ZigbeeReportingReconciler::setVerificationInterval(int verificationInterval)
+{
+    m_verificationInterval = qMax(0, verificationInterval);
+}
+
+void ZigbeeReportingReconciler::setDesiredConfiguration(ZigbeeCluster *cluster, const QList<ZigbeeClusterLibrary::AttributeReportingConfiguration> &configurations, quint16 manufacturerCode)
+{
+    foreach (const ZigbeeClusterLibrary::AttributeReportingConfiguration &configuration, configurations) {
+        QString key = entryKey(cluster->node()->extendedAddress(), cluster->endpoint()->endpointId(), cluster->clusterId(), manufacturerCode, configuration.attributeId);
+        int index = indexOfEntry(key);
+        if (index >= 0 && configurationMatches(configuration, m_entries.at(index).configuration))
+            continue;
+
+        Entry entry;
+        entry.extendedAddress = cluster->node()->extendedAddress();
+        entry.endpointId = cluster->endpoint()->endpointId();
+        entry.clusterId = cluster->clusterId();
+        entry.manufacturerCode = manufacturerCode;
+        entry.configuration = configuration;
+        entry.state = StatePending;
+        if (index >= 0) {
+            m_entries[index] = entry;
+        } else {
+            m_entries.append(entry);
+        }
+
+        qCDebug(dcZigbeeCluster()) << "Reporting reconciler: desired configuration changed" << entry;
+        if (m_database)
+            m_database->saveReportingConfiguration(entry);
+
+        emit entryChanged(entry);
+    }
+
+    reconcile();
+}
+
+void ZigbeeReportingReconciler::removeDesiredConfiguration(ZigbeeCluster *cluster, quint16 attributeId, quint16 manufacturerCode)
+{
+    int index = indexOfEntry(entryKey(cluster->node()->extendedAddress(), cluster->endpoint()->endpointId(), cluster->clusterId(), manufacturerCode, attributeId));
+    if (index < 0)
+        return;
+
+    // Note: the configuration stays on the node, it is just not managed any more
+    Entry entry = m_entries.takeAt(index);
+    if (m_database)
+        m_database->removeReportingConfiguration(entry);
+}
+
+QList<ZigbeeReportingReconciler::Entry> ZigbeeReportingReconciler::entries() const
+{
+    return m_entries;
+}
+
+QList<ZigbeeReportingReconciler::Entry> ZigbeeReportingReconciler::entries(ZigbeeNode *node) const
+{
+    QList<Entry> nodeEntries;
+    foreach (const Entry &entry, m_entries) {
+        if (entry.extendedAddress == node->extendedAddress()) {
+            nodeEntries.append(entry);
+        }
+    }
+    return nodeEntries;
+}
+
+void ZigbeeReportingReconciler::verifyNode(ZigbeeNode *node)
+{
+    bool changed = false;
+    for (int i = 0; i < m_entries.count(); i++) {
+        Entry &entry = m_entries[i];
+        if (entry.extendedAddress != node->extendedAddress() || entry.state == StatePending)
+            continue;
+
+        entry.state = StatePending;
+        changed = true;
+        if (m_database)
+            m_database->saveReportingConfiguration(entry);
+
+        emit entryChanged(entry);
+    }
+
+    if (changed) {
+        qCDebug(dcZigbeeCluster()) << "Reporting reconciler: verifying configurations of" << node << "on the next run";
+        reconcile();
+    }
+}
+
+void ZigbeeReportingReconciler::reconcile()
+{
+    if (m_network->state() != ZigbeeNetwork::StateRunning)
+        return;
+
+    QHash<QString, Job> jobs;
+    QStringList jobOrder;
+    foreach (const Entry &entry, m_entries) {
+        QString key = entryKey(entry);
+        if (m_scheduledEntries.contains(key) || !entryDue(entry))
+            continue;
+
+        ZigbeeNode *node = m_network->getZigbeeNode(entry.extendedAddress);
+        if (!node || !node->reachable())
+            continue;
+
+        ZigbeeNodeEndpoint *endpoint = node->getEndpoint(entry.endpointId);
+        ZigbeeCluster *cluster = endpoint ? endpoint->getInputCluster(entry.clusterId) : nullptr;
+        if (!cluster) {
+            qCWarning(dcZigbeeCluster()) << "Reporting reconciler: the cluster for" << entry << "does not exist";
+            continue;
+        }
+
+        // Group the attributes of one cluster into as few requests as possible
+        QString jobKey = QString("%1-%2-%3-%4").arg(entry.extendedAddress.toString()).arg(entry.endpointId).arg(entry.clusterId).arg(entry.manufacturerCode);
+        for (int i = 0; jobs.contains(jobKey) && jobs.value(jobKey).configurations.count() >= s_maxAttributesPerJob; i++) {
+            jobKey = QString("%1-%2-%3-%4-%5").arg(entry.extendedAddress.toString()).arg(entry.endpointId).arg(entry.clusterId).arg(entry.manufacturerCode).arg(i);
+        }
+
+        if (!jobs.contains(jobKey)) {
+            Job job;
+            job.node = node;
+            job.cluster = cluster;
+            job.manufacturerCode = entry.manufacturerCode;
+            jobs.insert(jobKey, job);
+            jobOrder.append(jobKey);
+        }
+
+        jobs[jobKey].configurations.append(entry.configuration);
+        m_scheduledEntries.insert(key);
+    }
+
+    if (jobOrder.isEmpty())
+        return;
+
+    qCDebug(dcZigbeeCluster()) << "Reporting reconciler: scheduling" << m_scheduledEntries.count() << "configurations in" << jobOrder.count() << "jobs";
+    foreach (const QString &jobKey, jobOrder) {
+        m_pendingJobs.append(jobs.value(jobKey));
+    }
+
+    startNextJobs();
+}
+
+bool ZigbeeReportingReconciler::running() const
+{
+    return !m_pendingJobs.isEmpty() || !m_activeJobs.isEmpty();
+}
+
+bool ZigbeeReportingReconciler::configurationMatches(const ZigbeeClusterLibrary::AttributeReportingConfiguration &desired, const ZigbeeClusterLibrary::AttributeReportingConfiguration &actual)
+{
+    if (desired.direction != actual.direction || desired.attributeId != actual.attributeId)
+        return false;
+
+    if (desired.direction == ZigbeeClusterLibrary::ReportingDirectionReceiving)
+        return desired.timeoutPeriod == actual.timeoutPeriod;
+
+    if (desired.dataType != actual.dataType || desired.minReportingInterval != actual.minReportingInterval || desired.maxReportingInterval != actual.maxReportingInterval)
+        return false;
+
+    return !ZigbeeClusterLibrary::isAnalogDataType(desired.dataType) || desired.reportableChange == actual.reportableChange;
+}
+
+void ZigbeeReportingReconciler::setDatabase(ZigbeeNetworkDatabase *database)
+{
+    m_database = database;
+    if (!m_database) {
+        m_entries.clear();
+        m_scheduledEntries.clear();
+        m_pendingJobs.clear();
+        m_activeJobs.clear();
+    }
+}
+
+void ZigbeeReportingReconciler::loadEntries()
+{
+    if (!m_database)
+        return;
+
+    m_entries = m_database->loadReportingConfigurations();
+    qCDebug(dcZigbeeCluster()) << "Reporting reconciler: loaded" << m_entries.count() << "reporting configurations";
+}
+
+QString ZigbeeReportingReconciler::entryKey(const ZigbeeAddress &extendedAddress, quint8 endpointId, quint16 clusterId, quint16 manufacturerCode, quint16 attributeId)
+{
+    return QString("%1-%2-%3-%4-%5").arg(extendedAddress.toString()).arg(endpointId).arg(clusterId).arg(manufacturerCode).arg(attributeId);
+}
+
+QString ZigbeeReportingReconciler::entryKey(const Entry &entry)
+{
+    return entryKey(entry.extendedAddress, entry.endpointId, entry.clusterId, entry.manufacturerCode, entry.configuration.attributeId);
+}
+
+int ZigbeeReportingReconciler::indexOfEntry(const QString &key) const
+{
+    for (int i = 0; i < m_entries.count(); i++) {
+        if (entryKey(m_entries.at(i)) == key) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool ZigbeeReportingReconciler::entryDue(const Entry &entry) const
+{
+    switch (entry.state) {
+    case StatePending:
+        return true;
+    case StateConfigured:
+        return !entry.timestamp.isValid() || entry.timestamp.secsTo(QDateTime::currentDateTimeUtc()) >= m_verificationInterval;
+    case StateFailed:
+        return !entry.timestamp.isValid() || entry.timestamp.secsTo(QDateTime::currentDateTimeUtc()) >= s_retryInterval;
+    }
+
+    return false;
+}
+
+void ZigbeeReportingReconciler::startNextJobs()
+{
+    QMutableListIterator<Job> it(m_pendingJobs);
+    while (it.hasNext() && m_activeJobs.count() < m_maxConcurrentNodes) {
+        Job job = it.next();
+        if (job.node.isNull() || job.cluster.isNull()) {
+            it.remove();
+            continue;
+        }
+
+        // Only one job per node at a time
+        ZigbeeNode *node = job.node.data();
+        if (m_activeJobs.contains(node))
+            continue;
+
+        it.remove();
+        m_activeJobs.insert(node, job);
+        connect(node, &QObject::destroyed, this, &ZigbeeReportingReconciler::onNodeDestroyed, Qt::UniqueConnection);
+        readConfiguration(node, false);
+    }
+
+    if (m_pendingJobs.isEmpty() && m_activeJobs.isEmpty() && !m_scheduledEntries.isEmpty()) {
+        m_scheduledEntries.clear();
+        qCDebug(dcZigbeeCluster()) << "Reporting reconciler: finished";
+        emit finished();
+    }
+}
+
+void ZigbeeReportingReconciler::readConfiguration(ZigbeeNode *node, bool verification)
+{
+    Job job = m_activeJobs.value(node);
+    QList<quint16> attributeIds;
+    foreach (const ZigbeeClusterLibrary::AttributeReportingConfiguration &configuration, job.configurations) {
+        attributeIds.append(configuration.attributeId);
+    }
+
+    ZigbeeClusterReply *reply = job.cluster->readReportingConfiguration(attributeIds, job.manufacturerCode);
+    connect(reply, &ZigbeeClusterReply::finished, this, [this, node, reply, verification](){
+        if (!m_activeJobs.contains(node))
+            return;
+
+        Job job = m_activeJobs.value(node);
+        if (reply->error() != ZigbeeClusterReply::ErrorNoError) {
+            // Probably not reachable, try again on the next run
+            qCWarning(dcZigbeeCluster()) << "Reporting reconciler: failed to read reporting configuration from" << node << reply->error();
+            finishJob(node);
+            return;
+        }
+
+        if (reply->responseFrame().header.command != ZigbeeClusterLibrary::CommandReadReportingConfigurationResponse) {
+            // Some nodes don't support reading the reporting configuration, rely on the configure response
+            qCDebug(dcZigbeeCluster()) << "Reporting reconciler:" << node << "does not support reading the reporting configuration";
+            if (verification) {
+                foreach (const ZigbeeClusterLibrary::AttributeReportingConfiguration &configuration, job.configurations) {
+                    updateEntry(job, configuration, StateConfigured);
+                }
+                finishJob(node);
+            } else {
+                pushConfiguration(node, job.configurations);
+            }
+            return;
+        }
+
+        QList<ZigbeeClusterLibrary::ReadReportingConfigurationRecord> records = ZigbeeClusterLibrary::parseReadReportingConfigurationRecords(reply->responseFrame().payload);
+        QList<ZigbeeClusterLibrary::AttributeReportingConfiguration> mismatchingConfigurations;
+        foreach (const ZigbeeClusterLibrary::AttributeReportingConfiguration &configuration, job.configurations) {
+            bool matches = false;
+            foreach (const ZigbeeClusterLibrary::ReadReportingConfigurationRecord &record, records) {
+                if (record.configuration.attributeId == configuration.attributeId && record.status == ZigbeeClusterLibrary::StatusSuccess) {
+                    matches = configurationMatches(configuration, record.configuration);
+                    break;
+                }
+            }
+
+            if (matches) {
+                updateEntry(job, configuration, StateConfigured);
+            } else if (verification) {
+                qCWarning(dcZigbeeCluster()) << "Reporting reconciler:" << node << "did not apply the reporting configuration" << configuration;
+                updateEntry(job, configuration, StateFailed);
+            } else {
+                mismatchingConfigurations.append(configuration);
+            }
+        }
+
+        if (mismatchingConfigurations.isEmpty()) {
+            finishJob(node);
+            return;
+        }
+
+        pushConfiguration(node, mismatchingConfigurations);
+    });
+}
+
+void ZigbeeReportingReconciler::pushConfiguration(ZigbeeNode *node, const QList<ZigbeeClusterLibrary::AttributeReportingConfiguration> &configurations)
+{
+    Job &job = m_activeJobs[node];
+    job.configurations = configurations;
+
+    qCDebug(dcZigbeeCluster()) << "Reporting reconciler: configuring" << configurations.count() << "attribute reports on" << node << job.cluster;
+    ZigbeeClusterReply *reply = job.cluster->configureReporting(configurations, job.manufacturerCode);
+    connect(reply, &ZigbeeClusterReply::finished, this, [this, node, reply](){
+        if (!m_activeJobs.contains(node))
+            return;
+
+        Job job = m_activeJobs.value(node);
+        if (reply->error() != ZigbeeClusterReply::ErrorNoError) {
+            qCWarning(dcZigbeeCluster()) << "Reporting reconciler: failed to configure reporting on" << node << reply->error();
+            finishJob(node);
+            return;
+        }
+
+        // Note: if all records have been accepted, the response contains only one success status
+        QList<quint16> rejectedAttributeIds;
+        QByteArray payload = reply->responseFrame().payload;
+        if (reply->responseFrame().header.command != ZigbeeClusterLibrary::CommandConfigureReportingResponse) {
+            foreach (const ZigbeeClusterLibrary::AttributeReportingConfiguration &configuration, job.configurations) {
+                rejectedAttributeIds.append(configuration.attributeId);
+            }
+        } else if (payload.size() > 1) {
+            foreach (const ZigbeeClusterLibrary::AttributeReportingStatusRecord &statusRecord, ZigbeeClusterLibrary::parseAttributeReportingStatusRecords(payload)) {
+                if (statusRecord.status != ZigbeeClusterLibrary::StatusSuccess) {
+                    rejectedAttributeIds.append(statusRecord.attributeId);
+                }
+            }
+        }
+
+        QList<ZigbeeClusterLibrary::AttributeReportingConfiguration> acceptedConfigurations;
+        foreach (const ZigbeeClusterLibrary::AttributeReportingConfiguration &configuration, job.configurations) {
+            if (rejectedAttributeIds.contains(configuration.attributeId)) {
+                qCWarning(dcZigbeeCluster()) << "Reporting reconciler:" << node << "rejected the reporting configuration" << configuration;
+                updateEntry(job, configuration, StateFailed);
+            } else {
+                acceptedConfigurations.append(configuration);
+            }
+        }
+
+        if (acceptedConfigurations.isEmpty()) {
+            finishJob(node);
+            return;
+        }
+
+        // Verify what the node actually applied
+        m_activeJobs[node].configurations = acceptedConfigurations;
+        readConfiguration(node, true);
+    });
+}
+
+void ZigbeeReportingReconciler::updateEntry(const Job &job, const ZigbeeClusterLibrary::AttributeReportingConfiguration &configuration, State state)
+{
+    if (job.cluster.isNull())
+        return;
+
+    int index = indexOfEntry(entryKey(job.cluster->node()->extendedAddress(), job.cluster->endpoint()->endpointId(), job.cluster->clusterId(), job.manufacturerCode, configuration.attributeId));
+    if (index < 0)
+        return;
+
+    // The desired configuration might have changed in the meantime
+    Entry &entry = m_entries[index];
+    if (!configurationMatches(entry.configuration, configuration))
+        return;
+
+    entry.state = state;
+    entry.timestamp = QDateTime::currentDateTimeUtc();
+    if (m_database)
+        m_database->saveReportingConfiguration(entry);
+
+    emit entryChanged(entry);
+}
+
+void ZigbeeReportingReconciler::finishJob(QObject *node)
+{
+    m_activeJobs.remove(node);
+    startNextJobs();
+}
+
+void ZigbeeReportingReconciler::onNodeRemoved(ZigbeeNode *node)
+{
+    // Note: the database entries will be removed together with the node
+    QMutableListIterator<Entry> it(m_entries);
+    while (it.hasNext()) {
+        if (it.next().extendedAddress == node->extendedAddress()) {
+            it.remove();
+        }
+    }
+}
+
+void ZigbeeReportingReconciler::onNodeDestroyed(QObject *node)
+{
+    QMutableListIterator<Job> it(m_pendingJobs);
+    while (it.hasNext()) {
+        if (it.next().node.isNull()) {
+            it.remove();
+        }
+    }
+
+    finishJob(node);
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeReportingReconciler::Entry &entry)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace() << "ReportingEntry(" << entry.extendedAddress.toString();
+    debug.nospace() << ", endpoint: " << entry.endpointId;
+    debug.nospace() << ", " << entry.clusterId;
+    if (entry.manufacturerCode != 0x0000)
+        debug.nospace() << ", manufacturer: " << ZigbeeUtils::convertUint16ToHexString(entry.manufacturerCode);
+
+    debug.nospace() << ", attribute: " << ZigbeeUtils::convertUint16ToHexString(entry.configuration.attributeId);
+    debug.nospace() << ", " << entry.state << ")";
+    return debug;
+}
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEEREPORTINGRECONCILER_H
+#define ZIGBEEREPORTINGRECONCILER_H
+
+#include <QSet>
+#include <QHash>
+#include <QTimer>
+#include <QObject>
+#include <QPointer>
+#include <QDateTime>
+
+#include "zigbeeaddress.h"
+#include "zcl/zigbeeclusterlibrary.h"
+
+class ZigbeeNode;
+class ZigbeeCluster;
+class ZigbeeNetwork;
+class ZigbeeNetworkDatabase;
+
+// Keeps the desired attribute reporting configurations of all nodes together with the state
+// on the node in the network database. Configurations which are missing or have not been verified
+// for a while will be checked using Read Reporting Configuration and only pushed to the node if they differ.
+
+class ZigbeeReportingReconciler : public QObject
+{
+    Q_OBJECT
+
+    friend class ZigbeeNetwork;
+
+public:
+    enum State {
+        StatePending, // Not known to be configured on the node
+        StateConfigured, // Verified to match the desired configuration
+        StateFailed // The node rejected the configuration, will be retried later
+    };
+    Q_ENUM(State)
+
+    typedef struct Entry {
+        ZigbeeAddress extendedAddress;
+        quint8 endpointId = 0;
+        ZigbeeClusterLibrary::ClusterId clusterId = ZigbeeClusterLibrary::ClusterIdUnknown;
+        quint16 manufacturerCode = 0x0000;
+        ZigbeeClusterLibrary::AttributeReportingConfiguration configuration;
+        State state = StatePending;
+        QDateTime timestamp; // Last verification or attempt
+    } Entry;
+
+    explicit ZigbeeReportingReconciler(ZigbeeNetwork *network, QObject *parent = nullptr);
+
+    // Nodes reconciled at the same time
+    int maxConcurrentNodes() const;
+    void setMaxConcurrentNodes(int maxConcurrentNodes);
+
+    // Configured entries older than this (seconds) will be verified again
+    int verificationInterval() const;
+    void setVerificationInterval(int verificationInterval);
+
+    void setDesiredConfiguration(ZigbeeCluster *cluster, const QList<ZigbeeClusterLibrary::AttributeReportingConfiguration> &configurations, quint16 manufacturerCode = 0x0000);
+    void removeDesiredConfiguration(ZigbeeCluster *cluster, quint16 attributeId, quint16 manufacturerCode = 0x0000);
+
+    QList<Entry> entries() const;
+    QList<Entry> entries(ZigbeeNode *node) const;
+
+    // Verify all configurations of the node on the next run, i.e. after the node has been reset
+    void verifyNode(ZigbeeNode *node);
+
+    void reconcile();
+    bool running() const;
+
+    static bool configurationMatches(const ZigbeeClusterLibrary::AttributeReportingConfiguration &desired, const ZigbeeClusterLibrary::AttributeReportingConfiguration &actual);
+
+signals:
+    void entryChanged(const ZigbeeReportingReconciler::Entry &entry);
+    void finished();
+
+private:
+    typedef struct Job {
+        QPointer<ZigbeeNode> node;
+        QPointer<ZigbeeCluster> cluster;
+        quint16 manufacturerCode = 0x0000;
+        QList<ZigbeeClusterLibrary::AttributeReportingConfiguration> configurations;
+    } Job;
+
+    ZigbeeNetwork *m_network = nullptr;
+    ZigbeeNetworkDatabase *m_database = nullptr;
+    QTimer *m_timer = nullptr;
+    int m_maxConcurrentNodes = 2;
+    int m_verificationInterval = 7 * 24 * 3600;
+
+    QList<Entry> m_entries;
+    QSet<QString> m_scheduledEntries;
+    QList<Job> m_pendingJobs;
+    QHash<QObject *, Job> m_activeJobs;
+
+    // Called by the network
+    void setDatabase(ZigbeeNetworkDatabase *database);
+    void loadEntries();
+
+    static QString entryKey(const ZigbeeAddress &extendedAddress, quint8 endpointId, quint16 clusterId, quint16 manufacturerCode, quint16 attributeId);
+    static QString entryKey(const Entry &entry);
+    int indexOfEntry(const QString &key) const;
+    bool entryDue(const Entry &entry) const;
+
+    void startNextJobs();
+    void readConfiguration(ZigbeeNode *node, bool verification);
+    void pushConfiguration(ZigbeeNode *node, const QList<ZigbeeClusterLibrary::AttributeReportingConfiguration> &configurations);
+    void updateEntry(const Job &job, const ZigbeeClusterLibrary::AttributeReportingConfiguration &configuration, State state);
+    void finishJob(QObject *node);
+
+private slots:
+    void onNodeRemoved(ZigbeeNode *node);
+    void onNodeDestroyed(QObject *node);
+
+};
+
+QDebug operator<<(QDebug debug, const ZigbeeReportingReconciler::Entry &entry);
+
+#endif // ZIGBEEREPORTINGRECONCILER_H
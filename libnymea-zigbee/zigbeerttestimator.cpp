@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeerttestimator.h"
+
+// Clock granularity of the timeout handling (timer wheel tick)
+static const qint64 s_granularity = 100;
+
+// Limit the backoff to 2^6 times the base timeout
+static const int s_maximumBackoff = 6;
+
+ZigbeeRttEstimator::ZigbeeRttEstimator()
+{
+
+}
+
+void ZigbeeRttEstimator::addSample(qint64 roundTripTime)
+{
+    roundTripTime = qMax(static_cast<qint64>(1), roundTripTime);
+    if (m_sampleCount == 0) {
+        // SRTT = R, RTTVAR = R / 2
+        m_scaledSmoothedRtt = roundTripTime << 3;
+        m_scaledRttVariation = roundTripTime << 1;
+    } else {
+        // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+        qint64 error = roundTripTime - (m_scaledSmoothedRtt >> 3);
+        m_scaledSmoothedRtt += error;
+        m_scaledRttVariation += qAbs(error) - (m_scaledRttVariation >> 2);
+    }
+
+    m_sampleCount++;
+    m_backoffCount = 0;
+}
+
+void ZigbeeRttEstimator::backoff()
+{
+    m_backoffCount = qMin(m_backoffCount + 1, s_maximumBackoff);
+}
+
+void ZigbeeRttEstimator::reset()
+{
+    m_scaledSmoothedRtt = 0;
+    m_scaledRttVariation = 0;
+    m_sampleCount = 0;
+    m_backoffCount = 0;
+}
+
+bool ZigbeeRttEstimator::hasSamples() const
+{
+    return m_sampleCount > 0;
+}
+
+quint32 ZigbeeRttEstimator::sampleCount() const
+{
+    return m_sampleCount;
+}
+
+int ZigbeeRttEstimator::backoffCount() const
+{
+    return m_backoffCount;
+}
+
+qint64 ZigbeeRttEstimator::smoothedRtt() const
+{
+    return m_scaledSmoothedRtt >> 3;
+}
+
+qint64 ZigbeeRttEstimator::rttVariation() const
+{
+    return m_scaledRttVariation >> 2;
+}
+
+qint64 ZigbeeRttEstimator::retransmissionTimeout(qint64 initialTimeout) const
+{
+    qint64 timeout = initialTimeout;
+    if (m_sampleCount > 0)
+        timeout = smoothedRtt() + qMax(s_granularity, m_scaledRttVariation);
+
+    return timeout << m_backoffCount;
+}
+
+QDebug operator<<(QDebug debug, const ZigbeeRttEstimator &estimator)
+{
+    debug.nospace() << "RttEstimator(";
+    if (estimator.hasSamples()) {
+        debug.nospace() << "SRTT: " << estimator.smoothedRtt() << " ms, ";
+        debug.nospace() << "RTTVAR: " << estimator.rttVariation() << " ms, ";
+        debug.nospace() << "samples: " << estimator.sampleCount();
+    } else {
+        debug.nospace() << "no samples";
+    }
+
+    if (estimator.backoffCount() > 0)
+        debug.nospace() << ", backoff: " << estimator.backoffCount();
+
+    debug.nospace() << ")";
+    return debug.space();
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEERTTESTIMATOR_H
+#define ZIGBEERTTESTIMATOR_H
+
+#include <QDebug>
+
+// Round trip time estimator as described by Jacobson/Karels (RFC 6298).
+// All values are in ms, the retransmission timeout is not clamped and
+// has to be limited by the user according to the device class.
+class ZigbeeRttEstimator
+{
+public:
+    ZigbeeRttEstimator();
+
+    void addSample(qint64 roundTripTime);
+
+    // Karn's algorithm: double the timeout on each expired request until the next valid sample
+    void backoff();
+    void reset();
+
+    bool hasSamples() const;
+    quint32 sampleCount() const;
+    int backoffCount() const;
+
+    qint64 smoothedRtt() const;
+    qint64 rttVariation() const;
+
+    // SRTT + max(G, 4 * RTTVAR), multiplied with the current backoff
+    qint64 retransmissionTimeout(qint64 initialTimeout) const;
+
+private:
+    // Scaled by 8 and 4 in order to stay in integer arithmetic
+    qint64 m_scaledSmoothedRtt = 0;
+    qint64 m_scaledRttVariation = 0;
+    quint32 m_sampleCount = 0;
+    int m_backoffCount = 0;
+
+};
+
+QDebug operator<<(QDebug debug, const ZigbeeRttEstimator &estimator);
+
+#endif // ZIGBEERTTESTIMATOR_H
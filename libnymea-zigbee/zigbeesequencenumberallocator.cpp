@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeesequencenumberallocator.h"
+
+ZigbeeSequenceNumberAllocator::ZigbeeSequenceNumberAllocator(quint8 firstSequenceNumber) :
+    m_nextSequenceNumber(firstSequenceNumber)
+{
+
+}
+
+quint8 ZigbeeSequenceNumberAllocator::allocate()
+{
+    quint8 sequenceNumber = m_nextSequenceNumber;
+    if (!isFull()) {
+        while (isInUse(sequenceNumber)) {
+            sequenceNumber++;
+        }
+    }
+
+    m_nextSequenceNumber = sequenceNumber + 1;
+    reserve(sequenceNumber);
+    return sequenceNumber;
+}
+
+bool ZigbeeSequenceNumberAllocator::reserve(quint8 sequenceNumber)
+{
+    if (isInUse(sequenceNumber))
+        return false;
+
+    m_inUse[sequenceNumber / 64] |= (static_cast<quint64>(1) << (sequenceNumber % 64));
+    m_inUseCount++;
+    return true;
+}
+
+void ZigbeeSequenceNumberAllocator::release(quint8 sequenceNumber)
+{
+    if (!isInUse(sequenceNumber))
+        return;
+
+    m_inUse[sequenceNumber / 64] &= ~(static_cast<quint64>(1) << (sequenceNumber % 64));
+    m_inUseCount--;
+}
+
+bool ZigbeeSequenceNumberAllocator::isInUse(quint8 sequenceNumber) const
+{
+    return (m_inUse[sequenceNumber / 64] >> (sequenceNumber % 64)) & 0x01;
+}
+
+bool ZigbeeSequenceNumberAllocator::isFull() const
+{
+    return m_inUseCount >= 256;
+}
+
+int ZigbeeSequenceNumberAllocator::inUseCount() const
+{
+    return m_inUseCount;
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEESEQUENCENUMBERALLOCATOR_H
+#define ZIGBEESEQUENCENUMBERALLOCATOR_H
+
+#include <QtGlobal>
+
+// Hands out 8 bit transaction sequence numbers for one destination and skips
+// the ones still in use by pending requests.
+
+class ZigbeeSequenceNumberAllocator
+{
+public:
+    explicit ZigbeeSequenceNumberAllocator(quint8 firstSequenceNumber = 1);
+
+    // Note: if all sequence numbers are in use, the next one will be reused
+    quint8 allocate();
+    bool reserve(quint8 sequenceNumber);
+    void release(quint8 sequenceNumber);
+
+    bool isInUse(quint8 sequenceNumber) const;
+    bool isFull() const;
+    int inUseCount() const;
+
+private:
+    quint8 m_nextSequenceNumber = 1;
+    quint64 m_inUse[4] = { 0, 0, 0, 0 };
+    int m_inUseCount = 0;
+
+};
+
+#endif // ZIGBEESEQUENCENUMBERALLOCATOR_H
@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "zigbeetimerwheel.h"
+#include "loggingcategory.h"
+
+ZigbeeTimerWheel::ZigbeeTimerWheel(int tickInterval, QObject *parent) :
+    QObject(parent),
+    m_tickInterval(qMax(1, tickInterval))
+{
+    for (int level = 0; level < LevelCount; level++) {
+        m_wheel[level].resize(SlotCount);
+    }
+
+    m_elapsedTimer.start();
+
+    m_timer.setInterval(m_tickInterval);
+    m_timer.setTimerType(Qt::CoarseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &ZigbeeTimerWheel::onTick);
+}
+
+int ZigbeeTimerWheel::tickInterval() const
+{
+    return m_tickInterval;
+}
+
+int ZigbeeTimerWheel::count() const
+{
+    return m_entries.count();
+}
+
+quint32 ZigbeeTimerWheel::schedule(int timeout, const Callback &callback)
+{
+    if (m_entries.isEmpty()) {
+        // The wheel has been idle, jump to the current time
+        m_currentTick = elapsedTicks();
+    }
+
+    // Note: 0 is reserved for invalid ids
+    do {
+        m_timerId++;
+    } while (m_timerId == 0 || m_entries.contains(m_timerId));
+
+    Entry entry;
+    entry.expiry = m_currentTick + qMax(1, (timeout + m_tickInterval - 1) / m_tickInterval);
+    entry.callback = callback;
+    insert(m_timerId, entry);
+
+    if (!m_timer.isActive())
+        m_timer.start();
+
+    return m_timerId;
+}
+
+bool ZigbeeTimerWheel::cancel(quint32 timerId)
+{
+    if (!m_entries.contains(timerId))
+        return false;
+
+    Entry entry = m_entries.take(timerId);
+    m_wheel[entry.level][entry.slot].remove(timerId);
+
+    if (m_entries.isEmpty())
+        m_timer.stop();
+
+    return true;
+}
+
+bool ZigbeeTimerWheel::isScheduled(quint32 timerId) const
+{
+    return m_entries.contains(timerId);
+}
+
+void ZigbeeTimerWheel::onTick()
+{
+    // Catch up in case the event loop has been blocked for more than one tick
+    quint64 targetTick = elapsedTicks();
+    while (m_currentTick < targetTick && !m_entries.isEmpty()) {
+        advance();
+    }
+
+    if (m_entries.isEmpty()) {
+        m_timer.stop();
+    }
+}
+
+quint64 ZigbeeTimerWheel::elapsedTicks() const
+{
+    return static_cast<quint64>(m_elapsedTimer.elapsed()) / m_tickInterval;
+}
+
+void ZigbeeTimerWheel::insert(quint32 timerId, Entry &entry)
+{
+    // Find the lowest level where the expiry falls within the current revolution
+    int level = 0;
+    quint64 expiry = entry.expiry;
+    while (level < LevelCount - 1 && (expiry >> (SlotBits * level)) - (m_currentTick >> (SlotBits * level)) >= SlotCount) {
+        level++;
+    }
+
+    // Beyond the range of the wheel, park it in the last slot of the highest level and reevaluate on cascade
+    int shift = SlotBits * level;
+    if ((expiry >> shift) - (m_currentTick >> shift) >= SlotCount) {
+        expiry = ((m_currentTick >> shift) + SlotCount - 1) << shift;
+    }
+
+    entry.level = level;
+    entry.slot = static_cast<int>((expiry >> shift) & SlotMask);
+    m_wheel[entry.level][entry.slot].insert(timerId);
+    m_entries.insert(timerId, entry);
+}
+
+void ZigbeeTimerWheel::cascade(int level)
+{
+    int slot = static_cast<int>((m_currentTick >> (SlotBits * level)) & SlotMask);
+    QSet<quint32> timerIds;
+    timerIds.swap(m_wheel[level][slot]);
+    foreach (quint32 timerId, timerIds) {
+        Entry entry = m_entries.take(timerId);
+        insert(timerId, entry);
+    }
+}
+
+void ZigbeeTimerWheel::advance()
+{
+    m_currentTick++;
+
+    // Redistribute the higher levels once the lower level completed a revolution, highest level first
+    for (int level = LevelCount - 1; level > 0; level--) {
+        quint64 mask = (static_cast<quint64>(1) << (SlotBits * level)) - 1;
+        if ((m_currentTick & mask) == 0) {
+            cascade(level);
+        }
+    }
+
+    int slot = static_cast<int>(m_currentTick & SlotMask);
+    if (m_wheel[0][slot].isEmpty())
+        return;
+
+    // Collect the callbacks first, they might schedule or cancel other timeouts
+    QList<Callback> callbacks;
+    QSet<quint32> timerIds;
+    timerIds.swap(m_wheel[0][slot]);
+    foreach (quint32 timerId, timerIds) {
+        callbacks.append(m_entries.take(timerId).callback);
+    }
+
+    foreach (const Callback &callback, callbacks) {
+        callback();
+    }
+}
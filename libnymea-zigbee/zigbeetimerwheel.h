@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ZIGBEETIMERWHEEL_H
+#define ZIGBEETIMERWHEEL_H
+
+#include <QSet>
+#include <QHash>
+#include <QTimer>
+#include <QObject>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include <functional>
+
+// Hierarchical timer wheel managing many timeouts with a single QTimer. Scheduling and
+// cancelling a timeout is O(1), the resolution is one tick. The tick timer only runs while
+// timeouts are pending.
+
+class ZigbeeTimerWheel : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<void()> Callback;
+
+    explicit ZigbeeTimerWheel(int tickInterval = 100, QObject *parent = nullptr);
+
+    int tickInterval() const;
+    int count() const;
+
+    // Returns the id of the timeout, 0 is never a valid id
+    quint32 schedule(int timeout, const Callback &callback);
+    bool cancel(quint32 timerId);
+    bool isScheduled(quint32 timerId) const;
+
+private slots:
+    void onTick();
+
+private:
+    enum {
+        SlotBits = 8,
+        SlotCount = 1 << SlotBits,
+        SlotMask = SlotCount - 1,
+        LevelCount = 3
+    };
+
+    typedef struct Entry {
+        quint64 expiry = 0;
+        int level = 0;
+        int slot = 0;
+        Callback callback;
+    } Entry;
+
+    int m_tickInterval = 100;
+    QTimer m_timer;
+    QElapsedTimer m_elapsedTimer;
+    quint64 m_currentTick = 0;
+    quint32 m_timerId = 0;
+
+    QHash<quint32, Entry> m_entries;
+    QVector<QSet<quint32>> m_wheel[LevelCount];
+
+    quint64 elapsedTicks() const;
+    void insert(quint32 timerId, Entry &entry);
+    void cascade(int level);
+    void advance();
+
+};
+
+#endif // ZIGBEETIMERWHEEL_H
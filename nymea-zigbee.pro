@@ -1,2 +1,4 @@
 TEMPLATE = subdirs
-SUBDIRS += libnymea-zigbee
+SUBDIRS += libnymea-zigbee tests
+
+tests.depends = libnymea-zigbee
@@ -0,0 +1,8 @@
+TEMPLATE = subdirs
+SUBDIRS += \
+    zigbeeduplicatefilter \
+    zigbeeframeringbuffer \
+    zigbeenetworkbackup \
+    zigbeerttestimator \
+    zigbeesequencenumberallocator \
+    zigbeetimerwheel
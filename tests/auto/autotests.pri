@@ -0,0 +1,8 @@
+include(../../config.pri)
+
+QT += testlib
+CONFIG += testcase no_testcase_installs
+
+INCLUDEPATH += $$sourceDir/libnymea-zigbee
+LIBS += -L$$buildDir/libnymea-zigbee -lnymea-zigbee
+QMAKE_RPATHDIR += $$buildDir/libnymea-zigbee
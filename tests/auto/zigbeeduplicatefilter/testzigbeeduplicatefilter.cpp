@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include <QtTest>
+
+#include "zigbeeduplicatefilter.h"
+
+class TestZigbeeDuplicateFilter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void duplicate();
+    void differentFrames();
+    void windowExpiry();
+    void disabled();
+    void entriesPerSource();
+    void statistics();
+
+private:
+    Zigbee::ApsdeDataIndication createIndication(quint16 sourceShortAddress, quint8 transactionSequenceNumber) const;
+
+};
+
+Zigbee::ApsdeDataIndication TestZigbeeDuplicateFilter::createIndication(quint16 sourceShortAddress, quint8 transactionSequenceNumber) const
+{
+    // ZCL attribute report of the on/off attribute
+    Zigbee::ApsdeDataIndication indication;
+    indication.sourceShortAddress = sourceShortAddress;
+    indication.sourceEndpoint = 0x01;
+    indication.destinationEndpoint = 0x01;
+    indication.profileId = 0x0104;
+    indication.clusterId = 0x0006;
+    indication.asdu = QByteArray::fromHex("18000a00001001");
+    indication.asdu[1] = static_cast<char>(transactionSequenceNumber);
+    return indication;
+}
+
+void TestZigbeeDuplicateFilter::duplicate()
+{
+    ZigbeeDuplicateFilter filter;
+    Zigbee::ApsdeDataIndication indication = createIndication(0x1234, 1);
+    QVERIFY(!filter.isDuplicate(indication));
+    QVERIFY(filter.isDuplicate(indication));
+    QVERIFY(filter.isDuplicate(indication));
+
+    // The link quality of the retransmission doesn't matter
+    indication.lqi = 42;
+    indication.rssi = -70;
+    QVERIFY(filter.isDuplicate(indication));
+}
+
+void TestZigbeeDuplicateFilter::differentFrames()
+{
+    ZigbeeDuplicateFilter filter;
+    QVERIFY(!filter.isDuplicate(createIndication(0x1234, 1)));
+
+    // Next transaction
+    QVERIFY(!filter.isDuplicate(createIndication(0x1234, 2)));
+
+    // Same frame from another node
+    QVERIFY(!filter.isDuplicate(createIndication(0x5678, 1)));
+
+    Zigbee::ApsdeDataIndication otherCluster = createIndication(0x1234, 1);
+    otherCluster.clusterId = 0x0008;
+    QVERIFY(!filter.isDuplicate(otherCluster));
+
+    Zigbee::ApsdeDataIndication otherEndpoint = createIndication(0x1234, 1);
+    otherEndpoint.sourceEndpoint = 0x02;
+    QVERIFY(!filter.isDuplicate(otherEndpoint));
+
+    Zigbee::ApsdeDataIndication otherPayload = createIndication(0x1234, 1);
+    otherPayload.asdu[6] = 0x00;
+    QVERIFY(!filter.isDuplicate(otherPayload));
+
+    Zigbee::ApsdeDataIndication longerPayload = createIndication(0x1234, 1);
+    longerPayload.asdu.append(static_cast<char>(0x00));
+    QVERIFY(!filter.isDuplicate(longerPayload));
+}
+
+void TestZigbeeDuplicateFilter::windowExpiry()
+{
+    ZigbeeDuplicateFilter filter;
+    filter.setWindow(100);
+    QCOMPARE(filter.window(), 100);
+
+    Zigbee::ApsdeDataIndication indication = createIndication(0x1234, 1);
+    QVERIFY(!filter.isDuplicate(indication));
+    QVERIFY(filter.isDuplicate(indication));
+
+    // A duplicate doesn't extend the window of the original frame
+    QTest::qSleep(20);
+    QVERIFY(filter.isDuplicate(indication));
+    QTest::qSleep(100);
+    QVERIFY(!filter.isDuplicate(indication));
+
+    // Seen again, so a new window starts
+    QVERIFY(filter.isDuplicate(indication));
+
+    QTest::qSleep(120);
+    QVERIFY(!filter.isDuplicate(indication));
+}
+
+void TestZigbeeDuplicateFilter::disabled()
+{
+    ZigbeeDuplicateFilter filter;
+    filter.setWindow(-1);
+    QCOMPARE(filter.window(), 0);
+
+    Zigbee::ApsdeDataIndication indication = createIndication(0x1234, 1);
+    QVERIFY(!filter.isDuplicate(indication));
+    QVERIFY(!filter.isDuplicate(indication));
+    QCOMPARE(filter.checkedIndications(), static_cast<quint32>(0));
+    QCOMPARE(filter.suppressedDuplicates(), static_cast<quint32>(0));
+}
+
+void TestZigbeeDuplicateFilter::entriesPerSource()
+{
+    // Only the last 8 frames of a source are remembered
+    ZigbeeDuplicateFilter filter;
+    for (int i = 0; i < 8; i++)
+        QVERIFY(!filter.isDuplicate(createIndication(0x1234, static_cast<quint8>(i))));
+
+    QVERIFY(filter.isDuplicate(createIndication(0x1234, 0)));
+
+    QVERIFY(!filter.isDuplicate(createIndication(0x1234, 8)));
+    QVERIFY(!filter.isDuplicate(createIndication(0x1234, 0)));
+    QVERIFY(filter.isDuplicate(createIndication(0x1234, 8)));
+
+    // Other sources have their own window
+    QVERIFY(!filter.isDuplicate(createIndication(0x5678, 0)));
+    QVERIFY(filter.isDuplicate(createIndication(0x5678, 0)));
+}
+
+void TestZigbeeDuplicateFilter::statistics()
+{
+    ZigbeeDuplicateFilter filter;
+    filter.isDuplicate(createIndication(0x1234, 1));
+    filter.isDuplicate(createIndication(0x1234, 1));
+    filter.isDuplicate(createIndication(0x1234, 1));
+    filter.isDuplicate(createIndication(0x5678, 1));
+    filter.isDuplicate(createIndication(0x5678, 1));
+    filter.isDuplicate(createIndication(0x9abc, 1));
+
+    QCOMPARE(filter.checkedIndications(), static_cast<quint32>(6));
+    QCOMPARE(filter.suppressedDuplicates(), static_cast<quint32>(3));
+    QCOMPARE(filter.suppressedDuplicates(0x1234), static_cast<quint32>(2));
+    QCOMPARE(filter.suppressedDuplicates(0x5678), static_cast<quint32>(1));
+    QCOMPARE(filter.suppressedDuplicates(0x9abc), static_cast<quint32>(0));
+
+    QHash<quint16, quint32> perSource = filter.suppressedDuplicatesPerSource();
+    QCOMPARE(perSource.count(), 2);
+    QCOMPARE(perSource.value(0x1234), static_cast<quint32>(2));
+    QCOMPARE(perSource.value(0x5678), static_cast<quint32>(1));
+
+    filter.reset();
+    QCOMPARE(filter.checkedIndications(), static_cast<quint32>(0));
+    QCOMPARE(filter.suppressedDuplicates(), static_cast<quint32>(0));
+    QVERIFY(filter.suppressedDuplicatesPerSource().isEmpty());
+
+    // The windows are gone as well
+    QVERIFY(!filter.isDuplicate(createIndication(0x1234, 1)));
+}
+
+QTEST_GUILESS_MAIN(TestZigbeeDuplicateFilter)
+
+#include "testzigbeeduplicatefilter.moc"
@@ -0,0 +1,5 @@
+include(../autotests.pri)
+
+TARGET = testzigbeeduplicatefilter
+
+SOURCES += testzigbeeduplicatefilter.cpp
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include <QtTest>
+
+#include <thread>
+
+#include "zigbeeframeringbuffer.h"
+
+class TestZigbeeFrameRingBuffer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void emptyBuffer();
+    void firstInFirstOut();
+    void fullBuffer();
+    void wrapAround();
+    void producerConsumerThreads();
+
+};
+
+void TestZigbeeFrameRingBuffer::emptyBuffer()
+{
+    ZigbeeFrameRingBuffer buffer(4);
+    QCOMPARE(buffer.capacity(), 4);
+    QVERIFY(buffer.isEmpty());
+
+    ZigbeeFrameRingBuffer::Entry entry;
+    QVERIFY(!buffer.pop(&entry));
+
+    ZigbeeFrameRingBuffer minimalBuffer(0);
+    QCOMPARE(minimalBuffer.capacity(), 1);
+}
+
+void TestZigbeeFrameRingBuffer::firstInFirstOut()
+{
+    ZigbeeFrameRingBuffer buffer(4);
+    QVERIFY(buffer.push(QByteArray("a"), 1));
+    QVERIFY(buffer.push(QByteArray("b"), 2));
+    QVERIFY(!buffer.isEmpty());
+
+    ZigbeeFrameRingBuffer::Entry entry;
+    QVERIFY(buffer.pop(&entry));
+    QCOMPARE(entry.frame, QByteArray("a"));
+    QCOMPARE(entry.timestamp, static_cast<qint64>(1));
+    QVERIFY(buffer.pop(&entry));
+    QCOMPARE(entry.frame, QByteArray("b"));
+    QCOMPARE(entry.timestamp, static_cast<qint64>(2));
+    QVERIFY(buffer.isEmpty());
+}
+
+void TestZigbeeFrameRingBuffer::fullBuffer()
+{
+    ZigbeeFrameRingBuffer buffer(3);
+    QVERIFY(buffer.push(QByteArray("1"), 0));
+    QVERIFY(buffer.push(QByteArray("2"), 0));
+    QVERIFY(buffer.push(QByteArray("3"), 0));
+    QVERIFY(!buffer.push(QByteArray("4"), 0));
+
+    ZigbeeFrameRingBuffer::Entry entry;
+    QVERIFY(buffer.pop(&entry));
+    QCOMPARE(entry.frame, QByteArray("1"));
+    QVERIFY(buffer.push(QByteArray("4"), 0));
+}
+
+void TestZigbeeFrameRingBuffer::wrapAround()
+{
+    ZigbeeFrameRingBuffer buffer(2);
+    ZigbeeFrameRingBuffer::Entry entry;
+    for (int i = 0; i < 10; i++) {
+        QVERIFY(buffer.push(QByteArray::number(i), i));
+        QVERIFY(buffer.pop(&entry));
+        QCOMPARE(entry.frame, QByteArray::number(i));
+        QCOMPARE(entry.timestamp, static_cast<qint64>(i));
+    }
+
+    QVERIFY(buffer.isEmpty());
+}
+
+void TestZigbeeFrameRingBuffer::producerConsumerThreads()
+{
+    const int frameCount = 100000;
+    ZigbeeFrameRingBuffer buffer(16);
+
+    std::thread producer([&](){
+        for (int i = 0; i < frameCount; i++) {
+            while (!buffer.push(QByteArray::number(i), i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int received = 0;
+    bool ordered = true;
+    ZigbeeFrameRingBuffer::Entry entry;
+    while (received < frameCount) {
+        if (!buffer.pop(&entry)) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (entry.frame != QByteArray::number(received) || entry.timestamp != received)
+            ordered = false;
+
+        received++;
+    }
+
+    producer.join();
+    QVERIFY(ordered);
+    QVERIFY(buffer.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestZigbeeFrameRingBuffer)
+
+#include "testzigbeeframeringbuffer.moc"
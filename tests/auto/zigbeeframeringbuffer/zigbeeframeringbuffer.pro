@@ -0,0 +1,5 @@
+include(../autotests.pri)
+
+TARGET = testzigbeeframeringbuffer
+
+SOURCES += testzigbeeframeringbuffer.cpp
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include <QtTest>
+
+#include "zigbeenetworkbackup.h"
+
+// Magic, format version, backend, timestamp, PAN ID, extended PAN ID, channel, channel mask,
+// security mode, network key, trust center link key, coordinator address
+static const int s_frameCounterOffset = 70;
+
+class TestZigbeeNetworkBackup : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void readVersion1();
+    void invalidData();
+    void journalRoundTrip();
+    void truncatedJournal();
+    void applyJournal();
+    void restoreFrameCounter();
+
+private:
+    ZigbeeNetworkBackup createBackup() const;
+
+};
+
+ZigbeeNetworkBackup TestZigbeeNetworkBackup::createBackup() const
+{
+    ZigbeeSecurityConfiguration securityConfiguration;
+    securityConfiguration.setZigbeeSecurityMode(ZigbeeSecurityConfiguration::ZigbeeSecurityModeNetworkLayer);
+    securityConfiguration.setNetworkKey(ZigbeeNetworkKey(QByteArray::fromHex("00112233445566778899aabbccddeeff")));
+    securityConfiguration.setGlobalTrustCenterlinkKey(ZigbeeNetworkKey(QByteArray("ZigBeeAlliance09")));
+
+    ZigbeeNetworkBackup::Node router;
+    router.ieeeAddress = ZigbeeAddress(Q_UINT64_C(0x00158d0001020304));
+    router.shortAddress = 0x1234;
+    router.macCapabilities = 0x8e;
+
+    ZigbeeNetworkBackup::Node endDevice;
+    endDevice.ieeeAddress = ZigbeeAddress(Q_UINT64_C(0x00158d0005060708));
+    endDevice.shortAddress = 0xabcd;
+    endDevice.macCapabilities = 0x80;
+
+    ZigbeeNetworkBackup backup;
+    backup.setBackendType(Zigbee::ZigbeeBackendTypeNxp);
+    backup.setTimestamp(QDateTime::fromMSecsSinceEpoch(Q_INT64_C(1700000000) * 1000));
+    backup.setPanId(0x1a62);
+    backup.setExtendedPanId(Q_UINT64_C(0xdddddddddddddddd));
+    backup.setChannel(15);
+    backup.setChannelMask(ZigbeeChannelMask(0x07fff800));
+    backup.setSecurityConfiguration(securityConfiguration);
+    backup.setCoordinatorAddress(ZigbeeAddress(Q_UINT64_C(0x00212effff001122)));
+    backup.setFrameCounter(123456);
+    backup.setNodes(QList<ZigbeeNetworkBackup::Node>() << router << endDevice);
+    backup.setControllerData(QByteArray::fromHex("0102030405"));
+    return backup;
+}
+
+void TestZigbeeNetworkBackup::roundTrip()
+{
+    ZigbeeNetworkBackup backup = createBackup();
+    ZigbeeNetworkBackup restored = ZigbeeNetworkBackup::fromByteArray(backup.toByteArray());
+
+    QVERIFY(restored.isValid());
+    QCOMPARE(restored.backendType(), backup.backendType());
+    QCOMPARE(restored.timestamp(), backup.timestamp());
+    QCOMPARE(restored.panId(), backup.panId());
+    QCOMPARE(restored.extendedPanId(), backup.extendedPanId());
+    QCOMPARE(restored.channel(), backup.channel());
+    QVERIFY(restored.channelMask() == backup.channelMask());
+    QCOMPARE(restored.securityConfiguration().zigbeeSecurityMode(), backup.securityConfiguration().zigbeeSecurityMode());
+    QVERIFY(restored.securityConfiguration().networkKey() == backup.securityConfiguration().networkKey());
+    QVERIFY(restored.securityConfiguration().globalTrustCenterLinkKey() == backup.securityConfiguration().globalTrustCenterLinkKey());
+    QVERIFY(restored.coordinatorAddress() == backup.coordinatorAddress());
+    QCOMPARE(restored.frameCounter(), backup.frameCounter());
+    QCOMPARE(restored.controllerData(), backup.controllerData());
+
+    QCOMPARE(restored.nodes().count(), 2);
+    for (int i = 0; i < backup.nodes().count(); i++) {
+        QVERIFY(restored.nodes().at(i).ieeeAddress == backup.nodes().at(i).ieeeAddress);
+        QCOMPARE(restored.nodes().at(i).shortAddress, backup.nodes().at(i).shortAddress);
+        QCOMPARE(restored.nodes().at(i).macCapabilities, backup.nodes().at(i).macCapabilities);
+    }
+
+    // Serializing again gives the same data
+    QCOMPARE(restored.toByteArray(), backup.toByteArray());
+}
+
+void TestZigbeeNetworkBackup::readVersion1()
+{
+    // Version 1 is version 2 without the frame counter
+    ZigbeeNetworkBackup backup = createBackup();
+    QByteArray data = backup.toByteArray();
+    QCOMPARE(static_cast<quint8>(data.at(4)), static_cast<quint8>(2));
+    data[4] = 1;
+    data.remove(s_frameCounterOffset, 4);
+
+    ZigbeeNetworkBackup restored = ZigbeeNetworkBackup::fromByteArray(data);
+    QVERIFY(restored.isValid());
+    QCOMPARE(restored.frameCounter(), static_cast<quint32>(0));
+    QCOMPARE(restored.panId(), backup.panId());
+    QVERIFY(restored.coordinatorAddress() == backup.coordinatorAddress());
+    QCOMPARE(restored.nodes().count(), backup.nodes().count());
+    QCOMPARE(restored.controllerData(), backup.controllerData());
+
+    // Written again in the current format
+    restored.setFrameCounter(backup.frameCounter());
+    QCOMPARE(restored.toByteArray(), backup.toByteArray());
+}
+
+void TestZigbeeNetworkBackup::invalidData()
+{
+    QByteArray data = createBackup().toByteArray();
+
+    QVERIFY(!ZigbeeNetworkBackup::fromByteArray(QByteArray()).isValid());
+
+    QByteArray wrongMagic = data;
+    wrongMagic[0] = 0x00;
+    QVERIFY(!ZigbeeNetworkBackup::fromByteArray(wrongMagic).isValid());
+
+    QByteArray futureVersion = data;
+    futureVersion[4] = 3;
+    QVERIFY(!ZigbeeNetworkBackup::fromByteArray(futureVersion).isValid());
+
+    QVERIFY(!ZigbeeNetworkBackup::fromByteArray(data.left(data.length() - 1)).isValid());
+    QVERIFY(!ZigbeeNetworkBackup::fromByteArray(data.left(s_frameCounterOffset)).isValid());
+}
+
+void TestZigbeeNetworkBackup::journalRoundTrip()
+{
+    QList<ZigbeeNetworkBackup::JournalEntry> entries;
+
+    ZigbeeNetworkBackup::JournalEntry added;
+    added.operation = ZigbeeNetworkBackup::JournalOperationNodeAdded;
+    added.node.ieeeAddress = ZigbeeAddress(Q_UINT64_C(0x00158d0009090909));
+    added.node.shortAddress = 0x4321;
+    added.node.macCapabilities = 0x8e;
+    entries.append(added);
+
+    ZigbeeNetworkBackup::JournalEntry removed;
+    removed.operation = ZigbeeNetworkBackup::JournalOperationNodeRemoved;
+    removed.node.ieeeAddress = ZigbeeAddress(Q_UINT64_C(0x00158d0005060708));
+    entries.append(removed);
+
+    ZigbeeNetworkBackup::JournalEntry networkChanged;
+    networkChanged.operation = ZigbeeNetworkBackup::JournalOperationNetworkChanged;
+    networkChanged.panId = 0x2b73;
+    networkChanged.extendedPanId = Q_UINT64_C(0x1122334455667788);
+    networkChanged.channel = 20;
+    networkChanged.networkKey = ZigbeeNetworkKey(QByteArray::fromHex("ffeeddccbbaa99887766554433221100"));
+    entries.append(networkChanged);
+
+    ZigbeeNetworkBackup::JournalEntry frameCounter;
+    frameCounter.operation = ZigbeeNetworkBackup::JournalOperationFrameCounter;
+    frameCounter.frameCounter = 200000;
+    entries.append(frameCounter);
+
+    QByteArray data;
+    foreach (const ZigbeeNetworkBackup::JournalEntry &entry, entries)
+        data.append(ZigbeeNetworkBackup::journalEntryToByteArray(entry));
+
+    QList<ZigbeeNetworkBackup::JournalEntry> parsed = ZigbeeNetworkBackup::journalFromByteArray(data);
+    QCOMPARE(parsed.count(), entries.count());
+    QCOMPARE(parsed.at(0).operation, ZigbeeNetworkBackup::JournalOperationNodeAdded);
+    QVERIFY(parsed.at(0).node.ieeeAddress == added.node.ieeeAddress);
+    QCOMPARE(parsed.at(0).node.shortAddress, added.node.shortAddress);
+    QCOMPARE(parsed.at(0).node.macCapabilities, added.node.macCapabilities);
+    QCOMPARE(parsed.at(1).operation, ZigbeeNetworkBackup::JournalOperationNodeRemoved);
+    QVERIFY(parsed.at(1).node.ieeeAddress == removed.node.ieeeAddress);
+    QCOMPARE(parsed.at(2).operation, ZigbeeNetworkBackup::JournalOperationNetworkChanged);
+    QCOMPARE(parsed.at(2).panId, networkChanged.panId);
+    QCOMPARE(parsed.at(2).extendedPanId, networkChanged.extendedPanId);
+    QCOMPARE(parsed.at(2).channel, networkChanged.channel);
+    QVERIFY(parsed.at(2).networkKey == networkChanged.networkKey);
+    QCOMPARE(parsed.at(3).operation, ZigbeeNetworkBackup::JournalOperationFrameCounter);
+    QCOMPARE(parsed.at(3).frameCounter, frameCounter.frameCounter);
+}
+
+void TestZigbeeNetworkBackup::truncatedJournal()
+{
+    ZigbeeNetworkBackup::JournalEntry frameCounter;
+    frameCounter.operation = ZigbeeNetworkBackup::JournalOperationFrameCounter;
+    frameCounter.frameCounter = 42;
+
+    ZigbeeNetworkBackup::JournalEntry added;
+    added.operation = ZigbeeNetworkBackup::JournalOperationNodeAdded;
+    added.node.ieeeAddress = ZigbeeAddress(Q_UINT64_C(0x00158d0009090909));
+
+    // An interrupted write leaves a partial last entry
+    QByteArray data = ZigbeeNetworkBackup::journalEntryToByteArray(frameCounter);
+    QByteArray addedData = ZigbeeNetworkBackup::journalEntryToByteArray(added);
+    data.append(addedData.left(addedData.length() - 2));
+
+    QList<ZigbeeNetworkBackup::JournalEntry> parsed = ZigbeeNetworkBackup::journalFromByteArray(data);
+    QCOMPARE(parsed.count(), 1);
+    QCOMPARE(parsed.at(0).frameCounter, static_cast<quint32>(42));
+}
+
+void TestZigbeeNetworkBackup::applyJournal()
+{
+    ZigbeeNetworkBackup backup = createBackup();
+    QList<ZigbeeNetworkBackup::JournalEntry> entries;
+
+    ZigbeeNetworkBackup::JournalEntry addressChanged;
+    addressChanged.operation = ZigbeeNetworkBackup::JournalOperationNodeAddressChanged;
+    addressChanged.node.ieeeAddress = backup.nodes().at(0).ieeeAddress;
+    addressChanged.node.shortAddress = 0x5555;
+    entries.append(addressChanged);
+
+    ZigbeeNetworkBackup::JournalEntry removed;
+    removed.operation = ZigbeeNetworkBackup::JournalOperationNodeRemoved;
+    removed.node.ieeeAddress = backup.nodes().at(1).ieeeAddress;
+    entries.append(removed);
+
+    ZigbeeNetworkBackup::JournalEntry frameCounter;
+    frameCounter.operation = ZigbeeNetworkBackup::JournalOperationFrameCounter;
+    frameCounter.frameCounter = 200000;
+    entries.append(frameCounter);
+
+    // Older checkpoints don't move the frame counter back
+    ZigbeeNetworkBackup::JournalEntry olderFrameCounter = frameCounter;
+    olderFrameCounter.frameCounter = 150000;
+    entries.append(olderFrameCounter);
+
+    backup.applyJournal(entries);
+    QCOMPARE(backup.nodes().count(), 1);
+    QCOMPARE(backup.nodes().at(0).shortAddress, static_cast<quint16>(0x5555));
+    QCOMPARE(backup.nodes().at(0).macCapabilities, static_cast<quint8>(0x8e));
+    QCOMPARE(backup.frameCounter(), static_cast<quint32>(200000));
+    QVERIFY(!backup.controllerData().isEmpty());
+
+    // A new network invalidates the controller specific data
+    ZigbeeNetworkBackup::JournalEntry networkChanged;
+    networkChanged.operation = ZigbeeNetworkBackup::JournalOperationNetworkChanged;
+    networkChanged.panId = 0x2b73;
+    networkChanged.extendedPanId = Q_UINT64_C(0x1122334455667788);
+    networkChanged.channel = 20;
+    networkChanged.networkKey = ZigbeeNetworkKey(QByteArray::fromHex("ffeeddccbbaa99887766554433221100"));
+    backup.applyJournal(QList<ZigbeeNetworkBackup::JournalEntry>() << networkChanged);
+    QCOMPARE(backup.panId(), networkChanged.panId);
+    QCOMPARE(backup.extendedPanId(), networkChanged.extendedPanId);
+    QCOMPARE(backup.channel(), networkChanged.channel);
+    QVERIFY(backup.securityConfiguration().networkKey() == networkChanged.networkKey);
+    QVERIFY(backup.controllerData().isEmpty());
+}
+
+void TestZigbeeNetworkBackup::restoreFrameCounter()
+{
+    ZigbeeNetworkBackup backup = createBackup();
+    QVERIFY(backup.restoreFrameCounter() > backup.frameCounter());
+
+    backup.setFrameCounter(0xfffffff0);
+    QCOMPARE(backup.restoreFrameCounter(), static_cast<quint32>(0xffffffff));
+}
+
+QTEST_GUILESS_MAIN(TestZigbeeNetworkBackup)
+
+#include "testzigbeenetworkbackup.moc"
@@ -0,0 +1,5 @@
+include(../autotests.pri)
+
+TARGET = testzigbeenetworkbackup
+
+SOURCES += testzigbeenetworkbackup.cpp
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include <QtTest>
+
+#include "zigbeerttestimator.h"
+
+class TestZigbeeRttEstimator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initialTimeout();
+    void firstSample();
+    void convergence();
+    void convergenceAfterChange();
+    void backoff();
+    void reset();
+
+};
+
+void TestZigbeeRttEstimator::initialTimeout()
+{
+    ZigbeeRttEstimator estimator;
+    QVERIFY(!estimator.hasSamples());
+    QCOMPARE(estimator.retransmissionTimeout(3000), static_cast<qint64>(3000));
+}
+
+void TestZigbeeRttEstimator::firstSample()
+{
+    // SRTT = R, RTTVAR = R / 2, RTO = SRTT + 4 * RTTVAR
+    ZigbeeRttEstimator estimator;
+    estimator.addSample(200);
+    QVERIFY(estimator.hasSamples());
+    QCOMPARE(estimator.sampleCount(), static_cast<quint32>(1));
+    QCOMPARE(estimator.smoothedRtt(), static_cast<qint64>(200));
+    QCOMPARE(estimator.rttVariation(), static_cast<qint64>(100));
+    QCOMPARE(estimator.retransmissionTimeout(3000), static_cast<qint64>(600));
+}
+
+void TestZigbeeRttEstimator::convergence()
+{
+    ZigbeeRttEstimator estimator;
+    for (int i = 0; i < 100; i++)
+        estimator.addSample(i % 2 == 0 ? 180 : 220);
+
+    // The average of the samples with a small variation
+    QVERIFY2(qAbs(estimator.smoothedRtt() - 200) <= 20, qPrintable(QString::number(estimator.smoothedRtt())));
+    QVERIFY2(estimator.rttVariation() >= 10 && estimator.rttVariation() <= 40, qPrintable(QString::number(estimator.rttVariation())));
+
+    // The variation is below the clock granularity, so the granularity is used
+    QCOMPARE(estimator.retransmissionTimeout(3000), estimator.smoothedRtt() + 100);
+}
+
+void TestZigbeeRttEstimator::convergenceAfterChange()
+{
+    ZigbeeRttEstimator estimator;
+    for (int i = 0; i < 50; i++)
+        estimator.addSample(100);
+
+    QCOMPARE(estimator.smoothedRtt(), static_cast<qint64>(100));
+
+    // The route got longer
+    for (int i = 0; i < 50; i++)
+        estimator.addSample(500);
+
+    QVERIFY2(qAbs(estimator.smoothedRtt() - 500) <= 5, qPrintable(QString::number(estimator.smoothedRtt())));
+    QVERIFY2(estimator.rttVariation() <= 5, qPrintable(QString::number(estimator.rttVariation())));
+    QVERIFY(estimator.retransmissionTimeout(3000) >= 500);
+}
+
+void TestZigbeeRttEstimator::backoff()
+{
+    ZigbeeRttEstimator estimator;
+    estimator.addSample(200);
+    qint64 timeout = estimator.retransmissionTimeout(3000);
+
+    estimator.backoff();
+    QCOMPARE(estimator.backoffCount(), 1);
+    QCOMPARE(estimator.retransmissionTimeout(3000), timeout * 2);
+
+    estimator.backoff();
+    QCOMPARE(estimator.retransmissionTimeout(3000), timeout * 4);
+
+    // Limited to 2^6
+    for (int i = 0; i < 10; i++)
+        estimator.backoff();
+
+    QCOMPARE(estimator.backoffCount(), 6);
+    QCOMPARE(estimator.retransmissionTimeout(3000), timeout * 64);
+
+    // A valid sample ends the backoff
+    estimator.addSample(200);
+    QCOMPARE(estimator.backoffCount(), 0);
+}
+
+void TestZigbeeRttEstimator::reset()
+{
+    ZigbeeRttEstimator estimator;
+    estimator.addSample(200);
+    estimator.backoff();
+    estimator.reset();
+
+    QVERIFY(!estimator.hasSamples());
+    QCOMPARE(estimator.backoffCount(), 0);
+    QCOMPARE(estimator.retransmissionTimeout(3000), static_cast<qint64>(3000));
+}
+
+QTEST_GUILESS_MAIN(TestZigbeeRttEstimator)
+
+#include "testzigbeerttestimator.moc"
@@ -0,0 +1,5 @@
+include(../autotests.pri)
+
+TARGET = testzigbeerttestimator
+
+SOURCES += testzigbeerttestimator.cpp
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include <QtTest>
+
+#include "zigbeesequencenumberallocator.h"
+
+class TestZigbeeSequenceNumberAllocator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void allocateIncrements();
+    void allocateSkipsInUse();
+    void allocateWrapsAround();
+    void reserveFailsIfInUse();
+    void releaseFreesSequenceNumber();
+    void fullAllocatorReuses();
+
+};
+
+void TestZigbeeSequenceNumberAllocator::allocateIncrements()
+{
+    ZigbeeSequenceNumberAllocator allocator;
+    QCOMPARE(allocator.allocate(), static_cast<quint8>(1));
+    QCOMPARE(allocator.allocate(), static_cast<quint8>(2));
+    QCOMPARE(allocator.allocate(), static_cast<quint8>(3));
+    QCOMPARE(allocator.inUseCount(), 3);
+}
+
+void TestZigbeeSequenceNumberAllocator::allocateSkipsInUse()
+{
+    ZigbeeSequenceNumberAllocator allocator(10);
+    QVERIFY(allocator.reserve(10));
+    QVERIFY(allocator.reserve(11));
+    QCOMPARE(allocator.allocate(), static_cast<quint8>(12));
+    QCOMPARE(allocator.inUseCount(), 3);
+}
+
+void TestZigbeeSequenceNumberAllocator::allocateWrapsAround()
+{
+    ZigbeeSequenceNumberAllocator allocator(0xfe);
+    QVERIFY(allocator.reserve(0xff));
+    QCOMPARE(allocator.allocate(), static_cast<quint8>(0xfe));
+    QCOMPARE(allocator.allocate(), static_cast<quint8>(0x00));
+    QCOMPARE(allocator.allocate(), static_cast<quint8>(0x01));
+}
+
+void TestZigbeeSequenceNumberAllocator::reserveFailsIfInUse()
+{
+    ZigbeeSequenceNumberAllocator allocator;
+    quint8 sequenceNumber = allocator.allocate();
+    QVERIFY(!allocator.reserve(sequenceNumber));
+    QCOMPARE(allocator.inUseCount(), 1);
+
+    QVERIFY(allocator.reserve(200));
+    QVERIFY(allocator.isInUse(200));
+    QCOMPARE(allocator.inUseCount(), 2);
+}
+
+void TestZigbeeSequenceNumberAllocator::releaseFreesSequenceNumber()
+{
+    ZigbeeSequenceNumberAllocator allocator;
+    quint8 sequenceNumber = allocator.allocate();
+    allocator.release(sequenceNumber);
+    QVERIFY(!allocator.isInUse(sequenceNumber));
+    QCOMPARE(allocator.inUseCount(), 0);
+
+    // Releasing twice must not corrupt the counter
+    allocator.release(sequenceNumber);
+    QCOMPARE(allocator.inUseCount(), 0);
+    QVERIFY(allocator.reserve(sequenceNumber));
+}
+
+void TestZigbeeSequenceNumberAllocator::fullAllocatorReuses()
+{
+    ZigbeeSequenceNumberAllocator allocator(0);
+    for (int i = 0; i < 256; i++)
+        QCOMPARE(allocator.allocate(), static_cast<quint8>(i));
+
+    QVERIFY(allocator.isFull());
+    QCOMPARE(allocator.inUseCount(), 256);
+
+    // Reuses the next one without changing the bookkeeping
+    QCOMPARE(allocator.allocate(), static_cast<quint8>(0));
+    QCOMPARE(allocator.inUseCount(), 256);
+
+    allocator.release(42);
+    QVERIFY(!allocator.isFull());
+    QCOMPARE(allocator.allocate(), static_cast<quint8>(42));
+    QVERIFY(allocator.isFull());
+}
+
+QTEST_GUILESS_MAIN(TestZigbeeSequenceNumberAllocator)
+
+#include "testzigbeesequencenumberallocator.moc"
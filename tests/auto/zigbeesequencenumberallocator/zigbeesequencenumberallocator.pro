@@ -0,0 +1,5 @@
+include(../autotests.pri)
+
+TARGET = testzigbeesequencenumberallocator
+
+SOURCES += testzigbeesequencenumberallocator.cpp
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* nymea-zigbee
+* Zigbee integration module for nymea
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-zigbee.
+*
+* nymea-zigbee is free software: you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public License
+* as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* nymea-zigbee is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with nymea-zigbee. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include <QtTest>
+#include <QThread>
+
+#include "zigbeetimerwheel.h"
+
+class TestZigbeeTimerWheel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void expiry();
+    void expiryOrder();
+    void cascading();
+    void cancel();
+    void scheduleFromCallback();
+    void catchUpAfterBlockedEventLoop();
+
+};
+
+void TestZigbeeTimerWheel::expiry()
+{
+    ZigbeeTimerWheel wheel(5);
+    QElapsedTimer elapsedTimer;
+    qint64 elapsed = -1;
+    int calls = 0;
+
+    elapsedTimer.start();
+    quint32 timerId = wheel.schedule(50, [&](){
+        elapsed = elapsedTimer.elapsed();
+        calls++;
+    });
+
+    QVERIFY(timerId != 0);
+    QVERIFY(wheel.isScheduled(timerId));
+    QCOMPARE(wheel.count(), 1);
+
+    QTRY_COMPARE_WITH_TIMEOUT(calls, 1, 2000);
+    QVERIFY2(elapsed >= 50 - wheel.tickInterval(), qPrintable(QString("Expired after %1 ms").arg(elapsed)));
+    QVERIFY(!wheel.isScheduled(timerId));
+    QCOMPARE(wheel.count(), 0);
+
+    // Fires only once
+    QTest::qWait(50);
+    QCOMPARE(calls, 1);
+}
+
+void TestZigbeeTimerWheel::expiryOrder()
+{
+    ZigbeeTimerWheel wheel(5);
+    QList<int> order;
+    wheel.schedule(120, [&](){ order.append(3); });
+    wheel.schedule(20, [&](){ order.append(1); });
+    wheel.schedule(60, [&](){ order.append(2); });
+
+    QTRY_COMPARE_WITH_TIMEOUT(order.count(), 3, 2000);
+    QCOMPARE(order, QList<int>() << 1 << 2 << 3);
+}
+
+void TestZigbeeTimerWheel::cascading()
+{
+    // With 1 ms ticks the first level covers 256 ms, longer timeouts get cascaded down from the second level
+    ZigbeeTimerWheel wheel(1);
+    QElapsedTimer elapsedTimer;
+    qint64 shortElapsed = -1;
+    qint64 longElapsed = -1;
+
+    elapsedTimer.start();
+    wheel.schedule(100, [&](){ shortElapsed = elapsedTimer.elapsed(); });
+    wheel.schedule(600, [&](){ longElapsed = elapsedTimer.elapsed(); });
+
+    QTRY_VERIFY_WITH_TIMEOUT(shortElapsed >= 0, 2000);
+    QCOMPARE(longElapsed, static_cast<qint64>(-1));
+    QCOMPARE(wheel.count(), 1);
+
+    QTRY_VERIFY_WITH_TIMEOUT(longElapsed >= 0, 3000);
+    QVERIFY2(longElapsed >= 600 - wheel.tickInterval(), qPrintable(QString("Expired after %1 ms").arg(longElapsed)));
+    QCOMPARE(wheel.count(), 0);
+}
+
+void TestZigbeeTimerWheel::cancel()
+{
+    ZigbeeTimerWheel wheel(5);
+    bool cancelledCalled = false;
+    bool otherCalled = false;
+
+    quint32 cancelledId = wheel.schedule(30, [&](){ cancelledCalled = true; });
+    wheel.schedule(60, [&](){ otherCalled = true; });
+    QCOMPARE(wheel.count(), 2);
+
+    QVERIFY(wheel.cancel(cancelledId));
+    QVERIFY(!wheel.cancel(cancelledId));
+    QVERIFY(!wheel.isScheduled(cancelledId));
+    QCOMPARE(wheel.count(), 1);
+
+    QTRY_VERIFY_WITH_TIMEOUT(otherCalled, 2000);
+    QVERIFY(!cancelledCalled);
+    QVERIFY(!wheel.cancel(0));
+}
+
+void TestZigbeeTimerWheel::scheduleFromCallback()
+{
+    ZigbeeTimerWheel wheel(5);
+    int calls = 0;
+    std::function<void()> reschedule = [&](){
+        calls++;
+        if (calls < 3) {
+            wheel.schedule(10, reschedule);
+        }
+    };
+
+    wheel.schedule(10, reschedule);
+    QTRY_COMPARE_WITH_TIMEOUT(calls, 3, 2000);
+    QCOMPARE(wheel.count(), 0);
+}
+
+void TestZigbeeTimerWheel::catchUpAfterBlockedEventLoop()
+{
+    ZigbeeTimerWheel wheel(5);
+    int calls = 0;
+    wheel.schedule(20, [&](){ calls++; });
+    wheel.schedule(40, [&](){ calls++; });
+
+    // All ticks missed while blocked are processed at once
+    QThread::msleep(100);
+    QTRY_COMPARE_WITH_TIMEOUT(calls, 2, 500);
+}
+
+QTEST_GUILESS_MAIN(TestZigbeeTimerWheel)
+
+#include "testzigbeetimerwheel.moc"
@@ -0,0 +1,5 @@
+include(../autotests.pri)
+
+TARGET = testzigbeetimerwheel
+
+SOURCES += testzigbeetimerwheel.cpp